@@ -0,0 +1,339 @@
+/*
+ * animate.c
+ *
+ * Renders a camera path through a scene as numbered ppm frames.  The
+ * scene is read and its bvh built once, then each frame only moves the
+ * view point and the window onto the world.  Each frame is written by a
+ * thread of its own while the next one is rendered.
+ *
+ * A camera path is a file of keyframes, one a line, each the world size
+ * and view point as at the top of a scene file:
+ *     <world width> <world height> <view x> <view y> <view z>
+ * Lines that don't hold five numbers are skipped.  Frames are spread
+ * evenly along the path, moving in a straight line between keyframes.
+ *
+ * Chris Blades
+ *
+ * 18/10/2026
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "common.h"
+#include "safe.h"
+#include "scan.h"
+#include "image.h"
+#include "ray.h"
+#include "bench.h"
+#include "stats.h"
+#include "animate.h"
+
+/*
+ * Check that a frame name pattern holds exactly one %d, so it can be given
+ * to printf with the frame number.  %% is allowed, as is a width or
+ * leading zeros for the number.
+ *
+ * PARAMETERS:
+ *  pattern - pattern to check
+ *
+ * RETURNS:
+ *  0 if it can be used
+ */
+static int animate_pattern(char *pattern) {
+    int numbers = 0;    // %d conversions
+
+    while ((pattern = strchr(pattern, '%')) != NULL) {
+        pattern++;
+        if (*pattern == '%') {
+            pattern++;
+            continue;
+        }
+        pattern += strspn(pattern, "0123456789");
+        if (*pattern != 'd') {
+            return -1;
+        }
+        numbers++;
+    }
+    return numbers == 1 ? 0 : -1;
+}
+
+/*
+ * Read a camera path.
+ *
+ * PARAMETERS:
+ *  path    - file of keyframes
+ *  nkeys   - where to store the number of keyframes
+ *
+ * RETURNS:
+ *  the keyframes, or NULL if there are none
+ */
+static keyframe_t *animate_path(char *path, int *nkeys) {
+    FILE       *in;
+    scan_t     *scan;
+    keyframe_t *keys = NULL;
+    double      vals[5];        // world size, then view point
+    int         cap = 0;        // keyframes keys holds
+
+    *nkeys = 0;
+    if ((in = fopenAndCheck(path, "r")) == NULL) {
+        return NULL;
+    }
+
+    scan = scan_init(in, path);
+    while (scan_doubles(scan, vals, 5, NULL) != EOF) {
+        if (*nkeys == cap) {
+            cap = cap > 0 ? cap * 2 : 16;
+            keys = (keyframe_t *)realloc(keys, sizeof(keyframe_t) * cap);
+            if (keys == NULL) {
+                perror("Error allocating camera path");
+                exit(EXIT_FAILURE);
+            }
+        }
+        keys[*nkeys].win_size_world[0] = vals[0];
+        keys[*nkeys].win_size_world[1] = vals[1];
+        keys[*nkeys].view_point[0]     = vals[2];
+        keys[*nkeys].view_point[1]     = vals[3];
+        keys[*nkeys].view_point[2]     = vals[4];
+        (*nkeys)++;
+    }
+    scan_free(scan);
+    fclose(in);
+
+    if (*nkeys == 0) {
+        fprintf(stderr, "No keyframes in camera path: %s\n", path);
+        free(keys);
+        return NULL;
+    }
+    return keys;
+}
+
+/*
+ * Find where the camera is for a frame, in a straight line between the
+ * keyframes on either side of it.
+ *
+ * PARAMETERS:
+ *  keys    - keyframes of the path
+ *  nkeys   - number of keyframes
+ *  f       - frame number
+ *  nframes - number of frames along the whole path
+ *  camera  - where to store the camera of the frame
+ */
+static void animate_camera(keyframe_t *keys, int nkeys, int f, int nframes,
+                           keyframe_t *camera) {
+    double t;           // position along the path, in keyframes
+    double u;           // fraction of the way to the next keyframe
+    int    k;           // keyframe before the frame
+    int    i;
+
+    if (nkeys == 1 || nframes == 1) {
+        *camera = keys[0];
+        return;
+    }
+
+    t = (double)f * (nkeys - 1) / (nframes - 1);
+    k = (int)t < nkeys - 2 ? (int)t : nkeys - 2;
+    u = t - k;
+
+    for (i = 0; i < 2; i++) {
+        camera->win_size_world[i] = keys[k].win_size_world[i] * (1.0 - u) +
+                                    keys[k + 1].win_size_world[i] * u;
+    }
+    for (i = 0; i < 3; i++) {
+        camera->view_point[i] = keys[k].view_point[i] * (1.0 - u) +
+                                keys[k + 1].view_point[i] * u;
+    }
+}
+
+/*
+ * Thread entry point, writes a frame out as a ppm.
+ *
+ * PARAMETERS:
+ *  arg     - frame_t of the frame
+ */
+static void *animate_write(void *arg) {
+    frame_t *frame = (frame_t *)arg;
+    double   start = bench_now();
+    size_t   len   = (size_t)frame->size[0] * frame->size[1] * 3;
+    FILE    *out;
+
+    frame->rc = -1;
+    if ((out = fopenAndCheck(frame->path, "wb")) == NULL) {
+        fprintf(stderr, "Could not write frame: %s\n", frame->path);
+        return NULL;
+    }
+
+    fprintf(out, "P6 %d %d 255\n", frame->size[0], frame->size[1]);
+    if (fwrite(frame->pixmap, 1, len, out) != len) {
+        fprintf(stderr, "Error writing frame: %s\n", frame->path);
+        fclose(out);
+        return NULL;
+    }
+    if (fclose(out) != 0) {
+        fprintf(stderr, "Error writing frame: %s\n", frame->path);
+        return NULL;
+    }
+
+    frame->write_time = bench_now() - start;
+    frame->rc = 0;
+    return NULL;
+}
+
+/*
+ * Wait for a frame to be written and report what it cost.
+ *
+ * PARAMETERS:
+ *  frame   - frame being written
+ *
+ * RETURNS:
+ *  0 if it was written
+ */
+static int animate_done(frame_t *frame) {
+    pthread_join(frame->thread, NULL);
+    if (frame->rc != 0) {
+        return frame->rc;
+    }
+
+    fprintf(stderr, "frame %d: %s, view (%lf, %lf, %lf), world %lf X %lf, "
+                    "render %.3lf s, write %.3lf s, %ld rays\n",
+            frame->index, frame->path, frame->camera.view_point[0],
+            frame->camera.view_point[1], frame->camera.view_point[2],
+            frame->camera.win_size_world[0], frame->camera.win_size_world[1],
+            frame->render_time, frame->write_time, frame->rays);
+    return 0;
+}
+
+/*
+ * Count every ray traced so far.
+ *
+ * PARAMETERS:
+ *  model   - model being rendered
+ *  ctx     - state of the calling thread, NULL if rendering with threads
+ *
+ * RETURNS:
+ *  the number of rays
+ */
+static long animate_rays(model_t *model, trace_ctx_t *ctx) {
+    long rays = 0;
+    int  i;
+
+    for (i = 0; i < RAY_KINDS; i++) {
+        rays += model->bench->rays[i] + (ctx != NULL ? ctx->rays[i] : 0);
+    }
+    return rays;
+}
+
+/**
+ * Render the frames of a camera path through a model into numbered ppm
+ * files.  Frame f is written while frame f + 1 is rendered, so two frames
+ * are held in memory.
+ *
+ * PARAMETERS:
+ *  model   - model to render, its projection moved along the path
+ *
+ * RETURNS:
+ *  0 on success
+ */
+int animate_run(model_t *model) {
+    options_t   *opts   = model->opts;
+    int          width  = model->proj->win_size_pixel[0];
+    int          height = model->proj->win_size_pixel[1];
+    frame_t      frames[2];
+    frame_t     *frame;
+    keyframe_t  *keys;
+    trace_ctx_t *ctx = NULL;
+    int          nkeys;
+    int          nframes;
+    int          joined = 0;    // frames waited for
+    double       start = bench_now();
+    double       elapsed;
+    long         rays;
+    int          rc = 0;
+    int          f;
+    int          i;
+
+    if (animate_pattern(opts->frame_name) != 0) {
+        fprintf(stderr, "Frame names need one %%d for the frame number: "
+                        "%s\n", opts->frame_name);
+        return EXIT_FAILURE;
+    }
+    if ((keys = animate_path(opts->animate, &nkeys)) == NULL) {
+        return EXIT_FAILURE;
+    }
+    if (opts->heatmap != NULL) {
+        fprintf(stderr, "No heatmap is written for an animation\n");
+    }
+
+    // one frame a keyframe unless told otherwise
+    nframes = opts->frames > 0 ? opts->frames : nkeys;
+
+    for (i = 0; i < 2; i++) {
+        frames[i].pixmap  = (unsigned char *)smalloc((size_t)width * height *
+                                                     3);
+        frames[i].size[0] = width;
+        frames[i].size[1] = height;
+    }
+
+    if (opts->threads == 1) {
+        ctx = trace_ctx_init(model);
+        stats_bind(ctx->stats);
+    }
+
+    for (f = 0; f < nframes; f++) {
+        // the buffer is free once the frame two back is written
+        if (f >= 2 && animate_done(&frames[joined++ % 2]) != 0) {
+            rc = EXIT_FAILURE;
+            break;
+        }
+
+        frame = &frames[f % 2];
+        frame->index = f;
+        snprintf(frame->path, sizeof(frame->path), opts->frame_name, f);
+
+        animate_camera(keys, nkeys, f, nframes, &frame->camera);
+        model->proj->win_size_world[0] = frame->camera.win_size_world[0];
+        model->proj->win_size_world[1] = frame->camera.win_size_world[1];
+        model->proj->view_point[0]     = frame->camera.view_point[0];
+        model->proj->view_point[1]     = frame->camera.view_point[1];
+        model->proj->view_point[2]     = frame->camera.view_point[2];
+
+        rays = animate_rays(model, ctx);
+        elapsed = bench_now();
+        make_band(model, ctx, 0, 0, width, height, frame->pixmap);
+        frame->render_time = bench_now() - elapsed;
+        frame->rays = animate_rays(model, ctx) - rays;
+
+        if (pthread_create(&frame->thread, NULL, animate_write, frame) != 0) {
+            fprintf(stderr, "Error creating frame writer thread.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // frames still being written, oldest first
+    while (joined < f) {
+        if (animate_done(&frames[joined++ % 2]) != 0) {
+            rc = EXIT_FAILURE;
+        }
+    }
+
+    if (ctx != NULL) {
+        for (i = 0; i < RAY_KINDS; i++) {
+            model->bench->rays[i] += ctx->rays[i];
+        }
+        if (model->stats != NULL && ctx->stats != NULL) {
+            stats_merge(model->stats, ctx->stats);
+        }
+        trace_ctx_free(ctx);
+    }
+
+    elapsed = bench_now() - start;
+    fprintf(stderr, "%d frames in %.3lf s, %.2lf frames/s, scene read "
+                    "once in %.3lf s\n", f, elapsed,
+            elapsed > 0.0 ? f / elapsed : 0.0, model->bench->parse_time);
+
+    for (i = 0; i < 2; i++) {
+        free(frames[i].pixmap);
+    }
+    free(keys);
+    return rc;
+}
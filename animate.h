@@ -0,0 +1,30 @@
+#include <pthread.h>
+#include "common.h"
+
+#ifndef ANIMATE_H
+#define ANIMATE_H
+
+#define DEFAULT_FRAME_NAME  "frame%04d.ppm"
+
+/* camera at one point along a path, as at the top of a scene file */
+typedef struct keyframe_type {
+    double  win_size_world[2];
+    double  view_point[3];
+} keyframe_t;
+
+/* frame written out while the next one is rendered */
+typedef struct frame_type {
+    pthread_t       thread;
+    int             index;      /* frame number */
+    char            path[FILENAME_MAX];
+    unsigned char  *pixmap;     /* pixels, top row first */
+    int             size[2];    /* width and height in pixels */
+    keyframe_t      camera;     /* where the frame was seen from */
+    double          render_time;/* seconds rendering */
+    double          write_time; /* seconds writing */
+    long            rays;       /* rays traced */
+    int             rc;         /* 0 once written */
+} frame_t;
+
+int animate_run(model_t *);
+#endif
@@ -0,0 +1,30 @@
+#include <stddef.h>
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#define ARENA_BLOCK     (1 << 20)   /* bytes in a block of an arena */
+#define ARENA_ALIGN     8           /* alignment of every allocation */
+
+/* block of memory an arena hands out in order */
+typedef struct arena_block_type {
+    struct arena_block_type *next;  /* block filled before this one */
+    size_t  size;                   /* bytes of data */
+    size_t  used;                   /* bytes handed out */
+    double  data[];                 /* the memory, aligned for any field */
+} arena_block_t;
+
+/* memory of a list of objects, handed out in load order and freed all at
+ * once */
+typedef struct arena_type {
+    arena_block_t *block;           /* block being filled */
+    size_t  allocs;                 /* allocations made */
+    size_t  bytes;                  /* bytes handed out */
+} arena_t;
+
+arena_t *arena_init(void);
+
+void *arena_alloc(arena_t *, size_t);
+
+void arena_free(arena_t *);
+#endif
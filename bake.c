@@ -0,0 +1,623 @@
+/*
+ * bake.c
+ *
+ * Bakes the geometry of the scene objects into flat arrays, one array per
+ * value and one set of arrays per shape.  A ray is then tested against
+ * several spheres, planes or fplanes at a time without chasing the priv
+ * pointers of each object.  The object list is still used for shading.
+ *
+ * Entries keep the order of the objects they were baked from, so any range
+ * of objects covers one run of entries of each shape.  The bvh bakes its
+ * objects in leaf order, which keeps the entries of a leaf together.
+ *
+ * Like the packet kernels, the kernels here do the same double precision
+ * operations in the same order as hits_sphere, hits_plane and hits_fplane,
+ * so they find exactly the same hits.
+ *
+ * Chris Blades
+ *
+ * 18/10/2026
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "common.h"
+#include "safe.h"
+#include "sphere.h"
+#include "plane.h"
+#include "fplane.h"
+#include "veclib3d.h"
+#include "bake.h"
+#include "stats.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BAKE_X86
+#endif
+
+/*
+ * Allocate one baked array, padded so a kernel can always load a full
+ * BAKE_WIDTH entries.
+ *
+ * PARAMETERS:
+ *  count   - number of entries
+ *
+ * RETURNS:
+ *  zeroed array
+ */
+static double *bake_array(int count) {
+    double *array = (double *)smalloc(sizeof(double) * (count + BAKE_WIDTH));
+
+    memset(array, 0, sizeof(double) * (count + BAKE_WIDTH));
+    return array;
+}
+
+/*
+ * Hit distance of a ray against one baked plane, see hits_plane.
+ *
+ * PARAMETERS:
+ *  nx, ny, nz  - normal of the plane
+ *  nq          - normal dot point of the plane
+ *  base        - origin of ray
+ *  dir         - direction of ray
+ *
+ * RETURNS:
+ *  distance to the hit, or -1
+ */
+static double plane_hit(double nx, double ny, double nz, double nq,
+                        double *base, double *dir) {
+    double NdotV = nx * base[0] + ny * base[1] + nz * base[2];
+    double NdotD = nx * dir[0] + ny * dir[1] + nz * dir[2];
+    double t = (nq - NdotV) / NdotD;
+
+    if (NdotD == 0.0 || t < 0.0001) {
+        return -1;
+    }
+
+    // hit point has to be behind the screen
+    if (base[2] + dir[2] * t >= 0) {
+        return -1;
+    }
+
+    return t;
+}
+
+/*
+ * Scalar sphere kernel.
+ *
+ * PARAMETERS:
+ *  bake    - baked scene
+ *  first   - first entry to test
+ *  n       - number of entries to test
+ *  base    - origin of ray
+ *  dir     - direction of ray
+ *  t       - distance to the hit for each entry, or -1
+ */
+static void spheres_scalar(bake_t *bake, int first, int n, double *base,
+                           double *dir, double *t) {
+    double a = vec_dot3(dir, dir);
+    double vx, vy, vz, b, c, disc;
+    int    i;
+
+    for (i = 0; i < n; i++) {
+        vx = base[0] - bake->scx[first + i];
+        vy = base[1] - bake->scy[first + i];
+        vz = base[2] - bake->scz[first + i];
+
+        b = 2.0 * (vx * dir[0] + vy * dir[1] + vz * dir[2]);
+        c = (vx * vx + vy * vy + vz * vz) - bake->sr2[first + i];
+        disc = b * b - (4 * a * c);
+
+        t[i] = disc > 0 ? ((b * -1) - sqrt(disc)) / (2 * a) : -1;
+    }
+}
+
+/*
+ * Scalar plane kernel.
+ *
+ * PARAMETERS:
+ *  bake    - baked scene
+ *  first   - first entry to test
+ *  n       - number of entries to test
+ *  base    - origin of ray
+ *  dir     - direction of ray
+ *  t       - distance to the hit for each entry, or -1
+ */
+static void planes_scalar(bake_t *bake, int first, int n, double *base,
+                          double *dir, double *t) {
+    int i;
+
+    for (i = first; i < first + n; i++) {
+        t[i - first] = plane_hit(bake->pnx[i], bake->pny[i], bake->pnz[i],
+                                 bake->pnq[i], base, dir);
+    }
+}
+
+/*
+ * Scalar fplane kernel.
+ *
+ * PARAMETERS:
+ *  bake    - baked scene
+ *  first   - first entry to test
+ *  n       - number of entries to test
+ *  base    - origin of ray
+ *  dir     - direction of ray
+ *  t       - distance to the hit for each entry, or -1
+ */
+static void fplanes_scalar(bake_t *bake, int first, int n, double *base,
+                           double *dir, double *t) {
+    double hx, hy, hz, x, y;
+    int    i;
+
+    for (i = first; i < first + n; i++) {
+        t[i - first] = plane_hit(bake->fnx[i], bake->fny[i], bake->fnz[i],
+                                 bake->fnq[i], base, dir);
+        if (t[i - first] < 0) {
+            continue;
+        }
+
+        // hit point in the plane's own coordinates
+        hx = (base[0] + dir[0] * t[i - first]) - bake->fpx[i];
+        hy = (base[1] + dir[1] * t[i - first]) - bake->fpy[i];
+        hz = (base[2] + dir[2] * t[i - first]) - bake->fpz[i];
+        x = bake->fux[i] * hx + bake->fuy[i] * hy + bake->fuz[i] * hz;
+        y = bake->fvx[i] * hx + bake->fvy[i] * hy + bake->fvz[i] * hz;
+
+        if (x > bake->fw[i] || x < 0.0 || y > bake->fh[i] || y < 0.0) {
+            t[i - first] = -1;
+        }
+    }
+}
+
+/*
+ * Kernel for objects of any other shape, calls their hits functions.
+ *
+ * PARAMETERS:
+ *  bake    - baked scene
+ *  first   - first entry to test
+ *  n       - number of entries to test
+ *  base    - origin of ray
+ *  dir     - direction of ray
+ *  t       - distance to the hit for each entry, or -1
+ */
+static void others_scalar(bake_t *bake, int first, int n, double *base,
+                          double *dir, double *t) {
+    obj_t **objs = bake->runs[BAKE_OTHERS].objs + first;
+    int     i;
+
+    for (i = 0; i < n; i++) {
+        t[i] = objs[i]->ops->hits(base, dir, objs[i]);
+    }
+}
+
+#ifdef BAKE_X86
+/*
+ * AVX2 sphere kernel, tests four spheres at once.
+ *
+ * PARAMETERS:
+ *  bake    - baked scene
+ *  first   - first entry to test
+ *  n       - number of entries to test, the rest are computed anyway
+ *  base    - origin of ray
+ *  dir     - direction of ray
+ *  t       - distance to the hit for each entry, or -1
+ */
+__attribute__((target("avx2")))
+static void spheres_avx2(bake_t *bake, int first, int n, double *base,
+                         double *dir, double *t) {
+    __m256d dx = _mm256_set1_pd(dir[0]);
+    __m256d dy = _mm256_set1_pd(dir[1]);
+    __m256d dz = _mm256_set1_pd(dir[2]);
+    __m256d a  = _mm256_set1_pd(vec_dot3(dir, dir));
+    __m256d vx, vy, vz, b, c, disc, res;
+
+    vx = _mm256_sub_pd(_mm256_set1_pd(base[0]),
+                       _mm256_loadu_pd(bake->scx + first));
+    vy = _mm256_sub_pd(_mm256_set1_pd(base[1]),
+                       _mm256_loadu_pd(bake->scy + first));
+    vz = _mm256_sub_pd(_mm256_set1_pd(base[2]),
+                       _mm256_loadu_pd(bake->scz + first));
+
+    b = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(vx, dx),
+                                    _mm256_mul_pd(vy, dy)),
+                      _mm256_mul_pd(vz, dz));
+    b = _mm256_mul_pd(_mm256_set1_pd(2.0), b);
+    c = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(vx, vx),
+                                    _mm256_mul_pd(vy, vy)),
+                      _mm256_mul_pd(vz, vz));
+    c = _mm256_sub_pd(c, _mm256_loadu_pd(bake->sr2 + first));
+
+    disc = _mm256_sub_pd(_mm256_mul_pd(b, b),
+                         _mm256_mul_pd(_mm256_mul_pd(_mm256_set1_pd(4.0), a),
+                                       c));
+    res = _mm256_div_pd(_mm256_sub_pd(_mm256_mul_pd(b, _mm256_set1_pd(-1.0)),
+                                      _mm256_sqrt_pd(disc)),
+                        _mm256_mul_pd(_mm256_set1_pd(2.0), a));
+
+    res = _mm256_blendv_pd(_mm256_set1_pd(-1.0), res,
+                    _mm256_cmp_pd(disc, _mm256_setzero_pd(), _CMP_GT_OQ));
+    _mm256_storeu_pd(t, res);
+}
+
+/*
+ * Hit distances of a ray against four baked planes, see plane_hit.
+ *
+ * PARAMETERS:
+ *  nx, ny, nz  - normals of the planes
+ *  nq          - normal dot point of the planes
+ *  base        - origin of ray
+ *  dir         - direction of ray
+ *
+ * RETURNS:
+ *  distance to each hit, or -1
+ */
+__attribute__((target("avx2")))
+static inline __m256d plane_avx2(double *nx, double *ny, double *nz,
+                                 double *nq, double *base, double *dir) {
+    __m256d vnx = _mm256_loadu_pd(nx);
+    __m256d vny = _mm256_loadu_pd(ny);
+    __m256d vnz = _mm256_loadu_pd(nz);
+    __m256d NdotV, NdotD, res, hz, hit;
+
+    NdotV = _mm256_add_pd(_mm256_add_pd(
+                _mm256_mul_pd(vnx, _mm256_set1_pd(base[0])),
+                _mm256_mul_pd(vny, _mm256_set1_pd(base[1]))),
+                _mm256_mul_pd(vnz, _mm256_set1_pd(base[2])));
+    NdotD = _mm256_add_pd(_mm256_add_pd(
+                _mm256_mul_pd(vnx, _mm256_set1_pd(dir[0])),
+                _mm256_mul_pd(vny, _mm256_set1_pd(dir[1]))),
+                _mm256_mul_pd(vnz, _mm256_set1_pd(dir[2])));
+    res = _mm256_div_pd(_mm256_sub_pd(_mm256_loadu_pd(nq), NdotV), NdotD);
+    hz = _mm256_add_pd(_mm256_set1_pd(base[2]),
+                       _mm256_mul_pd(_mm256_set1_pd(dir[2]), res));
+
+    hit = _mm256_cmp_pd(NdotD, _mm256_setzero_pd(), _CMP_NEQ_UQ);
+    hit = _mm256_and_pd(hit, _mm256_cmp_pd(res, _mm256_set1_pd(0.0001),
+                                           _CMP_GE_OQ));
+    hit = _mm256_and_pd(hit, _mm256_cmp_pd(hz, _mm256_setzero_pd(),
+                                           _CMP_LT_OQ));
+    return _mm256_blendv_pd(_mm256_set1_pd(-1.0), res, hit);
+}
+
+/*
+ * AVX2 plane kernel, tests four planes at once.
+ *
+ * PARAMETERS:
+ *  bake    - baked scene
+ *  first   - first entry to test
+ *  n       - number of entries to test, the rest are computed anyway
+ *  base    - origin of ray
+ *  dir     - direction of ray
+ *  t       - distance to the hit for each entry, or -1
+ */
+__attribute__((target("avx2")))
+static void planes_avx2(bake_t *bake, int first, int n, double *base,
+                        double *dir, double *t) {
+    _mm256_storeu_pd(t, plane_avx2(bake->pnx + first, bake->pny + first,
+                                   bake->pnz + first, bake->pnq + first,
+                                   base, dir));
+}
+
+/*
+ * AVX2 fplane kernel, tests four fplanes at once.
+ *
+ * PARAMETERS:
+ *  bake    - baked scene
+ *  first   - first entry to test
+ *  n       - number of entries to test, the rest are computed anyway
+ *  base    - origin of ray
+ *  dir     - direction of ray
+ *  t       - distance to the hit for each entry, or -1
+ */
+__attribute__((target("avx2")))
+static void fplanes_avx2(bake_t *bake, int first, int n, double *base,
+                         double *dir, double *t) {
+    __m256d zero = _mm256_setzero_pd();
+    __m256d res, hx, hy, hz, x, y, hit;
+
+    res = plane_avx2(bake->fnx + first, bake->fny + first, bake->fnz + first,
+                     bake->fnq + first, base, dir);
+
+    // hit point relative to the plane's origin
+    hx = _mm256_sub_pd(_mm256_add_pd(_mm256_set1_pd(base[0]),
+                        _mm256_mul_pd(_mm256_set1_pd(dir[0]), res)),
+                       _mm256_loadu_pd(bake->fpx + first));
+    hy = _mm256_sub_pd(_mm256_add_pd(_mm256_set1_pd(base[1]),
+                        _mm256_mul_pd(_mm256_set1_pd(dir[1]), res)),
+                       _mm256_loadu_pd(bake->fpy + first));
+    hz = _mm256_sub_pd(_mm256_add_pd(_mm256_set1_pd(base[2]),
+                        _mm256_mul_pd(_mm256_set1_pd(dir[2]), res)),
+                       _mm256_loadu_pd(bake->fpz + first));
+
+    // rotate into the plane's x and y
+    x = _mm256_add_pd(_mm256_add_pd(
+            _mm256_mul_pd(_mm256_loadu_pd(bake->fux + first), hx),
+            _mm256_mul_pd(_mm256_loadu_pd(bake->fuy + first), hy)),
+            _mm256_mul_pd(_mm256_loadu_pd(bake->fuz + first), hz));
+    y = _mm256_add_pd(_mm256_add_pd(
+            _mm256_mul_pd(_mm256_loadu_pd(bake->fvx + first), hx),
+            _mm256_mul_pd(_mm256_loadu_pd(bake->fvy + first), hy)),
+            _mm256_mul_pd(_mm256_loadu_pd(bake->fvz + first), hz));
+
+    hit = _mm256_cmp_pd(res, zero, _CMP_GE_OQ);
+    hit = _mm256_and_pd(hit, _mm256_cmp_pd(x, zero, _CMP_GE_OQ));
+    hit = _mm256_and_pd(hit, _mm256_cmp_pd(x,
+                _mm256_loadu_pd(bake->fw + first), _CMP_LE_OQ));
+    hit = _mm256_and_pd(hit, _mm256_cmp_pd(y, zero, _CMP_GE_OQ));
+    hit = _mm256_and_pd(hit, _mm256_cmp_pd(y,
+                _mm256_loadu_pd(bake->fh + first), _CMP_LE_OQ));
+    _mm256_storeu_pd(t, _mm256_blendv_pd(_mm256_set1_pd(-1.0), res, hit));
+}
+#endif
+
+/*
+ * Start an empty run.
+ *
+ * PARAMETERS:
+ *  run     - run to initialize
+ *  nobjs   - number of objects being baked
+ *  hits    - kernel for the run
+ */
+static void bake_run_init(bake_run_t *run, int nobjs,
+                          void (*hits)(bake_t *, int, int, double *, double *,
+                                       double *)) {
+    run->count = 0;
+    run->objs = (obj_t **)smalloc(sizeof(obj_t *) * (nobjs + 1));
+    run->before = (int *)smalloc(sizeof(int) * (nobjs + 1));
+    run->hits = hits;
+}
+
+/*
+ * Bake the geometry of an array of objects.
+ *
+ * PARAMETERS:
+ *  objs    - objects to bake, entries keep their order
+ *  nobjs   - number of objects
+ *
+ * RETURNS:
+ *  pointer to the baked scene
+ */
+bake_t *bake_build(obj_t **objs, int nobjs) {
+    bake_t   *bake = (bake_t *)smalloc(sizeof(bake_t));
+    sphere_t *sphere;
+    plane_t  *plane;
+    fplane_t *fplane;
+    obj_t    *obj;
+    int       i, r, k;
+
+    bake_run_init(&bake->runs[BAKE_SPHERES], nobjs, spheres_scalar);
+    bake_run_init(&bake->runs[BAKE_PLANES],  nobjs, planes_scalar);
+    bake_run_init(&bake->runs[BAKE_FPLANES], nobjs, fplanes_scalar);
+    bake_run_init(&bake->runs[BAKE_OTHERS],  nobjs, others_scalar);
+    bake->isa = "scalar";
+
+#ifdef BAKE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        bake->runs[BAKE_SPHERES].hits = spheres_avx2;
+        bake->runs[BAKE_PLANES].hits  = planes_avx2;
+        bake->runs[BAKE_FPLANES].hits = fplanes_avx2;
+        bake->isa = "avx2";
+    }
+#endif
+
+    // sort the objects into runs by shape
+    for (i = 0; i < nobjs; i++) {
+        for (r = 0; r < BAKE_RUNS; r++) {
+            bake->runs[r].before[i] = bake->runs[r].count;
+        }
+
+        if (objs[i]->ops->hits == hits_sphere) {
+            r = BAKE_SPHERES;
+        } else if (objs[i]->ops->hits == hits_plane) {
+            r = BAKE_PLANES;
+        } else if (objs[i]->ops->hits == hits_fplane) {
+            r = BAKE_FPLANES;
+        } else {
+            r = BAKE_OTHERS;
+        }
+        bake->runs[r].objs[bake->runs[r].count++] = objs[i];
+    }
+    for (r = 0; r < BAKE_RUNS; r++) {
+        bake->runs[r].before[nobjs] = bake->runs[r].count;
+    }
+
+    k = bake->runs[BAKE_SPHERES].count;
+    bake->scx = bake_array(k);
+    bake->scy = bake_array(k);
+    bake->scz = bake_array(k);
+    bake->sr2 = bake_array(k);
+    for (i = 0; i < k; i++) {
+        sphere = (sphere_t *)bake->runs[BAKE_SPHERES].objs[i]->priv;
+        bake->scx[i] = sphere->center[0];
+        bake->scy[i] = sphere->center[1];
+        bake->scz[i] = sphere->center[2];
+        bake->sr2[i] = sphere->radius * sphere->radius;
+    }
+
+    k = bake->runs[BAKE_PLANES].count;
+    bake->pnx = bake_array(k);
+    bake->pny = bake_array(k);
+    bake->pnz = bake_array(k);
+    bake->pnq = bake_array(k);
+    for (i = 0; i < k; i++) {
+        plane = (plane_t *)bake->runs[BAKE_PLANES].objs[i]->priv;
+        bake->pnx[i] = plane->normal[0];
+        bake->pny[i] = plane->normal[1];
+        bake->pnz[i] = plane->normal[2];
+        bake->pnq[i] = vec_dot3(plane->normal, plane->point);
+    }
+
+    k = bake->runs[BAKE_FPLANES].count;
+    bake->fnx = bake_array(k);
+    bake->fny = bake_array(k);
+    bake->fnz = bake_array(k);
+    bake->fnq = bake_array(k);
+    bake->fpx = bake_array(k);
+    bake->fpy = bake_array(k);
+    bake->fpz = bake_array(k);
+    bake->fux = bake_array(k);
+    bake->fuy = bake_array(k);
+    bake->fuz = bake_array(k);
+    bake->fvx = bake_array(k);
+    bake->fvy = bake_array(k);
+    bake->fvz = bake_array(k);
+    bake->fw  = bake_array(k);
+    bake->fh  = bake_array(k);
+    for (i = 0; i < k; i++) {
+        obj = bake->runs[BAKE_FPLANES].objs[i];
+        plane = (plane_t *)obj->priv;
+        fplane = (fplane_t *)plane->priv;
+        bake->fnx[i] = plane->normal[0];
+        bake->fny[i] = plane->normal[1];
+        bake->fnz[i] = plane->normal[2];
+        bake->fnq[i] = vec_dot3(plane->normal, plane->point);
+        bake->fpx[i] = plane->point[0];
+        bake->fpy[i] = plane->point[1];
+        bake->fpz[i] = plane->point[2];
+        bake->fux[i] = fplane->rotmat[0][0];
+        bake->fuy[i] = fplane->rotmat[0][1];
+        bake->fuz[i] = fplane->rotmat[0][2];
+        bake->fvx[i] = fplane->rotmat[1][0];
+        bake->fvy[i] = fplane->rotmat[1][1];
+        bake->fvz[i] = fplane->rotmat[1][2];
+        bake->fw[i]  = fplane->size[0];
+        bake->fh[i]  = fplane->size[1];
+    }
+
+    return bake;
+}
+
+/*
+ * Test a ray against a range of baked objects, keeping the closest hit.
+ * Ties go to the object loaded first, which is the one a scan of the scene
+ * list would keep.
+ *
+ * PARAMETERS:
+ *  bake    - baked scene
+ *  first   - first object of the range
+ *  count   - number of objects in the range
+ *  base    - origin of ray
+ *  dir     - direction of ray
+ *  last_hit- object the ray starts on, never counted as a hit
+ *  closest - closest object so far, updated on a closer hit
+ *  mindist - distance to closest, updated on a closer hit
+ */
+void bake_closest(bake_t *bake, int first, int count, double *base,
+                  double *dir, obj_t *last_hit, obj_t **closest,
+                  double *mindist) {
+    double      t[BAKE_WIDTH];
+    bake_run_t *run;
+    obj_t      *obj;
+    int         i, j, n, end, r;
+
+    for (r = 0; r < BAKE_RUNS; r++) {
+        run = &bake->runs[r];
+        end = run->before[first + count];
+
+        for (i = run->before[first]; i < end; i += BAKE_WIDTH) {
+            n = end - i < BAKE_WIDTH ? end - i : BAKE_WIDTH;
+            run->hits(bake, i, n, base, dir, t);
+
+            for (j = 0; j < n; j++) {
+                obj = run->objs[i + j];
+                STATS_TEST(obj->objtype, t[j] > 0);
+                if (!(t[j] > 0) || obj == last_hit) {
+                    continue;
+                }
+                if (*closest == NULL || t[j] < *mindist ||
+                    (t[j] == *mindist && obj->objid < (*closest)->objid)) {
+                    *closest = obj;
+                    *mindist = t[j];
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Find any baked object in a range blocking a ray before a given distance.
+ *
+ * PARAMETERS:
+ *  bake    - baked scene
+ *  first   - first object of the range
+ *  count   - number of objects in the range
+ *  base    - origin of ray
+ *  dir     - direction of ray
+ *  dist    - distance the ray travels
+ *  last_hit- object the ray starts on, never counted as a blocker
+ *
+ * RETURNS:
+ *  an object hit between base and dist, or NULL if there is none
+ */
+obj_t *bake_occluded(bake_t *bake, int first, int count, double *base,
+                     double *dir, double dist, obj_t *last_hit) {
+    double      t[BAKE_WIDTH];
+    bake_run_t *run;
+    int         i, j, n, end, r;
+
+    for (r = 0; r < BAKE_RUNS; r++) {
+        run = &bake->runs[r];
+        end = run->before[first + count];
+
+        for (i = run->before[first]; i < end; i += BAKE_WIDTH) {
+            n = end - i < BAKE_WIDTH ? end - i : BAKE_WIDTH;
+            run->hits(bake, i, n, base, dir, t);
+
+#ifdef RENDER_STATS
+            for (j = 0; j < n; j++) {
+                STATS_TEST(run->objs[i + j]->objtype, t[j] > 0);
+            }
+#endif
+            for (j = 0; j < n; j++) {
+                if (t[j] > 0 && t[j] < dist && run->objs[i + j] != last_hit) {
+                    return run->objs[i + j];
+                }
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Print information about a baked scene.
+ *
+ * PARAMETERS:
+ *  out     - file to print to
+ *  bake    - baked scene to dump
+ */
+void bake_dump(FILE *out, bake_t *bake) {
+    fprintf(out, "\t\tBaked: %d spheres, %d planes, %d fplanes, %d other "
+                 "(%s)\n", bake->runs[BAKE_SPHERES].count,
+                           bake->runs[BAKE_PLANES].count,
+                           bake->runs[BAKE_FPLANES].count,
+                           bake->runs[BAKE_OTHERS].count, bake->isa);
+}
+
+/*
+ * Free a baked scene.  The objects belong to the scene and are left alone.
+ *
+ * PARAMETERS:
+ *  bake    - baked scene to free
+ */
+void bake_free(bake_t *bake) {
+    double *arrays[] = { bake->scx, bake->scy, bake->scz, bake->sr2,
+                         bake->pnx, bake->pny, bake->pnz, bake->pnq,
+                         bake->fnx, bake->fny, bake->fnz, bake->fnq,
+                         bake->fpx, bake->fpy, bake->fpz,
+                         bake->fux, bake->fuy, bake->fuz,
+                         bake->fvx, bake->fvy, bake->fvz,
+                         bake->fw,  bake->fh };
+    int i;
+
+    for (i = 0; i < (int)(sizeof(arrays) / sizeof(arrays[0])); i++) {
+        free(arrays[i]);
+    }
+    for (i = 0; i < BAKE_RUNS; i++) {
+        free(bake->runs[i].objs);
+        free(bake->runs[i].before);
+    }
+    free(bake);
+}
@@ -0,0 +1,17 @@
+#include <stdio.h>
+#include "common.h"
+
+#ifndef BAKE_H
+#define BAKE_H
+
+bake_t *bake_build(obj_t **, int);
+
+void bake_closest(bake_t *, int, int, double *, double *, obj_t *, obj_t **,
+                  double *);
+
+obj_t *bake_occluded(bake_t *, int, int, double *, double *, double, obj_t *);
+
+void bake_dump(FILE *, bake_t *);
+
+void bake_free(bake_t *);
+#endif
@@ -0,0 +1,191 @@
+/*
+ * bench.c
+ *
+ * Times the stages of a run and reports them, with the rays traced, as a
+ * one line JSON summary that benchmark scripts can collect.
+ *
+ * Chris Blades
+ *
+ * 18/10/2026
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "common.h"
+#include "safe.h"
+#include "packet.h"
+#include "bench.h"
+#include "vtexture.h"
+
+/* names of the ray kinds in reports */
+static char *ray_names[RAY_KINDS] =
+{
+    "primary",
+    "shadow",
+    "specular"
+};
+
+/**
+ * Allocate an empty benchmark record and start its clock.
+ *
+ * RETURNS:
+ *  pointer to the new record
+ */
+bench_t *bench_init(void) {
+    bench_t *bench = (bench_t *)smalloc(sizeof(bench_t));
+    int      i;
+
+    bench->start       = bench_now();
+    bench->parse_time  = 0.0;
+    bench->build_time  = 0.0;
+    bench->render_time = 0.0;
+    bench->output_time = 0.0;
+    for (i = 0; i < RAY_KINDS; i++) {
+        bench->rays[i] = 0;
+    }
+
+    return bench;
+}
+
+/**
+ * Read a monotonic clock.
+ *
+ * RETURNS:
+ *  the time in seconds
+ */
+double bench_now(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/*
+ * Count the objects of a list.
+ *
+ * PARAMETERS:
+ *  list    - list to count
+ *
+ * RETURNS:
+ *  number of objects in the list
+ */
+static long bench_count(list_t *list) {
+    obj_t *obj;
+    long   count = 0;
+
+    for (obj = list->head; obj != NULL; obj = obj->next) {
+        count++;
+    }
+    return count;
+}
+
+/*
+ * Print the benchmark record of a model as one line of JSON.
+ *
+ * PARAMETERS:
+ *  out     - file to print to
+ *  model   - model that was rendered
+ */
+static void bench_json(FILE *out, model_t *model) {
+    bench_t      *bench = model->bench;
+    struct rusage usage;
+    double        wall  = bench_now() - bench->start;
+    long          total = 0;
+    int           i;
+
+    getrusage(RUSAGE_SELF, &usage);
+
+    for (i = 0; i < RAY_KINDS; i++) {
+        total += bench->rays[i];
+    }
+
+    fprintf(out, "{\"width\": %d, \"height\": %d, ",
+            model->proj->win_size_pixel[0], model->proj->win_size_pixel[1]);
+    fprintf(out, "\"threads\": %d, \"tile_size\": %d, \"packets\": \"%s\", ",
+            model->opts->threads, model->opts->tile_size,
+            model->opts->packets ? packet_isa() : "off");
+    fprintf(out, "\"engine\": \"%s\", ",
+            model->opts->wavefront ? "wavefront" : "path");
+    fprintf(out, "\"objects\": %ld, \"lights\": %ld, ",
+            bench_count(model->scene), bench_count(model->lights));
+    fprintf(out, "\"parse_s\": %.6f, \"build_s\": %.6f, \"render_s\": %.6f, "
+                 "\"wall_s\": %.6f, ", bench->parse_time, bench->build_time,
+                 bench->render_time, wall);
+
+    fprintf(out, "\"rays\": {");
+    for (i = 0; i < RAY_KINDS; i++) {
+        fprintf(out, "\"%s\": %ld, ", ray_names[i], bench->rays[i]);
+    }
+    fprintf(out, "\"total\": %ld}, ", total);
+
+    fprintf(out, "\"rays_per_s\": {");
+    for (i = 0; i < RAY_KINDS; i++) {
+        fprintf(out, "\"%s\": %.0f, ", ray_names[i],
+                bench->render_time > 0.0 ?
+                bench->rays[i] / bench->render_time : 0.0);
+    }
+    fprintf(out, "\"total\": %.0f}, ", bench->render_time > 0.0 ?
+                                       total / bench->render_time : 0.0);
+
+    if (vtex_enabled()) {
+        vtex_counts_t pages;
+
+        vtex_counts(&pages);
+        fprintf(out, "\"texture_pages\": {\"hits\": %ld, \"misses\": %ld, "
+                     "\"evictions\": %ld, \"resident\": %ld}, ", pages.hits,
+                     pages.misses, pages.evictions, pages.resident);
+    }
+    // ru_maxrss is in kilobytes on linux
+    fprintf(out, "\"peak_rss_kb\": %ld}\n", (long)usage.ru_maxrss);
+}
+
+/**
+ * Append the benchmark record of a model to a file as one line of JSON.
+ *
+ * PARAMETERS:
+ *  path    - file to append to, "-" for stderr
+ *  model   - model that was rendered
+ *
+ * RETURNS:
+ *  0 on success
+ */
+int bench_write(char *path, model_t *model) {
+    FILE *out;
+
+    if (path[0] == '-' && path[1] == '\0') {
+        bench_json(stderr, model);
+        return 0;
+    }
+
+    if ((out = fopenAndCheck(path, "a")) == NULL) {
+        return EXIT_FAILURE;
+    }
+
+    bench_json(out, model);
+    fclose(out);
+    return 0;
+}
+
+/**
+ * Print information about the benchmark record of a model.
+ *
+ * PARAMETERS:
+ *  out     - file to print to
+ *  model   - model that was rendered
+ */
+void bench_dump(FILE *out, model_t *model) {
+    bench_t *bench = model->bench;
+    int      i;
+
+    fprintf(out, "\tBENCH:\n");
+    fprintf(out, "\t\tParse time: %lf ms\n", bench->parse_time * 1000.0);
+    fprintf(out, "\t\tBuild time: %lf ms\n", bench->build_time * 1000.0);
+    fprintf(out, "\t\tRender time: %lf ms\n", bench->render_time * 1000.0);
+    for (i = 0; i < RAY_KINDS; i++) {
+        fprintf(out, "\t\tRays %s: %ld\n", ray_names[i], bench->rays[i]);
+    }
+    if (vtex_enabled()) {
+        vtex_dump(out);
+    }
+}
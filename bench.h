@@ -0,0 +1,14 @@
+#include <stdio.h>
+#include "common.h"
+
+#ifndef BENCH_H
+#define BENCH_H
+
+bench_t *bench_init(void);
+
+double bench_now(void);
+
+int bench_write(char *, model_t *);
+
+void bench_dump(FILE *, model_t *);
+#endif
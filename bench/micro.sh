@@ -0,0 +1,29 @@
+#!/bin/sh
+#
+# micro.sh
+#
+# Builds the kernel microbenchmarks from the ray tracer sources and runs
+# them, passing on any options, eg
+#
+#   bench/micro.sh -w bench/baseline.txt     record a baseline
+#   bench/micro.sh -c bench/baseline.txt     compare against it
+#
+# Environment:
+#   CC          compiler (default cc)
+#   CFLAGS      compiler flags (default -O2)
+#
+# Chris Blades
+#
+# 18/10/2026
+
+here=$(cd "$(dirname "$0")" && pwd)
+bin=${TMPDIR:-/tmp}/microbench.$$
+
+srcs=$(ls "$here"/../*.c | grep -v '/main\.c$')
+${CC:-cc} ${CFLAGS:--O2} -o "$bin" "$here/microbench.c" $srcs -lm -lpthread \
+    || exit 1
+
+"$bin" "$@"
+rc=$?
+rm -f "$bin"
+exit $rc
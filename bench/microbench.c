@@ -0,0 +1,405 @@
+/*
+ * microbench.c
+ *
+ * Times the vector routines of veclib3d.c and the intersectors and shaders
+ * of the scene objects one at a time.  Every kernel runs over a fixed
+ * input, the same call repeated, and over a set of random inputs, and is
+ * reported in nanoseconds per call.  Results can be written to a baseline
+ * file and later runs compared against it, so a change to the hot path
+ * shows up as a kernel getting slower.
+ *
+ *  microbench [-k kernel] [-w baseline] [-c baseline] [-t percent]
+ *
+ *  -k kernel    only time kernels whose name starts with kernel
+ *  -w baseline  write the results to baseline
+ *  -c baseline  compare against baseline, exit 1 if any kernel is more
+ *               than percent slower
+ *  -t percent   slowdown allowed by -c (default 10)
+ *
+ * Built from the ray tracer sources without main.c, see micro.sh.
+ *
+ * Chris Blades
+ *
+ * 18/10/2026
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "../common.h"
+#include "../scan.h"
+#include "../veclib3d.h"
+#include "../sphere.h"
+#include "../plane.h"
+#include "../fplane.h"
+#include "../tplane.h"
+#include "../pplane.h"
+#include "../psphere.h"
+#include "../texture.h"
+
+#define INPUTS          1024    /* random inputs, a power of two */
+#define MIN_TIME        0.05    /* seconds each kernel is timed for */
+#define MAX_KERNELS     64
+#define DEFAULT_SLOWER  10.0
+
+/* inputs shared by every kernel */
+static double   va[INPUTS][3];          // random vectors
+static double   vb[INPUTS][3];
+static double   vc[INPUTS][3];
+static double   unit[INPUTS][3];        // random unit vectors
+static double   mats[INPUTS][3][3];     // random matrices
+static double   rel[INPUTS][2];         // random texture coordinates
+static hit_t    hits[INPUTS];           // random hit points
+static double   origin[3] = {0.0, 0.0, 5.0};
+static double   scalar_sink;            // results, so no call is dropped
+static double   vec_sink[3][3];
+
+static obj_t     *sphere;
+static obj_t     *plane;
+static obj_t     *fplane;
+static obj_t     *tplane;
+static obj_t     *pplane;
+static obj_t     *psphere;
+static texture_t  texture;
+static texture_t  mipped;               // texture with a mip pyramid
+
+/*
+ * Random number in a range, from a 64 bit linear congruential generator so
+ * inputs are the same on every run.
+ */
+static unsigned long long seed = 1;
+
+static double rnd(double lo, double hi) {
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    return lo + (hi - lo) * ((seed >> 11) / 9007199254740992.0);
+}
+
+/*
+ * Build an object through its loader from a scene file fragment.
+ *
+ * PARAMETERS:
+ *  init    - loader of the object type
+ *  objtype - object type
+ *  text    - description of the object, as in a scene file
+ *
+ * RETURNS:
+ *  the new object
+ */
+static obj_t *make_obj(obj_t *(*init)(scan_t *, int), int objtype,
+                       char *text) {
+    FILE   *in = fmemopen(text, strlen(text), "r");
+    scan_t *scan = scan_init(in, "microbench");
+    obj_t  *obj = init(scan, objtype);
+
+    scan_free(scan);
+    fclose(in);
+    return obj;
+}
+
+/*
+ * Fill in the inputs and build the objects every kernel uses.
+ */
+static void setup(void) {
+    int i;
+    int j;
+    int k;
+
+    for (i = 0; i < INPUTS; i++) {
+        for (j = 0; j < 3; j++) {
+            va[i][j] = rnd(-10.0, 10.0);
+            vb[i][j] = rnd(-10.0, 10.0);
+            vc[i][j] = rnd(-10.0, 10.0);
+            for (k = 0; k < 3; k++) {
+                mats[i][j][k] = rnd(-1.0, 1.0);
+            }
+        }
+
+        // rays from the view point through a window in front of it
+        unit[i][0] = rnd(-4.0, 4.0);
+        unit[i][1] = rnd(-3.0, 3.0);
+        unit[i][2] = -5.0;
+        vec_unit3(unit[i], unit[i]);
+
+        rel[i][0] = rnd(0.0, 0.999);
+        rel[i][1] = rnd(0.0, 0.999);
+
+        hits[i].t = 1.0;
+        hits[i].hitloc[0] = rnd(-8.0, 8.0);
+        hits[i].hitloc[1] = rnd(-8.0, 8.0);
+        hits[i].hitloc[2] = rnd(-12.0, -4.0);
+        hits[i].planehit[0] = rnd(0.0, 4.0);
+        hits[i].planehit[1] = rnd(0.0, 4.0);
+    }
+
+    sphere  = make_obj(sphere_init, SPHERE,
+                       "1 1 1\n1 1 1\n0 0 0\n0 0 -8\n3\n");
+    plane   = make_obj(plane_init, PLANE,
+                       "1 1 1\n1 1 1\n0 0 0\n0 0.3 1\n0 0 -10\n");
+    fplane  = make_obj(fplane_init, FPLANE,
+                       "1 1 1\n1 1 1\n0 0 0\n0 0 1\n-2 -2 -8\n1 0 0\n"
+                       "4 4\n");
+    tplane  = make_obj(tplane_init, TPLANE,
+                       "1 1 1\n1 1 1\n0 0 0\n0 0 1\n0 0 -8\n1 1 0\n"
+                       "1 1\n0 0 0\n1 1 1\n0 0 0\n");
+    pplane  = make_obj(pplane_init, P_PLANE,
+                       "1 1 1\n1 1 1\n0 0 0\n0 1 0\n0 -4 0\n0\n");
+    psphere = make_obj(psphere_init, P_SPHERE,
+                       "1 1 1\n1 1 1\n0 0 0\n0 0 -8\n3\n0\n");
+
+    texture.size[0] = 512;
+    texture.size[1] = 512;
+    texture.texbuf = (unsigned char *)malloc(3 * 512 * 512);
+    for (i = 0; i < 3 * 512 * 512; i++) {
+        texture.texbuf[i] = (unsigned char)rnd(0.0, 255.0);
+    }
+
+    mipped = texture;
+    mipped.texbuf = (unsigned char *)malloc(3 * 512 * 512);
+    memcpy(mipped.texbuf, texture.texbuf, 3 * 512 * 512);
+    texture_build(&mipped);
+}
+
+/*
+ * One call of each kernel on input i.
+ */
+static void k_dot3(int i)     { scalar_sink += vec_dot3(va[i], vb[i]); }
+static void k_scale3(int i)   { vec_scale3(va[i][0], vb[i], vec_sink[0]); }
+static void k_length3(int i)  { scalar_sink += vec_length3(va[i]); }
+static void k_diff3(int i)    { vec_diff3(va[i], vb[i], vec_sink[0]); }
+static void k_sum3(int i)     { vec_sum3(va[i], vb[i], vec_sink[0]); }
+static void k_unit3(int i)    { vec_unit3(va[i], vec_sink[0]); }
+static void k_cross3(int i)   { vec_cross3(va[i], vb[i], vec_sink[0]); }
+static void k_project3(int i) { vec_project3(unit[i], va[i], vec_sink[0]); }
+static void k_reflect3(int i) { vec_reflect3(unit[i], vb[i], vec_sink[0]); }
+static void k_xform3(int i)   { xform3(mats[i], va[i], vec_sink[0]); }
+static void k_matmul3(int i)  { vec_matmul3(mats[i], mats[(i + 1) &
+                                (INPUTS - 1)], vec_sink); }
+static void k_xpose3(int i)   { xpose3(mats[i], vec_sink); }
+
+static void k_hits_sphere(int i) {
+    scalar_sink += hits_sphere(origin, unit[i], sphere);
+}
+static void k_hits_plane(int i) {
+    scalar_sink += hits_plane(origin, unit[i], plane);
+}
+static void k_hits_fplane(int i) {
+    scalar_sink += hits_fplane(origin, unit[i], fplane);
+}
+static void k_tp_select(int i) {
+    scalar_sink += tp_select(tplane, &hits[i]);
+}
+static void k_texel_get(int i) {
+    texel_get(&texture, rel[i][0], rel[i][1], vec_sink[0]);
+}
+static void k_texel_filter(int i) {
+    double st[2] = { rel[i][0] * 512, rel[i][1] * 512 };
+
+    texel_filter(&mipped, st, 8.0 * rel[i][1], 1, vec_sink[0]);
+}
+static void k_pplane0_amb(int i) {
+    pplane0_amb(pplane, &hits[i], vec_sink[0]);
+}
+static void k_psphere0_amb(int i) {
+    psphere0_amb(psphere, &hits[i], vec_sink[0]);
+}
+
+/* a kernel to time */
+typedef struct kernel_type {
+    char   *name;
+    void  (*run)(int);
+} kernel_t;
+
+static kernel_t kernels[] =
+{
+    { "vec_dot3",       k_dot3 },
+    { "vec_scale3",     k_scale3 },
+    { "vec_length3",    k_length3 },
+    { "vec_diff3",      k_diff3 },
+    { "vec_sum3",       k_sum3 },
+    { "vec_unit3",      k_unit3 },
+    { "vec_cross3",     k_cross3 },
+    { "vec_project3",   k_project3 },
+    { "vec_reflect3",   k_reflect3 },
+    { "xform3",         k_xform3 },
+    { "vec_matmul3",    k_matmul3 },
+    { "xpose3",         k_xpose3 },
+    { "hits_sphere",    k_hits_sphere },
+    { "hits_plane",     k_hits_plane },
+    { "hits_fplane",    k_hits_fplane },
+    { "tp_select",      k_tp_select },
+    { "texel_get",      k_texel_get },
+    { "texel_filter",   k_texel_filter },
+    { "pplane0_amb",    k_pplane0_amb },
+    { "psphere0_amb",   k_psphere0_amb }
+};
+#define NUM_KERNELS sizeof(kernels) / sizeof(kernel_t)
+
+/*
+ * Read a monotonic clock in seconds.
+ */
+static double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Time one kernel.
+ *
+ * PARAMETERS:
+ *  kernel  - kernel to time
+ *  mask    - mask applied to the call count to pick the input, 0 to call
+ *            it on the same input every time
+ *
+ * RETURNS:
+ *  nanoseconds per call
+ */
+static double time_kernel(kernel_t *kernel, int mask) {
+    long   calls = INPUTS;
+    long   i;
+    double start;
+    double elapsed;
+
+    // warm up, then double the calls until the run is long enough
+    for (i = 0; i < INPUTS; i++) {
+        kernel->run(i & mask);
+    }
+
+    for (;;) {
+        start = now();
+        for (i = 0; i < calls; i++) {
+            kernel->run(i & mask);
+        }
+        elapsed = now() - start;
+
+        if (elapsed >= MIN_TIME) {
+            return elapsed * 1e9 / calls;
+        }
+        calls *= 2;
+    }
+}
+
+/*
+ * Look up a result in a baseline file.
+ *
+ * PARAMETERS:
+ *  base    - open baseline file
+ *  name    - kernel name
+ *  mode    - fixed or random
+ *
+ * RETURNS:
+ *  nanoseconds per call in the baseline, or -1 if it isn't there
+ */
+static double baseline_get(FILE *base, char *name, char *mode) {
+    char   bname[64];
+    char   bmode[16];
+    double ns;
+
+    rewind(base);
+    while (fscanf(base, "%63s %15s %lf", bname, bmode, &ns) == 3) {
+        if (strcmp(bname, name) == 0 && strcmp(bmode, mode) == 0) {
+            return ns;
+        }
+    }
+    return -1.0;
+}
+
+/*
+ * Print a usage message and exit.
+ */
+static void usage(char *prog) {
+    fprintf(stderr, "usage: %s [-k kernel] [-w baseline] [-c baseline] "
+                    "[-t percent]\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * Entry point for the microbenchmarks.
+ *
+ * PARAMETERS:
+ *  argc    - the number of command line arguments
+ *  argv    - array of pointers to command line arguments
+ */
+int main(int argc, char **argv) {
+    static char *modes[2] = { "fixed", "random" };
+    char   *only    = NULL;     // prefix of the kernels to time
+    FILE   *write   = NULL;     // baseline to write
+    FILE   *compare = NULL;     // baseline to compare against
+    double  slower  = DEFAULT_SLOWER;
+    double  ns;
+    double  old;
+    int     failed  = 0;
+    int     opt;
+    int     m;
+    size_t  k;
+
+    while ((opt = getopt(argc, argv, "k:w:c:t:")) != -1) {
+        switch (opt) {
+            case 'k':
+                only = optarg;
+                break;
+            case 'w':
+                if ((write = fopen(optarg, "w")) == NULL) {
+                    perror(optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'c':
+                if ((compare = fopen(optarg, "r")) == NULL) {
+                    perror(optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 't':
+                slower = atof(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                break;
+        }
+    }
+
+    setup();
+
+    printf("%-16s %-8s %10s", "kernel", "input", "ns/op");
+    if (compare != NULL) {
+        printf(" %10s %8s", "baseline", "change");
+    }
+    printf("\n");
+
+    for (k = 0; k < NUM_KERNELS; k++) {
+        if (only != NULL && strncmp(kernels[k].name, only, strlen(only))) {
+            continue;
+        }
+
+        for (m = 0; m < 2; m++) {
+            ns = time_kernel(&kernels[k], m == 0 ? 0 : INPUTS - 1);
+            printf("%-16s %-8s %10.3f", kernels[k].name, modes[m], ns);
+
+            if (write != NULL) {
+                fprintf(write, "%s %s %.3f\n", kernels[k].name, modes[m], ns);
+            }
+
+            if (compare != NULL &&
+                (old = baseline_get(compare, kernels[k].name, modes[m])) > 0) {
+                printf(" %10.3f %+7.1f%%", old, (ns - old) * 100.0 / old);
+                if (ns > old * (1.0 + slower / 100.0)) {
+                    printf("  SLOWER");
+                    failed = 1;
+                }
+            }
+            printf("\n");
+        }
+    }
+
+    if (write != NULL) {
+        fclose(write);
+    }
+    if (compare != NULL) {
+        fclose(compare);
+    }
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
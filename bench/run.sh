@@ -0,0 +1,75 @@
+#!/bin/sh
+#
+# run.sh
+#
+# End to end benchmark of the ray tracer over generated scenes.  Each scene
+# is rendered once with -b, which appends a JSON line holding the parse,
+# build, render and wall times, the primary, shadow and specular rays
+# traced and rays per second of each, and the peak RSS.  The lines are
+# gathered into summary.json in the output directory.
+#
+#   bench/run.sh path/to/rt [outdir]
+#
+# Environment:
+#   SCALE       multiplies the object counts (default 1)
+#   WIDTH       image width (default 640)
+#   HEIGHT      image height (default 480)
+#   RTFLAGS     extra ray tracer options, eg "-t 0 -p auto"
+#   CC          compiler for scenegen (default cc)
+#
+# Chris Blades
+#
+# 18/10/2026
+
+rt=$1
+out=${2:-bench_out}
+scale=${SCALE:-1}
+width=${WIDTH:-640}
+height=${HEIGHT:-480}
+here=$(cd "$(dirname "$0")" && pwd)
+
+if [ -z "$rt" ] || [ ! -x "$rt" ]; then
+    echo "usage: $0 path/to/rt [outdir]" >&2
+    exit 1
+fi
+rt=$(cd "$(dirname "$rt")" && pwd)/$(basename "$rt")
+
+mkdir -p "$out" || exit 1
+cd "$out" || exit 1
+rm -f runs.jsonl summary.json
+
+${CC:-cc} -O2 -o scenegen "$here/scenegen.c" || exit 1
+./scenegen texture 2048 > bench_tex.ppm
+
+# name kind count lights
+while read name kind count lights; do
+    ./scenegen "$kind" $((count * scale)) "$lights" > "$name.txt"
+
+    rm -f run.json
+    if ! "$rt" "$width" "$height" $RTFLAGS -b run.json < "$name.txt" \
+                                     > "$name.ppm" 2> "$name.log"; then
+        echo "$name: render failed, see $out/$name.log" >&2
+        continue
+    fi
+
+    sed "s/^{/{\"scene\": \"$name\", /" run.json >> runs.jsonl
+    tail -n 1 runs.jsonl
+done <<SCENES
+spheres_1k      spheres   1000  2
+spheres_10k     spheres   10000 2
+lights_32       spheres   200   32
+mirrors         mirrors   300   3
+fplanes_2k      fplanes   2000  2
+texplanes       texplanes 200   2
+SCENES
+rm -f run.json
+
+# one JSON document holding every run
+{
+    printf '{"width": %d, "height": %d, "rtflags": "%s", "runs": [\n' \
+           "$width" "$height" "$RTFLAGS"
+    sed '$!s/$/,/' runs.jsonl
+    printf ']}\n'
+} > summary.json
+
+echo "summary written to $out/summary.json"
@@ -0,0 +1,201 @@
+/*
+ * scenegen.c
+ *
+ * Writes synthetic scenes of any size for benchmarking the ray tracer, and
+ * the ppm textures they use.  Scenes are random but repeatable, every run
+ * with the same arguments writes the same scene.
+ *
+ *  scenegen spheres   count lights [seed]  spheres over a floor
+ *  scenegen mirrors   count lights [seed]  specular spheres between mirrors
+ *  scenegen fplanes   count lights [seed]  randomly turned finite planes
+ *  scenegen texplanes count lights [seed]  textured planes, see texture
+ *  scenegen texture   size                 size x size texture on stdout
+ *
+ * Chris Blades
+ *
+ * 18/10/2026
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEXTURE_NAME    "bench_tex.ppm"     /* texture the texplanes use */
+
+static unsigned long long seed = 1;
+
+/*
+ * Random number in a range, from a 64 bit linear congruential generator so
+ * scenes don't depend on the C library.
+ *
+ * PARAMETERS:
+ *  lo  - smallest value
+ *  hi  - largest value
+ *
+ * RETURNS:
+ *  a random value between lo and hi
+ */
+static double rnd(double lo, double hi) {
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    return lo + (hi - lo) * ((seed >> 11) / 9007199254740992.0);
+}
+
+/*
+ * Print a random colour.
+ *
+ * PARAMETERS:
+ *  lo  - smallest value of a channel
+ *  hi  - largest value of a channel
+ */
+static void colour(double lo, double hi) {
+    printf("%.4f %.4f %.4f\n", rnd(lo, hi), rnd(lo, hi), rnd(lo, hi));
+}
+
+/*
+ * Print the projection and lights every scene starts with.
+ *
+ * PARAMETERS:
+ *  lights  - number of lights
+ */
+static void header(int lights) {
+    int i;
+
+    printf("8 6\n0 0 5\n\n");
+    for (i = 0; i < lights; i++) {
+        printf("10\n");
+        colour(4.0, 8.0);
+        printf("%.4f %.4f %.4f\n\n", rnd(-12.0, 12.0), rnd(4.0, 12.0),
+               rnd(-8.0, 4.0));
+    }
+
+    // floor
+    printf("14\n0.1 0.1 0.1\n3 3 3\n0 0 0\n0 1 0\n0 -8 0\n\n");
+}
+
+/*
+ * Print a sphere somewhere in front of the view point.
+ *
+ * PARAMETERS:
+ *  spec    - largest specular value
+ */
+static void sphere(double spec) {
+    printf("13\n");
+    colour(0.0, 1.0);
+    colour(0.5, 4.0);
+    colour(0.0, spec);
+    printf("%.4f %.4f %.4f\n%.4f\n\n", rnd(-14.0, 14.0), rnd(-8.0, 10.0),
+           rnd(-45.0, -10.0), rnd(0.3, 1.5));
+}
+
+/*
+ * Print the material, normal, point, x direction and size of a randomly
+ * turned finite plane.
+ *
+ * PARAMETERS:
+ *  type    - object type to print
+ */
+static void fplane(int type) {
+    printf("%d\n", type);
+    colour(0.0, 1.0);
+    colour(0.5, 4.0);
+    printf("0 0 0\n");
+    printf("%.4f %.4f %.4f\n", rnd(-1.0, 1.0), rnd(-1.0, 1.0), rnd(0.2, 1.0));
+    printf("%.4f %.4f %.4f\n", rnd(-14.0, 14.0), rnd(-8.0, 10.0),
+           rnd(-45.0, -10.0));
+    printf("%.4f %.4f %.4f\n", rnd(0.2, 1.0), rnd(-1.0, 1.0), 0.0);
+    printf("%.4f %.4f\n", rnd(0.5, 3.0), rnd(0.5, 3.0));
+}
+
+/*
+ * Print a size x size ppm texture of coloured checks.
+ *
+ * PARAMETERS:
+ *  size    - edge of the texture in pixels
+ */
+static void texture(int size) {
+    unsigned char *row = (unsigned char *)malloc(3 * size);
+    int x;
+    int y;
+
+    printf("P6 %d %d 255\n", size, size);
+    for (y = 0; y < size; y++) {
+        for (x = 0; x < size; x++) {
+            row[3 * x + 0] = ((x / 32 + y / 32) & 1) ? 230 : 40;
+            row[3 * x + 1] = (unsigned char)(x * 255 / size);
+            row[3 * x + 2] = (unsigned char)(y * 255 / size);
+        }
+        fwrite(row, 1, 3 * size, stdout);
+    }
+    free(row);
+}
+
+/*
+ * Print a usage message and exit.
+ *
+ * PARAMETERS:
+ *  prog    - name of the program
+ */
+static void usage(char *prog) {
+    fprintf(stderr, "usage: %s spheres|mirrors|fplanes|texplanes count "
+                    "lights [seed]\n", prog);
+    fprintf(stderr, "       %s texture size\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * Entry point for the scene generator.
+ *
+ * PARAMETERS:
+ *  argc    - the number of command line arguments
+ *  argv    - array of pointers to command line arguments
+ */
+int main(int argc, char **argv) {
+    int count;
+    int lights;
+    int i;
+
+    if (argc == 3 && strcmp(argv[1], "texture") == 0) {
+        texture(atoi(argv[2]));
+        return EXIT_SUCCESS;
+    }
+
+    if (argc < 4) {
+        usage(argv[0]);
+    }
+
+    count  = atoi(argv[2]);
+    lights = atoi(argv[3]);
+    seed   = argc > 4 ? strtoull(argv[4], NULL, 10) : 1;
+
+    header(lights);
+
+    if (strcmp(argv[1], "spheres") == 0) {
+        for (i = 0; i < count; i++) {
+            sphere(0.2);
+        }
+    } else if (strcmp(argv[1], "mirrors") == 0) {
+        // mirrors on both sides and behind, so rays bounce until the
+        // distance limit
+        printf("15\n0 0 0\n0.5 0.5 0.5\n0.9 0.9 0.9\n1 0 0\n-16 0 -25\n"
+               "0 0 -1\n40 30\n\n");
+        printf("15\n0 0 0\n0.5 0.5 0.5\n0.9 0.9 0.9\n-1 0 0\n16 0 -25\n"
+               "0 0 1\n40 30\n\n");
+        printf("14\n0 0 0\n0.5 0.5 0.5\n0.8 0.8 0.8\n0 0 1\n0 0 -48\n\n");
+        for (i = 0; i < count; i++) {
+            sphere(0.9);
+        }
+    } else if (strcmp(argv[1], "fplanes") == 0) {
+        for (i = 0; i < count; i++) {
+            fplane(15);
+            printf("\n");
+        }
+    } else if (strcmp(argv[1], "texplanes") == 0) {
+        for (i = 0; i < count; i++) {
+            fplane(17);
+            printf("%s\n%d\n\n", TEXTURE_NAME, i % 2 ? 1 : 2);
+        }
+    } else {
+        usage(argv[0]);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,674 @@
+/*
+ * bvh.c
+ *
+ * Bounding volume hierarchy over the scene objects.  The tree is built
+ * top down, splitting each node where the surface area heuristic says a
+ * ray is cheapest to trace.  Objects without a bounding box (infinite
+ * planes) are kept in a side list and tested by every ray.
+ *
+ * Chris Blades
+ *
+ * 18/10/2026
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "common.h"
+#include "safe.h"
+#include "bvh.h"
+#include "packet.h"
+#include "bake.h"
+
+#define BVH_BINS        16      /* candidate split planes per axis */
+#define BVH_LEAF_SIZE   BAKE_WIDTH  /* nodes this small are always leaves */
+#define BVH_MAX_LEAF    8       /* nodes bigger than this are always split */
+#define BVH_MAX_DEPTH   64      /* deeper nodes are always leaves */
+#define BVH_TRAVERSE    1.0     /* cost of visiting a node, relative to
+                                   intersecting one object */
+#define BVH_PAD         1e-7    /* bounding box padding for rounding error */
+
+/* bounds of one object, only used while building */
+typedef struct bvh_prim_type {
+    obj_t  *obj;
+    double  min[3];
+    double  max[3];
+    double  centroid[3];
+} bvh_prim_t;
+
+/* objects falling in one bin of a split candidate */
+typedef struct bvh_bin_type {
+    double  min[3];
+    double  max[3];
+    int     count;
+} bvh_bin_t;
+
+/*
+ * Empty a bounding box so that growing it by anything gives that thing.
+ *
+ * PARAMETERS:
+ *  min     - lower corner of the box
+ *  max     - upper corner of the box
+ */
+static void box_empty(double *min, double *max) {
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        min[i] =  1e300;
+        max[i] = -1e300;
+    }
+}
+
+/*
+ * Grow a bounding box to contain another one.
+ *
+ * PARAMETERS:
+ *  min     - lower corner of the box to grow
+ *  max     - upper corner of the box to grow
+ *  omin    - lower corner of the box to add
+ *  omax    - upper corner of the box to add
+ */
+static void box_grow(double *min, double *max, double *omin, double *omax) {
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        min[i] = omin[i] < min[i] ? omin[i] : min[i];
+        max[i] = omax[i] > max[i] ? omax[i] : max[i];
+    }
+}
+
+/*
+ * Half the surface area of a bounding box, which is all the heuristic
+ * needs since only ratios of areas are compared.
+ *
+ * PARAMETERS:
+ *  min     - lower corner of the box
+ *  max     - upper corner of the box
+ *
+ * RETURNS:
+ *  half the surface area, 0 for an empty box
+ */
+static double box_area(double *min, double *max) {
+    double dx = max[0] - min[0];
+    double dy = max[1] - min[1];
+    double dz = max[2] - min[2];
+
+    if (dx < 0 || dy < 0 || dz < 0) {
+        return 0.0;
+    }
+    return dx * dy + dy * dz + dz * dx;
+}
+
+/*
+ * Bin a centroid along an axis.
+ *
+ * PARAMETERS:
+ *  c       - centroid coordinate
+ *  cmin    - smallest centroid coordinate in the node
+ *  scale   - number of bins over the extent of the centroids
+ *
+ * RETURNS:
+ *  the bin the centroid falls in
+ */
+static int bvh_bin(double c, double cmin, double scale) {
+    int b = (int)((c - cmin) * scale);
+
+    return b < 0 ? 0 : (b >= BVH_BINS ? BVH_BINS - 1 : b);
+}
+
+/*
+ * Cost of intersecting a ray with the objects of a leaf.  The baked
+ * kernels test BAKE_WIDTH objects of a shape at once, so a leaf costs
+ * about as much as the number of kernel calls it takes.
+ *
+ * PARAMETERS:
+ *  count   - number of objects in the leaf
+ *
+ * RETURNS:
+ *  cost relative to intersecting one object
+ */
+static double bvh_leaf_cost(int count) {
+    return (count + BAKE_WIDTH - 1) / BAKE_WIDTH;
+}
+
+/*
+ * Build the node for a range of objects, and recursively its children.
+ *
+ * PARAMETERS:
+ *  bvh     - hierarchy being built
+ *  prims   - objects being sorted into the tree
+ *  first   - first object of the node
+ *  count   - number of objects in the node
+ *  depth   - depth of the node
+ *
+ * RETURNS:
+ *  index of the new node
+ */
+static int bvh_build_node(bvh_t *bvh, bvh_prim_t *prims, int first,
+                          int count, int depth) {
+    int         node = bvh->nnodes++;       // index of the new node
+    bvh_node_t *n = &bvh->nodes[node];
+    bvh_bin_t   bins[BVH_BINS];
+    double      cmin[3];                    // bounds of the centroids
+    double      cmax[3];
+    double      lmin[3], lmax[3];           // bounds left of a split
+    double      rmin[3], rmax[3];           // bounds right of a split
+    double      larea[BVH_BINS];            // area left of each split
+    int         lcount[BVH_BINS];           // objects left of each split
+    double      parea;                      // area of this node
+    double      cost;                       // cost of a candidate split
+    double      best_cost = bvh_leaf_cost(count);   // cost of making a leaf
+    int         best_axis = -1;
+    int         best_split = 0;
+    double      scale;
+    int         mid;                        // first object right of split
+    int         rcount;
+    int         axis, i, b;
+    bvh_prim_t  tmp;
+
+    box_empty(n->min, n->max);
+    box_empty(cmin, cmax);
+    for (i = first; i < first + count; i++) {
+        box_grow(n->min, n->max, prims[i].min, prims[i].max);
+        box_grow(cmin, cmax, prims[i].centroid, prims[i].centroid);
+    }
+
+    n->index = first;
+    n->count = count;
+    if (count <= BVH_LEAF_SIZE || depth >= BVH_MAX_DEPTH) {
+        return node;
+    }
+
+    // find the cheapest split over all three axes
+    parea = box_area(n->min, n->max);
+    for (axis = 0; axis < 3 && parea > 0; axis++) {
+        if (cmax[axis] <= cmin[axis]) {
+            continue;
+        }
+        scale = BVH_BINS / (cmax[axis] - cmin[axis]);
+
+        for (b = 0; b < BVH_BINS; b++) {
+            box_empty(bins[b].min, bins[b].max);
+            bins[b].count = 0;
+        }
+        for (i = first; i < first + count; i++) {
+            b = bvh_bin(prims[i].centroid[axis], cmin[axis], scale);
+            box_grow(bins[b].min, bins[b].max, prims[i].min, prims[i].max);
+            bins[b].count++;
+        }
+
+        // sweep from the left, then from the right, pricing every split
+        box_empty(lmin, lmax);
+        rcount = 0;
+        for (b = 0; b < BVH_BINS - 1; b++) {
+            box_grow(lmin, lmax, bins[b].min, bins[b].max);
+            rcount += bins[b].count;
+            lcount[b] = rcount;
+            larea[b] = box_area(lmin, lmax);
+        }
+        box_empty(rmin, rmax);
+        rcount = 0;
+        for (b = BVH_BINS - 1; b > 0; b--) {
+            box_grow(rmin, rmax, bins[b].min, bins[b].max);
+            rcount += bins[b].count;
+            if (lcount[b - 1] == 0 || rcount == 0) {
+                continue;
+            }
+            cost = BVH_TRAVERSE +
+                   (larea[b - 1] * bvh_leaf_cost(lcount[b - 1]) +
+                    box_area(rmin, rmax) * bvh_leaf_cost(rcount)) / parea;
+            if (cost < best_cost) {
+                best_cost  = cost;
+                best_axis  = axis;
+                best_split = b;
+            }
+        }
+    }
+
+    if (best_axis < 0) {
+        if (count <= BVH_MAX_LEAF) {
+            return node;
+        }
+        // nothing to gain from the heuristic but too many for a leaf
+        mid = first + count / 2;
+    } else {
+        scale = BVH_BINS / (cmax[best_axis] - cmin[best_axis]);
+        mid = first;
+        for (i = first; i < first + count; i++) {
+            b = bvh_bin(prims[i].centroid[best_axis], cmin[best_axis], scale);
+            if (b < best_split) {
+                tmp = prims[i];
+                prims[i] = prims[mid];
+                prims[mid++] = tmp;
+            }
+        }
+    }
+
+    // left child is always the next node, only the right one is recorded
+    n->count = 0;
+    bvh_build_node(bvh, prims, first, mid - first, depth + 1);
+    n->index = bvh_build_node(bvh, prims, mid, first + count - mid,
+                              depth + 1);
+
+    return node;
+}
+
+/*
+ * Build a bounding volume hierarchy over the objects in a scene.
+ *
+ * PARAMETERS:
+ *  scene   - list of objects in the scene
+ *
+ * RETURNS:
+ *  pointer to the new hierarchy
+ */
+bvh_t *bvh_build(list_t *scene) {
+    bvh_t      *bvh = (bvh_t *)smalloc(sizeof(bvh_t));
+    bvh_prim_t *prims;
+    obj_t     **baked;              // objects in the order they are baked
+    obj_t      *obj;
+    int         nobjs = 0;          // number of objects in the scene
+    int         i, j;
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (obj = scene->head; obj != NULL; obj = obj->next) {
+        nobjs++;
+    }
+
+    prims = (bvh_prim_t *)smalloc(sizeof(bvh_prim_t) * (nobjs + 1));
+    bvh->unbounded = (obj_t **)smalloc(sizeof(obj_t *) * (nobjs + 1));
+    bvh->nobjs = 0;
+    bvh->nunbounded = 0;
+
+    // sort the objects into bounded and unbounded
+    for (obj = scene->head; obj != NULL; obj = obj->next) {
+        if (obj->ops->bounds == NULL) {
+            bvh->unbounded[bvh->nunbounded++] = obj;
+            continue;
+        }
+
+        prims[bvh->nobjs].obj = obj;
+        obj->ops->bounds(obj, prims[bvh->nobjs].min, prims[bvh->nobjs].max);
+        for (j = 0; j < 3; j++) {
+            prims[bvh->nobjs].min[j] -= BVH_PAD;
+            prims[bvh->nobjs].max[j] += BVH_PAD;
+            prims[bvh->nobjs].centroid[j] = 0.5 * 
+                    (prims[bvh->nobjs].min[j] + prims[bvh->nobjs].max[j]);
+        }
+        bvh->nobjs++;
+    }
+
+    // a tree over n objects never has more than 2n - 1 nodes
+    bvh->nodes = (bvh_node_t *)smalloc(sizeof(bvh_node_t) *
+                                       (2 * bvh->nobjs + 1));
+    bvh->nnodes = 0;
+    if (bvh->nobjs > 0) {
+        bvh_build_node(bvh, prims, 0, bvh->nobjs, 0);
+    }
+
+    bvh->objs = (obj_t **)smalloc(sizeof(obj_t *) * (bvh->nobjs + 1));
+    for (i = 0; i < bvh->nobjs; i++) {
+        bvh->objs[i] = prims[i].obj;
+    }
+    free(prims);
+
+    // bake the objects in leaf order, followed by the unbounded ones
+    baked = (obj_t **)smalloc(sizeof(obj_t *) * (nobjs + 1));
+    for (i = 0; i < bvh->nobjs; i++) {
+        baked[i] = bvh->objs[i];
+    }
+    for (i = 0; i < bvh->nunbounded; i++) {
+        baked[bvh->nobjs + i] = bvh->unbounded[i];
+    }
+    bvh->bake = bake_build(baked, nobjs);
+    free(baked);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    bvh->build_time = (end.tv_sec - start.tv_sec) +
+                      (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    return bvh;
+}
+
+/*
+ * Intersect a ray with a node's bounding box.
+ *
+ * PARAMETERS:
+ *  n       - node to test
+ *  base    - origin of ray
+ *  dir     - direction of ray
+ *  inv     - 1 / dir for each component
+ *  tfar    - distance to the closest hit so far, or -1 for none
+ *
+ * RETURNS:
+ *  distance to where the ray enters the box (0 if it starts inside), or -1
+ *  if it misses the box or enters it beyond tfar
+ */
+static double bvh_box(bvh_node_t *n, double *base, double *dir,
+                      double *inv, double tfar) {
+    double tmin = 0.0;
+    double tmax = 1e300;
+    double t0, t1, tmp;
+    int    i;
+
+    for (i = 0; i < 3; i++) {
+        // parallel to this slab, it either always or never overlaps
+        if (dir[i] == 0.0) {
+            if (base[i] < n->min[i] || base[i] > n->max[i]) {
+                return -1;
+            }
+            continue;
+        }
+        t0 = (n->min[i] - base[i]) * inv[i];
+        t1 = (n->max[i] - base[i]) * inv[i];
+        if (t0 > t1) {
+            tmp = t0;
+            t0 = t1;
+            t1 = tmp;
+        }
+        tmin = t0 > tmin ? t0 : tmin;
+        tmax = t1 < tmax ? t1 : tmax;
+        if (tmin > tmax) {
+            return -1;
+        }
+    }
+
+    // ties with the closest hit still have to be checked, since the
+    // object earliest in the scene wins a tie
+    if (tfar >= 0 && tmin > tfar) {
+        return -1;
+    }
+    return tmin;
+}
+
+/*
+ * Find the closest object a ray hits.
+ *
+ * PARAMETERS:
+ *  bvh     - hierarchy over the scene
+ *  base    - origin of ray
+ *  dir     - direction of ray
+ *  last_hit- object the ray starts on, never counted as a hit
+ *  mindist - set to the distance to the closest hit, or -1 for none
+ *
+ * RETURNS:
+ *  the closest object the ray hits, or NULL
+ */
+obj_t *bvh_closest(bvh_t *bvh, double *base, double *dir, obj_t *last_hit,
+                   double *mindist) {
+    obj_t      *closest = NULL;
+    int         stack[BVH_MAX_DEPTH + 2];   // nodes still to visit
+    int         sp = 0;                     // top of stack
+    int         node = 0;
+    bvh_node_t *n;
+    double      inv[3];
+    double      tl, tr;                     // distance to left/right child
+    int         i;
+
+    *mindist = -1;
+
+    bake_closest(bvh->bake, bvh->nobjs, bvh->nunbounded, base, dir, last_hit,
+                 &closest, mindist);
+
+    if (bvh->nnodes == 0) {
+        return closest;
+    }
+
+    for (i = 0; i < 3; i++) {
+        inv[i] = 1.0 / dir[i];
+    }
+
+    if (bvh_box(&bvh->nodes[0], base, dir, inv, *mindist) < 0) {
+        return closest;
+    }
+
+    while (1) {
+        n = &bvh->nodes[node];
+
+        if (n->count > 0) {
+            bake_closest(bvh->bake, n->index, n->count, base, dir, last_hit,
+                         &closest, mindist);
+        } else {
+            tl = bvh_box(&bvh->nodes[node + 1], base, dir, inv, *mindist);
+            tr = bvh_box(&bvh->nodes[n->index], base, dir, inv, *mindist);
+
+            // go to the nearer child and come back for the other one
+            if (tl >= 0 && tr >= 0) {
+                if (tl <= tr) {
+                    stack[sp++] = n->index;
+                    node = node + 1;
+                } else {
+                    stack[sp++] = node + 1;
+                    node = n->index;
+                }
+                continue;
+            } else if (tl >= 0) {
+                node = node + 1;
+                continue;
+            } else if (tr >= 0) {
+                node = n->index;
+                continue;
+            }
+        }
+
+        // pop the next node that could still hold a closer object
+        do {
+            if (sp == 0) {
+                return closest;
+            }
+            node = stack[--sp];
+        } while (bvh_box(&bvh->nodes[node], base, dir, inv, *mindist) < 0);
+    }
+}
+
+/*
+ * Find which lanes of a packet enter a node's bounding box before their
+ * closest hit so far.
+ *
+ * PARAMETERS:
+ *  n       - node to test
+ *  pk      - packet of rays
+ *  inv     - 1 / dir for each ray
+ *  mask    - lanes to test
+ *  tnear   - set to the smallest entry distance of any lane
+ *
+ * RETURNS:
+ *  mask of the lanes that enter the box
+ */
+static int bvh_box_packet(bvh_node_t *n, packet_t *pk,
+                          double inv[][3], int mask, double *tnear) {
+    int    hits = 0;
+    double t;
+    int    i;
+
+    *tnear = 1e300;
+    for (i = 0; i < pk->n; i++) {
+        if (!(mask & (1 << i))) {
+            continue;
+        }
+        t = bvh_box(n, pk->base, pk->dir[i], inv[i], pk->t[i]);
+        if (t >= 0) {
+            hits |= 1 << i;
+            *tnear = t < *tnear ? t : *tnear;
+        }
+    }
+
+    return hits;
+}
+
+/*
+ * Find the closest object each ray of a packet hits.  The packet walks the
+ * tree together, carrying a mask of the rays still inside each node, so
+ * rays that go different ways drop out of the packet instead of dragging
+ * the others along.
+ *
+ * PARAMETERS:
+ *  bvh     - hierarchy over the scene
+ *  pk      - packet of rays, the closest hits are stored in it
+ */
+void bvh_closest_packet(bvh_t *bvh, packet_t *pk) {
+    int         nstack[2 * BVH_MAX_DEPTH + 4];  // nodes still to visit
+    int         mstack[2 * BVH_MAX_DEPTH + 4];  // and the rays visiting them
+    int         sp = 0;                         // top of stack
+    double      inv[PACKET_SIZE][3];
+    bvh_node_t *n;
+    int         node, mask, lmask, rmask;
+    double      tl, tr;
+    int         i, j;
+
+    mask = (1 << pk->n) - 1;
+    for (i = 0; i < bvh->nunbounded; i++) {
+        packet_test(pk, bvh->unbounded[i], mask);
+    }
+
+    if (bvh->nnodes == 0) {
+        return;
+    }
+
+    for (i = 0; i < pk->n; i++) {
+        for (j = 0; j < 3; j++) {
+            inv[i][j] = 1.0 / pk->dir[i][j];
+        }
+    }
+
+    nstack[sp] = 0;
+    mstack[sp++] = mask;
+    while (sp > 0) {
+        node = nstack[--sp];
+        n = &bvh->nodes[node];
+        mask = bvh_box_packet(n, pk, inv, mstack[sp], &tl);
+        if (mask == 0) {
+            continue;
+        }
+
+        if (n->count > 0) {
+            for (i = n->index; i < n->index + n->count; i++) {
+                packet_test(pk, bvh->objs[i], mask);
+            }
+            continue;
+        }
+
+        // visit the child the packet reaches first
+        lmask = bvh_box_packet(&bvh->nodes[node + 1], pk, inv, mask, &tl);
+        rmask = bvh_box_packet(&bvh->nodes[n->index], pk, inv, mask, &tr);
+        if (tl <= tr) {
+            if (rmask) {
+                nstack[sp] = n->index;
+                mstack[sp++] = rmask;
+            }
+            if (lmask) {
+                nstack[sp] = node + 1;
+                mstack[sp++] = lmask;
+            }
+        } else {
+            if (lmask) {
+                nstack[sp] = node + 1;
+                mstack[sp++] = lmask;
+            }
+            if (rmask) {
+                nstack[sp] = n->index;
+                mstack[sp++] = rmask;
+            }
+        }
+    }
+}
+
+/*
+ * Find any object blocking a ray before a given distance.  Unlike
+ * bvh_closest this stops at the first blocker found, in no particular
+ * order.
+ *
+ * PARAMETERS:
+ *  bvh     - hierarchy over the scene
+ *  base    - origin of ray
+ *  dir     - direction of ray
+ *  dist    - distance the ray travels
+ *  last_hit- object the ray starts on, never counted as a blocker
+ *
+ * RETURNS:
+ *  an object hit between base and dist, or NULL if there is none
+ */
+obj_t *bvh_occluded(bvh_t *bvh, double *base, double *dir, double dist,
+                    obj_t *last_hit) {
+    int         stack[BVH_MAX_DEPTH + 2];   // nodes still to visit
+    int         sp = 0;                     // top of stack
+    bvh_node_t *n;
+    obj_t      *obj;
+    double      inv[3];
+    int         i;
+
+    obj = bake_occluded(bvh->bake, bvh->nobjs, bvh->nunbounded, base, dir,
+                        dist, last_hit);
+    if (obj != NULL) {
+        return obj;
+    }
+
+    if (bvh->nnodes == 0) {
+        return NULL;
+    }
+
+    for (i = 0; i < 3; i++) {
+        inv[i] = 1.0 / dir[i];
+    }
+
+    stack[sp++] = 0;
+    while (sp > 0) {
+        n = &bvh->nodes[stack[--sp]];
+        if (bvh_box(n, base, dir, inv, dist) < 0) {
+            continue;
+        }
+
+        if (n->count == 0) {
+            stack[sp++] = n->index;
+            stack[sp++] = n - bvh->nodes + 1;
+            continue;
+        }
+
+        obj = bake_occluded(bvh->bake, n->index, n->count, base, dir, dist,
+                            last_hit);
+        if (obj != NULL) {
+            return obj;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Print information about a bounding volume hierarchy.
+ *
+ * PARAMETERS:
+ *  out     - file to print to
+ *  bvh     - hierarchy to dump
+ */
+void bvh_dump(FILE *out, bvh_t *bvh) {
+    int leaves = 0;
+    int i;
+
+    for (i = 0; i < bvh->nnodes; i++) {
+        leaves += bvh->nodes[i].count > 0;
+    }
+
+    fprintf(out, "\tBVH:\n");
+    fprintf(out, "\t\tNodes: %d (%d leaves)\n", bvh->nnodes, leaves);
+    fprintf(out, "\t\tObjects: %d bounded, %d unbounded\n", bvh->nobjs,
+                                                           bvh->nunbounded);
+    bake_dump(out, bvh->bake);
+    fprintf(out, "\t\tBuild time: %lf ms\n", bvh->build_time * 1000.0);
+}
+
+/*
+ * Free a bounding volume hierarchy.  The objects belong to the scene and
+ * are left alone.
+ *
+ * PARAMETERS:
+ *  bvh     - hierarchy to free
+ */
+void bvh_free(bvh_t *bvh) {
+    free(bvh->nodes);
+    free(bvh->objs);
+    free(bvh->unbounded);
+    bake_free(bvh->bake);
+    free(bvh);
+}
@@ -0,0 +1,19 @@
+#include <stdio.h>
+#include "common.h"
+#include "packet.h"
+
+#ifndef BVH_H
+#define BVH_H
+
+bvh_t *bvh_build(list_t *);
+
+obj_t *bvh_closest(bvh_t *, double *, double *, obj_t *, double *);
+
+obj_t *bvh_occluded(bvh_t *, double *, double *, double, obj_t *);
+
+void bvh_closest_packet(bvh_t *, packet_t *);
+
+void bvh_dump(FILE *, bvh_t *);
+
+void bvh_free(bvh_t *);
+#endif
@@ -14,6 +14,7 @@
 /* object types */
 #define FIRST_TYPE  10
 #define LIGHT       10
+#define LIMITS      11      /* render limits, not an object */
 #define SPHERE      13
 #define PLANE       14
 #define FPLANE      15
@@ -32,40 +33,92 @@ typedef struct material_type {
     double specular[3];
 } material_t;
 
-typedef struct obj_type {
-    struct obj_type *next;
-    int    objid;
-    int    objtype;
+/* where a ray hit an object, filled in for the closest object only */
+typedef struct hit_type {
+    struct obj_type *obj;   /* object that was hit */
+    double  t;              /* distance along the ray, -1 for a miss */
+    double  hitloc[3];      /* hit point */
+    double  normal[3];      /* unit normal at the hit point */
+    double  planehit[2];    /* x, y of the hit point on a finite plane */
+    double  footprint;      /* width of the surface one pixel covers at the
+                               hit point, in world units */
+    struct projection_type *proj;   /* projection of the image the ray is
+                                       traced for */
+} hit_t;
 
-    /* hits function */
+/* functions of an object, one table shared by every object of a type, or
+ * of a type and procedural shader.  Those called while tracing come first */
+typedef struct obj_ops_type {
+    /* hits function, returns the distance to the hit point or -1 */
     double (*hits) (double *, double *, struct obj_type *);
-    
+
+    /* fills in hit point, normal and plane coordinates for a hit */
+    void   (*hitinfo) (double *, double *, struct obj_type *, hit_t *);
+
+    /* fills in all three reflectivities at a hit at once */
+    void   (*shade) (struct obj_type *, hit_t *, struct material_type *);
+
+    /* reflectivity and light functions */
+    void   (*getamb) (struct obj_type *, hit_t *, double *);
+    void   (*getdif) (struct obj_type *, hit_t *, double *);
+    void   (*getspec) (struct obj_type *, hit_t *, double *);
+
+    /* bounding box function, NULL for unbounded objects */
+    void   (*bounds) (struct obj_type *, double *, double *);
+
     /* dump function */
     void   (*dump) (FILE *, struct obj_type *);
-    
-    /* delete function */
-    void (*obj_free) (struct obj_type *);
 
-    /* reflectivity and light functions */
-    void   (*getamb) (struct obj_type *, double *);
-    void   (*getdif) (struct obj_type *, double *);
-    void   (*getspec) (struct obj_type *, double *);
+    /* lets go of what the object holds outside its list's arena, NULL if
+     * it holds nothing */
+    void   (*release) (struct obj_type *);
+} obj_ops_t;
 
-    /* defines refelctivity and light properties */
-    material_t material;
+typedef struct obj_type {
+    struct obj_type *next;
+    const obj_ops_t *ops;   /* functions of the object's type */
 
-    /* private data area */
+    /* private data area, allocated straight after the object */
     void    *priv;
 
-    double hitloc[3];
-    double normal[3];
+    int    objid;
+    int    objtype;
+
+    /* defines refelctivity and light properties */
+    material_t material;
 } obj_t;
 
 
-/* holds texture data for textured plane */
+/* one level of a texture's mip pyramid.  Texels are stored bottom row
+ * first in square tiles, row by row, each tile in Morton order so texels
+ * close on the texture are close in memory */
+typedef struct texlevel_type {
+    int         size[2];    /* x, y dimensions */
+    double      scale[2];   /* size relative to the bottom level */
+    int         tiles;      /* tiles across a row */
+    unsigned char *texels;  /* rgb texels */
+} texlevel_t;
+
+#define TEXTURE_LEVELS  32  /* most levels in a mip pyramid */
+
+/* holds texture data for textured plane, shared by every texplane using
+ * the same file */
 typedef struct texture_type {
     int         size[2];    /* x, y dimensions */
-    unsigned char *texbuf;  /* pixmap buffer */
+    unsigned char *texbuf;  /* pixmap buffer, NULL once mipmapped or if
+                               the texture is virtual */
+    int         levels;     /* levels in the mip pyramid, 0 for none */
+    texlevel_t  level[TEXTURE_LEVELS];
+    unsigned char *mipbuf;  /* texels of every level */
+    void       *map;        /* mapping of the file texbuf points into, or
+                               NULL if texbuf was read into memory */
+    size_t      mapsize;
+    int         fd;         /* file a virtual texture's pages are read
+                               from, -1 if its pixels are in memory */
+    long        offset;     /* start of the pixels in the file */
+    char       *path;       /* canonical path of the file */
+    int         refs;       /* texplanes using the texture */
+    struct texture_type *next;  /* next loaded texture */
 } texture_t;
 
 /* textured plane type */
@@ -97,7 +150,6 @@ typedef struct fplane_type {
     double xdir[3];     // x axis direction
     double size[2];     // width x height
     double rotmat[3][3];// rotation matrix
-    double lasthit[2];  // used for textures
     void  *priv;        // hold derived classes
 } fplane_t;
 
@@ -118,18 +170,168 @@ typedef struct projection_type {
     int     win_size_pixel[2];
     double  win_size_world[2];
     double  view_point[3];
+
+    /* limits on the reflections traced, from the scene's limits record */
+    int     max_depth;      /* reflections a path may have */
+    double  max_dist;       /* distance a path may travel */
+    double  min_weight;     /* paths whose contribution falls below this
+                               end, 0 to never end them early */
+    int     roulette;       /* end such paths at random instead, keeping
+                               the image unbiased */
 } proj_t;
 
 
+/* render settings from the command line */
+typedef struct options_type {
+    int     threads;        /* number of render threads, 1 -> serial */
+    int     tile_size;      /* edge length of a render tile in pixels */
+    int     packets;        /* trace primary rays in packets */
+    int     stream;         /* write rows out as soon as they are done */
+    int     mipmap;         /* filter textures through mip pyramids */
+    int     wavefront;      /* trace tiles a stage at a time */
+    double  texture_budget; /* megabytes of virtual texture pages, 0 to
+                               read textures whole */
+    char   *bench;          /* write a benchmark report here */
+    char   *stats;          /* write a statistics report here */
+    char   *heatmap;        /* write the work spent on each pixel here */
+    int     heat_metric;    /* what the heatmap measures */
+    char   *compile;        /* write a compiled scene here and exit */
+    int     farm;           /* worker processes to fork */
+    char   *farm_listen;    /* address workers connect to, NULL for a
+                               private socket */
+    char   *worker;         /* render bands for the coordinator here */
+    double  farm_timeout;   /* seconds before a band is handed out again */
+    char   *daemon;         /* serve render requests on this socket */
+    int     jobs;           /* images the daemon renders at once */
+    char   *animate;        /* render frames along this camera path */
+    int     frames;         /* frames along the path, 0 for a keyframe
+                               each */
+    char   *frame_name;     /* printf pattern of the frame files */
+    char   *incremental;    /* trace again only pixels the scene's edits
+                               can change, dependencies kept here */
+    char   *relight;        /* relight the hits kept here if only the
+                               lights changed */
+} options_t;
+
+
 typedef struct list_type {
     obj_t   *head;
     obj_t   *tail;
+    struct arena_type *arena;   /* memory of the objects read into the list */
 } list_t;
 
+/* node of a bounding volume hierarchy */
+typedef struct bvh_node_type {
+    double  min[3];         /* bounding box */
+    double  max[3];
+    int     index;          /* leaf: first object, inner: right child */
+    int     count;          /* leaf: number of objects, inner: 0 */
+} bvh_node_t;
+
+/* runs of a baked scene, one per shape */
+#define BAKE_SPHERES    0
+#define BAKE_PLANES     1
+#define BAKE_FPLANES    2
+#define BAKE_OTHERS     3       /* tested through their hits function */
+#define BAKE_RUNS       4
+
+#define BAKE_WIDTH      4       /* entries tested together */
+
+struct bake_type;
+
+/* objects of one shape baked into flat arrays */
+typedef struct bake_run_type {
+    int     count;
+    obj_t **objs;           /* object each entry was baked from */
+    int    *before;         /* entries baked from the objects before each
+                               object, so a range of objects covers a run
+                               of entries */
+    /* finds the hit distance, or -1, of a ray against up to BAKE_WIDTH
+     * entries */
+    void  (*hits)(struct bake_type *, int, int, double *, double *, double *);
+} bake_run_t;
+
+/* scene geometry baked into one array per value, so one ray can be tested
+ * against several objects of the same shape at a time */
+typedef struct bake_type {
+    bake_run_t  runs[BAKE_RUNS];
+    double     *scx, *scy, *scz;    /* sphere centers */
+    double     *sr2;                /* sphere radius squared */
+    double     *pnx, *pny, *pnz;    /* plane normals */
+    double     *pnq;                /* plane normal dot point */
+    double     *fnx, *fny, *fnz;    /* fplane normals */
+    double     *fnq;                /* fplane normal dot point */
+    double     *fpx, *fpy, *fpz;    /* fplane points */
+    double     *fux, *fuy, *fuz;    /* fplane x directions */
+    double     *fvx, *fvy, *fvz;    /* fplane y directions */
+    double     *fw, *fh;            /* fplane sizes */
+    char       *isa;                /* instruction set of the kernels */
+} bake_t;
+
+/* bounding volume hierarchy over the scene, left children follow their
+ * parent in the node array */
+typedef struct bvh_type {
+    bvh_node_t *nodes;
+    int         nnodes;
+    obj_t     **objs;       /* bounded objects in leaf order */
+    int         nobjs;
+    obj_t     **unbounded;  /* objects without bounds, tested by every ray */
+    int         nunbounded;
+    double      build_time; /* seconds taken to build */
+    bake_t     *bake;       /* objs then unbounded, baked */
+} bvh_t;
+
+/* kinds of rays traced */
+#define RAY_PRIMARY     0       /* from the view point through a pixel */
+#define RAY_SHADOW      1       /* from a hit point towards a light */
+#define RAY_SPECULAR    2       /* reflected off a specular object */
+#define RAY_KINDS       3
+
+/* one hit along a path of reflections, kept until the path ends so the
+ * contributions can be summed from the far end back */
+typedef struct trace_frame_type {
+    double  local[3];       /* light reflected straight off the hit */
+    double  spec[3];        /* specular reflectivity at the hit */
+    double  scale;          /* weight of the rest of the path, above 1 if
+                               it survived russian roulette */
+} trace_frame_t;
+
+/* state kept by one render thread across all the rays it traces */
+typedef struct trace_ctx_type {
+    obj_t **occluders;      /* last object found shadowing each light */
+    int     nlights;
+    trace_frame_t *stack;   /* hits of the path being traced, max_depth of
+                               them */
+    unsigned long long rng; /* random state for russian roulette, seeded
+                               from each pixel */
+    struct wave_type *wave; /* queues of the wavefront engine, NULL until
+                               it is first used */
+    long    rays[RAY_KINDS];/* rays traced by this thread, by kind */
+    struct stats_type *stats;   /* statistics, NULL without RENDER_STATS */
+    struct deps_rec_type *deps; /* what the rays of the pixel touch, NULL
+                                   unless recording */
+    struct relight_rec_type *relight;   /* hits of the pixels traced, NULL
+                                           unless keeping them */
+} trace_ctx_t;
+
+/* what loading and rendering a scene cost */
+typedef struct bench_type {
+    double  start;          /* when the run started */
+    double  parse_time;     /* seconds reading the scene */
+    double  build_time;     /* seconds building the bvh */
+    double  render_time;    /* seconds rendering and writing the image */
+    double  output_time;    /* seconds of render_time spent writing */
+    long    rays[RAY_KINDS];/* rays traced by every thread, by kind */
+} bench_t;
+
 typedef struct model_type {
     proj_t  *proj;
     list_t  *lights;
     list_t  *scene;
+    options_t *opts;
+    bvh_t   *bvh;
+    bench_t *bench;
+    struct stats_type *stats;   /* statistics, NULL without RENDER_STATS */
 }   model_t;
 
 #endif
@@ -0,0 +1,932 @@
+/*
+ * daemon.c
+ *
+ * Keeps scenes loaded and renders them on request, so a scene rendered
+ * many times from different view points and at different sizes is only
+ * parsed, and its bvh built, once.  Clients connect to a Unix socket and
+ * send one request per connection, a line of text:
+ *
+ *     LOAD <bytes>         followed by a text or compiled scene
+ *     RENDER <scene> <width> <height> [view=x,y,z] [world=w,h]
+ *                                     [region=left,top,cols,rows]
+ *     CANCEL <job>
+ *     DROP <scene>
+ *     STATUS
+ *     QUIT
+ *
+ * and are answered with a line starting OK or ERR.  A scene is named by
+ * the hash of its bytes, so loading it again finds it loaded.  A render
+ * is queued and answered with its job number, then the image is written
+ * as a ppm once it is rendered, a band of rows at a time.  Closing the
+ * connection or cancelling the job stops it before its next band.
+ *
+ * Chris Blades
+ *
+ * 18/10/2026
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include "common.h"
+#include "safe.h"
+#include "model.h"
+#include "scan.h"
+#include "list.h"
+#include "projection.h"
+#include "image.h"
+#include "ray.h"
+#include "bvh.h"
+#include "bench.h"
+#include "stats.h"
+#include "scenebin.h"
+#include "daemon.h"
+
+#define DAEMON_LINE         1024    /* longest request line */
+#define DAEMON_TIMEOUT      30      /* seconds a client may stall for */
+#define DAEMON_POLL_MS      200     /* longest wait between checks */
+#define DAEMON_CHUNK        65536   /* bytes of scene copied at a time */
+#define DAEMON_MAX_SCENE    (1L << 31)  /* most bytes a scene may have */
+
+/* connection being served */
+typedef struct daemon_client_type {
+    daemon_t   *daemon;
+    int         fd;
+} daemon_client_t;
+
+/*
+ * Write exactly len bytes to a client.
+ *
+ * RETURNS:
+ *  0 on success, -1 if the client went away
+ */
+static int daemon_write(int fd, void *buf, size_t len) {
+    ssize_t n;
+
+    while (len > 0) {
+        // a client that went away is an error here, not a signal
+        if ((n = send(fd, buf, len, MSG_NOSIGNAL)) <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf = (char *)buf + n;
+        len -= n;
+    }
+    return 0;
+}
+
+/*
+ * Answer a client with a line of text.
+ *
+ * PARAMETERS:
+ *  fd      - client connection
+ *  fmt     - printf format of the line, without its newline
+ *
+ * RETURNS:
+ *  0 on success, -1 if the client went away
+ */
+static int daemon_reply(int fd, char *fmt, ...) {
+    char    line[DAEMON_LINE];
+    va_list args;
+    int     n;
+
+    va_start(args, fmt);
+    n = vsnprintf(line, sizeof(line) - 1, fmt, args);
+    va_end(args);
+
+    n = n < (int)sizeof(line) - 1 ? n : (int)sizeof(line) - 2;
+    line[n++] = '\n';
+    return daemon_write(fd, line, n);
+}
+
+/*
+ * Read a request line from a client.
+ *
+ * PARAMETERS:
+ *  fd      - client connection
+ *  line    - buffer of DAEMON_LINE bytes for the line, without its newline
+ *
+ * RETURNS:
+ *  0 on success, -1 if the client went away or the line is too long
+ */
+static int daemon_line(int fd, char *line) {
+    ssize_t got;
+    int     n = 0;
+
+    // a byte at a time, so nothing after the line is read
+    while (n < DAEMON_LINE - 1) {
+        got = recv(fd, line + n, 1, 0);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return -1;
+        }
+        if (line[n] == '\n') {
+            line[n] = '\0';
+            return 0;
+        }
+        n++;
+    }
+    return -1;
+}
+
+/*
+ * Hash the bytes of a scene, 64 bit FNV-1a.
+ *
+ * PARAMETERS:
+ *  bytes   - scene
+ *  len     - number of bytes
+ *
+ * RETURNS:
+ *  the hash
+ */
+static uint64_t daemon_hash(unsigned char *bytes, size_t len) {
+    uint64_t hash = 14695981039346656037ULL;
+    size_t   i;
+
+    for (i = 0; i < len; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/*
+ * Compile a scene in a child process, so a scene with errors only ends
+ * the child.  The child runs this program again with --compile rather
+ * than parsing the scene itself, as a child forked from the threads of
+ * the daemon may find a lock held by a thread that is not copied into it.
+ *
+ * PARAMETERS:
+ *  daemon  - daemon loading the scene
+ *  in      - file holding the scene as sent
+ *  out     - file to write the compiled scene to
+ *
+ * RETURNS:
+ *  0 on success
+ */
+static int daemon_compile(daemon_t *daemon, FILE *in, FILE *out) {
+    char    path[32];   // out, named through the descriptor the child keeps
+    char   *args[6];
+    pid_t   pid;
+    int     status;
+
+    // everything the child needs is ready before the fork, so it only
+    // calls what is safe there
+    snprintf(path, sizeof(path), "/dev/fd/%d", fileno(out));
+    args[0] = daemon->argv[0];
+    args[1] = daemon->argv[1];
+    args[2] = daemon->argv[2];
+    args[3] = "--compile";
+    args[4] = path;
+    args[5] = NULL;
+
+    rewind(in);
+    fflush(stdout);
+    fflush(stderr);
+    if ((pid = fork()) < 0) {
+        perror("Error forking to load a scene");
+        return -1;
+    }
+
+    if (pid == 0) {
+        // read just like a scene on stdin
+        if (dup2(fileno(in), STDIN_FILENO) < 0) {
+            _exit(EXIT_FAILURE);
+        }
+        execv("/proc/self/exe", args);
+        execv(daemon->argv[0], args);
+        _exit(EXIT_FAILURE);
+    }
+
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Free a scene no job renders any more.
+ *
+ * PARAMETERS:
+ *  scene   - scene to free
+ */
+static void daemon_free_scene(daemon_scene_t *scene) {
+    bvh_free(scene->model->bvh);
+    list_del(scene->model->lights);
+    list_del(scene->model->scene);
+    scenebin_close(scene->bin);
+    fclose(scene->file);
+    free(scene->model->proj);
+    free(scene->model->bench);
+    free(scene->model);
+    free(scene);
+}
+
+/*
+ * Find a loaded scene.
+ *
+ * PARAMETERS:
+ *  daemon  - daemon holding the scenes, locked
+ *  hash    - hash of the scene
+ *
+ * RETURNS:
+ *  the scene, or NULL if it isn't loaded
+ */
+static daemon_scene_t *daemon_find(daemon_t *daemon, uint64_t hash) {
+    daemon_scene_t *scene;
+
+    for (scene = daemon->scenes; scene != NULL; scene = scene->next) {
+        if (scene->hash == hash && !scene->dropped) {
+            return scene;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Load the scene a client sends, unless it is loaded already.  It is
+ * compiled by a child process, then mapped and its bvh built here.
+ *
+ * PARAMETERS:
+ *  daemon  - daemon to load into
+ *  fd      - client connection, at the start of the scene
+ *  len     - bytes in the scene
+ */
+static void daemon_load(daemon_t *daemon, int fd, size_t len) {
+    daemon_scene_t *scene;
+    unsigned char  *bytes;
+    uint64_t        hash;
+    FILE           *in;
+    FILE           *out;
+    double          start = bench_now();
+    size_t          got = 0;
+    ssize_t         n;
+
+    // the length is the client's word, so a bad one fails only its request
+    if (len > DAEMON_MAX_SCENE ||
+        (bytes = (unsigned char *)malloc(len > 0 ? len : 1)) == NULL) {
+        daemon_reply(fd, "ERR scene too large");
+        return;
+    }
+
+    while (got < len) {
+        n = recv(fd, bytes + got, len - got < DAEMON_CHUNK ?
+                                  len - got : DAEMON_CHUNK, 0);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            free(bytes);
+            return;
+        }
+        got += n;
+    }
+    hash = daemon_hash(bytes, len);
+
+    // loads are one at a time, so a scene sent twice at once loads once
+    pthread_mutex_lock(&daemon->load);
+    pthread_mutex_lock(&daemon->lock);
+    scene = daemon_find(daemon, hash);
+    pthread_mutex_unlock(&daemon->lock);
+    if (scene != NULL) {
+        pthread_mutex_unlock(&daemon->load);
+        free(bytes);
+        daemon_reply(fd, "OK %016llx loaded", (unsigned long long)hash);
+        return;
+    }
+
+    in  = tmpfile();
+    out = tmpfile();
+    if (in == NULL || out == NULL || fwrite(bytes, 1, len, in) != len ||
+        fflush(in) != 0 || daemon_compile(daemon, in, out) != 0) {
+        pthread_mutex_unlock(&daemon->load);
+        if (in != NULL) {
+            fclose(in);
+        }
+        if (out != NULL) {
+            fclose(out);
+        }
+        free(bytes);
+        daemon_reply(fd, "ERR scene could not be loaded");
+        return;
+    }
+    fclose(in);
+    free(bytes);
+    rewind(out);
+
+    scene = (daemon_scene_t *)smalloc(sizeof(daemon_scene_t));
+    scene->hash    = hash;
+    scene->file    = out;
+    scene->refs    = 0;
+    scene->dropped = 0;
+    scene->model   = (model_t *)smalloc(sizeof(model_t));
+    scene->model->opts   = daemon->opts;
+    scene->model->bench  = bench_init();
+    scene->model->stats  = NULL;
+    scene->model->lights = list_init();
+    scene->model->scene  = list_init();
+
+    // written by this build, so it is read without complaint
+    scene->bin = scenebin_open(out, "scene");
+    scene->model->proj = projection_copy(scenebin_proj(scene->bin));
+    scenebin_load(scene->bin, scene->model);
+    scene->model->bvh = bvh_build(scene->model->scene);
+
+    pthread_mutex_lock(&daemon->lock);
+    scene->next = daemon->scenes;
+    daemon->scenes = scene;
+    pthread_mutex_unlock(&daemon->lock);
+    pthread_mutex_unlock(&daemon->load);
+
+    fprintf(stderr, "daemon: scene %016llx loaded in %.3lf s\n",
+            (unsigned long long)hash, bench_now() - start);
+    daemon_reply(fd, "OK %016llx", (unsigned long long)hash);
+}
+
+/*
+ * Queue a render request.  The job takes over the connection, which it
+ * writes the image to.
+ *
+ * PARAMETERS:
+ *  daemon  - daemon to queue the job with
+ *  fd      - client connection
+ *  args    - rest of the request line
+ *
+ * RETURNS:
+ *  1 if the job was queued, 0 if the request was answered with an error
+ */
+static int daemon_queue(daemon_t *daemon, int fd, char *args) {
+    daemon_job_t *job = (daemon_job_t *)smalloc(sizeof(daemon_job_t));
+    unsigned long long hash;
+    proj_t       *proj = &job->proj;
+    char         *save;
+    char         *word;
+    int          *region = job->region;
+
+    if ((word = strtok_r(args, " ", &save)) == NULL ||
+        sscanf(word, "%llx", &hash) != 1) {
+        free(job);
+        return daemon_reply(fd, "ERR no scene given"), 0;
+    }
+
+    pthread_mutex_lock(&daemon->lock);
+    if ((job->scene = daemon_find(daemon, hash)) != NULL) {
+        job->scene->refs++;
+        job->proj = *job->scene->model->proj;
+    }
+    pthread_mutex_unlock(&daemon->lock);
+    if (job->scene == NULL) {
+        free(job);
+        return daemon_reply(fd, "ERR scene %016llx not loaded", hash), 0;
+    }
+
+    proj->win_size_pixel[0] = 0;
+    proj->win_size_pixel[1] = 0;
+    if ((word = strtok_r(NULL, " ", &save)) != NULL) {
+        proj->win_size_pixel[0] = atoi(word);
+    }
+    if ((word = strtok_r(NULL, " ", &save)) != NULL) {
+        proj->win_size_pixel[1] = atoi(word);
+    }
+    region[0] = -1;
+
+    // optional changes to the stored projection
+    while ((word = strtok_r(NULL, " ", &save)) != NULL) {
+        if (sscanf(word, "view=%lf,%lf,%lf", &proj->view_point[0],
+                   &proj->view_point[1], &proj->view_point[2]) == 3 ||
+            sscanf(word, "world=%lf,%lf", &proj->win_size_world[0],
+                   &proj->win_size_world[1]) == 2 ||
+            sscanf(word, "region=%d,%d,%d,%d", &region[0], &region[1],
+                   &region[2], &region[3]) == 4) {
+            continue;
+        }
+        region[0] = -2;
+        break;
+    }
+    if (region[0] == -1) {
+        region[0] = 0;
+        region[1] = 0;
+        region[2] = proj->win_size_pixel[0];
+        region[3] = proj->win_size_pixel[1];
+    }
+
+    // pixels are mapped to the world over size - 1 steps
+    if (proj->win_size_pixel[0] < 2 || proj->win_size_pixel[1] < 2 ||
+        region[0] < 0 || region[1] < 0 || region[2] < 1 || region[3] < 1 ||
+        region[0] + region[2] > proj->win_size_pixel[0] ||
+        region[1] + region[3] > proj->win_size_pixel[1]) {
+        pthread_mutex_lock(&daemon->lock);
+        job->scene->refs--;
+        pthread_mutex_unlock(&daemon->lock);
+        free(job);
+        return daemon_reply(fd, "ERR bad size, view or region"), 0;
+    }
+
+    job->fd     = fd;
+    job->cancel = 0;
+    job->next   = NULL;
+
+    pthread_mutex_lock(&daemon->lock);
+    job->id = daemon->next_id++;
+    pthread_mutex_unlock(&daemon->lock);
+
+    // answered before the image so the job can be cancelled meanwhile,
+    // and before it is queued so no worker writes to the client first
+    if (daemon_reply(fd, "OK %d", job->id) != 0) {
+        pthread_mutex_lock(&daemon->lock);
+        job->scene->refs--;
+        pthread_mutex_unlock(&daemon->lock);
+        free(job);
+        return 0;
+    }
+
+    pthread_mutex_lock(&daemon->lock);
+    if (daemon->tail != NULL) {
+        daemon->tail->next = job;
+    } else {
+        daemon->queue = job;
+    }
+    daemon->tail = job;
+    pthread_cond_signal(&daemon->ready);
+    pthread_mutex_unlock(&daemon->lock);
+    return 1;
+}
+
+/*
+ * Let go of a job's scene, freeing it if it was dropped and this was the
+ * last job rendering it.
+ *
+ * PARAMETERS:
+ *  daemon  - daemon holding the scene, locked
+ *  scene   - scene of a finished job
+ */
+static void daemon_release(daemon_t *daemon, daemon_scene_t *scene) {
+    daemon_scene_t **prev;
+
+    if (--scene->refs > 0 || !scene->dropped) {
+        return;
+    }
+    for (prev = &daemon->scenes; *prev != scene; prev = &(*prev)->next) {
+    }
+    *prev = scene->next;
+    daemon_free_scene(scene);
+}
+
+/*
+ * Cancel a job, taking it off the queue if it hasn't started.
+ *
+ * PARAMETERS:
+ *  daemon  - daemon running the job, locked
+ *  id      - job to cancel
+ *
+ * RETURNS:
+ *  0 on success, -1 if there is no such job
+ */
+static int daemon_cancel(daemon_t *daemon, int id) {
+    daemon_job_t *before = NULL;    // job queued before the one looked at
+    daemon_job_t *job;
+
+    for (job = daemon->running; job != NULL; job = job->next) {
+        if (job->id == id) {
+            job->cancel = 1;
+            return 0;
+        }
+    }
+
+    for (job = daemon->queue; job != NULL; before = job, job = job->next) {
+        if (job->id == id) {
+            if (before != NULL) {
+                before->next = job->next;
+            } else {
+                daemon->queue = job->next;
+            }
+            if (daemon->tail == job) {
+                daemon->tail = before;
+            }
+            close(job->fd);
+            daemon_release(daemon, job->scene);
+            free(job);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Drop a scene, freeing it once no job renders it.
+ *
+ * PARAMETERS:
+ *  daemon  - daemon holding the scene, locked
+ *  hash    - hash of the scene
+ *
+ * RETURNS:
+ *  0 on success, -1 if the scene isn't loaded
+ */
+static int daemon_drop(daemon_t *daemon, uint64_t hash) {
+    daemon_scene_t *scene = daemon_find(daemon, hash);
+
+    if (scene == NULL) {
+        return -1;
+    }
+    scene->dropped = 1;
+    scene->refs++;
+    daemon_release(daemon, scene);
+    return 0;
+}
+
+/*
+ * Describe what is loaded, queued and rendering, a line each, for the
+ * client to be sent once the daemon is unlocked.
+ *
+ * PARAMETERS:
+ *  daemon  - daemon to describe, locked
+ *  len     - set to the length of the description
+ *
+ * RETURNS:
+ *  the description, to be freed by the caller
+ */
+static char *daemon_status(daemon_t *daemon, size_t *len) {
+    daemon_scene_t *scene;
+    daemon_job_t   *job;
+    char           *buf;
+    size_t          lines = 1;
+    size_t          n;
+
+    for (scene = daemon->scenes; scene != NULL; scene = scene->next) {
+        lines++;
+    }
+    for (job = daemon->running; job != NULL; job = job->next) {
+        lines++;
+    }
+    for (job = daemon->queue; job != NULL; job = job->next) {
+        lines++;
+    }
+
+    // no line comes near DAEMON_LINE bytes
+    buf = (char *)smalloc(lines * DAEMON_LINE);
+    n = sprintf(buf, "OK\n");
+    for (scene = daemon->scenes; scene != NULL; scene = scene->next) {
+        n += sprintf(buf + n, "scene %016llx jobs %d%s\n",
+                     (unsigned long long)scene->hash, scene->refs,
+                     scene->dropped ? " dropped" : "");
+    }
+    for (job = daemon->running; job != NULL; job = job->next) {
+        n += sprintf(buf + n, "job %d running %016llx %dx%d\n", job->id,
+                     (unsigned long long)job->scene->hash, job->region[2],
+                     job->region[3]);
+    }
+    for (job = daemon->queue; job != NULL; job = job->next) {
+        n += sprintf(buf + n, "job %d queued %016llx %dx%d\n", job->id,
+                     (unsigned long long)job->scene->hash, job->region[2],
+                     job->region[3]);
+    }
+    *len = n;
+    return buf;
+}
+
+/*
+ * Thread entry point, serves one request of one client.
+ *
+ * PARAMETERS:
+ *  arg     - daemon_client_t for the connection
+ */
+static void *daemon_client(void *arg) {
+    daemon_client_t *client = (daemon_client_t *)arg;
+    daemon_t        *daemon = client->daemon;
+    int              fd = client->fd;
+    char             line[DAEMON_LINE];
+    char            *args;
+    unsigned long long hash;
+    long             len;
+    char            *status;
+    size_t           size;
+    int              kept = 0;      // the connection went to a job
+    int              rc;
+
+    free(client);
+
+    if (daemon_line(fd, line) == 0) {
+        args = strchr(line, ' ');
+        args = args != NULL ? args + 1 : line + strlen(line);
+
+        if (strncmp(line, "LOAD ", 5) == 0 && (len = atol(args)) > 0) {
+            daemon_load(daemon, fd, len);
+        } else if (strncmp(line, "RENDER ", 7) == 0) {
+            kept = daemon_queue(daemon, fd, args);
+        } else if (strncmp(line, "CANCEL ", 7) == 0) {
+            pthread_mutex_lock(&daemon->lock);
+            rc = daemon_cancel(daemon, atoi(args));
+            pthread_mutex_unlock(&daemon->lock);
+            daemon_reply(fd, rc < 0 ? "ERR no such job" : "OK");
+        } else if (strncmp(line, "DROP ", 5) == 0 &&
+                   sscanf(args, "%llx", &hash) == 1) {
+            pthread_mutex_lock(&daemon->lock);
+            rc = daemon_drop(daemon, hash);
+            pthread_mutex_unlock(&daemon->lock);
+            daemon_reply(fd, rc < 0 ? "ERR scene not loaded" : "OK");
+        } else if (strcmp(line, "STATUS") == 0) {
+            pthread_mutex_lock(&daemon->lock);
+            status = daemon_status(daemon, &size);
+            pthread_mutex_unlock(&daemon->lock);
+            daemon_write(fd, status, size);
+            free(status);
+        } else if (strcmp(line, "QUIT") == 0) {
+            pthread_mutex_lock(&daemon->lock);
+            daemon->quit = 1;
+            pthread_cond_broadcast(&daemon->ready);
+            pthread_mutex_unlock(&daemon->lock);
+            daemon_reply(fd, "OK");
+        } else {
+            daemon_reply(fd, "ERR unknown request");
+        }
+    }
+
+    if (!kept) {
+        close(fd);
+    }
+
+    pthread_mutex_lock(&daemon->lock);
+    daemon->clients--;
+    pthread_cond_signal(&daemon->idle);
+    pthread_mutex_unlock(&daemon->lock);
+    return NULL;
+}
+
+/*
+ * Render a job's image and write it to its client a band of rows at a
+ * time.  The job's model shares the scene's objects and bvh, only the
+ * projection is its own.
+ *
+ * PARAMETERS:
+ *  daemon  - daemon running the job
+ *  job     - job to render
+ */
+static void daemon_render(daemon_t *daemon, daemon_job_t *job) {
+    model_t        model = *job->scene->model;
+    trace_ctx_t   *ctx = NULL;
+    unsigned char *pixmap;
+    char           header[64];
+    int            left = job->region[0];
+    int            cols = job->region[2];
+    int            bottom = job->region[1] + job->region[3];
+    int            ts = daemon->opts->tile_size;
+    int            top;
+    int            rows;
+    int            cancel = 0;
+    long           rays = 0;
+    int            i;
+
+    model.proj  = &job->proj;
+    model.bench = bench_init();
+    model.stats = NULL;
+    if (daemon->opts->threads == 1) {
+        ctx = trace_ctx_init(&model);
+        stats_bind(ctx->stats);
+    }
+
+    pixmap = (unsigned char *)smalloc((size_t)cols * ts * 3);
+    snprintf(header, sizeof(header), "P6 %d %d 255\n", cols, job->region[3]);
+    cancel = daemon_write(job->fd, header, strlen(header)) != 0;
+
+    for (top = job->region[1]; top < bottom && !cancel; top += rows) {
+        rows = bottom - top < ts ? bottom - top : ts;
+        make_band(&model, ctx, left, top, cols, rows, pixmap);
+
+        pthread_mutex_lock(&daemon->lock);
+        cancel = job->cancel;
+        pthread_mutex_unlock(&daemon->lock);
+
+        // a client that went away cancels its job
+        cancel = cancel || daemon_write(job->fd, pixmap,
+                                        (size_t)cols * rows * 3) != 0;
+    }
+
+    if (ctx != NULL) {
+        for (i = 0; i < RAY_KINDS; i++) {
+            model.bench->rays[i] += ctx->rays[i];
+        }
+        trace_ctx_free(ctx);
+    }
+    for (i = 0; i < RAY_KINDS; i++) {
+        rays += model.bench->rays[i];
+    }
+
+    fprintf(stderr, "daemon: job %d %s, %dx%d of %016llx in %.3lf s, "
+                    "%ld rays\n", job->id, cancel ? "cancelled" : "done",
+            cols, job->region[3], (unsigned long long)job->scene->hash,
+            bench_now() - model.bench->start, rays);
+
+    free(pixmap);
+    free(model.bench);
+}
+
+/*
+ * Thread entry point, renders queued jobs until the daemon quits.
+ *
+ * PARAMETERS:
+ *  arg     - daemon_t of the daemon
+ */
+static void *daemon_runner(void *arg) {
+    daemon_t      *daemon = (daemon_t *)arg;
+    daemon_job_t **prev;
+    daemon_job_t  *job;
+
+    pthread_mutex_lock(&daemon->lock);
+    while (1) {
+        while (!daemon->quit && daemon->queue == NULL) {
+            pthread_cond_wait(&daemon->ready, &daemon->lock);
+        }
+        if (daemon->quit) {
+            break;
+        }
+
+        job = daemon->queue;
+        daemon->queue = job->next;
+        if (daemon->queue == NULL) {
+            daemon->tail = NULL;
+        }
+        job->next = daemon->running;
+        daemon->running = job;
+        pthread_mutex_unlock(&daemon->lock);
+
+        daemon_render(daemon, job);
+        close(job->fd);
+
+        pthread_mutex_lock(&daemon->lock);
+        for (prev = &daemon->running; *prev != job; prev = &(*prev)->next) {
+        }
+        *prev = job->next;
+        daemon_release(daemon, job->scene);
+        free(job);
+    }
+    pthread_mutex_unlock(&daemon->lock);
+    return NULL;
+}
+
+/*
+ * Open the socket clients connect to.
+ *
+ * PARAMETERS:
+ *  path    - path of the Unix socket
+ *
+ * RETURNS:
+ *  the socket, or -1 on error
+ */
+static int daemon_listen(char *path) {
+    struct sockaddr_un sun;
+    int                fd;
+
+    if (strlen(path) >= sizeof(sun.sun_path)) {
+        fprintf(stderr, "Daemon socket path too long: %s\n", path);
+        return -1;
+    }
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    strcpy(sun.sun_path, path);
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+        return -1;
+    }
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&sun, sizeof(sun)) != 0 ||
+        listen(fd, SOMAXCONN) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Serve render requests on a Unix socket until a client asks the daemon
+ * to quit.  opts->jobs images are rendered at once, each with
+ * opts->threads render threads.
+ *
+ * PARAMETERS:
+ *  argc    - number of command line arguments
+ *  argv    - array of command line arguments
+ *  opts    - render settings of every job
+ *
+ * RETURNS:
+ *  0 on success
+ */
+int daemon_run(int argc, char **argv, options_t *opts) {
+    daemon_t         daemon;
+    daemon_client_t *client;
+    daemon_scene_t  *scene;
+    daemon_job_t    *job;
+    pthread_t       *runners;
+    pthread_t        thread;
+    pthread_attr_t   detached;
+    struct pollfd    pfd;
+    struct timeval   tv;
+    int              fd;
+    int              i;
+
+    if ((daemon.fd = daemon_listen(opts->daemon)) < 0) {
+        fprintf(stderr, "Could not listen on %s\n", opts->daemon);
+        return EXIT_FAILURE;
+    }
+    daemon.opts    = opts;
+    daemon.argc    = argc;
+    daemon.argv    = argv;
+    daemon.scenes  = NULL;
+    daemon.queue   = NULL;
+    daemon.tail    = NULL;
+    daemon.running = NULL;
+    daemon.next_id = 1;
+    daemon.clients = 0;
+    daemon.quit    = 0;
+    pthread_mutex_init(&daemon.lock, NULL);
+    pthread_mutex_init(&daemon.load, NULL);
+    pthread_cond_init(&daemon.ready, NULL);
+    pthread_cond_init(&daemon.idle, NULL);
+
+    runners = (pthread_t *)smalloc(sizeof(pthread_t) * opts->jobs);
+    for (i = 0; i < opts->jobs; i++) {
+        if (pthread_create(&runners[i], NULL, daemon_runner, &daemon) != 0) {
+            fprintf(stderr, "Error creating render thread.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    pthread_attr_init(&detached);
+    pthread_attr_setdetachstate(&detached, PTHREAD_CREATE_DETACHED);
+    fprintf(stderr, "daemon: listening on %s\n", opts->daemon);
+
+    pfd.fd = daemon.fd;
+    pfd.events = POLLIN;
+    while (!daemon.quit) {
+        if (poll(&pfd, 1, DAEMON_POLL_MS) <= 0 ||
+            (fd = accept(daemon.fd, NULL, NULL)) < 0) {
+            continue;
+        }
+
+        // a client stalled in the middle of a request is given up on
+        tv.tv_sec  = DAEMON_TIMEOUT;
+        tv.tv_usec = 0;
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+        client = (daemon_client_t *)smalloc(sizeof(daemon_client_t));
+        client->daemon = &daemon;
+        client->fd     = fd;
+
+        pthread_mutex_lock(&daemon.lock);
+        daemon.clients++;
+        pthread_mutex_unlock(&daemon.lock);
+        if (pthread_create(&thread, &detached, daemon_client, client) != 0) {
+            fprintf(stderr, "Error creating client thread.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    close(daemon.fd);
+    unlink(opts->daemon);
+
+    // jobs being rendered stop at their next band, queued ones never start
+    pthread_mutex_lock(&daemon.lock);
+    for (job = daemon.running; job != NULL; job = job->next) {
+        job->cancel = 1;
+    }
+    while (daemon.clients > 0) {
+        pthread_cond_wait(&daemon.idle, &daemon.lock);
+    }
+    pthread_mutex_unlock(&daemon.lock);
+
+    for (i = 0; i < opts->jobs; i++) {
+        pthread_join(runners[i], NULL);
+    }
+    while ((job = daemon.queue) != NULL) {
+        daemon.queue = job->next;
+        close(job->fd);
+        job->scene->refs--;
+        free(job);
+    }
+    while ((scene = daemon.scenes) != NULL) {
+        daemon.scenes = scene->next;
+        daemon_free_scene(scene);
+    }
+
+    pthread_attr_destroy(&detached);
+    pthread_mutex_destroy(&daemon.lock);
+    pthread_mutex_destroy(&daemon.load);
+    pthread_cond_destroy(&daemon.ready);
+    pthread_cond_destroy(&daemon.idle);
+    free(runners);
+    return 0;
+}
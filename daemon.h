@@ -0,0 +1,56 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "common.h"
+#include "scenebin.h"
+
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#define DEFAULT_DAEMON_JOBS 2   /* images rendered at once */
+
+/* scene kept loaded between renders, found by a hash of the bytes it was
+ * loaded from */
+typedef struct daemon_scene_type {
+    uint64_t    hash;
+    model_t    *model;          /* objects, bvh and stored projection */
+    scenebin_t *bin;            /* compiled scene the objects live in */
+    FILE       *file;           /* file the compiled scene is mapped from */
+    int         refs;           /* jobs rendering it */
+    int         dropped;        /* freed once no job renders it */
+    struct daemon_scene_type *next;
+} daemon_scene_t;
+
+/* request to render an image of a loaded scene */
+typedef struct daemon_job_type {
+    int         id;
+    int         fd;             /* connection the image is written to */
+    daemon_scene_t *scene;
+    proj_t      proj;           /* the scene's projection, changed by the
+                                   request */
+    int         region[4];      /* left, top, columns and rows rendered */
+    int         cancel;         /* stop before the next band */
+    struct daemon_job_type *next;
+} daemon_job_t;
+
+/* daemon state shared by the threads serving clients and rendering */
+typedef struct daemon_type {
+    int             fd;         /* socket clients connect to */
+    options_t      *opts;       /* render settings of every job */
+    int             argc;       /* command line, for the image size */
+    char          **argv;
+    pthread_mutex_t lock;       /* guards everything below */
+    pthread_cond_t  ready;      /* a job was queued or the daemon quit */
+    pthread_cond_t  idle;       /* a client was served */
+    pthread_mutex_t load;       /* one scene is loaded at a time */
+    daemon_scene_t *scenes;
+    daemon_job_t   *queue;      /* jobs waiting, oldest first */
+    daemon_job_t   *tail;
+    daemon_job_t   *running;    /* jobs being rendered */
+    int             next_id;    /* id of the next job */
+    int             clients;    /* connections being served */
+    int             quit;
+} daemon_t;
+
+int daemon_run(int, char **, options_t *);
+#endif
@@ -0,0 +1,866 @@
+/*
+ * deps.c
+ *
+ * Renders an edited scene again by tracing only the pixels the edit can
+ * change.  Every pixel's rays are recorded as they are traced: the
+ * objects they hit or found blocking a light, the hit points along the
+ * path, and the direction the path left the scene in, if it did.  The
+ * image, the recording and what each object held are kept in a
+ * dependency file.
+ *
+ * When the scene is rendered again with the same file, its objects are
+ * matched to the stored ones by what they hold.  A pixel is
+ * traced again if one of its rays touched an object that changed or went
+ * away, or if one of its rays, or its shadow rays to the lights, crosses
+ * the bounds of an object that changed or is new.  The other pixels keep
+ * their color.  A new or changed object without bounds, a change to the
+ * lights, or a different projection means tracing every pixel.
+ *
+ * Chris Blades
+ *
+ * 18/10/2026
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "common.h"
+#include "safe.h"
+#include "image.h"
+#include "ray.h"
+#include "bench.h"
+#include "stats.h"
+#include "scenebin.h"
+#include "deps.h"
+
+#define DEPS_PAD        1e-3    /* bounds are widened by this much, relative
+                                   to their size, to cover points stored as
+                                   floats */
+#define DEPS_HEAD       3       /* words before a pixel record's ids */
+
+/* dependency file read into memory */
+typedef struct deps_file_type {
+    deps_header_t   header;
+    deps_obj_t     *objs;
+    unsigned char  *pixels;     /* image, top row first */
+    uint32_t       *pool;       /* pixel records */
+    uint64_t       *offsets;    /* record of each pixel in pool */
+} deps_file_t;
+
+/* pixel records of one image row, built while rendering */
+typedef struct deps_row_type {
+    uint32_t   *words;
+    size_t      len;
+    size_t      cap;
+} deps_row_t;
+
+/* state shared by the render threads */
+typedef struct deps_job_type {
+    model_t        *model;
+    deps_file_t    *old;        /* last render, NULL to trace every pixel */
+    char           *gone;       /* by old id, objects changed since then */
+    uint32_t       *remap;      /* by old id, id of the same object now */
+    int             maxid;      /* highest old id */
+    int             removed;    /* old objects not in the scene now */
+    deps_obj_t    **boxes;      /* changed objects with bounds */
+    int             nboxes;
+    double        (*lights)[3]; /* centers of the lights */
+    int             nlights;
+    unsigned char  *pixels;     /* image being rendered, top row first */
+    deps_row_t     *rows;
+    int             next;       /* next row to render */
+    long            traced;     /* pixels traced */
+    pthread_mutex_t lock;
+} deps_job_t;
+
+/* one render thread */
+typedef struct deps_worker_type {
+    pthread_t       thread;
+    deps_job_t     *job;
+    trace_ctx_t    *ctx;
+    deps_rec_t      rec;        /* what the pixel being traced touched */
+} deps_worker_t;
+
+/*
+ * Grow an array to hold at least n items.
+ *
+ * PARAMETERS:
+ *  array   - array to grow
+ *  cap     - items it holds, updated
+ *  n       - items it must hold
+ *  size    - bytes in an item
+ *
+ * RETURNS:
+ *  the array, moved if it grew
+ */
+static void *deps_grow(void *array, int *cap, int n, size_t size) {
+    if (n <= *cap) {
+        return array;
+    }
+    *cap = *cap * 2 > n ? *cap * 2 : n + 8;
+    if ((array = realloc(array, size * *cap)) == NULL) {
+        fprintf(stderr, "Error allocating memory.\n");
+        exit(EXIT_FAILURE);
+    }
+    return array;
+}
+
+/*
+ * Add an object to those the pixel's rays touched.
+ *
+ * PARAMETERS:
+ *  rec     - recording of the pixel
+ *  id      - id of the object
+ */
+static void deps_id(deps_rec_t *rec, int id) {
+    int i;
+
+    for (i = 0; i < rec->nids; i++) {
+        if (rec->ids[i] == (uint32_t)id) {
+            return;
+        }
+    }
+    rec->ids = (uint32_t *)deps_grow(rec->ids, &rec->idcap, rec->nids + 1,
+                                     sizeof(uint32_t));
+    rec->ids[rec->nids++] = id;
+}
+
+/**
+ * Record a hit along the path of the pixel being traced.
+ *
+ * PARAMETERS:
+ *  rec     - recording of the pixel
+ *  hit     - hit, the object and hit point filled in
+ */
+void deps_hit(deps_rec_t *rec, hit_t *hit) {
+    deps_id(rec, hit->obj->objid);
+
+    rec->points = (float *)deps_grow(rec->points, &rec->pcap,
+                                     (rec->npoints + 1) * 3, sizeof(float));
+    rec->points[rec->npoints * 3 + 0] = hit->hitloc[0];
+    rec->points[rec->npoints * 3 + 1] = hit->hitloc[1];
+    rec->points[rec->npoints * 3 + 2] = hit->hitloc[2];
+    rec->npoints++;
+}
+
+/**
+ * Record an object found between a hit point and a light.
+ *
+ * PARAMETERS:
+ *  rec     - recording of the pixel
+ *  obj     - object blocking the light
+ */
+void deps_occluder(deps_rec_t *rec, obj_t *obj) {
+    deps_id(rec, obj->objid);
+}
+
+/**
+ * Record the path of the pixel leaving the scene.
+ *
+ * PARAMETERS:
+ *  rec     - recording of the pixel
+ *  dir     - direction of the ray that hit nothing
+ */
+void deps_escape(deps_rec_t *rec, double *dir) {
+    rec->escapes = 1;
+    rec->escape[0] = dir[0];
+    rec->escape[1] = dir[1];
+    rec->escape[2] = dir[2];
+}
+
+/*
+ * Find the words in a pixel record.
+ *
+ * PARAMETERS:
+ *  rec     - start of the record
+ *
+ * RETURNS:
+ *  the number of words
+ */
+static size_t deps_words(uint32_t *rec) {
+    return DEPS_HEAD + (size_t)rec[0] + 3 * (size_t)rec[1] +
+           3 * (size_t)rec[2];
+}
+
+/*
+ * Add a pixel record to those of its row.
+ *
+ * PARAMETERS:
+ *  row     - records of the row
+ *  words   - record to add, or NULL to add that of rec
+ *  rec     - recording of a pixel just traced
+ *
+ * RETURNS:
+ *  the record as added
+ */
+static uint32_t *deps_append(deps_row_t *row, uint32_t *words,
+                             deps_rec_t *rec) {
+    size_t    n;
+    uint32_t *to;
+
+    n = words != NULL ? deps_words(words) :
+        (size_t)(DEPS_HEAD + rec->nids + 3 * rec->npoints + 3 * rec->escapes);
+    if (row->len + n > row->cap) {
+        row->cap = row->cap * 2 > row->len + n ? row->cap * 2 :
+                                                row->len + n + 256;
+        row->words = (uint32_t *)realloc(row->words,
+                                         sizeof(uint32_t) * row->cap);
+        if (row->words == NULL) {
+            fprintf(stderr, "Error allocating memory.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    to = row->words + row->len;
+    row->len += n;
+
+    if (words != NULL) {
+        memcpy(to, words, sizeof(uint32_t) * n);
+        return to;
+    }
+
+    to[0] = rec->nids;
+    to[1] = rec->npoints;
+    to[2] = rec->escapes;
+    memcpy(to + DEPS_HEAD, rec->ids, sizeof(uint32_t) * rec->nids);
+    to += DEPS_HEAD + rec->nids;
+    memcpy(to, rec->points, sizeof(float) * 3 * rec->npoints);
+    if (rec->escapes) {
+        memcpy(to + 3 * rec->npoints, rec->escape, sizeof(float) * 3);
+    }
+    return row->words + row->len - n;
+}
+
+/*
+ * Test whether a ray segment crosses the bounds of an object.
+ *
+ * PARAMETERS:
+ *  base    - start of the segment
+ *  dir     - segment from base to its end, or direction of a ray that
+ *            goes on forever
+ *  tmax    - 1 for a segment, HUGE_VAL for a ray
+ *  obj     - object, its bounds widened
+ *
+ * RETURNS:
+ *  1 if it crosses them
+ */
+static int deps_crosses(double *base, double *dir, double tmax,
+                        deps_obj_t *obj) {
+    double t0 = 0.0;
+    double t1 = tmax;
+    double near;
+    double far;
+    double swap;
+    int    i;
+
+    for (i = 0; i < 3; i++) {
+        if (dir[i] == 0.0) {
+            if (base[i] < obj->min[i] || base[i] > obj->max[i]) {
+                return 0;
+            }
+            continue;
+        }
+        near = (obj->min[i] - base[i]) / dir[i];
+        far  = (obj->max[i] - base[i]) / dir[i];
+        if (near > far) {
+            swap = near;
+            near = far;
+            far = swap;
+        }
+        t0 = near > t0 ? near : t0;
+        t1 = far < t1 ? far : t1;
+        if (t0 > t1) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Test whether a segment crosses the bounds of any changed object.
+ *
+ * PARAMETERS:
+ *  job     - render holding the changed objects
+ *  from    - start of the segment
+ *  to      - its end, or the direction it goes on in forever
+ *  tmax    - 1 for a segment, HUGE_VAL for a ray
+ *
+ * RETURNS:
+ *  1 if it does
+ */
+static int deps_segment(deps_job_t *job, double *from, double *to,
+                        double tmax) {
+    double dir[3];
+    int    i;
+
+    for (i = 0; i < 3; i++) {
+        dir[i] = tmax == 1.0 ? to[i] - from[i] : to[i];
+    }
+    for (i = 0; i < job->nboxes; i++) {
+        if (deps_crosses(from, dir, tmax, job->boxes[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Decide whether a pixel has to be traced again.
+ *
+ * PARAMETERS:
+ *  job     - render holding the changed objects
+ *  rec     - record of the pixel from the last render
+ *
+ * RETURNS:
+ *  1 if the edit can change the pixel
+ */
+static int deps_dirty(deps_job_t *job, uint32_t *rec) {
+    uint32_t *ids    = rec + DEPS_HEAD;
+    float    *points = (float *)(ids + rec[0]);
+    double    from[3];          // start of the next segment along the path
+    double    point[3];
+    int       i;
+    int       j;
+    int       k;
+
+    for (i = 0; i < (int)rec[0]; i++) {
+        if ((int)ids[i] > job->maxid || job->gone[ids[i]]) {
+            return 1;
+        }
+    }
+    if (job->nboxes == 0) {
+        return 0;
+    }
+
+    for (k = 0; k < 3; k++) {
+        from[k] = job->model->proj->view_point[k];
+    }
+    for (i = 0; i < (int)rec[1]; i++) {
+        for (k = 0; k < 3; k++) {
+            point[k] = points[i * 3 + k];
+        }
+        if (deps_segment(job, from, point, 1.0)) {
+            return 1;
+        }
+
+        // shadow rays to every light, traced or not
+        for (j = 0; j < job->nlights; j++) {
+            if (deps_segment(job, point, job->lights[j], 1.0)) {
+                return 1;
+            }
+        }
+        for (k = 0; k < 3; k++) {
+            from[k] = point[k];
+        }
+    }
+
+    if (rec[2]) {
+        for (k = 0; k < 3; k++) {
+            point[k] = points[rec[1] * 3 + k];
+        }
+        return deps_segment(job, from, point, HUGE_VAL);
+    }
+    return 0;
+}
+
+/*
+ * Thread entry point, renders rows until there are none left.
+ *
+ * PARAMETERS:
+ *  arg     - deps_worker_t for this thread
+ */
+static void *deps_worker(void *arg) {
+    deps_worker_t *worker = (deps_worker_t *)arg;
+    deps_job_t    *job = worker->job;
+    deps_rec_t    *rec = &worker->rec;
+    model_t       *model = job->model;
+    int            width  = model->proj->win_size_pixel[0];
+    int            height = model->proj->win_size_pixel[1];
+    uint32_t      *old;         // record of the pixel from the last render
+    long           traced = 0;
+    size_t         i;
+    int            r;
+    int            x;
+    int            k;
+
+    stats_bind(worker->ctx->stats);
+    while (1) {
+        pthread_mutex_lock(&job->lock);
+        r = job->next++;
+        pthread_mutex_unlock(&job->lock);
+        if (r >= height) {
+            break;
+        }
+
+        for (x = 0; x < width; x++) {
+            i = (size_t)r * width + x;
+            old = job->old != NULL ? job->old->pool + job->old->offsets[i] :
+                                     NULL;
+            if (old != NULL && !deps_dirty(job, old)) {
+                memcpy(job->pixels + i * 3, job->old->pixels + i * 3, 3);
+                // the objects it touched may be numbered differently now
+                old = deps_append(&job->rows[r], old, NULL);
+                for (k = 0; k < (int)old[0]; k++) {
+                    old[DEPS_HEAD + k] = job->remap[old[DEPS_HEAD + k]];
+                }
+                continue;
+            }
+
+            rec->nids = 0;
+            rec->npoints = 0;
+            rec->escapes = 0;
+            worker->ctx->deps = rec;
+            // y counts up from the bottom
+            make_pixel(model, worker->ctx, x, height - r - 1,
+                       job->pixels + i * 3);
+            worker->ctx->deps = NULL;
+            deps_append(&job->rows[r], NULL, rec);
+            traced++;
+        }
+    }
+
+    pthread_mutex_lock(&job->lock);
+    job->traced += traced;
+    pthread_mutex_unlock(&job->lock);
+    return NULL;
+}
+
+/*
+ * Fill in the header a dependency file of this render would have.
+ *
+ * PARAMETERS:
+ *  model   - model being rendered
+ *  header  - header to fill in
+ */
+static void deps_header(model_t *model, deps_header_t *header) {
+    proj_t *proj = model->proj;
+    obj_t  *light;
+    int     i = 0;                  // place of the light in the list
+
+    memset(header, 0, sizeof(deps_header_t));
+    memcpy(header->magic, DEPS_MAGIC, sizeof(DEPS_MAGIC));
+    header->version    = DEPS_VERSION;
+    header->size[0]    = proj->win_size_pixel[0];
+    header->size[1]    = proj->win_size_pixel[1];
+    header->mipmap     = model->opts->mipmap;
+    header->world[0]   = proj->win_size_world[0];
+    header->world[1]   = proj->win_size_world[1];
+    header->view[0]    = proj->view_point[0];
+    header->view[1]    = proj->view_point[1];
+    header->view[2]    = proj->view_point[2];
+    header->max_depth  = proj->max_depth;
+    header->roulette   = proj->roulette;
+    header->max_dist   = proj->max_dist;
+    header->min_weight = proj->min_weight;
+
+    // lights share ids with objects, so an object added before them
+    // renumbers them without changing them
+    for (light = model->lights->head; light != NULL; light = light->next) {
+        header->lights = (header->lights ^ scenebin_hash(light)) *
+                         1099511628211ULL + i++;
+    }
+}
+
+/*
+ * Free a dependency file read into memory.
+ */
+static void deps_free(deps_file_t *file) {
+    free(file->objs);
+    free(file->pixels);
+    free(file->pool);
+    free(file->offsets);
+    free(file);
+}
+
+/*
+ * Read the dependency file of the last render, if it was of the same
+ * image of the same lights.
+ *
+ * PARAMETERS:
+ *  path    - dependency file
+ *  model   - model being rendered
+ *
+ * RETURNS:
+ *  the file, or NULL if every pixel has to be traced
+ */
+static deps_file_t *deps_read(char *path, model_t *model) {
+    deps_header_t expect;
+    deps_file_t  *file;
+    FILE         *in;
+    size_t        npixels;
+    uint64_t      off = 0;
+    size_t        i;
+
+    if ((in = fopen(path, "rb")) == NULL) {
+        fprintf(stderr, "No dependency file %s, tracing every pixel\n",
+                path);
+        return NULL;
+    }
+
+    deps_header(model, &expect);
+    file = (deps_file_t *)smalloc(sizeof(deps_file_t));
+    memset(file, 0, sizeof(deps_file_t));
+
+    if (fread(&file->header, sizeof(deps_header_t), 1, in) != 1 ||
+        memcmp(file->header.magic, DEPS_MAGIC, sizeof(DEPS_MAGIC)) != 0 ||
+        file->header.version != DEPS_VERSION) {
+        fprintf(stderr, "%s isn't a dependency file, tracing every pixel\n",
+                path);
+        fclose(in);
+        deps_free(file);
+        return NULL;
+    }
+
+    // the objects and records follow, the rest must match
+    expect.nobjs = file->header.nobjs;
+    expect.npool = file->header.npool;
+    if (memcmp(&expect, &file->header, sizeof(deps_header_t)) != 0) {
+        fprintf(stderr, "Projection, limits or lights changed since %s, "
+                        "tracing every pixel\n", path);
+        fclose(in);
+        deps_free(file);
+        return NULL;
+    }
+
+    npixels = (size_t)expect.size[0] * expect.size[1];
+    file->objs    = (deps_obj_t *)smalloc(sizeof(deps_obj_t) *
+                                          (expect.nobjs + 1));
+    file->pixels  = (unsigned char *)smalloc(npixels * 3);
+    file->pool    = (uint32_t *)smalloc(sizeof(uint32_t) *
+                                        (expect.npool + 1));
+    file->offsets = (uint64_t *)smalloc(sizeof(uint64_t) * npixels);
+
+    if (fread(file->objs, sizeof(deps_obj_t), expect.nobjs, in) !=
+                                                        expect.nobjs ||
+        fread(file->pixels, 3, npixels, in) != npixels ||
+        fread(file->pool, sizeof(uint32_t), expect.npool, in) !=
+                                                        expect.npool) {
+        fprintf(stderr, "%s is cut short, tracing every pixel\n", path);
+        fclose(in);
+        deps_free(file);
+        return NULL;
+    }
+    fclose(in);
+
+    // records hold their own lengths, so they are found by walking them
+    for (i = 0; i < npixels; i++) {
+        if (off + DEPS_HEAD > expect.npool ||
+            off + deps_words(file->pool + off) > expect.npool) {
+            fprintf(stderr, "%s is corrupt, tracing every pixel\n", path);
+            deps_free(file);
+            return NULL;
+        }
+        file->offsets[i] = off;
+        off += deps_words(file->pool + off);
+    }
+    return file;
+}
+
+/*
+ * Write the dependency file of a render, replacing the last one once it
+ * is complete.
+ *
+ * PARAMETERS:
+ *  path    - dependency file
+ *  job     - render that is done
+ *  objs    - objects of the scene
+ *  nobjs   - number of objects
+ *
+ * RETURNS:
+ *  0 on success
+ */
+static int deps_write(char *path, deps_job_t *job, deps_obj_t *objs,
+                      int nobjs) {
+    model_t      *model = job->model;
+    int           height = model->proj->win_size_pixel[1];
+    size_t        npixels = (size_t)model->proj->win_size_pixel[0] * height;
+    deps_header_t header;
+    char          tmp[FILENAME_MAX];
+    FILE         *out;
+    int           ok;
+    int           r;
+
+    deps_header(model, &header);
+    header.nobjs = nobjs;
+    for (r = 0; r < height; r++) {
+        header.npool += job->rows[r].len;
+    }
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    if ((out = fopenAndCheck(tmp, "wb")) == NULL) {
+        return EXIT_FAILURE;
+    }
+
+    ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+         fwrite(objs, sizeof(deps_obj_t), nobjs, out) == (size_t)nobjs &&
+         fwrite(job->pixels, 3, npixels, out) == npixels;
+    for (r = 0; r < height && ok; r++) {
+        ok = fwrite(job->rows[r].words, sizeof(uint32_t), job->rows[r].len,
+                    out) == job->rows[r].len;
+    }
+    if (fclose(out) != 0 || !ok || rename(tmp, path) != 0) {
+        fprintf(stderr, "Error writing dependency file: %s\n", path);
+        remove(tmp);
+        return EXIT_FAILURE;
+    }
+    return 0;
+}
+
+/*
+ * Describe the objects of the scene being rendered.
+ *
+ * PARAMETERS:
+ *  model   - model being rendered
+ *  nobjs   - where to store the number of objects
+ *
+ * RETURNS:
+ *  an object record for each
+ */
+static deps_obj_t *deps_objects(model_t *model, int *nobjs) {
+    deps_obj_t *objs;
+    obj_t      *obj;
+    int         n = 0;
+
+    for (obj = model->scene->head; obj != NULL; obj = obj->next) {
+        n++;
+    }
+    objs = (deps_obj_t *)smalloc(sizeof(deps_obj_t) * (n + 1));
+    memset(objs, 0, sizeof(deps_obj_t) * (n + 1));
+
+    n = 0;
+    for (obj = model->scene->head; obj != NULL; obj = obj->next, n++) {
+        objs[n].objid   = obj->objid;
+        objs[n].objtype = obj->objtype;
+        objs[n].hash    = scenebin_hash(obj);
+        objs[n].bounded = obj->ops->bounds != NULL;
+        if (objs[n].bounded) {
+            obj->ops->bounds(obj, objs[n].min, objs[n].max);
+        }
+    }
+    *nobjs = n;
+    return objs;
+}
+
+/*
+ * Order object records by what they hold, then by id.
+ */
+static int deps_cmp(const void *a, const void *b) {
+    const deps_obj_t *x = (const deps_obj_t *)a;
+    const deps_obj_t *y = (const deps_obj_t *)b;
+
+    if (x->hash != y->hash) {
+        return x->hash < y->hash ? -1 : 1;
+    }
+    if (x->objtype != y->objtype) {
+        return x->objtype < y->objtype ? -1 : 1;
+    }
+    return x->objid < y->objid ? -1 : x->objid > y->objid;
+}
+
+/*
+ * Match the objects of the last render with those of this one by what
+ * they hold, so objects renumbered by an edit earlier in the scene still
+ * match.  Objects left over are the ones that changed: those of the last
+ * render mark the pixels that touched them, and the bounds of those of
+ * this one are what the pixels' rays are checked against.  An object
+ * moved is one of each.
+ *
+ * PARAMETERS:
+ *  job     - render to fill in the changed objects of
+ *  objs    - objects of the scene, sorted
+ *  nobjs   - number of objects
+ *
+ * RETURNS:
+ *  the number of objects of this render that changed or are new, or -1 if
+ *  one without bounds did so every pixel has to be traced
+ */
+static int deps_diff(deps_job_t *job, deps_obj_t *objs, int nobjs) {
+    deps_file_t *old = job->old;
+    int          nold = (int)old->header.nobjs;
+    int          changed = 0;
+    int          unbounded = 0;
+    double       pad;
+    int          i;
+    int          j;
+    int          k;
+
+    job->maxid = 0;
+    for (i = 0; i < nold; i++) {
+        if (old->objs[i].objid < 0) {
+            old->objs[i].objid = 0;
+        }
+        job->maxid = old->objs[i].objid > job->maxid ? old->objs[i].objid :
+                                                       job->maxid;
+    }
+
+    // old ids not in the file are taken to be gone
+    job->gone  = (char *)smalloc(job->maxid + 1);
+    job->remap = (uint32_t *)smalloc(sizeof(uint32_t) * (job->maxid + 1));
+    for (i = 0; i <= job->maxid; i++) {
+        job->gone[i] = 1;
+    }
+
+    qsort(old->objs, nold, sizeof(deps_obj_t), deps_cmp);
+    qsort(objs, nobjs, sizeof(deps_obj_t), deps_cmp);
+
+    job->boxes = (deps_obj_t **)smalloc(sizeof(deps_obj_t *) * (nobjs + 1));
+    job->nboxes = 0;
+    for (i = 0, j = 0; i < nobjs; i++) {
+        // skip old objects ordered before this one, they are gone
+        while (j < nold && old->objs[j].hash < objs[i].hash) {
+            j++;
+        }
+        while (j < nold && old->objs[j].hash == objs[i].hash &&
+               old->objs[j].objtype < objs[i].objtype) {
+            j++;
+        }
+        if (j < nold && old->objs[j].hash == objs[i].hash &&
+            old->objs[j].objtype == objs[i].objtype) {
+            job->gone[old->objs[j].objid] = 0;
+            job->remap[old->objs[j].objid] = objs[i].objid;
+            j++;
+            continue;
+        }
+
+        // pixels whose rays cross where the object is now
+        objs[i].changed = 1;
+        changed++;
+        if (!objs[i].bounded) {
+            unbounded = 1;
+            continue;
+        }
+        for (k = 0; k < 3; k++) {
+            pad = DEPS_PAD * (1.0 + fabs(objs[i].min[k]) +
+                              fabs(objs[i].max[k]));
+            objs[i].min[k] -= pad;
+            objs[i].max[k] += pad;
+        }
+        job->boxes[job->nboxes++] = &objs[i];
+    }
+
+    for (i = 0; i < nold; i++) {
+        job->removed += job->gone[old->objs[i].objid];
+    }
+    return unbounded ? -1 : changed;
+}
+
+/**
+ * Render a model, tracing only the pixels its edits since the last render
+ * with the same dependency file can change, and write the image to stdout
+ * as make_image would.  The dependency file is then replaced by one for
+ * this render.  Pixels are traced one at a time, without packets or the
+ * wavefront engine, so their rays can be recorded.
+ *
+ * PARAMETERS:
+ *  model   - model to render
+ *
+ * RETURNS:
+ *  0 on success
+ */
+int deps_render(model_t *model) {
+    options_t     *opts   = model->opts;
+    int            width  = model->proj->win_size_pixel[0];
+    int            height = model->proj->win_size_pixel[1];
+    deps_job_t     job;
+    deps_worker_t *workers;
+    deps_obj_t    *objs;
+    obj_t         *light;
+    int            nobjs;
+    int            changed;         // objects changed, -1 for every pixel
+    double         start;
+    int            rc;
+    int            i;
+    int            k;
+
+    // pixels are traced one at a time so their rays can be recorded
+    if (opts->heatmap != NULL || opts->stream || opts->packets ||
+        opts->wavefront) {
+        fprintf(stderr, "No heatmap, streaming, packets or wavefront engine "
+                        "for an incremental render\n");
+    }
+
+    memset(&job, 0, sizeof(job));
+    job.model  = model;
+    job.pixels = (unsigned char *)smalloc((size_t)width * height * 3);
+    job.rows   = (deps_row_t *)smalloc(sizeof(deps_row_t) * height);
+    memset(job.rows, 0, sizeof(deps_row_t) * height);
+    pthread_mutex_init(&job.lock, NULL);
+
+    for (light = model->lights->head; light != NULL; light = light->next) {
+        job.nlights++;
+    }
+    job.lights = (double (*)[3])smalloc(sizeof(double) * 3 *
+                                        (job.nlights + 1));
+    for (light = model->lights->head, i = 0; light != NULL;
+                                      light = light->next, i++) {
+        memcpy(job.lights[i], ((light_t *)light->priv)->center,
+               sizeof(double) * 3);
+    }
+
+    objs = deps_objects(model, &nobjs);
+    changed = nobjs;
+    if ((job.old = deps_read(opts->incremental, model)) != NULL &&
+        (changed = deps_diff(&job, objs, nobjs)) < 0) {
+        fprintf(stderr, "An object without bounds changed, tracing every "
+                        "pixel\n");
+        deps_free(job.old);
+        job.old = NULL;
+    }
+
+    workers = (deps_worker_t *)smalloc(sizeof(deps_worker_t) * opts->threads);
+    memset(workers, 0, sizeof(deps_worker_t) * opts->threads);
+    for (i = 0; i < opts->threads; i++) {
+        workers[i].job = &job;
+        workers[i].ctx = trace_ctx_init(model);
+        if (pthread_create(&workers[i].thread, NULL, deps_worker,
+                           &workers[i]) != 0) {
+            fprintf(stderr, "Error creating render thread.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (i = 0; i < opts->threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        for (k = 0; k < RAY_KINDS; k++) {
+            model->bench->rays[k] += workers[i].ctx->rays[k];
+        }
+        if (model->stats != NULL && workers[i].ctx->stats != NULL) {
+            stats_merge(model->stats, workers[i].ctx->stats);
+        }
+        trace_ctx_free(workers[i].ctx);
+        free(workers[i].rec.ids);
+        free(workers[i].rec.points);
+    }
+    free(workers);
+
+    start = bench_now();
+    printf("P6 %d %d 255\n", width, height);
+    fwrite(job.pixels, sizeof(unsigned char), (size_t)width * height * 3,
+           stdout);
+    fflush(stdout);
+    model->bench->output_time += bench_now() - start;
+
+    fprintf(stderr, "%d of %d objects new or changed, %d gone, %ld of %ld "
+                    "pixels traced (%.1lf%%)\n",
+            job.old != NULL ? changed : nobjs, nobjs, job.removed,
+            job.traced, (long)width * height,
+            100.0 * job.traced / ((double)width * height));
+
+    rc = deps_write(opts->incremental, &job, objs, nobjs);
+
+    if (job.old != NULL) {
+        deps_free(job.old);
+    }
+    for (i = 0; i < height; i++) {
+        free(job.rows[i].words);
+    }
+    pthread_mutex_destroy(&job.lock);
+    free(job.rows);
+    free(job.pixels);
+    free(job.lights);
+    free(job.gone);
+    free(job.remap);
+    free(job.boxes);
+    free(objs);
+    return rc;
+}
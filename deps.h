@@ -0,0 +1,61 @@
+#include <stdint.h>
+#include "common.h"
+
+#ifndef DEPS_H
+#define DEPS_H
+
+#define DEPS_MAGIC      "RTDEPS"    /* first bytes of a dependency file */
+#define DEPS_VERSION    1
+
+/* what the rays of the pixel being rendered touched */
+typedef struct deps_rec_type {
+    uint32_t   *ids;            /* objects hit or found blocking a light */
+    int         nids;
+    int         idcap;
+    float      *points;         /* hit points along the path, x y z each */
+    int         npoints;
+    int         pcap;
+    int         escapes;        /* the path left the scene */
+    float       escape[3];      /* direction it left in */
+} deps_rec_t;
+
+/* start of a dependency file.  It is followed by an object record for
+ * each scene object, the image, and a record for each pixel: its number
+ * of ids, of points and whether it escapes, then the ids, points and
+ * direction */
+typedef struct deps_header_type {
+    char        magic[8];
+    uint32_t    version;
+    uint32_t    size[2];        /* image width and height */
+    uint32_t    mipmap;         /* textures were filtered */
+    double      world[2];       /* projection the image was rendered with */
+    double      view[3];
+    int32_t     max_depth;
+    int32_t     roulette;
+    double      max_dist;
+    double      min_weight;
+    uint64_t    lights;         /* hash of every light */
+    uint64_t    nobjs;          /* object records */
+    uint64_t    npool;          /* 32 bit words of pixel records */
+} deps_header_t;
+
+/* scene object as it was when the image was rendered */
+typedef struct deps_obj_type {
+    int32_t     objid;
+    int32_t     objtype;
+    uint64_t    hash;           /* of what the object holds */
+    int32_t     bounded;        /* min and max hold its bounds */
+    int32_t     changed;        /* nothing in the last render held the
+                                   same */
+    double      min[3];
+    double      max[3];
+} deps_obj_t;
+
+void deps_hit(deps_rec_t *, hit_t *);
+
+void deps_occluder(deps_rec_t *, obj_t *);
+
+void deps_escape(deps_rec_t *, double *);
+
+int deps_render(model_t *);
+#endif
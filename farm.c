@@ -0,0 +1,815 @@
+/*
+ * farm.c
+ *
+ * Renders an image with several worker processes.  The coordinator parses
+ * the scene once, compiles it and sends it to every worker that connects,
+ * over a Unix or TCP socket.  It then hands out bands of whole rows, one
+ * at a time to each worker, and writes the image out in order as the
+ * bands come back.  A worker that goes away has its band handed to
+ * another one, and a band that takes far longer than the others is handed
+ * to an idle worker as well, the first copy back being kept.
+ *
+ * Workers are forked by the coordinator or started on their own with the
+ * coordinator's address.  They map the scene they are sent like any
+ * compiled scene and render each band with make_band.
+ *
+ * Chris Blades
+ *
+ * 18/10/2026
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "common.h"
+#include "safe.h"
+#include "image.h"
+#include "ray.h"
+#include "bvh.h"
+#include "list.h"
+#include "projection.h"
+#include "scenebin.h"
+#include "bench.h"
+#include "stats.h"
+#include "farm.h"
+
+#define FARM_MAX_WORKERS    256     /* workers connected at once */
+#define FARM_COPIES         2       /* workers rendering one band at most */
+#define FARM_SLOW           4.0     /* bands taking this many times the
+                                       mean are handed out again */
+#define FARM_IO_TIMEOUT     30      /* seconds a message may stall for */
+#define FARM_POLL_MS        100     /* longest wait between checks */
+#define FARM_RETRIES        50      /* tries to reach the coordinator */
+#define FARM_CHUNK          65536   /* bytes of scene copied at a time */
+
+/*
+ * Find the path of a Unix socket address, "unix:path" or anything with a
+ * slash in it.
+ *
+ * PARAMETERS:
+ *  addr    - address to look at
+ *
+ * RETURNS:
+ *  the path, or NULL if the address is host:port
+ */
+static char *farm_unix_path(char *addr) {
+    if (strncmp(addr, "unix:", 5) == 0) {
+        return addr + 5;
+    }
+    return strchr(addr, '/') != NULL ? addr : NULL;
+}
+
+/*
+ * Open a socket listening on, or connected to, an address.
+ *
+ * PARAMETERS:
+ *  addr    - "unix:path", a path, or "host:port" with an empty host
+ *            standing for every interface or the local host
+ *  server  - 1 to listen, 0 to connect
+ *
+ * RETURNS:
+ *  the socket, or -1 on error
+ */
+static int farm_open(char *addr, int server) {
+    struct sockaddr_un sun;
+    struct addrinfo    hints;
+    struct addrinfo   *found;
+    struct addrinfo   *ai;
+    char   host[256];
+    char  *path = farm_unix_path(addr);
+    char  *port;
+    int    fd = -1;
+    int    one = 1;
+
+    if (path != NULL) {
+        if (strlen(path) >= sizeof(sun.sun_path)) {
+            fprintf(stderr, "Farm socket path too long: %s\n", path);
+            return -1;
+        }
+        memset(&sun, 0, sizeof(sun));
+        sun.sun_family = AF_UNIX;
+        strcpy(sun.sun_path, path);
+
+        if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+            return -1;
+        }
+        if (server) {
+            unlink(path);
+            if (bind(fd, (struct sockaddr *)&sun, sizeof(sun)) != 0 ||
+                listen(fd, FARM_MAX_WORKERS) != 0) {
+                close(fd);
+                return -1;
+            }
+        } else if (connect(fd, (struct sockaddr *)&sun, sizeof(sun)) != 0) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    if ((port = strrchr(addr, ':')) == NULL ||
+        (size_t)(port - addr) >= sizeof(host)) {
+        fprintf(stderr, "Farm address must be unix:path or host:port: %s\n",
+                addr);
+        return -1;
+    }
+    memcpy(host, addr, port - addr);
+    host[port - addr] = '\0';
+    port++;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags    = server ? AI_PASSIVE : 0;
+    if (getaddrinfo(host[0] != '\0' ? host : NULL, port, &hints, &found)
+        != 0) {
+        fprintf(stderr, "Farm address not found: %s\n", addr);
+        return -1;
+    }
+
+    for (ai = found; ai != NULL; ai = ai->ai_next) {
+        if ((fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol))
+            < 0) {
+            continue;
+        }
+        if (server) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 &&
+                listen(fd, FARM_MAX_WORKERS) == 0) {
+                break;
+            }
+        } else if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            // bands are small messages answered straight away
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(found);
+    return fd;
+}
+
+/*
+ * Give up on a socket whose peer stalls in the middle of a message.
+ *
+ * PARAMETERS:
+ *  fd      - socket
+ */
+static void farm_timeouts(int fd) {
+    struct timeval tv;
+    int            one = 1;
+
+    tv.tv_sec  = FARM_IO_TIMEOUT;
+    tv.tv_usec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+/*
+ * Read exactly len bytes from a socket.
+ *
+ * RETURNS:
+ *  0 on success, -1 if the peer went away or the read failed
+ */
+static int farm_read(int fd, void *buf, size_t len) {
+    ssize_t n;
+
+    while (len > 0) {
+        if ((n = recv(fd, buf, len, 0)) <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf = (char *)buf + n;
+        len -= n;
+    }
+    return 0;
+}
+
+/*
+ * Read len bytes from a socket and throw them away.
+ *
+ * RETURNS:
+ *  0 on success, -1 if the peer went away or the read failed
+ */
+static int farm_skip(int fd, size_t len) {
+    char   scratch[FARM_CHUNK];
+    size_t n;
+
+    while (len > 0) {
+        n = len < sizeof(scratch) ? len : sizeof(scratch);
+        if (farm_read(fd, scratch, n) != 0) {
+            return -1;
+        }
+        len -= n;
+    }
+    return 0;
+}
+
+/*
+ * Write exactly len bytes to a socket.
+ *
+ * RETURNS:
+ *  0 on success, -1 if the peer went away or the write failed
+ */
+static int farm_write(int fd, void *buf, size_t len) {
+    ssize_t n;
+
+    while (len > 0) {
+        // a dead peer is an error here, not a signal
+        if ((n = send(fd, buf, len, MSG_NOSIGNAL)) <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf = (char *)buf + n;
+        len -= n;
+    }
+    return 0;
+}
+
+/*
+ * Send a message and the bytes that follow it.
+ *
+ * PARAMETERS:
+ *  fd      - socket
+ *  type    - FARM_ message type
+ *  msg     - header to fill in and send, its band fields already set, or
+ *            NULL for a message without any
+ *  data    - bytes to follow
+ *  size    - number of bytes
+ *
+ * RETURNS:
+ *  0 on success, -1 if the peer went away
+ */
+static int farm_send(int fd, int type, farm_msg_t *msg, void *data,
+                     size_t size) {
+    farm_msg_t empty;
+
+    if (msg == NULL) {
+        memset(&empty, 0, sizeof(empty));
+        msg = &empty;
+    }
+    msg->type    = type;
+    msg->version = FARM_VERSION;
+    msg->size    = size;
+
+    if (farm_write(fd, msg, sizeof(farm_msg_t)) != 0) {
+        return -1;
+    }
+    return size > 0 ? farm_write(fd, data, size) : 0;
+}
+
+/*
+ * Read the header of the next message.
+ *
+ * RETURNS:
+ *  0 on success, -1 if the peer went away or speaks another version
+ */
+static int farm_recv(int fd, farm_msg_t *msg) {
+    if (farm_read(fd, msg, sizeof(farm_msg_t)) != 0) {
+        return -1;
+    }
+    if (msg->version != FARM_VERSION) {
+        fprintf(stderr, "Farm peer speaks version %u, expected %u\n",
+                msg->version, FARM_VERSION);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Forget a worker, putting its band back to be handed out again.
+ *
+ * PARAMETERS:
+ *  worker  - worker that went away
+ *  bands   - every band
+ */
+static void farm_drop(farm_worker_t *worker, farm_band_t *bands) {
+    if (worker->band >= 0) {
+        bands[worker->band].copies--;
+    }
+    close(worker->fd);
+    worker->fd = -1;
+    worker->band = -1;
+}
+
+/*
+ * Hand a band to every idle worker.  Bands no one has are handed out
+ * first, in order, then bands that are taking too long.
+ *
+ * PARAMETERS:
+ *  workers - connected workers
+ *  n       - number of them
+ *  bands   - every band
+ *  nbands  - number of bands
+ *  slow    - seconds after which a band is taking too long
+ */
+static void farm_assign(farm_worker_t *workers, int n, farm_band_t *bands,
+                        int nbands, double slow) {
+    farm_msg_t msg;
+    double     now = bench_now();
+    int        pick;            // band handed out
+    int        w;
+    int        b;
+
+    for (w = 0; w < n; w++) {
+        if (workers[w].fd < 0 || !workers[w].ready || workers[w].band >= 0) {
+            continue;
+        }
+
+        pick = -1;
+        for (b = 0; b < nbands && pick < 0; b++) {
+            if (!bands[b].done && bands[b].copies == 0) {
+                pick = b;
+            }
+        }
+        for (b = 0; b < nbands && pick < 0; b++) {
+            if (!bands[b].done && bands[b].copies < FARM_COPIES &&
+                now - bands[b].sent > slow) {
+                pick = b;
+            }
+        }
+        if (pick < 0) {
+            return;
+        }
+
+        memset(&msg, 0, sizeof(msg));
+        msg.band = pick;
+        msg.top  = bands[pick].top;
+        msg.rows = bands[pick].rows;
+        if (farm_send(workers[w].fd, FARM_BAND, &msg, NULL, 0) != 0) {
+            farm_drop(&workers[w], bands);
+            continue;
+        }
+#ifdef DEBUG_FARM
+        fprintf(stderr, "farm: band %d to worker %d%s\n", pick, w,
+                bands[pick].copies > 0 ? " again" : "");
+#endif
+        bands[pick].copies++;
+        bands[pick].sent = now;
+        workers[w].band = pick;
+    }
+}
+
+/*
+ * Handle the next message from a worker.
+ *
+ * PARAMETERS:
+ *  model   - model being rendered
+ *  worker  - worker with a message waiting
+ *  bands   - every band
+ *  nbands  - number of bands
+ *  scene   - compiled scene to send
+ *  image   - pixels of the whole image
+ *  times   - seconds and count of bands rendered, updated
+ */
+static void farm_message(model_t *model, farm_worker_t *worker,
+                         farm_band_t *bands, int nbands,
+                         scenebin_out_t *scene, unsigned char *image,
+                         double *times) {
+    int           width = model->proj->win_size_pixel[0];
+    farm_msg_t    msg;
+    farm_band_t  *band;
+    int           i;
+
+    if (farm_recv(worker->fd, &msg) != 0) {
+        farm_drop(worker, bands);
+        return;
+    }
+
+    switch (msg.type) {
+        case FARM_HELLO:
+            if (farm_send(worker->fd, FARM_SCENE, NULL, scene->buf,
+                          scene->len) != 0) {
+                farm_drop(worker, bands);
+                return;
+            }
+            worker->ready = 1;
+            break;
+        case FARM_PIXELS:
+            if (worker->band < 0 || msg.band >= (uint32_t)nbands ||
+                msg.band != (uint32_t)worker->band ||
+                msg.size != (uint64_t)bands[msg.band].rows * width * 3) {
+                fprintf(stderr, "Farm worker sent a band it wasn't given\n");
+                farm_drop(worker, bands);
+                return;
+            }
+            band = &bands[msg.band];
+
+            // the first copy back is kept, later ones are read and dropped
+            if ((band->done ? farm_skip(worker->fd, msg.size) :
+                 farm_read(worker->fd, image + (size_t)band->top * width * 3,
+                           msg.size)) != 0) {
+                farm_drop(worker, bands);
+                return;
+            }
+            if (!band->done) {
+                band->done = 1;
+                for (i = 0; i < RAY_KINDS; i++) {
+                    model->bench->rays[i] += msg.rays[i];
+                }
+                times[0] += bench_now() - band->sent;
+                times[1]++;
+            }
+            band->copies--;
+            worker->band = -1;
+            break;
+        default:
+            fprintf(stderr, "Farm worker sent message %u\n", msg.type);
+            farm_drop(worker, bands);
+            break;
+    }
+}
+
+/*
+ * Reap the forked workers that have exited.
+ *
+ * PARAMETERS:
+ *  pids    - forked workers, 0 for those already reaped
+ *  n       - number of them
+ *
+ * RETURNS:
+ *  number still running
+ */
+static int farm_reap(pid_t *pids, int n) {
+    int running = 0;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (pids[i] > 0 && waitpid(pids[i], NULL, WNOHANG) == pids[i]) {
+            pids[i] = 0;
+        }
+        running += pids[i] > 0;
+    }
+    return running;
+}
+
+/*
+ * Render the bands no worker is left to render with this process.
+ *
+ * PARAMETERS:
+ *  model   - model being rendered
+ *  bands   - every band
+ *  nbands  - number of bands
+ *  image   - pixels of the whole image
+ */
+static void farm_local(model_t *model, farm_band_t *bands, int nbands,
+                       unsigned char *image) {
+    int          width = model->proj->win_size_pixel[0];
+    trace_ctx_t *ctx = NULL;
+    int          b;
+    int          i;
+
+    fprintf(stderr, "No farm workers left, rendering locally\n");
+    if (model->opts->threads == 1) {
+        ctx = trace_ctx_init(model);
+        stats_bind(ctx->stats);
+    }
+
+    for (b = 0; b < nbands; b++) {
+        if (!bands[b].done) {
+            make_band(model, ctx, 0, bands[b].top, width, bands[b].rows,
+                      image + (size_t)bands[b].top * width * 3);
+            bands[b].done = 1;
+        }
+    }
+
+    if (ctx != NULL) {
+        for (i = 0; i < RAY_KINDS; i++) {
+            model->bench->rays[i] += ctx->rays[i];
+        }
+        trace_ctx_free(ctx);
+    }
+}
+
+/**
+ * Render a model with worker processes and write the image to stdout.
+ * The coordinator listens on the farm address, or on a private Unix
+ * socket, and forks the local workers asked for.  Others may connect at
+ * any time while the image is rendered.  If every worker is gone and none
+ * can join, the rest of the image is rendered locally.
+ *
+ * PARAMETERS:
+ *  model   - model to render
+ *
+ * RETURNS:
+ *  0 on success
+ */
+int farm_render(model_t *model) {
+    options_t     *opts   = model->opts;
+    int            width  = model->proj->win_size_pixel[0];
+    int            height = model->proj->win_size_pixel[1];
+    int            ts     = opts->tile_size;
+    int            nbands = (height + ts - 1) / ts;
+    farm_band_t   *bands;
+    farm_worker_t  workers[FARM_MAX_WORKERS];
+    struct pollfd  fds[FARM_MAX_WORKERS + 1];
+    int            nworkers = 0;
+    pid_t         *pids;            // forked workers
+    int            children = 0;    // those still running
+    scenebin_out_t scene;
+    unsigned char *image;
+    char           addr[128];       // private socket if none is given
+    char          *listen_addr = opts->farm_listen;
+    double         times[2] = { 0.0, 0.0 };    // seconds, bands rendered
+    double         slow;            // seconds a band may take
+    double         start;
+    int            written = 0;     // bands written out
+    int            lfd;
+    int            live;
+    int            fd;
+    int            b;
+    int            w;
+
+    if (opts->heatmap != NULL) {
+        fprintf(stderr, "No heatmap is written by a farm\n");
+    }
+    if (listen_addr == NULL) {
+        snprintf(addr, sizeof(addr), "unix:/tmp/rt-farm.%d", (int)getpid());
+        listen_addr = addr;
+    }
+    if ((lfd = farm_open(listen_addr, 1)) < 0) {
+        fprintf(stderr, "Could not listen on %s\n", listen_addr);
+        return EXIT_FAILURE;
+    }
+
+    scenebin_compile(&scene, model);
+
+    bands = (farm_band_t *)smalloc(sizeof(farm_band_t) * nbands);
+    for (b = 0; b < nbands; b++) {
+        bands[b].top    = b * ts;
+        bands[b].rows   = height - b * ts < ts ? height - b * ts : ts;
+        bands[b].done   = 0;
+        bands[b].copies = 0;
+        bands[b].sent   = 0.0;
+    }
+    image = (unsigned char *)smalloc((size_t)width * height * 3);
+
+    // children mustn't write out what is buffered here a second time
+    fflush(stdout);
+    fflush(stderr);
+    pids = (pid_t *)smalloc(sizeof(pid_t) * (opts->farm + 1));
+    for (w = 0; w < opts->farm; w++) {
+        if ((pids[w] = fork()) == 0) {
+            close(lfd);
+            _exit(farm_worker(listen_addr, opts) == 0 ? EXIT_SUCCESS :
+                                                        EXIT_FAILURE);
+        } else if (pids[w] < 0) {
+            perror("Error forking farm worker");
+            pids[w] = 0;
+        }
+    }
+
+    printf("P6 %d %d 255\n", width, height);
+
+    while (written < nbands) {
+        children = farm_reap(pids, opts->farm);
+
+        live = 0;
+        for (w = 0; w < nworkers; w++) {
+            live += workers[w].fd >= 0;
+        }
+        if (live == 0 && children == 0 && opts->farm_listen == NULL) {
+            farm_local(model, bands, nbands, image);
+        } else {
+            slow = times[1] > 0 ? FARM_SLOW * times[0] / times[1] : 0.0;
+            slow = slow > opts->farm_timeout ? slow : opts->farm_timeout;
+            farm_assign(workers, nworkers, bands, nbands, slow);
+
+            fds[0].fd = lfd;
+            fds[0].events = POLLIN;
+            for (w = 0; w < nworkers; w++) {
+                fds[w + 1].fd = workers[w].fd;
+                fds[w + 1].events = POLLIN;
+                fds[w + 1].revents = 0;
+            }
+
+            if (poll(fds, nworkers + 1, FARM_POLL_MS) > 0) {
+                for (w = 0; w < nworkers; w++) {
+                    if (workers[w].fd >= 0 && fds[w + 1].revents != 0) {
+                        farm_message(model, &workers[w], bands, nbands,
+                                     &scene, image, times);
+                    }
+                }
+
+                if ((fds[0].revents & POLLIN) &&
+                    (fd = accept(lfd, NULL, NULL)) >= 0) {
+                    // slots of workers that are gone are used again
+                    for (w = 0; w < nworkers && workers[w].fd >= 0; w++) {
+                    }
+                    if (w == FARM_MAX_WORKERS) {
+                        close(fd);
+                    } else {
+                        farm_timeouts(fd);
+                        workers[w].fd    = fd;
+                        workers[w].band  = -1;
+                        workers[w].ready = 0;
+                        nworkers = w == nworkers ? nworkers + 1 : nworkers;
+                    }
+                }
+            }
+        }
+
+        // bands are written out in order as soon as they are all there
+        start = bench_now();
+        while (written < nbands && bands[written].done) {
+            fwrite(image + (size_t)bands[written].top * width * 3, 1,
+                   (size_t)bands[written].rows * width * 3, stdout);
+            written++;
+        }
+        fflush(stdout);
+        model->bench->output_time += bench_now() - start;
+    }
+
+    for (w = 0; w < nworkers; w++) {
+        if (workers[w].fd >= 0) {
+            farm_send(workers[w].fd, FARM_DONE, NULL, NULL, 0);
+            close(workers[w].fd);
+        }
+    }
+
+    // forked workers that don't take their leave, stuck or stopped, are
+    // killed
+    start = bench_now();
+    while (farm_reap(pids, opts->farm) > 0 &&
+           bench_now() - start < opts->farm_timeout) {
+        usleep(FARM_POLL_MS * 100);
+    }
+    for (w = 0; w < opts->farm; w++) {
+        if (pids[w] > 0) {
+            kill(pids[w], SIGKILL);
+            waitpid(pids[w], NULL, 0);
+        }
+    }
+    free(pids);
+
+    close(lfd);
+    if (farm_unix_path(listen_addr) != NULL) {
+        unlink(farm_unix_path(listen_addr));
+    }
+    free(scene.buf);
+    free(scene.relocs);
+    free(bands);
+    free(image);
+    return 0;
+}
+
+/*
+ * Copy the compiled scene following a message into a temporary file so it
+ * can be mapped.
+ *
+ * PARAMETERS:
+ *  fd      - socket
+ *  size    - bytes of scene
+ *
+ * RETURNS:
+ *  the file, read from its start, or NULL on error
+ */
+static FILE *farm_scene(int fd, uint64_t size) {
+    FILE *file = tmpfile();
+    char *buf;
+    size_t n;
+
+    if (file == NULL) {
+        return NULL;
+    }
+
+    buf = (char *)smalloc(FARM_CHUNK);
+    while (size > 0) {
+        n = size < FARM_CHUNK ? size : FARM_CHUNK;
+        if (farm_read(fd, buf, n) != 0 || fwrite(buf, 1, n, file) != n) {
+            free(buf);
+            fclose(file);
+            return NULL;
+        }
+        size -= n;
+    }
+    free(buf);
+
+    if (fflush(file) != 0) {
+        fclose(file);
+        return NULL;
+    }
+    rewind(file);
+    return file;
+}
+
+/**
+ * Render bands for a coordinator until it has no more.
+ *
+ * PARAMETERS:
+ *  addr    - address of the coordinator
+ *  opts    - render settings of this worker
+ *
+ * RETURNS:
+ *  0 on success
+ */
+int farm_worker(char *addr, options_t *opts) {
+    model_t       *model;
+    trace_ctx_t   *ctx = NULL;
+    scenebin_t    *bin;
+    farm_msg_t     msg;
+    FILE          *file;
+    unsigned char *pixmap = NULL;
+    size_t         cap = 0;         // bytes pixmap holds
+    long           sent[RAY_KINDS]; // rays already reported
+    long           rays;
+    int            width;
+    int            fd = -1;
+    int            tries;
+    int            i;
+
+    // a coordinator started at the same time may not be listening yet
+    for (tries = 0; tries < FARM_RETRIES && fd < 0; tries++) {
+        if ((fd = farm_open(addr, 0)) < 0) {
+            usleep(FARM_POLL_MS * 1000);
+        }
+    }
+    if (fd < 0) {
+        fprintf(stderr, "Could not reach farm coordinator at %s\n", addr);
+        return EXIT_FAILURE;
+    }
+    farm_timeouts(fd);
+
+    if (farm_send(fd, FARM_HELLO, NULL, NULL, 0) != 0 ||
+        farm_recv(fd, &msg) != 0 || msg.type != FARM_SCENE ||
+        (file = farm_scene(fd, msg.size)) == NULL) {
+        fprintf(stderr, "Farm coordinator sent no scene\n");
+        close(fd);
+        return EXIT_FAILURE;
+    }
+
+    model = (model_t *)smalloc(sizeof(model_t));
+    model->opts   = opts;
+    model->bench  = bench_init();
+    model->stats  = NULL;
+    model->lights = list_init();
+    model->scene  = list_init();
+
+    if ((bin = scenebin_open(file, "farm scene")) == NULL) {
+        fprintf(stderr, "Farm coordinator sent a bad scene\n");
+        exit(EXIT_FAILURE);
+    }
+    model->proj = projection_copy(scenebin_proj(bin));
+    scenebin_load(bin, model);
+    model->bvh = bvh_build(model->scene);
+    width = model->proj->win_size_pixel[0];
+
+    if (opts->threads == 1) {
+        ctx = trace_ctx_init(model);
+        stats_bind(ctx->stats);
+    }
+    for (i = 0; i < RAY_KINDS; i++) {
+        sent[i] = 0;
+    }
+
+    while (farm_recv(fd, &msg) == 0 && msg.type == FARM_BAND) {
+        if ((size_t)msg.rows * width * 3 > cap) {
+            free(pixmap);
+            cap = (size_t)msg.rows * width * 3;
+            pixmap = (unsigned char *)smalloc(cap);
+        }
+        make_band(model, ctx, 0, msg.top, width, msg.rows, pixmap);
+
+        // rays of the band, whether traced by ctx or by render threads
+        for (i = 0; i < RAY_KINDS; i++) {
+            rays = model->bench->rays[i] + (ctx != NULL ? ctx->rays[i] : 0);
+            msg.rays[i] = rays - sent[i];
+            sent[i] = rays;
+        }
+        if (farm_send(fd, FARM_PIXELS, &msg, pixmap,
+                      (size_t)msg.rows * width * 3) != 0) {
+            break;
+        }
+    }
+    close(fd);
+
+    if (ctx != NULL) {
+        trace_ctx_free(ctx);
+    }
+    free(pixmap);
+    bvh_free(model->bvh);
+    list_del(model->lights);
+    list_del(model->scene);
+    scenebin_close(bin);
+    fclose(file);
+    free(model->proj);
+    free(model->bench);
+    free(model);
+    return 0;
+}
@@ -0,0 +1,51 @@
+#include <stdint.h>
+#include <sys/types.h>
+#include "common.h"
+
+#ifndef FARM_H
+#define FARM_H
+
+#define FARM_VERSION        1
+
+/* messages between the coordinator and its workers */
+#define FARM_HELLO          1   /* worker: ready for a scene */
+#define FARM_SCENE          2   /* coordinator: compiled scene follows */
+#define FARM_BAND           3   /* coordinator: render a band of rows */
+#define FARM_PIXELS         4   /* worker: pixels of a band follow */
+#define FARM_DONE           5   /* coordinator: no more work */
+
+#define DEFAULT_FARM_TIMEOUT 2.0   /* seconds before a band is handed out
+                                      again */
+
+/* header of every message, followed by size bytes */
+typedef struct farm_msg_type {
+    uint32_t    type;
+    uint32_t    version;        /* FARM_VERSION of the sender */
+    uint32_t    band;           /* index of the band rendered */
+    uint32_t    top;            /* its first image row */
+    uint32_t    rows;           /* and its number of rows */
+    uint32_t    spare;
+    uint64_t    size;           /* bytes following the header */
+    int64_t     rays[RAY_KINDS];/* rays the worker traced for the band */
+} farm_msg_t;
+
+/* band of whole rows handed out to workers */
+typedef struct farm_band_type {
+    int     top;                /* first image row */
+    int     rows;
+    int     done;               /* pixels are in the image */
+    int     copies;             /* workers rendering it */
+    double  sent;               /* when it was last handed out */
+} farm_band_t;
+
+/* worker connected to the coordinator */
+typedef struct farm_worker_type {
+    int     fd;                 /* socket, -1 once the worker is gone */
+    int     band;               /* band it is rendering, -1 if idle */
+    int     ready;              /* it has the scene */
+} farm_worker_t;
+
+int farm_render(model_t *);
+
+int farm_worker(char *, options_t *);
+#endif
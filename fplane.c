@@ -16,55 +16,40 @@
 #include "material.h"
 #include "veclib3d.h"
 
+/* functions of every fplane */
+static const obj_ops_t fplane_ops = {
+    hits_fplane, fplane_hitinfo, shade_default,
+    getamb_default, getdif_default, getspec_default,
+    fplane_bounds, fplane_dump, NULL
+};
+
 /**
  * Initialize an ffplane object from a file.
  *
  * PARAMETERS:
- *  in      - file to read from
+ *  scan    - scanner to read from
  *  objtype - type of object to initalize
  *
  *  RETURNS:
  *  the newly created object
  */
-obj_t * fplane_init(FILE *in, int objtype) {
-    obj_t *obj = plane_init(in, objtype);  // base object struct
+obj_t * fplane_init(scan_t *scan, int objtype) {
+    obj_t *obj = plane_init(scan, objtype);  // base object struct
     plane_t *plane = (plane_t *)obj->priv; // base plane struct
 
     fplane_t *fplane = 
-            (fplane_t *)smalloc(sizeof(fplane_t));   // new fplane struct
+            (fplane_t *)object_alloc(sizeof(fplane_t));  // new fplane
     
     fplane->priv = NULL;
 
     plane->priv = fplane;      // connect fplane to obj
-    obj->hits = hits_fplane; // connect hits function
-    obj->dump = fplane_dump;
-    obj->obj_free = fplane_free;
-
-    char    buf[256];       // buffer for reading in values
-    int     rc = 0;         // read counter
-
+    fplane_bind(obj);          // connect fplane functions
 
     // read in x direction
-    while (rc != 3) {
-        rc = fscanf(in, "%lf %lf %lf", fplane->xdir, (fplane->xdir + 1),
-                                        (fplane->xdir + 2));
-        fgets(buf, 256, in);
-#ifdef DEBUG_OBJECTS
-        fprintf(stderr, "fplane read %s\n", buf);
-#endif
-    }
+    scan_doubles(scan, fplane->xdir, 3, "fplane x direction");
 
-    rc = 0;
     // read in size
-    while (rc != 2) {
-        rc = fscanf(in, "%lf %lf", fplane->size,
-                                       (fplane->size + 1));
-
-        fgets(buf, 256, in);
-#ifdef DEBUG_OBJECTS
-        fprintf(stderr, "fplane read %s\n", buf);
-#endif
-    }
+    scan_doubles(scan, fplane->size, 2, "fplane size");
 
 
     // construct rotation matrix
@@ -85,15 +70,14 @@ obj_t * fplane_init(FILE *in, int objtype) {
    return obj;
 }
 
-void fplane_free(obj_t *obj) {
-    plane_t  *p  = (plane_t *)obj->priv;
-    fplane_t *fp = (fplane_t *)p->priv;
-
-    if (fp->priv != NULL) {
-        free(fp->priv);
-    }
-
-    plane_free(obj);
+/*
+ * Connect the function table of an fplane object.
+ *
+ * PARAMETERS:
+ *  obj -   object to bind
+ */
+void fplane_bind(obj_t *obj) {
+    obj->ops = &fplane_ops;
 }
 
 
@@ -145,7 +129,9 @@ double hits_fplane(double *base, double *dir, obj_t *obj) {
         return(t);
     }
     
-    vec_diff3(plane->point, obj->hitloc, newhit);
+    vec_scale3(t, dir, newhit);
+    vec_sum3(base, newhit, newhit);
+    vec_diff3(plane->point, newhit, newhit);
     
     
     xform3(fplane->rotmat, newhit, newhit);
@@ -157,11 +143,59 @@ double hits_fplane(double *base, double *dir, obj_t *obj) {
     if ((newhit[1] > fplane->size[1]) || (newhit[1] < 0.0)) {
         return -1;
     }
-    
-    fplane->lasthit[0] = newhit[0];
-    fplane->lasthit[1] = newhit[1];
-
 
     return t;
     
 }
+
+/*
+ * Fills in the hit point, normal and plane coordinates for a ray that hits
+ * a fplane.
+ *
+ * PARAMETERS:
+ * base -   starting point of ray
+ * dir  -   direction of ray
+ * obj  -   fplane that was hit
+ * hit  -   hit record holding the distance, filled in with the rest
+ */
+void fplane_hitinfo(double *base, double *dir, obj_t *obj, hit_t *hit) {
+    plane_t  *plane  = (plane_t *)obj->priv;       // plane struct
+    fplane_t *fplane = (fplane_t *)plane->priv;    // fplane struct
+    double newhit[3];
+
+    plane_hitinfo(base, dir, obj, hit);
+
+    vec_diff3(plane->point, hit->hitloc, newhit);
+    xform3(fplane->rotmat, newhit, newhit);
+
+    hit->planehit[0] = newhit[0];
+    hit->planehit[1] = newhit[1];
+}
+
+/*
+ * Finds the bounding box of a fplane from its four corners.  The rows of
+ * the rotation matrix are the plane's x and y directions in the world.
+ *
+ * PARAMETERS:
+ *  obj     - fplane object
+ *  min     - lower corner of the box
+ *  max     - upper corner of the box
+ */
+void fplane_bounds(obj_t *obj, double *min, double *max) {
+    plane_t  *plane  = (plane_t *)obj->priv;       // plane struct
+    fplane_t *fplane = (fplane_t *)plane->priv;    // fplane struct
+    double corner;
+    int i, c;
+
+    for (i = 0; i < 3; i++) {
+        min[i] = plane->point[i];
+        max[i] = plane->point[i];
+        for (c = 1; c < 4; c++) {
+            corner = plane->point[i] +
+                     (c & 1) * fplane->size[0] * fplane->rotmat[0][i] +
+                     (c >> 1) * fplane->size[1] * fplane->rotmat[1][i];
+            min[i] = corner < min[i] ? corner : min[i];
+            max[i] = corner > max[i] ? corner : max[i];
+        }
+    }
+}
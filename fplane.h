@@ -4,11 +4,16 @@
 #ifndef FPLANE_H
 #define FPLANE_H
 
-obj_t *fplane_init(FILE *, int);
+obj_t *fplane_init(scan_t *, int);
+
+void fplane_bind(obj_t *);
 
-void fplane_free(obj_t *);
 
 void fplane_dump(FILE *, obj_t *);
 
 double hits_fplane(double *, double *, obj_t *);
+
+void fplane_hitinfo(double *, double *, obj_t *, hit_t *);
+
+void fplane_bounds(obj_t *, double *, double *);
 #endif
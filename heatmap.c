@@ -0,0 +1,251 @@
+/*
+ * heatmap.c
+ *
+ * Measures the work spent on each pixel and writes it as a second image.
+ * The work is read from a running counter before and after each pixel:
+ * the time stamp counter, the rays traced by the thread, or the
+ * intersection tests it made.  The heatmap is written as a false colour
+ * ppm scaled to the costliest pixels, or as a pfm holding the raw costs.
+ *
+ * Chris Blades
+ *
+ * 18/10/2026
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "common.h"
+#include "safe.h"
+#include "stats.h"
+#include "heatmap.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HEAT_TSC
+#endif
+
+#define HEAT_PERCENTILE 0.995   /* cost shown at full heat in a ppm */
+
+/* names of the metrics, indexed by HEAT_ value */
+static char *metric_names[] =
+{
+    "cycles",
+    "rays",
+    "tests"
+};
+#define NUM_METRICS sizeof(metric_names) / sizeof(char *)
+
+/* false colour ramp of a ppm heatmap, from no work to the most */
+static double ramp[][3] =
+{
+    { 0.0, 0.0, 0.0 },
+    { 0.0, 0.0, 1.0 },
+    { 1.0, 0.0, 0.0 },
+    { 1.0, 1.0, 0.0 },
+    { 1.0, 1.0, 1.0 }
+};
+#define RAMP_STEPS (sizeof(ramp) / sizeof(ramp[0]) - 1)
+
+/**
+ * Look up a heatmap metric by name.
+ *
+ * PARAMETERS:
+ *  name    - name of the metric
+ *
+ * RETURNS:
+ *  the HEAT_ value of the metric, -1 if there is none by that name or it
+ *  isn't built in
+ */
+int heat_metric(char *name) {
+    int i;
+
+    for (i = 0; i < (int)NUM_METRICS; i++) {
+        if (strcmp(name, metric_names[i]) == 0) {
+#ifndef RENDER_STATS
+            // tests are only counted by statistics builds
+            if (i == HEAT_TESTS) {
+                return -1;
+            }
+#endif
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Name of a heatmap metric.
+ *
+ * PARAMETERS:
+ *  metric  - HEAT_ value of the metric
+ *
+ * RETURNS:
+ *  the name of the metric
+ */
+char *heat_metric_name(int metric) {
+    return metric_names[metric];
+}
+
+/**
+ * Read the counter a heatmap measures for the calling thread.  The work
+ * spent on a pixel is the difference between a sample taken before and
+ * one taken after it.
+ *
+ * PARAMETERS:
+ *  model   - model being rendered
+ *  ctx     - state of the calling render thread
+ *
+ * RETURNS:
+ *  the current count
+ */
+double heat_sample(model_t *model, trace_ctx_t *ctx) {
+    double count = 0.0;
+    int    i;
+
+    switch (model->opts->heat_metric) {
+        case HEAT_RAYS:
+            for (i = 0; i < RAY_KINDS; i++) {
+                count += ctx->rays[i];
+            }
+            break;
+#ifdef RENDER_STATS
+        case HEAT_TESTS:
+            for (i = 0; i < STATS_TYPES; i++) {
+                count += ctx->stats->tests[i];
+            }
+            break;
+#endif
+        default: {
+#ifdef HEAT_TSC
+            count = (double)__rdtsc();
+#else
+            // no time stamp counter, count nanoseconds instead
+            struct timespec now;
+
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            count = now.tv_sec * 1e9 + now.tv_nsec;
+#endif
+            break;
+        }
+    }
+
+    return count;
+}
+
+/*
+ * Compare two costs, for qsort.
+ */
+static int heat_compare(const void *a, const void *b) {
+    double da = *(const double *)a;
+    double db = *(const double *)b;
+
+    return (da > db) - (da < db);
+}
+
+/*
+ * Write a heatmap as a ppm, coloured along the ramp.  Costs are scaled so
+ * all but the costliest few pixels fall on the ramp, so a handful of slow
+ * pixels doesn't leave the rest of the image black.
+ *
+ * PARAMETERS:
+ *  out     - file to write to
+ *  heat    - cost of each pixel, top row first
+ *  width   - width of the image
+ *  height  - height of the image
+ */
+static void heat_ppm(FILE *out, double *heat, int width, int height) {
+    int     size   = width * height;
+    double *sorted = (double *)smalloc(sizeof(double) * size);
+    unsigned char *row = (unsigned char *)smalloc(3 * width);
+    double  top;        // cost shown at full heat
+    double  pos;        // position of a cost along the ramp
+    int     step;
+    int     i, x, y;
+
+    memcpy(sorted, heat, sizeof(double) * size);
+    qsort(sorted, size, sizeof(double), heat_compare);
+    top = sorted[(int)((size - 1) * HEAT_PERCENTILE)];
+    if (top <= 0.0) {
+        top = sorted[size - 1] > 0.0 ? sorted[size - 1] : 1.0;
+    }
+    free(sorted);
+
+    fprintf(out, "P6 %d %d 255\n", width, height);
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            pos = heat[y * width + x] / top;
+            pos = pos < 0.0 ? 0.0 : pos > 1.0 ? 1.0 : pos;
+            pos *= RAMP_STEPS;
+            step = (int)pos < (int)RAMP_STEPS ? (int)pos : RAMP_STEPS - 1;
+            pos -= step;
+
+            for (i = 0; i < 3; i++) {
+                row[3 * x + i] = (unsigned char)(255 *
+                        (ramp[step][i] + (ramp[step + 1][i] -
+                                          ramp[step][i]) * pos));
+            }
+        }
+        fwrite(row, 1, 3 * width, out);
+    }
+    free(row);
+}
+
+/*
+ * Write a heatmap as a greyscale pfm of raw costs.  Pfm rows run from the
+ * bottom of the image up.
+ *
+ * PARAMETERS:
+ *  out     - file to write to
+ *  heat    - cost of each pixel, top row first
+ *  width   - width of the image
+ *  height  - height of the image
+ */
+static void heat_pfm(FILE *out, double *heat, int width, int height) {
+    float *row = (float *)smalloc(sizeof(float) * width);
+    int    x, y;
+    int    little = 1;
+
+    // a negative scale means little endian
+    fprintf(out, "Pf\n%d %d\n%s\n", width, height,
+            *(char *)&little ? "-1.0" : "1.0");
+    for (y = height - 1; y >= 0; y--) {
+        for (x = 0; x < width; x++) {
+            row[x] = (float)heat[y * width + x];
+        }
+        fwrite(row, sizeof(float), width, out);
+    }
+    free(row);
+}
+
+/**
+ * Write the heatmap of a render, as a pfm if the file name ends in .pfm
+ * and as a ppm otherwise.
+ *
+ * PARAMETERS:
+ *  path    - file to write
+ *  model   - model that was rendered
+ *  heat    - cost of each pixel, top row first
+ *
+ * RETURNS:
+ *  0 on success
+ */
+int heat_write(char *path, model_t *model, double *heat) {
+    int   width  = model->proj->win_size_pixel[0];
+    int   height = model->proj->win_size_pixel[1];
+    int   len    = strlen(path);
+    FILE *out;
+
+    if ((out = fopenAndCheck(path, "wb")) == NULL) {
+        return EXIT_FAILURE;
+    }
+
+    if (len > 4 && strcmp(path + len - 4, ".pfm") == 0) {
+        heat_pfm(out, heat, width, height);
+    } else {
+        heat_ppm(out, heat, width, height);
+    }
+
+    fclose(out);
+    return 0;
+}
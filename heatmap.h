@@ -0,0 +1,19 @@
+#include <stdio.h>
+#include "common.h"
+
+#ifndef HEATMAP_H
+#define HEATMAP_H
+
+/* what a heatmap measures */
+#define HEAT_CYCLES     0       /* time stamp counter ticks */
+#define HEAT_RAYS       1       /* rays traced */
+#define HEAT_TESTS      2       /* intersection tests, needs RENDER_STATS */
+
+int heat_metric(char *);
+
+char *heat_metric_name(int);
+
+double heat_sample(model_t *, trace_ctx_t *);
+
+int heat_write(char *, model_t *, double *);
+#endif
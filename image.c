@@ -9,84 +9,375 @@
  */
 #include <string.h>
 #include <stdlib.h>
+#include <pthread.h>
 #include "safe.h"
 #include "projection.h"
 #include "veclib3d.h"
 #include "image.h"
 #include "ray.h"
+#include "sched.h"
+#include "packet.h"
+#include "stats.h"
+#include "bench.h"
+#include "heatmap.h"
+#include "wavefront.h"
+
+/* run of image rows held in memory, top row first, whole rows or a run
+ * of columns of each */
+typedef struct band_type {
+    unsigned char  *pixmap;     /* pixel data of the rows */
+    int             top;        /* image row of the first row, counted down
+                                   from the top of the image */
+    int             rows;       /* number of rows */
+    int             left;       /* first column */
+    int             cols;       /* number of columns */
+    double         *heat;       /* work spent on each pixel of the whole
+                                   image, top row first, or NULL */
+} band_t;
+
+/* state handed to each render thread */
+typedef struct worker_type {
+    pthread_t       thread;
+    int             index;      /* worker index in the scheduler */
+    model_t        *model;      /* model representing the 3d scene */
+    trace_ctx_t    *ctx;        /* state kept by this thread's rays */
+    sched_t        *sched;      /* scheduler to take tiles from */
+    band_t         *band;       /* rows shared by all workers */
+} worker_t;
 
 /**
- * Call methods that find rgb values for each pixel in the ppm file.
+ * Render a run of pixels from one row into a band, in packets if packet
+ * tracing is turned on.
  *
  * PARAMETERS:
- *  model   - model representing the 3d scene and other ray tracing values
+ *  model   - model representing the 3d scene
+ *  ctx     - state of the calling render thread
+ *  band    - rows being rendered
+ *  r       - image row, counted down from the top of the image
+ *  x0      - first pixel of the run
+ *  x1      - one past the last pixel of the run
  */
-void make_image(model_t *model) {
-    unsigned char *pixmap = NULL;               // buffer to hold pixel data
-    unsigned char *pixcurr = NULL;              // current position in buffer
-    int x = 0;                                  // x coord (in pixels)
-    int y = 0;                                  // y coord (in pixels)
-    int size = model->proj->win_size_pixel[0] * // size of the img in pixels
-        model->proj->win_size_pixel[1];
-
-    // allocate space for the buffer
-    pixmap = (unsigned char *)smalloc(sizeof(unsigned char) * 3 * size);
-    pixcurr = pixmap;
+static void render_row(model_t *model, trace_ctx_t *ctx, band_t *band,
+                       int r, int x0, int x1) {
+    int width  = model->proj->win_size_pixel[0];
+    int height = model->proj->win_size_pixel[1];
+    // rows are stored top down, but y counts up from the bottom
+    unsigned char *row = band->pixmap + ((r - band->top) * band->cols -
+                                         band->left) * 3;
+    int y = height - r - 1;
+    int x = x0;
+    int n;                                  // number of pixels in a packet
+    int i;
+    double before = 0.0;                    // work counter before a pixel
+    double cost;                            // work spent on each pixel
 
-    // for every pixel, call make_pixel
-    for (y = 0; y < model->proj->win_size_pixel[1]; y++) {
-        for (x = 0; x < model->proj->win_size_pixel[0]; x++) {
+    while (x < x1) {
 #ifdef DEBUG_MAKE
-            fprintf(stderr, "make_image: pixel(%d, %d)\n", x, y);
+        fprintf(stderr, "make_image: pixel(%d, %d)\n", x, y);
 #endif
-            // index into pixmap to get the location of the current pixel
-            pixcurr = pixmap + ((model->proj->win_size_pixel[1] - y - 1) * 
-                    model->proj->win_size_pixel[0] * 3) + (x * 3);
+        if (band->heat != NULL) {
+            before = heat_sample(model, ctx);
+        }
 
-            make_pixel(model, x, y, pixcurr);
+        if (model->opts->packets) {
+            n = x1 - x < PACKET_SIZE ? x1 - x : PACKET_SIZE;
+            make_packet(model, ctx, x, y, n, row + (x * 3));
+        } else {
+            n = 1;
+            make_pixel(model, ctx, x, y, row + (x * 3));
+        }
 
+        // the pixels of a packet share its work evenly
+        if (band->heat != NULL) {
+            cost = (heat_sample(model, ctx) - before) / n;
+            for (i = 0; i < n; i++) {
+                band->heat[r * width + x + i] = cost;
+            }
         }
+        x += n;
     }
-    
-    // print header
-    printf("P6 %d %d 255\n", model->proj->win_size_pixel[0],
-            model->proj->win_size_pixel[1]);
+}
 
-    // dump pixel values to file
-    fwrite(pixmap,
-            sizeof(unsigned char),
-            model->proj->win_size_pixel[0] * model->proj->win_size_pixel[1] * 3,
-            stdout);
+/**
+ * Render a block of pixels from a band through the wavefront engine.  The
+ * work is only known for the whole block, so its pixels share it evenly.
+ *
+ * PARAMETERS:
+ *  model   - model representing the 3d scene
+ *  ctx     - state of the calling render thread
+ *  band    - rows being rendered
+ *  r0      - first image row of the block, counted down from the top
+ *  r1      - one past the last row of the block
+ *  x0      - first column of the block
+ *  x1      - one past the last column of the block
+ */
+static void render_wave(model_t *model, trace_ctx_t *ctx, band_t *band,
+                        int r0, int r1, int x0, int x1) {
+    int width  = model->proj->win_size_pixel[0];
+    int height = model->proj->win_size_pixel[1];
+    unsigned char *row = band->pixmap + ((r0 - band->top) * band->cols -
+                                         band->left) * 3;
+    double before = 0.0;                    // work counter before the block
+    double cost;                            // work spent on each pixel
+    int r;
+    int x;
+
+    if (band->heat != NULL) {
+        before = heat_sample(model, ctx);
+    }
 
-    free(pixmap);
+    // y counts up from the bottom
+    make_wave(model, ctx, x0, height - r0 - 1, x1 - x0, r1 - r0,
+              row + (x0 * 3), band->cols * 3);
+
+    if (band->heat != NULL) {
+        cost = (heat_sample(model, ctx) - before) / ((r1 - r0) * (x1 - x0));
+        for (r = r0; r < r1; r++) {
+            for (x = x0; x < x1; x++) {
+                band->heat[r * width + x] = cost;
+            }
+        }
+    }
 }
 
 /**
- * For each pixel, call ray_trace and set rgb values of corresponding pixel.
+ * Render every pixel of one tile of a band.
  *
  * PARAMETERS:
- *  model   - container for the scene and other ray tracing structs
- *  x       - x coordinate of the pixel
- *  y       - y coordinage of the pixel
- *  pixval  - pointer to location to store rgb values
+ *  model   - model representing the 3d scene
+ *  ctx     - state of the calling render thread
+ *  band    - rows being rendered
+ *  tile    - index of the tile to render, counted from the top left of
+ *            the band
  */
-void make_pixel(model_t *model, int x, int y, unsigned char *pixval) {
-    double *world     = alloca(3 * sizeof(double)); // world coords of pixel
-    double *intensity = alloca(3 * sizeof(double)); // intensity of rgb
-    double *dir       = alloca(3 * sizeof(double)); // direction of ray
+static void render_tile(model_t *model, trace_ctx_t *ctx, band_t *band,
+                        int tile) {
+    int ts     = model->opts->tile_size;
+    int tiles_x = (band->cols + ts - 1) / ts;   // number of tiles across
+    int right  = band->left + band->cols;   // one past the last band column
+    int bottom = band->top + band->rows;    // one past the last band row
+    int x0 = band->left + (tile % tiles_x) * ts;    // upper left corner of
+    int r0 = band->top + (tile / tiles_x) * ts;     // the tile
+    int x1 = x0 + ts < right  ? x0 + ts : right;
+    int r1 = r0 + ts < bottom ? r0 + ts : bottom;
+    int r;
 
-    // convert pixel coords to world coords
-    map_pix_to_world(model->proj, x, y, world);
+    if (model->opts->wavefront) {
+        render_wave(model, ctx, band, r0, r1, x0, x1);
+        return;
+    }
 
-    // zero out intensity
-    memset(intensity, 0, 3 * sizeof(double));
+    for (r = r0; r < r1; r++) {
+        render_row(model, ctx, band, r, x0, x1);
+    }
+}
 
-    // find direction of ray and convert to unit vector
-    vec_diff3(model->proj->view_point, world, dir);
-    vec_unit3(dir, dir);
+/**
+ * Thread entry point, renders tiles until the scheduler runs dry.
+ *
+ * PARAMETERS:
+ *  arg     - worker_t for this thread
+ */
+static void *render_worker(void *arg) {
+    worker_t *worker = (worker_t *)arg;
+    int       tile;
 
-    ray_trace(model, model->proj->view_point, dir, intensity, 0.0, NULL);
+    stats_bind(worker->ctx->stats);
+    while ((tile = sched_next(worker->sched, worker->index)) >= 0) {
+        render_tile(worker->model, worker->ctx, worker->band, tile);
+    }
 
+    return NULL;
+}
+
+/**
+ * Add up the rays a render thread traced and free its state.
+ *
+ * PARAMETERS:
+ *  model   - model representing the 3d scene
+ *  ctx     - state of a render thread that is done
+ */
+static void render_done(model_t *model, trace_ctx_t *ctx) {
+    int i;
+
+    for (i = 0; i < RAY_KINDS; i++) {
+        model->bench->rays[i] += ctx->rays[i];
+    }
+    if (model->stats != NULL && ctx->stats != NULL) {
+        stats_merge(model->stats, ctx->stats);
+    }
+    trace_ctx_free(ctx);
+}
+
+/**
+ * Render a band with several threads.  The band is cut into square
+ * tiles which are handed out by a work stealing scheduler.  The scene is
+ * only read while rendering, so all threads share it.  Each pixel is still
+ * computed by make_pixel, so the result is the same as the serial path.
+ *
+ * PARAMETERS:
+ *  model   - model representing the 3d scene
+ *  band    - rows to fill
+ */
+static void render_parallel(model_t *model, band_t *band) {
+    int ts       = model->opts->tile_size;
+    int nthreads = model->opts->threads;
+    int ntiles   = ((band->cols + ts - 1) / ts) * ((band->rows + ts - 1) / ts);
+    worker_t *workers = (worker_t *)smalloc(sizeof(worker_t) * nthreads);
+    sched_t  *sched   = sched_init(nthreads, ntiles);
+    int i;
+
+    for (i = 0; i < nthreads; i++) {
+        workers[i].index  = i;
+        workers[i].model  = model;
+        workers[i].ctx    = trace_ctx_init(model);
+        workers[i].sched  = sched;
+        workers[i].band   = band;
+
+        if (pthread_create(&workers[i].thread, NULL, render_worker,
+                           &workers[i]) != 0) {
+            fprintf(stderr, "Error creating render thread.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (i = 0; i < nthreads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        render_done(model, workers[i].ctx);
+    }
+
+    sched_free(sched);
+    free(workers);
+}
+
+/**
+ * Render every pixel of a band, with the render threads if there are
+ * several, else with the calling thread's context.
+ *
+ * PARAMETERS:
+ *  model   - model representing the 3d scene
+ *  ctx     - state of the calling thread, NULL if rendering with threads
+ *  band    - rows to fill
+ */
+static void render_band(model_t *model, trace_ctx_t *ctx, band_t *band) {
+    int ts    = model->opts->tile_size;
+    int tile;
+    int r;
+
+    if (model->opts->threads > 1) {
+        render_parallel(model, band);
+    } else if (model->opts->wavefront) {
+        // the wavefront engine traces a tile at a time
+        for (tile = 0; tile < ((band->cols + ts - 1) / ts) *
+                              ((band->rows + ts - 1) / ts); tile++) {
+            render_tile(model, ctx, band, tile);
+        }
+    } else {
+        // for every row, render every pixel
+        for (r = band->top; r < band->top + band->rows; r++) {
+            render_row(model, ctx, band, r, band->left,
+                       band->left + band->cols);
+        }
+    }
+}
+
+/**
+ * Render a block of the image into a buffer.
+ *
+ * PARAMETERS:
+ *  model   - model representing the 3d scene
+ *  ctx     - state of the calling thread, NULL if rendering with threads
+ *  left    - first column of the block
+ *  top     - image row of the first row, counted down from the top
+ *  cols    - number of columns
+ *  rows    - number of rows
+ *  pixmap  - buffer for the block's pixels, top row first
+ */
+void make_band(model_t *model, trace_ctx_t *ctx, int left, int top,
+               int cols, int rows, unsigned char *pixmap) {
+    band_t band;
+
+    band.pixmap = pixmap;
+    band.top    = top;
+    band.rows   = rows;
+    band.left   = left;
+    band.cols   = cols;
+    band.heat   = NULL;
+    render_band(model, ctx, &band);
+}
+
+/**
+ * Call methods that find rgb values for each pixel in the ppm file.  The
+ * image is rendered top down in bands of rows.  Each band is written out
+ * as soon as it is done, so when streaming only a tile high band of rows
+ * is held in memory and the image is written as it is rendered.
+ * Otherwise the whole image is one band.
+ *
+ * PARAMETERS:
+ *  model   - model representing the 3d scene and other ray tracing values
+ */
+void make_image(model_t *model) {
+    band_t band;                                // rows being rendered
+    trace_ctx_t *ctx = NULL;                    // state kept across rays
+    int width  = model->proj->win_size_pixel[0];
+    int height = model->proj->win_size_pixel[1];
+    int window = model->opts->stream ?          // rows held in memory
+                 model->opts->tile_size : height;
+    double start;                               // when output started
+
+    window = window < height ? window : height;
+
+    // allocate space for the buffer
+    band.pixmap = (unsigned char *)smalloc(sizeof(unsigned char) * 3 *
+                                           width * window);
+    band.left = 0;
+    band.cols = width;
+    band.heat = NULL;
+    if (model->opts->heatmap != NULL) {
+        band.heat = (double *)smalloc(sizeof(double) * width * height);
+    }
+
+    if (model->opts->threads == 1) {
+        ctx = trace_ctx_init(model);
+        stats_bind(ctx->stats);
+    }
+
+    // print header
+    printf("P6 %d %d 255\n", width, height);
+
+    for (band.top = 0; band.top < height; band.top += band.rows) {
+        band.rows = height - band.top < window ? height - band.top : window;
+
+        render_band(model, ctx, &band);
+
+        // dump pixel values to file
+        start = bench_now();
+        fwrite(band.pixmap, sizeof(unsigned char), width * band.rows * 3,
+               stdout);
+        fflush(stdout);
+        model->bench->output_time += bench_now() - start;
+    }
+
+    if (ctx != NULL) {
+        render_done(model, ctx);
+    }
+
+    if (band.heat != NULL) {
+        heat_write(model->opts->heatmap, model, band.heat);
+        free(band.heat);
+    }
+
+    free(band.pixmap);
+}
+
+/**
+ * Clamp an intensity to [0, 1] and store it as an rgb pixel.
+ *
+ * PARAMETERS:
+ *  intensity - intensity of rgb
+ *  pixval    - pointer to location to store rgb values
+ */
+void set_pixel(double *intensity, unsigned char *pixval) {
 #ifdef DEBUG_MAKE
     fprintf(stderr, "Intensity: %lf %lf %lf\n", *(intensity + 0),
             *(intensity + 1),
@@ -115,3 +406,120 @@ void make_pixel(model_t *model, int x, int y, unsigned char *pixval) {
                                              *(pixval + 2));
 #endif
 }
+
+/**
+ * For each pixel, call ray_trace and set rgb values of corresponding pixel.
+ *
+ * PARAMETERS:
+ *  model   - container for the scene and other ray tracing structs
+ *  ctx     - state of the calling render thread
+ *  x       - x coordinate of the pixel
+ *  y       - y coordinage of the pixel
+ *  pixval  - pointer to location to store rgb values
+ */
+void make_pixel(model_t *model, trace_ctx_t *ctx, int x, int y,
+                unsigned char *pixval) {
+    double *world     = alloca(3 * sizeof(double)); // world coords of pixel
+    double *intensity = alloca(3 * sizeof(double)); // intensity of rgb
+    double *dir       = alloca(3 * sizeof(double)); // direction of ray
+
+    // convert pixel coords to world coords
+    map_pix_to_world(model->proj, x, y, world);
+
+    // zero out intensity
+    memset(intensity, 0, 3 * sizeof(double));
+
+    // find direction of ray and convert to unit vector
+    vec_diff3(model->proj->view_point, world, dir);
+    vec_unit3(dir, dir);
+
+    ctx->rays[RAY_PRIMARY]++;
+    ray_seed(ctx, x, y);
+    ray_trace(model, ctx, model->proj->view_point, dir, intensity, 0.0, NULL);
+
+    set_pixel(intensity, pixval);
+}
+
+/**
+ * Trace a block of pixels through the wavefront engine and set their rgb
+ * values.
+ *
+ * PARAMETERS:
+ *  model   - container for the scene and other ray tracing structs
+ *  ctx     - state of the calling render thread
+ *  x       - x coordinate of the left column
+ *  y       - y coordinate of the top row
+ *  w       - columns in the block
+ *  h       - rows in the block, going down from y
+ *  pixval  - pointer to location to store rgb values of the top left pixel
+ *  stride  - bytes from one row of pixval to the next
+ */
+void make_wave(model_t *model, trace_ctx_t *ctx, int x, int y, int w, int h,
+               unsigned char *pixval, int stride) {
+    double *intensity = wave_trace(model, ctx, x, y, w, h);
+    int     i;
+    int     j;
+
+    for (j = 0; j < h; j++) {
+        for (i = 0; i < w; i++) {
+            set_pixel(intensity + 3 * (j * w + i),
+                      pixval + (j * stride) + (i * 3));
+        }
+    }
+}
+
+/**
+ * Trace the primary rays of a run of neighbouring pixels in one row as a
+ * packet, then shade each pixel on its own.
+ *
+ * PARAMETERS:
+ *  model   - container for the scene and other ray tracing structs
+ *  ctx     - state of the calling render thread
+ *  x       - x coordinate of the first pixel
+ *  y       - y coordinage of the pixels
+ *  n       - number of pixels, at most PACKET_SIZE
+ *  pixval  - pointer to location to store rgb values of the first pixel
+ */
+void make_packet(model_t *model, trace_ctx_t *ctx, int x, int y, int n,
+                 unsigned char *pixval) {
+    packet_t pk;            // primary rays of the pixels
+    hit_t    hit;           // where a ray hit its closest object
+    double   world[3];      // world coords of pixel
+    double   intensity[3];  // intensity of rgb
+    int      i;
+    int      j;
+
+    packet_init(&pk, model->proj->view_point, n);
+
+    for (i = 0; i < PACKET_SIZE; i++) {
+        // unused lanes repeat the last pixel so the kernels see real rays
+        map_pix_to_world(model->proj, x + (i < n ? i : n - 1), y, world);
+        vec_diff3(model->proj->view_point, world, pk.dir[i]);
+        vec_unit3(pk.dir[i], pk.dir[i]);
+
+        for (j = 0; j < 3; j++) {
+            pk.soa[j][i] = pk.dir[i][j];
+        }
+    }
+
+    ctx->rays[RAY_PRIMARY] += n;
+    for (i = 0; i < n; i++) {
+        STATS_RAY();
+    }
+    find_closest_packet(model, &pk);
+
+    for (i = 0; i < n; i++) {
+        memset(intensity, 0, 3 * sizeof(double));
+
+        if (pk.closest[i] != NULL) {
+            ray_seed(ctx, x + i, y);
+            hit.obj = pk.closest[i];
+            hit.t = pk.t[i];
+            hit.obj->ops->hitinfo(pk.base, pk.dir[i], hit.obj, &hit);
+
+            ray_shade(model, ctx, pk.dir[i], &hit, intensity, 0.0);
+        }
+
+        set_pixel(intensity, pixval + (i * 3));
+    }
+}
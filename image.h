@@ -3,5 +3,15 @@
 
 void make_image(model_t *);
 
-void make_pixel(model_t *, int, int, unsigned char *);
+void make_band(model_t *, trace_ctx_t *, int, int, int, int,
+               unsigned char *);
+
+void make_pixel(model_t *, trace_ctx_t *, int, int, unsigned char *);
+
+void make_packet(model_t *, trace_ctx_t *, int, int, int, unsigned char *);
+
+void make_wave(model_t *, trace_ctx_t *, int, int, int, int, unsigned char *,
+               int);
+
+void set_pixel(double *, unsigned char *);
 #endif
@@ -14,53 +14,48 @@
 #include "light.h"
 #include "veclib3d.h"
 
+/* functions of every light */
+static const obj_ops_t light_ops = {
+    NULL, NULL, shade_default,
+    getamb_default, getdif_default, getspec_default,
+    NULL, light_dump, NULL
+};
+
 /**
  * Initialize a light object from a file.
  *
  * PARAMETERS:
- *  in      - file to read from
+ *  scan    - scanner to read from
  *  objtype - type of object to initalize
  *
  *  RETURNS:
  *  the newly created object
  */
-obj_t * light_init(FILE *in, int objtype) {
-    obj_t *obj = object_init(in, objtype);  // base object struct
-    light_t *light = (light_t *)smalloc(sizeof(light_t));   // new light struct
+obj_t * light_init(scan_t *scan, int objtype) {
+    obj_t *obj = object_init(scan, objtype);  // base object struct
+    light_t *light = (light_t *)object_alloc(sizeof(light_t));  // new light
 
     obj->priv = light;      // connect light to obj
-    obj->dump = light_dump;
-
-    char    buf[256];       // buffer for reading in values
-    int     rc = 0;         // read counter
-
+    light_bind(obj);
 
     // read in emissivity
-    while (rc != 3 && !feof(in)) {
-        rc = fscanf(in, "%lf %lf %lf", light->emissivity,
-                                      (light->emissivity + 1),
-                                      (light->emissivity + 2));
-        fgets(buf, 256, in);
-#ifdef DEBUG_OBJECTS
-        fprintf(stderr, "1)light read %s\n", buf);
-#endif
-    }
-
-    rc = 0;
+    scan_doubles(scan, light->emissivity, 3, "light emissivity");
 
     // read in center
-    while (rc != 3 && !feof(in)) {
-        rc = fscanf(in, "%lf %lf %lf",  light->center,
-                                       (light->center + 1),
-                                       (light->center + 2));
-        fgets(buf, 256, in);
-#ifdef DEBUG_OBJECTS
-        fprintf(stderr, "2)light read %s\n", buf);
-#endif
-    }
+    scan_doubles(scan, light->center, 3, "light center");
     return obj;
 }
 
+/*
+ * Connect the function table of a light object.
+ *
+ * PARAMETERS:
+ *  obj -   object to bind
+ */
+void light_bind(obj_t *obj) {
+    obj->ops = &light_ops;
+}
+
 /**
  * Prints information about a light object to a file.
  *
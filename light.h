@@ -1,7 +1,11 @@
+#include "common.h"
+#include "scan.h"
+
 #ifndef LIGHT_H
 #define LIGHT_H
-obj_t * light_init(FILE *, int);
+obj_t * light_init(scan_t *, int);
 
+void light_bind(obj_t *);
 
 void light_dump(FILE *, obj_t *);
 #endif
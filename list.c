@@ -2,6 +2,7 @@
 #include "list.h"
 #include "common.h"
 #include "safe.h"
+#include "arena.h"
 
 /* 
  * Allocate a new list header on the heap and initialize it 
@@ -13,6 +14,7 @@ list_t *list_init(void) {
     list_t *list = (list_t *)smalloc(sizeof(list_t));
     list->head = NULL;
     list->tail = NULL;
+    list->arena = arena_init();
     
     return list;
 }
@@ -41,26 +43,21 @@ void list_add(list_t *list, obj_t *entity) {
 }
 
 /*
- * Delete all of the list objects and the list
+ * Delete all of the list objects and the list.  Objects only let go of
+ * what they hold elsewhere, their memory goes with the list's arena.
  *
  * PARAMETERS:
  *  list - list_t to free
  */
 void list_del(list_t *list) {
     obj_t *current;
-    obj_t *temp;
 
-    if (list->head == NULL) {
-        free(list);
-    } else {
-        current = list->head;
-
-        while (current != NULL) {
-            temp = current->next;
-            current->obj_free(current);
-            current = temp;
+    for (current = list->head; current != NULL; current = current->next) {
+        if (current->ops->release != NULL) {
+            current->ops->release(current);
         }
-
-        free(list);
     }
+
+    arena_free(list->arena);
+    free(list);
 }
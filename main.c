@@ -14,6 +14,17 @@
 #include "list.h"
 #include "safe.h"
 #include "image.h"
+#include "options.h"
+#include "bvh.h"
+#include "scan.h"
+#include "scenebin.h"
+#include "bench.h"
+#include "stats.h"
+#include "farm.h"
+#include "daemon.h"
+#include "animate.h"
+#include "deps.h"
+#include "relight.h"
 
 /**
  * Entry point for ray tracer.  call methods to initialize model, projection,
@@ -29,26 +40,122 @@ int main(int argc, char **argv) {
 
     int rc; // return value from model_init
 
-    // initialize projection
-    model->proj = projection_init(argc, argv, stdin);
+    scan_t *scan;       // scanner for a text scene
+    scenebin_t *bin;    // compiled scene, if stdin holds one
+    double start;       // when rendering started
 
-    projection_dump(stderr, model->proj);
+    // read render settings from the command line
+    model->opts = options_init(argc, argv);
+
+    // a worker is sent its scene by the farm coordinator
+    if (model->opts->worker != NULL) {
+        rc = farm_worker(model->opts->worker, model->opts);
+        free(model->opts);
+        free(model);
+        return rc == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // the daemon is sent its scenes by its clients
+    if (model->opts->daemon != NULL) {
+        rc = daemon_run(argc, argv, model->opts);
+        free(model->opts);
+        free(model);
+        return rc == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    model->bench = bench_init();
+#ifdef RENDER_STATS
+    model->stats = stats_init();
+#else
+    model->stats = NULL;
+    if (model->opts->stats != NULL) {
+        fprintf(stderr, "Built without RENDER_STATS, no statistics "
+                        "will be written\n");
+    }
+#endif
 
     model->lights = list_init();
     model->scene = list_init();
+    model->bvh = NULL;
 
-    rc = model_init(stdin, model);
+    // scene description is read from stdin, mapped in place if compiled
+    if ((bin = scenebin_open(stdin, "stdin")) != NULL) {
+        model->proj = projection_load(argc, argv, scenebin_proj(bin));
+        rc = scenebin_load(bin, model);
+    } else {
+        scan = scan_init(stdin, "stdin");
+        model->proj = projection_init(argc, argv, scan);
+        rc = model_init(scan, model);
+        scan_free(scan);
+    }
+    model->bench->parse_time = bench_now() - model->bench->start;
+
+    options_dump(stderr, model->opts);
+    projection_dump(stderr, model->proj);
+
+    if (model->opts->compile != NULL) {
+        rc = scenebin_write(model->opts->compile, model);
+        list_del(model->lights);
+        list_del(model->scene);
+        if (bin != NULL) {
+            scenebin_close(bin);
+        }
+        free(model->proj);
+        free(model->opts);
+        free(model->bench);
+        if (model->stats != NULL) {
+            stats_free(model->stats);
+        }
+        free(model);
+        return rc == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // build the hierarchy the tracer walks instead of the scene list
+    model->bvh = bvh_build(model->scene);
+    model->bench->build_time = model->bvh->build_time;
 
     model_dump(stderr, model);
 
     if (rc == 0) {
-        make_image(model);
+        start = bench_now();
+        if (model->opts->animate != NULL) {
+            rc = animate_run(model);
+        } else if (model->opts->incremental != NULL) {
+            rc = deps_render(model);
+        } else if (model->opts->relight != NULL) {
+            rc = relight_render(model);
+        } else if (model->opts->farm > 0 ||
+                   model->opts->farm_listen != NULL) {
+            rc = farm_render(model);
+        } else {
+            make_image(model);
+        }
+        model->bench->render_time = bench_now() - start;
+
+        bench_dump(stderr, model);
+        if (model->opts->bench != NULL) {
+            bench_write(model->opts->bench, model);
+        }
+        if (model->opts->stats != NULL && model->stats != NULL) {
+            stats_write(model->opts->stats, model, model->stats);
+        }
     }
 
+    bvh_free(model->bvh);
     list_del(model->lights);
     list_del(model->scene);
 
+    // objects of a compiled scene live in the mapping
+    if (bin != NULL) {
+        scenebin_close(bin);
+    }
+
     free(model->proj);
+    free(model->opts);
+    free(model->bench);
+    if (model->stats != NULL) {
+        stats_free(model->stats);
+    }
     free(model);
 
     return(EXIT_SUCCESS);
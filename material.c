@@ -10,40 +10,20 @@
 #include <stdio.h>
 #include "common.h"
 #include "material.h"
+#include "scan.h"
 
 /**
  * Initialize a material struct by reading in ambient, diffuse, and specular
  * rgb values from a file.
  *
  * PARAMETERS:
- *  in  -   file to read from
+ *  scan -  scanner to read from
  *  mat -   material struct to initialize
  */
-void material_init(FILE *in, material_t *mat) {
-    char buf[256];  // buffer to read into
-    int  rc = 0;    // read counter
-
-    while (rc != 3) {
-        rc = fscanf(in, "%lf %lf %lf", mat->ambient, (mat->ambient + 1),
-                                        (mat->ambient + 2) );
-        fgets(buf, 256, in);
-    }
-    
-    rc = 0;
-
-    while (rc != 3) {
-        rc = fscanf(in, "%lf %lf %lf", mat->diffuse, (mat->diffuse + 1),
-                                        (mat->diffuse + 2) );
-        fgets(buf, 256, in);
-    }
-
-    rc = 0;
-
-    while (rc != 3) {
-        rc = fscanf(in, "%lf %lf %lf", mat->specular, (mat->specular + 1),
-                                        (mat->specular + 2) );
-        fgets(buf, 256, in);
-    }
+void material_init(scan_t *scan, material_t *mat) {
+    scan_doubles(scan, mat->ambient, 3, "ambient");
+    scan_doubles(scan, mat->diffuse, 3, "diffuse");
+    scan_doubles(scan, mat->specular, 3, "specular");
 }
 
 /*
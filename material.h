@@ -1,7 +1,10 @@
+#include "common.h"
+#include "scan.h"
+
 #ifndef MATERIAL_H
 #define MATERIAL_H
 
-void material_init(FILE *, material_t *);
+void material_init(scan_t *, material_t *);
 
 void material_dump(FILE *, material_t *);
 #endif
@@ -19,13 +19,15 @@
 #include "object.h"
 #include "common.h"
 #include "list.h"
+#include "bvh.h"
+#include "scan.h"
 #include <stdio.h>
 #include <stdlib.h>
 
 
-obj_t *dummy_init(FILE *, int);
+obj_t *dummy_init(scan_t *, int);
 
-static obj_t *(*object_loaders[])(FILE *, int) =
+static obj_t *(*object_loaders[])(scan_t *, int) =
 {
     light_init, 
     dummy_init,
@@ -45,51 +47,58 @@ static obj_t *(*object_loaders[])(FILE *, int) =
  * Initialize a model struct and scene object by reading in from a file.
  *
  * PARAMETERS:
- *  in      - file to read from
+ *  scan    - scanner to read from
  *  model   - model to initalize
  *
  * RETURN:
  * 0 on success
  */
-int model_init(FILE *in, model_t *model) {
-    char buf[256];      // buffer to read into
+int model_init(scan_t *scan, model_t *model) {
     int  objtype = 0;   // type of object currently being read in
     obj_t *obj;         // new object being initalized
 
     // read in from file to initialize scene objects
-    while (fscanf(in, "%d", &objtype) != EOF) {
-        fgets(buf, 256, in);
+    while (scan_ints(scan, &objtype, 1, NULL) != EOF) {
 #ifdef DEBUG_MODEL
-        fprintf(stderr, "model_init read %s\n", buf);
+        fprintf(stderr, "model_init read %d\n", objtype);
 #endif
         if (objtype > LAST_TYPE || objtype < FIRST_TYPE) {
-            fprintf(stderr, "Invalid object type: %d\n", objtype);
-            exit(EXIT_FAILURE);
+            scan_error(scan, "Invalid object type: %d", objtype);
         }
-        obj = object_loaders[(objtype - FIRST_TYPE)](in, objtype); 
+
+        // limits aren't an object, they belong with the projection
+        if (objtype == LIMITS) {
+            projection_limits(scan, model->proj);
+            continue;
+        }
+
+        // each list's objects are read into its own arena, in load order
+        object_arena(objtype > LAST_LIGHT ? model->scene->arena :
+                                            model->lights->arena);
+        obj = object_loaders[(objtype - FIRST_TYPE)](scan, objtype); 
 
         /*
         switch (objtype) {
             case LIGHT:
-                obj = light_init(in, objtype);
+                obj = light_init(scan, objtype);
                 break;
             case SPHERE:
-                obj = sphere_init(in, objtype);
+                obj = sphere_init(scan, objtype);
                 break;
             case PLANE:
-                obj = plane_init(in, objtype);
+                obj = plane_init(scan, objtype);
                 break;
             case FPLANE:
-                obj = fplane_init(in, objtype);
+                obj = fplane_init(scan, objtype);
                 break;
             case TPLANE:
-                obj = tplane_init(in, objtype);
+                obj = tplane_init(scan, objtype);
                 break;
             case P_SPHERE:
-                obj = psphere_init(in, objtype);
+                obj = psphere_init(scan, objtype);
                 break;
             case P_PLANE:
-                obj = pplane_init(in, objtype);
+                obj = pplane_init(scan, objtype);
                 break;
             default:
                 fprintf(stderr, "Unknown object type: %d\n", objtype);
@@ -110,6 +119,7 @@ int model_init(FILE *in, model_t *model) {
         }
 
     }
+    object_arena(NULL);
 
     return 0;
 }
@@ -129,18 +139,22 @@ void model_dump(FILE *out, model_t *model) {
     
     // print out objects in the scene
     while (obj != NULL) {
-        obj->dump(stderr, obj);
+        obj->ops->dump(stderr, obj);
         obj = obj->next;
     }
 
+    if (model->bvh != NULL) {
+        bvh_dump(stderr, model->bvh);
+    }
+
 }
 
 /**
  * Place holder for objtypes that haven't been defined
  */
-obj_t *dummy_init(FILE *in, int objtype) {
-    fprintf(stderr, "Invalid object type %d\n", objtype);   
-    exit(EXIT_FAILURE);
+obj_t *dummy_init(scan_t *scan, int objtype) {
+    scan_error(scan, "Invalid object type %d", objtype);
+    return NULL;
 }
 
 
@@ -1,10 +1,11 @@
 #include "ray.h"
+#include "scan.h"
 #include <stdio.h>
 
 #ifndef MODEL_H
 #define MODEL_H
 
-int model_init(FILE *, model_t *);
+int model_init(scan_t *, model_t *);
 
 void model_dump(FILE *, model_t *);
 
@@ -8,37 +8,45 @@
  * 31/3/2011
  */
 #include <stdio.h>
+#include <stdlib.h>
 #include "common.h"
 #include "safe.h"
 #include "material.h"
 #include "object.h"
 #include "sphere.h"
 #include "plane.h"
+#include "arena.h"
+
+static arena_t *object_mem = NULL;  // arena objects are read into
+
+/* functions of an object whose type binds none of its own */
+static const obj_ops_t object_ops = {
+    NULL, NULL, shade_default,
+    getamb_default, getdif_default, getspec_default,
+    NULL, NULL, NULL
+};
 
 /**
  * Intialize an object by reading in from a file.
  *
  * PARAMETERS:
- *  in      - file to read from
+ *  scan    - scanner to read from
  *  objtyp  - type of object to read in
  *
  *  RETURNS:
  *  pointer to the newly initialized object
  */
-obj_t *object_init(FILE *in, int objtype) {
+obj_t *object_init(scan_t *scan, int objtype) {
     obj_t   *new      = NULL;   // object being created
     static int id     = 0;      // id for object, every object has unize id
     
-    new = (obj_t *)smalloc(sizeof(obj_t));
+    new = (obj_t *)object_alloc(sizeof(obj_t));
 
 
     new->objtype = objtype;
     new->objid   = id;
     
-    new->getamb = getamb_default;
-    new->getdif = getdif_default;
-    new->getspec = getspec_default;
-    new->obj_free = obj_free;
+    object_bind(new);
      
     new->next=NULL;
     id++;
@@ -46,14 +54,43 @@ obj_t *object_init(FILE *in, int objtype) {
 }
 
 /*
- * Frees an obj_t by freeing the priv pointer and then the obj_t struct.
+ * Set the arena objects are read into from now on.
+ *
+ * PARAMETERS:
+ *  arena   - arena to allocate from, NULL for none
+ */
+void object_arena(arena_t *arena) {
+    object_mem = arena;
+}
+
+/*
+ * Allocate part of an object from the arena objects are read into.  The
+ * parts of one object follow each other in memory.
+ *
+ * PARAMETERS:
+ *  size    - bytes to allocate
+ *
+ * RETURNS:
+ *  pointer to the memory
+ */
+void *object_alloc(size_t size) {
+    // objects read outside a model get an arena that is never freed
+    if (object_mem == NULL) {
+        object_mem = arena_init();
+    }
+    return arena_alloc(object_mem, size);
+}
+
+/*
+ * Connect the default functions of an object.  Each object type binds its
+ * own table instead, both when it is read from a file and when it is
+ * mapped from a compiled scene.
  *
  * PARAMETERS:
- *  obj -   object to free
+ *  obj -   object to bind
  */
-void obj_free(obj_t * obj) {
-    free(obj->priv);
-    free(obj);
+void object_bind(obj_t *obj) {
+    obj->ops = &object_ops;
 }
 
 /**
@@ -61,9 +98,10 @@ void obj_free(obj_t * obj) {
  *
  * PARAMETERS:
  *  obj       - object to retrieve ambient values from
+ *  hit       - hit point on the object
  *  intensity - array to store ambient values in
  */
-void getamb_default (obj_t *obj, double *intensity) {
+void getamb_default (obj_t *obj, hit_t *hit, double *intensity) {
     material_t *mat = &obj->material; // material struct
     double *ambient = mat->ambient;   // ambient array from mat
 
@@ -78,9 +116,10 @@ void getamb_default (obj_t *obj, double *intensity) {
  *
  * PARAMETERS:
  *  obj       - object to retrieve diffuse values from
+ *  hit       - hit point on the object
  *  intensity - array to store ambient values in
  */
-void getdif_default (obj_t *obj, double *intensity) {
+void getdif_default (obj_t *obj, hit_t *hit, double *intensity) {
     material_t *mat = &obj->material; // material struct
     double *diffuse = mat->diffuse;   // ambient array from mat
 
@@ -96,9 +135,10 @@ void getdif_default (obj_t *obj, double *intensity) {
  *
  * PARAMETERS:
  *  obj       - object to retrieve diffuse values from
+ *  hit       - hit point on the object
  *  intensity - array to store specular values in
  */
-void getspec_default (obj_t *obj, double *intensity) {
+void getspec_default (obj_t *obj, hit_t *hit, double *intensity) {
     material_t *mat = &obj->material; // material struct
     double *specular = mat->specular;   // ambient array from mat
 
@@ -108,6 +148,34 @@ void getspec_default (obj_t *obj, double *intensity) {
 
 }
 
+/**
+ * Returns the reflectivities of an object whose material is the same all
+ * over it.
+ *
+ * PARAMETERS:
+ *  obj     - object that was hit
+ *  hit     - hit point on the object
+ *  mat     - material to store the reflectivities in
+ */
+void shade_default(obj_t *obj, hit_t *hit, material_t *mat) {
+    *mat = obj->material;
+}
+
+/**
+ * Returns the reflectivities of an object through its ambient, diffuse
+ * and specular functions, for objects that only replace some of them.
+ *
+ * PARAMETERS:
+ *  obj     - object that was hit
+ *  hit     - hit point on the object
+ *  mat     - material to store the reflectivities in
+ */
+void shade_getters(obj_t *obj, hit_t *hit, material_t *mat) {
+    obj->ops->getamb(obj, hit, mat->ambient);
+    obj->ops->getdif(obj, hit, mat->diffuse);
+    obj->ops->getspec(obj, hit, mat->specular);
+}
+
 /**
  * Prints information about an object.
  *
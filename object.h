@@ -1,17 +1,27 @@
 #include <stdio.h>
 #include "ray.h"
+#include "scan.h"
+#include "arena.h"
 
 #ifndef OBJECT_H
 #define OBJECT_H
-obj_t *object_init(FILE *, int);
+obj_t *object_init(scan_t *, int);
 
-void obj_free(obj_t *);
+void object_arena(arena_t *);
 
-void getamb_default (obj_t *, double *);
+void *object_alloc(size_t);
 
-void getdif_default (obj_t *, double *);
+void object_bind(obj_t *);
 
-void getspec_default (obj_t *, double *);
+void getamb_default (obj_t *, hit_t *, double *);
+
+void getdif_default (obj_t *, hit_t *, double *);
+
+void getspec_default (obj_t *, hit_t *, double *);
+
+void shade_default(obj_t *, hit_t *, material_t *);
+
+void shade_getters(obj_t *, hit_t *, material_t *);
 
 void object_dump(FILE *, obj_t *);
 #endif
@@ -0,0 +1,317 @@
+/*
+ * options.c
+ *
+ * Parse and dump the optional render settings given on the command line
+ * after the image size.
+ *
+ * Chris Blades
+ *
+ * 18/10/2026
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <getopt.h>
+#include "common.h"
+#include "safe.h"
+#include "options.h"
+#include "packet.h"
+#include "heatmap.h"
+#include "texture.h"
+#include "vtexture.h"
+#include "farm.h"
+#include "daemon.h"
+#include "animate.h"
+
+#define DEFAULT_THREADS     1
+#define DEFAULT_TILE_SIZE   16
+
+static struct option long_options[] = {
+    { "stream",  no_argument,       NULL, 'S' },
+    { "mipmap",  no_argument,       NULL, 'm' },
+    { "wavefront", no_argument,     NULL, 'w' },
+    { "texture-budget", required_argument, NULL, 'T' },
+    { "bench",   required_argument, NULL, 'b' },
+    { "stats",   required_argument, NULL, 'r' },
+    { "heatmap", required_argument, NULL, 'H' },
+    { "heat-metric", required_argument, NULL, 'M' },
+    { "compile", required_argument, NULL, 'c' },
+    { "farm",    required_argument, NULL, 'f' },
+    { "listen",  required_argument, NULL, 'L' },
+    { "worker",  required_argument, NULL, 'W' },
+    { "farm-timeout", required_argument, NULL, 'O' },
+    { "daemon",  required_argument, NULL, 'D' },
+    { "jobs",    required_argument, NULL, 'j' },
+    { "animate", required_argument, NULL, 'A' },
+    { "frames",  required_argument, NULL, 'n' },
+    { "output",  required_argument, NULL, 'o' },
+    { "incremental", required_argument, NULL, 'I' },
+    { "relight", required_argument, NULL, 'G' },
+    { NULL,      0,                 NULL, 0   }
+};
+
+/*
+ * Print a usage message and exit.
+ *
+ * PARAMETERS:
+ *  prog    - name of the program
+ */
+static void usage(char *prog) {
+    fprintf(stderr, "usage: %s width height [-t threads] [-s tile_size] "
+                    "[-p kernels] [-S] [-m] [-w] [-T mb] [-b file]\n"
+                    "\t[-r file] [-H file [-M metric]] [--compile file] "
+                    "[-f workers] [-L addr] [-W addr] [-O s]\n"
+                    "\t[-D socket [-j jobs]] [-A path [-n frames] "
+                    "[-o name]] [-I file] [-G file]\n",
+            prog);
+    fprintf(stderr, "\t-t threads    render threads, 0 for one per cpu "
+                    "(default %d)\n", DEFAULT_THREADS);
+    fprintf(stderr, "\t-s tile_size  edge of a render tile in pixels "
+                    "(default %d)\n", DEFAULT_TILE_SIZE);
+    fprintf(stderr, "\t-p kernels    trace primary rays in packets with "
+                    "auto, avx2, sse2 or scalar kernels\n");
+    fprintf(stderr, "\t-S, --stream  write rows as soon as they are "
+                    "rendered, holding only tile_size rows in memory\n");
+    fprintf(stderr, "\t-m, --mipmap  filter textures trilinearly through "
+                    "mip pyramids, picking the level from the size of each "
+                    "pixel on the surface\n");
+    fprintf(stderr, "\t-w, --wavefront  trace each tile a stage at a time: "
+                    "all its rays are intersected, then shaded, then their "
+                    "shadow rays traced\n");
+    fprintf(stderr, "\t-T, --texture-budget mb  read textures a page at a "
+                    "time as they are used, holding at most mb megabytes of "
+                    "pages.  Not used for mipmapped textures\n");
+    fprintf(stderr, "\t-b, --bench file    append a JSON line with timings "
+                    "and rays traced to file, - for stderr\n");
+    fprintf(stderr, "\t-r, --stats file    write a JSON report of render "
+                    "statistics to file, - for stderr.  Needs a build with "
+                    "-DRENDER_STATS\n");
+    fprintf(stderr, "\t-H, --heatmap file  write the work spent on each "
+                    "pixel to file, a pfm if it ends in .pfm, else a ppm\n");
+    fprintf(stderr, "\t-M, --heat-metric metric  work to measure: cycles "
+                    "(default), rays or tests (RENDER_STATS builds)\n");
+    fprintf(stderr, "\t-c, --compile file  write the scene read from stdin "
+                    "to a compiled scene file instead of rendering it\n");
+    fprintf(stderr, "\t-f, --farm workers  render bands of rows in this "
+                    "many worker processes\n");
+    fprintf(stderr, "\t-L, --listen addr   let workers connect at addr, "
+                    "unix:path or host:port, as well as those forked\n");
+    fprintf(stderr, "\t-W, --worker addr   render bands for the farm "
+                    "coordinator at addr instead of reading a scene\n");
+    fprintf(stderr, "\t-O, --farm-timeout s  hand out again bands taking "
+                    "longer than s seconds (default %.1lf), or four times "
+                    "the mean if that is longer\n", DEFAULT_FARM_TIMEOUT);
+    fprintf(stderr, "\t-D, --daemon socket  keep scenes loaded and render "
+                    "them on requests to the Unix socket, see daemon.c\n");
+    fprintf(stderr, "\t-j, --jobs jobs  images the daemon renders at once, "
+                    "each with the render threads (default %d)\n",
+            DEFAULT_DAEMON_JOBS);
+    fprintf(stderr, "\t-A, --animate path  render frames along a camera "
+                    "path of keyframes, a line each of world width and "
+                    "height and view point\n");
+    fprintf(stderr, "\t-n, --frames frames  frames spread along the path "
+                    "(default one a keyframe)\n");
+    fprintf(stderr, "\t-o, --output name  frame files, a pattern with one "
+                    "%%d for the frame number (default %s)\n",
+            DEFAULT_FRAME_NAME);
+    fprintf(stderr, "\t-I, --incremental file  trace again only the pixels "
+                    "edits since the last render with file can change, "
+                    "and update it\n");
+    fprintf(stderr, "\t-G, --relight file  keep every hit in file, and "
+                    "only light them again while just the lights change\n");
+    exit(EXIT_FAILURE);
+}
+
+/*
+ * Initialize an options struct from the command line.  The first two
+ * arguments are the image size and are read by projection_init, so
+ * options are only looked for after them.
+ *
+ * PARAMETERS:
+ *  argc    - number of command line arguments
+ *  argv    - array of command line arguments
+ *
+ * RETURNS:
+ *  an initialized options struct
+ */
+options_t *options_init(int argc, char **argv) {
+    options_t *opts = (options_t *)smalloc(sizeof(options_t));
+    int        opt;                 // current option character
+
+    opts->threads   = DEFAULT_THREADS;
+    opts->tile_size = DEFAULT_TILE_SIZE;
+    opts->packets   = 0;
+    opts->stream    = 0;
+    opts->mipmap    = 0;
+    opts->wavefront = 0;
+    opts->texture_budget = 0.0;
+    opts->bench     = NULL;
+    opts->stats     = NULL;
+    opts->heatmap   = NULL;
+    opts->heat_metric = HEAT_CYCLES;
+    opts->compile   = NULL;
+    opts->farm      = 0;
+    opts->farm_listen = NULL;
+    opts->worker    = NULL;
+    opts->farm_timeout = DEFAULT_FARM_TIMEOUT;
+    opts->daemon    = NULL;
+    opts->jobs      = DEFAULT_DAEMON_JOBS;
+    opts->animate   = NULL;
+    opts->frames    = 0;
+    opts->frame_name = DEFAULT_FRAME_NAME;
+    opts->incremental = NULL;
+    opts->relight   = NULL;
+
+    if (argc < 3) {
+        usage(argv[0]);
+    }
+
+    // argv[2] stands in for the program name so getopt starts at argv[3]
+    optind = 1;
+    while ((opt = getopt_long(argc - 2, argv + 2,
+                              "t:s:p:SmwT:b:r:H:M:c:f:L:W:O:"
+                              "D:j:A:n:o:I:G:",
+                              long_options, NULL)) != -1) {
+        switch (opt) {
+            case 't':
+                opts->threads = atoi(optarg);
+                break;
+            case 's':
+                opts->tile_size = atoi(optarg);
+                break;
+            case 'p':
+                if (packet_select(optarg) != 0) {
+                    fprintf(stderr, "Packet kernels not supported: %s\n",
+                            optarg);
+                    exit(EXIT_FAILURE);
+                }
+                opts->packets = 1;
+                break;
+            case 'S':
+                opts->stream = 1;
+                break;
+            case 'm':
+                opts->mipmap = 1;
+                texture_mipmap(1);
+                break;
+            case 'w':
+                opts->wavefront = 1;
+                break;
+            case 'T':
+                opts->texture_budget = atof(optarg);
+                if (opts->texture_budget <= 0.0) {
+                    fprintf(stderr, "Texture budget must be positive: %s\n",
+                            optarg);
+                    exit(EXIT_FAILURE);
+                }
+                vtex_init(opts->texture_budget);
+                break;
+            case 'b':
+                opts->bench = optarg;
+                break;
+            case 'r':
+                opts->stats = optarg;
+                break;
+            case 'H':
+                opts->heatmap = optarg;
+                break;
+            case 'M':
+                if ((opts->heat_metric = heat_metric(optarg)) < 0) {
+                    fprintf(stderr, "Heatmap metric not supported: %s\n",
+                            optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'c':
+                opts->compile = optarg;
+                break;
+            case 'f':
+                opts->farm = atoi(optarg);
+                break;
+            case 'L':
+                opts->farm_listen = optarg;
+                break;
+            case 'W':
+                opts->worker = optarg;
+                break;
+            case 'O':
+                opts->farm_timeout = atof(optarg);
+                break;
+            case 'D':
+                opts->daemon = optarg;
+                break;
+            case 'j':
+                opts->jobs = atoi(optarg);
+                break;
+            case 'A':
+                opts->animate = optarg;
+                break;
+            case 'n':
+                opts->frames = atoi(optarg);
+                break;
+            case 'o':
+                opts->frame_name = optarg;
+                break;
+            case 'I':
+                opts->incremental = optarg;
+                break;
+            case 'G':
+                opts->relight = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                break;
+        }
+    }
+
+    // zero threads means one per online processor
+    if (opts->threads == 0) {
+        opts->threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+
+    if (opts->threads < 1 || opts->tile_size < 1 || opts->farm < 0 ||
+        opts->farm_timeout <= 0.0 || opts->jobs < 1 || opts->frames < 0) {
+        usage(argv[0]);
+    }
+
+    return opts;
+}
+
+/**
+ * Print information about an options struct.
+ *
+ * PARAMETERS:
+ *  out     - file to print to
+ *  opts    - options to dump
+ */
+void options_dump(FILE *out, options_t *opts) {
+    fprintf(out, "\tOPTIONS:\n");
+    fprintf(out, "\t\tThreads: %d\n", opts->threads);
+    fprintf(out, "\t\tTile size: %d\n", opts->tile_size);
+    fprintf(out, "\t\tPackets: %s\n", opts->packets ? packet_isa() : "off");
+    fprintf(out, "\t\tStream: %s\n", opts->stream ? "on" : "off");
+    fprintf(out, "\t\tMipmap: %s\n", opts->mipmap ? "on" : "off");
+    fprintf(out, "\t\tWavefront: %s\n", opts->wavefront ? "on" : "off");
+    if (opts->texture_budget > 0.0) {
+        fprintf(out, "\t\tTexture budget: %.1lf MB\n", opts->texture_budget);
+    }
+    if (opts->heatmap != NULL) {
+        fprintf(out, "\t\tHeatmap: %s (%s)\n", opts->heatmap,
+                heat_metric_name(opts->heat_metric));
+    }
+    if (opts->farm > 0 || opts->farm_listen != NULL) {
+        fprintf(out, "\t\tFarm: %d workers%s%s\n", opts->farm,
+                opts->farm_listen != NULL ? ", listening on " : "",
+                opts->farm_listen != NULL ? opts->farm_listen : "");
+    }
+    if (opts->animate != NULL) {
+        fprintf(out, "\t\tAnimation: %s, %d frames to %s\n", opts->animate,
+                opts->frames, opts->frame_name);
+    }
+    if (opts->incremental != NULL) {
+        fprintf(out, "\t\tIncremental: %s\n", opts->incremental);
+    }
+    if (opts->relight != NULL) {
+        fprintf(out, "\t\tRelight cache: %s\n", opts->relight);
+    }
+}
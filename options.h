@@ -0,0 +1,9 @@
+#include "common.h"
+
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+options_t *options_init(int, char **);
+
+void options_dump(FILE *, options_t *);
+#endif
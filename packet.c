@@ -0,0 +1,465 @@
+/*
+ * packet.c
+ *
+ * Intersection kernels that test a packet of up to four primary rays
+ * against one sphere, plane or fplane at a time.  AVX2 and SSE2 versions
+ * are picked at run time from what the cpu supports, and anything else
+ * falls back to calling each object's hits function once per ray.
+ *
+ * The kernels do the same double precision operations in the same order
+ * as hits_sphere, hits_plane and hits_fplane, so a packet finds exactly
+ * the hits that single rays would.  That only holds if the compiler
+ * doesn't fuse multiplies and adds in the scalar code, so don't build
+ * with -ffp-contract=fast on cpus with FMA.
+ *
+ * Chris Blades
+ *
+ * 18/10/2026
+ */
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "common.h"
+#include "sphere.h"
+#include "plane.h"
+#include "fplane.h"
+#include "veclib3d.h"
+#include "packet.h"
+#include "stats.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PACKET_X86
+#endif
+
+/* instruction sets a kernel can be written in */
+#define ISA_SCALAR  0
+#define ISA_SSE2    1
+#define ISA_AVX2    2
+
+static char *isa_names[] = { "scalar", "sse2", "avx2" };
+
+/* kernels find the hit distance for every ray in a packet */
+typedef void (*kernel_t)(packet_t *, obj_t *, double *);
+
+/* selected kernels, indexed by shape */
+#define KERNEL_SPHERE   0
+#define KERNEL_PLANE    1
+#define KERNEL_FPLANE   2
+#define NUM_KERNELS     3
+
+static int      isa = ISA_SCALAR;
+static kernel_t kernels[NUM_KERNELS];
+
+/*
+ * Scalar kernel, calls the object's hits function for each ray.
+ *
+ * PARAMETERS:
+ *  pk      - packet of rays
+ *  obj     - object to test
+ *  t       - distance to the hit for each ray, or -1
+ */
+static void hits_scalar(packet_t *pk, obj_t *obj, double *t) {
+    int i;
+
+    for (i = 0; i < pk->n; i++) {
+        t[i] = obj->ops->hits(pk->base, pk->dir[i], obj);
+    }
+}
+
+#ifdef PACKET_X86
+/*
+ * AVX2 sphere kernel, see hits_sphere.
+ *
+ * PARAMETERS:
+ *  pk      - packet of rays
+ *  obj     - sphere to test
+ *  t       - distance to the hit for each ray, or -1
+ */
+__attribute__((target("avx2")))
+static void sphere_avx2(packet_t *pk, obj_t *obj, double *t) {
+    sphere_t *sphere = (sphere_t *)obj->priv;
+    double    Vprime[3];
+    __m256d   dx = _mm256_loadu_pd(pk->soa[0]);
+    __m256d   dy = _mm256_loadu_pd(pk->soa[1]);
+    __m256d   dz = _mm256_loadu_pd(pk->soa[2]);
+    __m256d   a, b, c, disc, res;
+
+    vec_diff3(sphere->center, pk->base, Vprime);
+
+    a = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx),
+                                    _mm256_mul_pd(dy, dy)),
+                      _mm256_mul_pd(dz, dz));
+    b = _mm256_add_pd(_mm256_add_pd(
+                _mm256_mul_pd(_mm256_set1_pd(Vprime[0]), dx),
+                _mm256_mul_pd(_mm256_set1_pd(Vprime[1]), dy)),
+                _mm256_mul_pd(_mm256_set1_pd(Vprime[2]), dz));
+    b = _mm256_mul_pd(_mm256_set1_pd(2.0), b);
+    c = _mm256_set1_pd(vec_dot3(Vprime, Vprime) -
+                       sphere->radius * sphere->radius);
+
+    disc = _mm256_sub_pd(_mm256_mul_pd(b, b),
+                         _mm256_mul_pd(_mm256_mul_pd(_mm256_set1_pd(4.0), a),
+                                       c));
+    res = _mm256_div_pd(_mm256_sub_pd(_mm256_mul_pd(b, _mm256_set1_pd(-1.0)),
+                                      _mm256_sqrt_pd(disc)),
+                        _mm256_mul_pd(_mm256_set1_pd(2.0), a));
+
+    // rays that miss the sphere get -1
+    res = _mm256_blendv_pd(_mm256_set1_pd(-1.0), res,
+                    _mm256_cmp_pd(disc, _mm256_setzero_pd(), _CMP_GT_OQ));
+    _mm256_storeu_pd(t, res);
+}
+
+/*
+ * AVX2 plane kernel, see hits_plane.
+ *
+ * PARAMETERS:
+ *  pk      - packet of rays
+ *  obj     - plane to test
+ *  t       - distance to the hit for each ray, or -1
+ */
+__attribute__((target("avx2")))
+static void plane_avx2(packet_t *pk, obj_t *obj, double *t) {
+    plane_t *plane = (plane_t *)obj->priv;
+    double   NdotQ = vec_dot3(plane->normal, plane->point);
+    double   NdotV = vec_dot3(plane->normal, pk->base);
+    __m256d  dx = _mm256_loadu_pd(pk->soa[0]);
+    __m256d  dy = _mm256_loadu_pd(pk->soa[1]);
+    __m256d  dz = _mm256_loadu_pd(pk->soa[2]);
+    __m256d  NdotD, res, hz, hit;
+
+    NdotD = _mm256_add_pd(_mm256_add_pd(
+                _mm256_mul_pd(_mm256_set1_pd(plane->normal[0]), dx),
+                _mm256_mul_pd(_mm256_set1_pd(plane->normal[1]), dy)),
+                _mm256_mul_pd(_mm256_set1_pd(plane->normal[2]), dz));
+    res = _mm256_div_pd(_mm256_set1_pd(NdotQ - NdotV), NdotD);
+
+    // z of the hit point, which has to be behind the screen
+    hz = _mm256_add_pd(_mm256_set1_pd(pk->base[2]), _mm256_mul_pd(res, dz));
+
+    hit = _mm256_cmp_pd(NdotD, _mm256_setzero_pd(), _CMP_NEQ_UQ);
+    hit = _mm256_and_pd(hit, _mm256_cmp_pd(res, _mm256_set1_pd(0.0001),
+                                           _CMP_GE_OQ));
+    hit = _mm256_and_pd(hit, _mm256_cmp_pd(hz, _mm256_setzero_pd(),
+                                           _CMP_LT_OQ));
+    _mm256_storeu_pd(t, _mm256_blendv_pd(_mm256_set1_pd(-1.0), res, hit));
+}
+
+/*
+ * AVX2 fplane kernel, see hits_fplane.
+ *
+ * PARAMETERS:
+ *  pk      - packet of rays
+ *  obj     - fplane to test
+ *  t       - distance to the hit for each ray, or -1
+ */
+__attribute__((target("avx2")))
+static void fplane_avx2(packet_t *pk, obj_t *obj, double *t) {
+    plane_t  *plane  = (plane_t *)obj->priv;
+    fplane_t *fplane = (fplane_t *)plane->priv;
+    __m256d   res, nx, ny, nz, x, y, hit;
+    __m256d   zero = _mm256_setzero_pd();
+
+    plane_avx2(pk, obj, t);
+    res = _mm256_loadu_pd(t);
+
+    // hit point relative to the plane's origin
+    nx = _mm256_sub_pd(_mm256_add_pd(_mm256_set1_pd(pk->base[0]),
+                        _mm256_mul_pd(res, _mm256_loadu_pd(pk->soa[0]))),
+                       _mm256_set1_pd(plane->point[0]));
+    ny = _mm256_sub_pd(_mm256_add_pd(_mm256_set1_pd(pk->base[1]),
+                        _mm256_mul_pd(res, _mm256_loadu_pd(pk->soa[1]))),
+                       _mm256_set1_pd(plane->point[1]));
+    nz = _mm256_sub_pd(_mm256_add_pd(_mm256_set1_pd(pk->base[2]),
+                        _mm256_mul_pd(res, _mm256_loadu_pd(pk->soa[2]))),
+                       _mm256_set1_pd(plane->point[2]));
+
+    // rotate into the plane's x and y
+    x = _mm256_add_pd(_mm256_add_pd(
+            _mm256_mul_pd(_mm256_set1_pd(fplane->rotmat[0][0]), nx),
+            _mm256_mul_pd(_mm256_set1_pd(fplane->rotmat[0][1]), ny)),
+            _mm256_mul_pd(_mm256_set1_pd(fplane->rotmat[0][2]), nz));
+    y = _mm256_add_pd(_mm256_add_pd(
+            _mm256_mul_pd(_mm256_set1_pd(fplane->rotmat[1][0]), nx),
+            _mm256_mul_pd(_mm256_set1_pd(fplane->rotmat[1][1]), ny)),
+            _mm256_mul_pd(_mm256_set1_pd(fplane->rotmat[1][2]), nz));
+
+    hit = _mm256_cmp_pd(res, _mm256_set1_pd(0.00001), _CMP_GE_OQ);
+    hit = _mm256_and_pd(hit, _mm256_cmp_pd(x, zero, _CMP_GE_OQ));
+    hit = _mm256_and_pd(hit, _mm256_cmp_pd(x,
+                _mm256_set1_pd(fplane->size[0]), _CMP_LE_OQ));
+    hit = _mm256_and_pd(hit, _mm256_cmp_pd(y, zero, _CMP_GE_OQ));
+    hit = _mm256_and_pd(hit, _mm256_cmp_pd(y,
+                _mm256_set1_pd(fplane->size[1]), _CMP_LE_OQ));
+    _mm256_storeu_pd(t, _mm256_blendv_pd(_mm256_set1_pd(-1.0), res, hit));
+}
+
+/*
+ * SSE2 sphere kernel, see hits_sphere.  Works on two rays at a time.
+ *
+ * PARAMETERS:
+ *  pk      - packet of rays
+ *  obj     - sphere to test
+ *  t       - distance to the hit for each ray, or -1
+ */
+static void sphere_sse2(packet_t *pk, obj_t *obj, double *t) {
+    sphere_t *sphere = (sphere_t *)obj->priv;
+    double    Vprime[3];
+    __m128d   dx, dy, dz, a, b, c, disc, res, hit;
+    int       i;
+
+    vec_diff3(sphere->center, pk->base, Vprime);
+    c = _mm_set1_pd(vec_dot3(Vprime, Vprime) -
+                    sphere->radius * sphere->radius);
+
+    for (i = 0; i < PACKET_SIZE; i += 2) {
+        dx = _mm_loadu_pd(pk->soa[0] + i);
+        dy = _mm_loadu_pd(pk->soa[1] + i);
+        dz = _mm_loadu_pd(pk->soa[2] + i);
+
+        a = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)),
+                       _mm_mul_pd(dz, dz));
+        b = _mm_add_pd(_mm_add_pd(_mm_mul_pd(_mm_set1_pd(Vprime[0]), dx),
+                                  _mm_mul_pd(_mm_set1_pd(Vprime[1]), dy)),
+                       _mm_mul_pd(_mm_set1_pd(Vprime[2]), dz));
+        b = _mm_mul_pd(_mm_set1_pd(2.0), b);
+
+        disc = _mm_sub_pd(_mm_mul_pd(b, b),
+                          _mm_mul_pd(_mm_mul_pd(_mm_set1_pd(4.0), a), c));
+        res = _mm_div_pd(_mm_sub_pd(_mm_mul_pd(b, _mm_set1_pd(-1.0)),
+                                    _mm_sqrt_pd(disc)),
+                         _mm_mul_pd(_mm_set1_pd(2.0), a));
+
+        hit = _mm_cmpgt_pd(disc, _mm_setzero_pd());
+        res = _mm_or_pd(_mm_and_pd(hit, res),
+                        _mm_andnot_pd(hit, _mm_set1_pd(-1.0)));
+        _mm_storeu_pd(t + i, res);
+    }
+}
+
+/*
+ * SSE2 plane kernel, see hits_plane.  Works on two rays at a time.
+ *
+ * PARAMETERS:
+ *  pk      - packet of rays
+ *  obj     - plane to test
+ *  t       - distance to the hit for each ray, or -1
+ */
+static void plane_sse2(packet_t *pk, obj_t *obj, double *t) {
+    plane_t *plane = (plane_t *)obj->priv;
+    double   NdotQ = vec_dot3(plane->normal, plane->point);
+    double   NdotV = vec_dot3(plane->normal, pk->base);
+    __m128d  dx, dy, dz, NdotD, res, hz, hit;
+    int      i;
+
+    for (i = 0; i < PACKET_SIZE; i += 2) {
+        dx = _mm_loadu_pd(pk->soa[0] + i);
+        dy = _mm_loadu_pd(pk->soa[1] + i);
+        dz = _mm_loadu_pd(pk->soa[2] + i);
+
+        NdotD = _mm_add_pd(_mm_add_pd(
+                    _mm_mul_pd(_mm_set1_pd(plane->normal[0]), dx),
+                    _mm_mul_pd(_mm_set1_pd(plane->normal[1]), dy)),
+                    _mm_mul_pd(_mm_set1_pd(plane->normal[2]), dz));
+        res = _mm_div_pd(_mm_set1_pd(NdotQ - NdotV), NdotD);
+        hz = _mm_add_pd(_mm_set1_pd(pk->base[2]), _mm_mul_pd(res, dz));
+
+        hit = _mm_cmpneq_pd(NdotD, _mm_setzero_pd());
+        hit = _mm_and_pd(hit, _mm_cmpge_pd(res, _mm_set1_pd(0.0001)));
+        hit = _mm_and_pd(hit, _mm_cmplt_pd(hz, _mm_setzero_pd()));
+        res = _mm_or_pd(_mm_and_pd(hit, res),
+                        _mm_andnot_pd(hit, _mm_set1_pd(-1.0)));
+        _mm_storeu_pd(t + i, res);
+    }
+}
+
+/*
+ * SSE2 fplane kernel, see hits_fplane.  Works on two rays at a time.
+ *
+ * PARAMETERS:
+ *  pk      - packet of rays
+ *  obj     - fplane to test
+ *  t       - distance to the hit for each ray, or -1
+ */
+static void fplane_sse2(packet_t *pk, obj_t *obj, double *t) {
+    plane_t  *plane  = (plane_t *)obj->priv;
+    fplane_t *fplane = (fplane_t *)plane->priv;
+    __m128d   res, nx, ny, nz, x, y, hit;
+    __m128d   zero = _mm_setzero_pd();
+    int       i;
+
+    plane_sse2(pk, obj, t);
+
+    for (i = 0; i < PACKET_SIZE; i += 2) {
+        res = _mm_loadu_pd(t + i);
+
+        nx = _mm_sub_pd(_mm_add_pd(_mm_set1_pd(pk->base[0]),
+                            _mm_mul_pd(res, _mm_loadu_pd(pk->soa[0] + i))),
+                        _mm_set1_pd(plane->point[0]));
+        ny = _mm_sub_pd(_mm_add_pd(_mm_set1_pd(pk->base[1]),
+                            _mm_mul_pd(res, _mm_loadu_pd(pk->soa[1] + i))),
+                        _mm_set1_pd(plane->point[1]));
+        nz = _mm_sub_pd(_mm_add_pd(_mm_set1_pd(pk->base[2]),
+                            _mm_mul_pd(res, _mm_loadu_pd(pk->soa[2] + i))),
+                        _mm_set1_pd(plane->point[2]));
+
+        x = _mm_add_pd(_mm_add_pd(
+                _mm_mul_pd(_mm_set1_pd(fplane->rotmat[0][0]), nx),
+                _mm_mul_pd(_mm_set1_pd(fplane->rotmat[0][1]), ny)),
+                _mm_mul_pd(_mm_set1_pd(fplane->rotmat[0][2]), nz));
+        y = _mm_add_pd(_mm_add_pd(
+                _mm_mul_pd(_mm_set1_pd(fplane->rotmat[1][0]), nx),
+                _mm_mul_pd(_mm_set1_pd(fplane->rotmat[1][1]), ny)),
+                _mm_mul_pd(_mm_set1_pd(fplane->rotmat[1][2]), nz));
+
+        hit = _mm_cmpge_pd(res, _mm_set1_pd(0.00001));
+        hit = _mm_and_pd(hit, _mm_cmpge_pd(x, zero));
+        hit = _mm_and_pd(hit, _mm_cmple_pd(x, _mm_set1_pd(fplane->size[0])));
+        hit = _mm_and_pd(hit, _mm_cmpge_pd(y, zero));
+        hit = _mm_and_pd(hit, _mm_cmple_pd(y, _mm_set1_pd(fplane->size[1])));
+        res = _mm_or_pd(_mm_and_pd(hit, res),
+                        _mm_andnot_pd(hit, _mm_set1_pd(-1.0)));
+        _mm_storeu_pd(t + i, res);
+    }
+}
+#endif
+
+/*
+ * Select the kernels to trace packets with.
+ *
+ * PARAMETERS:
+ *  name    - "auto" for the best the cpu supports, or one of "avx2",
+ *            "sse2" or "scalar"
+ *
+ * RETURNS:
+ *  0 on success, -1 if name is unknown or not supported by the cpu
+ */
+int packet_select(char *name) {
+    int want = -1;          // requested instruction set
+    int best = ISA_SCALAR;  // best instruction set the cpu has
+    int i;
+
+#ifdef PACKET_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        best = ISA_SSE2;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        best = ISA_AVX2;
+    }
+#endif
+
+    if (strcmp(name, "auto") == 0) {
+        want = best;
+    }
+    for (i = 0; i <= ISA_AVX2; i++) {
+        if (strcmp(name, isa_names[i]) == 0) {
+            want = i;
+        }
+    }
+    if (want < 0 || want > best) {
+        return -1;
+    }
+
+    isa = want;
+    for (i = 0; i < NUM_KERNELS; i++) {
+        kernels[i] = hits_scalar;
+    }
+#ifdef PACKET_X86
+    if (isa == ISA_AVX2) {
+        kernels[KERNEL_SPHERE] = sphere_avx2;
+        kernels[KERNEL_PLANE]  = plane_avx2;
+        kernels[KERNEL_FPLANE] = fplane_avx2;
+    } else if (isa == ISA_SSE2) {
+        kernels[KERNEL_SPHERE] = sphere_sse2;
+        kernels[KERNEL_PLANE]  = plane_sse2;
+        kernels[KERNEL_FPLANE] = fplane_sse2;
+    }
+#endif
+
+    return 0;
+}
+
+/*
+ * Name of the instruction set packets are traced with.
+ *
+ * RETURNS:
+ *  name of the selected kernels
+ */
+char *packet_isa(void) {
+    return isa_names[isa];
+}
+
+/*
+ * Start a packet of primary rays.
+ *
+ * PARAMETERS:
+ *  pk      - packet to initialize, the caller fills in dir
+ *  base    - origin of every ray
+ *  n       - number of rays
+ */
+void packet_init(packet_t *pk, double *base, int n) {
+    int i;
+
+    pk->n = n;
+    pk->base[0] = base[0];
+    pk->base[1] = base[1];
+    pk->base[2] = base[2];
+
+    for (i = 0; i < PACKET_SIZE; i++) {
+        pk->closest[i] = NULL;
+        pk->t[i] = -1;
+    }
+}
+
+/*
+ * Test the active rays of a packet against an object, keeping the closest
+ * hit of each ray.  Ties go to the object loaded first, like bvh_closest.
+ *
+ * PARAMETERS:
+ *  pk      - packet of rays, dir and soa must be filled in
+ *  obj     - object to test
+ *  mask    - bit i set if ray i is to be tested
+ */
+void packet_test(packet_t *pk, obj_t *obj, int mask) {
+    double   t[PACKET_SIZE];
+    kernel_t kernel = hits_scalar;
+    int      i;
+
+    // the kernels only know plain shapes, anything else goes ray by ray
+    if (obj->ops->hits == hits_sphere) {
+        kernel = kernels[KERNEL_SPHERE];
+    } else if (obj->ops->hits == hits_plane) {
+        kernel = kernels[KERNEL_PLANE];
+    } else if (obj->ops->hits == hits_fplane) {
+        kernel = kernels[KERNEL_FPLANE];
+    }
+
+    // a lone ray isn't worth a vector kernel
+    if ((mask & (mask - 1)) == 0) {
+        for (i = 0; i < pk->n; i++) {
+            t[i] = -1;
+            if (mask & (1 << i)) {
+                t[i] = obj->ops->hits(pk->base, pk->dir[i], obj);
+            }
+        }
+    } else {
+        kernel(pk, obj, t);
+    }
+
+    for (i = 0; i < pk->n; i++) {
+        if (!(mask & (1 << i))) {
+            continue;
+        }
+        STATS_TEST(obj->objtype, t[i] > 0);
+        if (!(t[i] > 0)) {
+            continue;
+        }
+        if (pk->closest[i] == NULL || t[i] < pk->t[i] ||
+            (t[i] == pk->t[i] && obj->objid < pk->closest[i]->objid)) {
+            pk->closest[i] = obj;
+            pk->t[i] = t[i];
+        }
+    }
+}
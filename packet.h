@@ -0,0 +1,26 @@
+#include "common.h"
+
+#ifndef PACKET_H
+#define PACKET_H
+
+#define PACKET_SIZE 4
+
+/* primary rays from neighbouring pixels traced together, they all start
+ * at the view point */
+typedef struct packet_type {
+    int     n;                          /* number of rays in use */
+    double  base[3];                    /* origin shared by every ray */
+    double  dir[PACKET_SIZE][3];        /* direction of each ray */
+    double  soa[3][PACKET_SIZE];        /* the same directions by axis */
+    obj_t  *closest[PACKET_SIZE];       /* closest object each ray hits */
+    double  t[PACKET_SIZE];             /* distance to it, -1 for none */
+} packet_t;
+
+int packet_select(char *);
+
+char *packet_isa(void);
+
+void packet_init(packet_t *, double *, int);
+
+void packet_test(packet_t *, obj_t *, int);
+#endif
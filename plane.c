@@ -15,68 +15,50 @@
 #include "material.h"
 #include "veclib3d.h"
 
+/* functions of every plane */
+static const obj_ops_t plane_ops = {
+    hits_plane, plane_hitinfo, shade_default,
+    getamb_default, getdif_default, getspec_default,
+    NULL, plane_dump, NULL
+};
+
 /**
  * Initialize a plane object from a file.
  *
  * PARAMETERS:
- *  in      - file to read from
+ *  scan    - scanner to read from
  *  objtype - type of object to initalize
  *
  *  RETURNS:
  *  the newly created object
  */
-obj_t * plane_init(FILE *in, int objtype) {
-    obj_t *obj = object_init(in, objtype);  // base object struct
-    plane_t *plane = (plane_t *)smalloc(sizeof(plane_t));   // new plane struct
+obj_t * plane_init(scan_t *scan, int objtype) {
+    obj_t *obj = object_init(scan, objtype);  // base object struct
+    plane_t *plane = (plane_t *)object_alloc(sizeof(plane_t));  // new plane
 
-    material_init(in, &obj->material);
+    material_init(scan, &obj->material);
     plane->priv = NULL;
     obj->priv = plane;      // connect plane to obj
-    obj->hits = hits_plane; // connect hits function
-    obj->dump = plane_dump;
-    obj->obj_free = plane_free;
-
-    char    buf[256];       // buffer for reading in values
-    int     rc = 0;         // read counter
+    plane_bind(obj);        // connect plane functions
 
     // read in normal
-    while (rc != 3) {
-        rc = fscanf(in, "%lf %lf %lf", plane->normal,
-                                       (plane->normal + 1),
-                                       (plane->normal + 2));
-        vec_unit3(plane->normal, plane->normal);
-        fgets(buf, 256, in);
-#ifdef DEBUG_OBJECTS
-        fprintf(stderr, "plane read %s\n", buf);
-#endif
-    }
+    scan_doubles(scan, plane->normal, 3, "plane normal");
+    vec_unit3(plane->normal, plane->normal);
 
-    rc = 0;
     // read in point
-    while (rc != 3) {
-        rc = fscanf(in, "%lf %lf %lf", plane->point, (plane->point + 1),
-                                        (plane->point + 2));
-        fgets(buf, 256, in);
-#ifdef DEBUG_OBJECTS
-        fprintf(stderr, "plane read %s\n", buf);
-#endif
-    }
+    scan_doubles(scan, plane->point, 3, "plane point");
 
     return obj;
 }
 
 /*
- * Free a plane structure, free priv pointer and then call obj_free.
+ * Connect the function table of a plane object.
  *
- * PARAMETER:
- *  obj -   plane object to free
+ * PARAMETERS:
+ *  obj -   object to bind
  */
-void plane_free(obj_t *obj) {
-    plane_t *plane = (plane_t *)(obj->priv);
-    if (plane->priv != NULL) {
-        free(plane->priv);
-    }
-    obj_free(obj);
+void plane_bind(obj_t *obj) {
+    obj->ops = &plane_ops;
 }
 
 /**
@@ -142,14 +124,27 @@ double hits_plane(double *base, double *dir, obj_t *obj) {
         return -1;
     }
 
-    obj->hitloc[0] = H[0];
-    obj->hitloc[1] = H[1];
-    obj->hitloc[2] = H[2];
+    return t;
+}
+
+/*
+ * Fills in the hit point and normal for a ray that hits a plane.
+ *
+ * PARAMETERS:
+ * base -   starting point of ray
+ * dir  -   direction of ray
+ * obj  -   plane that was hit
+ * hit  -   hit record holding the distance, filled in with the rest
+ */
+void plane_hitinfo(double *base, double *dir, obj_t *obj, hit_t *hit) {
+    plane_t *plane = (plane_t *)obj->priv;                  // plane struct
+    double tD[3];
 
-    obj->normal[0] = plane->normal[0];
-    obj->normal[1] = plane->normal[1];
-    obj->normal[2] = plane->normal[2];
+    vec_scale3(hit->t, dir, tD);
+    vec_sum3(base, tD, hit->hitloc);
 
-    return t;
+    hit->normal[0] = plane->normal[0];
+    hit->normal[1] = plane->normal[1];
+    hit->normal[2] = plane->normal[2];
 }
 
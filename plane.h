@@ -4,11 +4,14 @@
 #ifndef PLANE_H
 #define PLANE_H
 
-obj_t *plane_init(FILE *, int);
+obj_t *plane_init(scan_t *, int);
+
+void plane_bind(obj_t *);
 
-void plane_free(obj_t *);
 
 void plane_dump(FILE *, obj_t *);
 
 double hits_plane(double *, double *, obj_t *);
+
+void plane_hitinfo(double *, double *, obj_t *, hit_t *);
 #endif
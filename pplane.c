@@ -19,47 +19,73 @@
 
 
 /**
- * Function table that holds pointers to shader functions
+ * Function tables of pplanes, one per shader
  */
-static void (*plane_shaders[])(obj_t *, double *) =
+static const obj_ops_t plane_shaders[] =
 {
-    &pplane0_amb,
-    &pplane1_amb
+    { hits_plane, plane_hitinfo, shade_getters,
+      &pplane0_amb, getdif_default, getspec_default,
+      NULL, plane_dump, NULL },
+    { hits_plane, plane_hitinfo, shade_getters,
+      &pplane1_amb, getdif_default, getspec_default,
+      NULL, plane_dump, NULL }
 };
-#define PLANE_NUM_SHADERS sizeof(plane_shaders) / sizeof(void *)
+#define PLANE_NUM_SHADERS sizeof(plane_shaders) / sizeof(obj_ops_t)
 
 /**
  * Initialize a plane object from a file.
  *
  * PARAMETERS:
- *  in      - file to read from
+ *  scan    - scanner to read from
  *  objtype - type of object to initalize
  *
  *  RETURNS:
  *  the newly created object
  */
-obj_t * pplane_init(FILE *in, int objtype) {
-    obj_t *obj = plane_init(in, objtype);  // base object struct
-    char    buf[256];       // buffer for reading in values
-    int     rc = 0;         // read counter
+obj_t * pplane_init(scan_t *scan, int objtype) {
+    obj_t *obj = plane_init(scan, objtype);  // base object struct
     int     sndx = -1;      // shader index
 
     // read in shader index
-    while (rc != 1) {
-        rc = fscanf(in, "%d", &sndx);
-        fgets(buf, 256, in);
-#ifdef DEBUG_OBJECTS
-        fprintf(stderr, "pplane read %s\n", buf);
-#endif
-    }
-    
+    scan_ints(scan, &sndx, 1, "shader index");
+    pplane_shade(obj, sndx);
+    return obj;
+}
+
+/*
+ * Connect one of the procedural shaders to a pplane object.
+ *
+ * PARAMETERS:
+ *  obj     - pplane object to shade
+ *  sndx    - index of the shader
+ */
+void pplane_shade(obj_t *obj, int sndx) {
     if (sndx >= PLANE_NUM_SHADERS || sndx < 0) {
         fprintf(stderr, "Invalid shader index given: %d\n", sndx);
         exit(EXIT_FAILURE);
     } else {
-        obj->getamb = plane_shaders[sndx];
+        obj->ops = &plane_shaders[sndx];
     }
-    return obj;
+}
+
+/*
+ * Find the index of the procedural shader connected to a pplane object.
+ *
+ * PARAMETERS:
+ *  obj     - pplane object
+ *
+ * RETURNS:
+ *  index of the shader, -1 if it has none
+ */
+int pplane_shader(obj_t *obj) {
+    int sndx;
+
+    for (sndx = 0; sndx < PLANE_NUM_SHADERS; sndx++) {
+        if (obj->ops == &plane_shaders[sndx]) {
+            return sndx;
+        }
+    }
+    return -1;
 }
 
 /*
@@ -67,21 +93,22 @@ obj_t * pplane_init(FILE *in, int objtype) {
  *
  * PARAMETERS:
  *  obj     - the plane object to shade
+ *  hit     - hit point on the plane
  *  value   - intensity vector
  */
-void pplane0_amb(obj_t *obj, double *value) {
+void pplane0_amb(obj_t *obj, hit_t *hit, double *value) {
     double vec[3];
     plane_t *p = (plane_t *)(obj->priv);
     int distanceX, distanceY;
     
     // find x distance
-    getamb_default(obj, value);
-    vec_diff3(p->point, obj->hitloc, vec);
+    getamb_default(obj, hit, value);
+    vec_diff3(p->point, hit->hitloc, vec);
     vec[1] = 0;
     distanceX = (int)vec_length3(vec);
     
     // find y distance
-    vec_diff3(p->point, obj->hitloc, vec);
+    vec_diff3(p->point, hit->hitloc, vec);
     vec[0] = 0;
     distanceY = (int)vec_length3(vec);
 
@@ -99,16 +126,17 @@ void pplane0_amb(obj_t *obj, double *value) {
  *
  * PARAMETERS:
  *  obj     - the plane object to shade
+ *  hit     - hit point on the plane
  *  value   - intensity vector
  */
-void pplane1_amb(obj_t *obj, double *value) {
+void pplane1_amb(obj_t *obj, hit_t *hit, double *value) {
     double vec[3];
     plane_t *p = (plane_t *)(obj->priv);
     double distanceX;
     
     // find x distance
-    getamb_default(obj, value);
-    vec_diff3(p->point, obj->hitloc, vec);
+    getamb_default(obj, hit, value);
+    vec_diff3(p->point, hit->hitloc, vec);
     vec[1] = 0;
     distanceX = (int)vec_length3(vec);
     distanceX = distanceX / 10;
@@ -3,10 +3,14 @@
 
 #ifndef PPLANE_H
 #define PPLANE_H
-obj_t *pplane_init(FILE *, int);
+obj_t *pplane_init(scan_t *, int);
 
-void pplane0_amb(obj_t *, double *);
+void pplane_shade(obj_t *, int);
 
-void pplane1_amb(obj_t *, double *);
+int pplane_shader(obj_t *);
+
+void pplane0_amb(obj_t *, hit_t *, double *);
+
+void pplane1_amb(obj_t *, hit_t *, double *);
 
 #endif
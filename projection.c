@@ -9,10 +9,11 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 #include "common.h"
 #include "safe.h"
-
-static proj_t *projection;
+#include "scan.h"
+#include "ray.h"
 
 /*
  * initialize a projection struct from a file and command line arguments.
@@ -20,50 +21,97 @@ static proj_t *projection;
  * PARAMETERS:
  * argc - number of command line arguments
  * argv - array of command line arguments
- * in   - file to read from
+ * scan - scanner to read from
  *
  * RETURNS:
  * an initialized projection struct
  */
-proj_t *projection_init(int argc, char **argv, FILE *in) {
-    char buf[256];      // buffer for reading in
-    int  rc      = 0;   // read counter
-
+proj_t *projection_init(int argc, char **argv, scan_t *scan) {
     // new projection struct
     proj_t *proj = (proj_t *)smalloc(sizeof(proj_t));
 
     // read in read in size of world
-    while (rc != 2) {
-        rc = fscanf(in, "%lf %lf", proj->win_size_world,
-                                   (proj->win_size_world + 1));
-        fgets(buf, 256, in);
-#ifdef DEBUG_OBJECTS
-        fprintf(stderr, "projection read %s\n", buf);
-#endif
-    }
-
-    rc = 0;
+    scan_doubles(scan, proj->win_size_world, 2, "world size");
 
     // read in view point location
-    while (rc != 3) {
-        rc = fscanf(in, "%lf %lf %lf", proj->view_point,
-                                   (proj->view_point + 1),
-                                   (proj->view_point + 2));
-        fgets(buf, 256, in);
-#ifdef DEBUG_OBJECTS
-        fprintf(stderr, "projection read %s\n", buf);
-#endif
-    }
+    scan_doubles(scan, proj->view_point, 3, "view point");
 
     // copy size of screen in pixels from command line args
     proj->win_size_pixel[0] = atoi(argv[1]);
     proj->win_size_pixel[1] = atoi(argv[2]);
-    
-    projection = proj;
+
+    // render limits, unless the scene has a limits record
+    proj->max_depth  = DEFAULT_MAX_DEPTH;
+    proj->max_dist   = DEFAULT_MAX_DIST;
+    proj->min_weight = 0.0;
+    proj->roulette   = 0;
     
     return proj;
 }
 
+/*
+ * initialize a projection struct as a copy of another, image size and
+ * all.
+ *
+ * PARAMETERS:
+ * stored - projection to copy
+ *
+ * RETURNS:
+ * an initialized projection struct
+ */
+proj_t *projection_copy(proj_t *stored) {
+    // new projection struct
+    proj_t *proj = (proj_t *)smalloc(sizeof(proj_t));
+
+    *proj = *stored;
+
+    return proj;
+}
+
+/*
+ * initialize a projection struct from one stored in a compiled scene and
+ * command line arguments.
+ *
+ * PARAMETERS:
+ * argc   - number of command line arguments
+ * argv   - array of command line arguments
+ * stored - projection read from the compiled scene
+ *
+ * RETURNS:
+ * an initialized projection struct
+ */
+proj_t *projection_load(int argc, char **argv, proj_t *stored) {
+    proj_t *proj = projection_copy(stored);
+
+    // the image size always comes from the command line
+    proj->win_size_pixel[0] = atoi(argv[1]);
+    proj->win_size_pixel[1] = atoi(argv[2]);
+
+    return proj;
+}
+
+/*
+ * Read a scene's limits record, which bounds the reflections traced:
+ *     <max depth>
+ *     <max distance>
+ *     <min weight>
+ *     <russian roulette, 0 or 1>
+ *
+ * PARAMETERS:
+ * scan - scanner to read from, just past the record's type
+ * proj - projection to store the limits in
+ */
+void projection_limits(scan_t *scan, proj_t *proj) {
+    scan_ints(scan, &proj->max_depth, 1, "max depth");
+    scan_doubles(scan, &proj->max_dist, 1, "max distance");
+    scan_doubles(scan, &proj->min_weight, 1, "min weight");
+    scan_ints(scan, &proj->roulette, 1, "russian roulette");
+
+    if (proj->max_depth < 1) {
+        scan_error(scan, "Max depth must be at least 1: %d", proj->max_depth);
+    }
+}
+
 /**
  * Print information about a projection structure.
  *
@@ -82,6 +130,9 @@ void projection_dump(FILE *out, proj_t *proj) {
     fprintf(out, "\t\tViewpoint: (%lf, %lf, %lf)\n",  proj->view_point[0],
                                                     proj->view_point[1],
                                                     proj->view_point[2]);
+    fprintf(out, "\t\tLimits: depth %d, distance %lf, weight %lf%s\n",
+            proj->max_depth, proj->max_dist, proj->min_weight,
+            proj->roulette ? ", russian roulette" : "");
 }
 
 /*
@@ -108,12 +159,54 @@ void map_pix_to_world(proj_t *proj, int x, int y, double *world) {
     *(world + 2) = 0.0;
 }
 
-void map_world_to_pix(double *point, int *pixhit) {
-    *(pixhit + 0) = (projection->win_size_pixel[0] - 1) *  
-                    (*(point + 0) / projection->win_size_world[0]);
+/*
+ * Converts coordinates in the scene to coordinates on the screen, in
+ * pixels.
+ *
+ * PARAMETERS:
+ *  proj    - projection struct
+ *  point   - 3d coordinates in the scene
+ *  pixhit  - array to store screen coordinates in
+ */
+void map_world_to_pix(proj_t *proj, double *point, int *pixhit) {
+    *(pixhit + 0) = (proj->win_size_pixel[0] - 1) *  
+                    (*(point + 0) / proj->win_size_world[0]);
                        
     
-    *(pixhit + 1) = (projection->win_size_pixel[1] - 1) * 
-                    (*(point + 1) / projection->win_size_world[1]);
+    *(pixhit + 1) = (proj->win_size_pixel[1] - 1) * 
+                    (*(point + 1) / proj->win_size_world[1]);
                      
 }
+
+/*
+ * Converts coordinates in the scene to coordinates on the screen, in
+ * pixels, without rounding to whole pixels.
+ *
+ * PARAMETERS:
+ *  proj    - projection struct
+ *  point   - 3d coordinates in the scene
+ *  pix     - array to store screen coordinates in
+ */
+void map_world_to_pixf(proj_t *proj, double *point, double *pix) {
+    *(pix + 0) = (proj->win_size_pixel[0] - 1) *
+                 (*(point + 0) / proj->win_size_world[0]);
+
+    *(pix + 1) = (proj->win_size_pixel[1] - 1) *
+                 (*(point + 1) / proj->win_size_world[1]);
+}
+
+/*
+ * Finds how quickly rays through neighbouring pixels spread apart.
+ *
+ * PARAMETERS:
+ *  proj    - projection struct
+ *
+ * RETURNS:
+ *  the width one pixel covers per unit of distance along a ray
+ */
+double pixel_spread(proj_t *proj) {
+    double pixel = proj->win_size_world[0] / (proj->win_size_pixel[0] - 1);
+    double dist  = fabs(proj->view_point[2]);   // view point to screen
+
+    return dist > 0.0 ? pixel / dist : pixel;
+}
@@ -1,13 +1,24 @@
 #include "common.h"
+#include "scan.h"
 
 #ifndef PROJECTION_H
 #define PROJECTION_H
 
-proj_t *projection_init(int, char **, FILE *);
+proj_t *projection_init(int, char **, scan_t *);
+
+proj_t *projection_load(int, char **, proj_t *);
+
+proj_t *projection_copy(proj_t *);
+
+void projection_limits(scan_t *, proj_t *);
 
 void projection_dump(FILE *, proj_t *);
 
 void map_pix_to_world(proj_t *, int, int, double *);
 
-void map_world_to_pix(double *, int *);
+void map_world_to_pix(proj_t *, double *, int *);
+
+void map_world_to_pixf(proj_t *, double *, double *);
+
+double pixel_spread(proj_t *);
 #endif
@@ -9,6 +9,8 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <math.h>
 #include "common.h"
 #include "object.h"
@@ -20,50 +22,100 @@
 
 
 /**
- * Function table that holds pointers to shader functions
+ * Function tables of pspheres, one per shader
  */
-static void (*sphere_shaders[])(obj_t *, double *) =
+static const obj_ops_t sphere_shaders[] =
 {
-    &psphere0_amb
+    { hits_sphere, sphere_hitinfo, shade_getters,
+      &psphere0_amb, getdif_default, getspec_default,
+      sphere_bounds, sphere_dump, NULL }
 };
-#define PLANE_NUM_SHADERS sizeof(sphere_shaders) / sizeof(void *)
+#define PLANE_NUM_SHADERS sizeof(sphere_shaders) / sizeof(obj_ops_t)
 
 /**
  * Initialize a sphere object from a file.
  *
  * PARAMETERS:
- *  in      - file to read from
+ *  scan    - scanner to read from
  *  objtype - type of object to initalize
  *
  *  RETURNS:
  *  the newly created object
  */
-obj_t * psphere_init(FILE *in, int objtype) {
-    obj_t *obj = sphere_init(in, objtype);  // base object struct
-    char    buf[256];       // buffer for reading in values
-    int     rc = 0;         // read counter
+obj_t * psphere_init(scan_t *scan, int objtype) {
+    obj_t *obj = sphere_init(scan, objtype);  // base object struct
     int     sndx = -1;      // shader index
 
     // read in shader index
-    while (rc != 1) {
-        rc = fscanf(in, "%d", &sndx);
-        fgets(buf, 256, in);
-#ifdef DEBUG_OBJECTS
-        fprintf(stderr, "psphere read %s\n", buf);
-#endif
-    }
-    
+    scan_ints(scan, &sndx, 1, "shader index");
+    psphere_shade(obj, sndx);
+
+    return obj;
+}
+
+/*
+ * Connect one of the procedural shaders to a psphere object.
+ *
+ * PARAMETERS:
+ *  obj     - psphere object to shade
+ *  sndx    - index of the shader
+ */
+void psphere_shade(obj_t *obj, int sndx) {
     if (sndx >= PLANE_NUM_SHADERS || sndx < 0) {
         fprintf(stderr, "Invalid shader index given: %d\n", sndx);
         exit(EXIT_FAILURE);
     } else {
-        obj->getamb = sphere_shaders[sndx];
+        obj->ops = &sphere_shaders[sndx];
     }
-    
-    // seed randomizer for later use
-    srand(1);
+}
 
-    return obj;
+/*
+ * Find the index of the procedural shader connected to a psphere object.
+ *
+ * PARAMETERS:
+ *  obj     - psphere object
+ *
+ * RETURNS:
+ *  index of the shader, -1 if it has none
+ */
+int psphere_shader(obj_t *obj) {
+    int sndx;
+
+    for (sndx = 0; sndx < PLANE_NUM_SHADERS; sndx++) {
+        if (obj->ops == &sphere_shaders[sndx]) {
+            return sndx;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Hash a hit point into a pseudo random number.  Shaders use this instead
+ * of rand() so that a pixel's color doesn't depend on the order pixels are
+ * rendered in.
+ *
+ * PARAMETERS:
+ *  point   - hit point to hash
+ *
+ * RETURNS:
+ *  a non-negative pseudo random number
+ */
+static int psphere_hash(double *point) {
+    uint64_t bits;          // bit pattern of the current coordinate
+    uint64_t hash = 0;      // running hash
+    int      i;
+
+    for (i = 0; i < 3; i++) {
+        memcpy(&bits, point + i, sizeof(bits));
+        hash ^= bits + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+    }
+
+    // final avalanche so nearby points give unrelated results
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+
+    return (int)(hash & 0x7fffffff);
 }
 
 /*
@@ -71,21 +123,22 @@ obj_t * psphere_init(FILE *in, int objtype) {
  *
  * PARAMETERS:
  *  obj     - the sphere object to shade
+ *  hit     - hit point on the sphere
  *  value   - intensity vector
  */
-void psphere0_amb(obj_t *obj, double *value) {
+void psphere0_amb(obj_t *obj, hit_t *hit, double *value) {
     double vec[3];
     sphere_t *p = (sphere_t *)(obj->priv);
     int distance;
     
-    getamb_default(obj, value);   
+    getamb_default(obj, hit, value);   
     
     // find y distance
-    vec_diff3(p->center, obj->hitloc, vec);
+    vec_diff3(p->center, hit->hitloc, vec);
     distance = (int)vec_length3(vec);
        
     if (distance % 2 == 0) {
-        int ran = rand();
+        int ran = psphere_hash(hit->hitloc);
         *(value + (ran % 3)) = 0;
     }
 }
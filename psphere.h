@@ -3,10 +3,14 @@
 
 #ifndef PSPHERE_H
 #define PSPHERE_H
-obj_t *psphere_init(FILE *, int);
+obj_t *psphere_init(scan_t *, int);
 
-void psphere0_amb(obj_t *, double *);
+void psphere_shade(obj_t *, int);
 
-void psphere1_amb(obj_t *, double *);
+int psphere_shader(obj_t *);
+
+void psphere0_amb(obj_t *, hit_t *, double *);
+
+void psphere1_amb(obj_t *, hit_t *, double *);
 
 #endif
@@ -12,112 +12,356 @@
 #include "ray.h"
 #include "veclib3d.h"
 #include "common.h"
+#include "bvh.h"
+#include "safe.h"
+#include "stats.h"
+#include "projection.h"
+#include "wavefront.h"
+#include "deps.h"
+#include "relight.h"
+
+#define FOOTPRINT_MIN_COS   0.01    /* steepest angle a footprint widens to */
+
 /**
  * Project rays from the view point through the screen to determine the
  * rgb values of that pixel.
  *
  * PARAMETERSS:
  *  model     - contains scene data
+ *  ctx       - state of the calling render thread
  *  base      - origin of ray
  *  dir       - direction of ray
  *  intensity - intensity of rgb values of the pixel
  *  total_dist- the total distance the ray has traveled
  *  last_hit  - location of the rays last hit
  */
-void ray_trace(model_t *model, double base[3], double dir[3], 
-               double intensity[3], double total_dist, obj_t *last_hit) {
-    
-    double ambient[3];      // holds ambient value for rgb at hit point
+void ray_trace(model_t *model, trace_ctx_t *ctx, double base[3],
+               double dir[3], double intensity[3], double total_dist,
+               obj_t *last_hit) {
     obj_t *closest = NULL;  // closest object that ray hits
-    double mindist = 0.0;   // distance from ray origin to hit point
-    double specref[3] = {0.0, 0.0, 0.0};
-    double ref_dir[3];
+    hit_t  hit;             // where the ray hits the closest object
 
-    if (total_dist > MAX_DIST) {
+    if (total_dist > model->proj->max_dist) {
+        STATS_CUTOFF();
         return;
     }
+    STATS_RAY();
 
     // get closet object that is hit
-    closest = find_closest_obj(model->scene, base, dir, last_hit, &mindist);
+    closest = find_closest_obj(model, base, dir, last_hit, &hit);
 
     if (closest == NULL) {
+        if (ctx->deps != NULL) {
+            deps_escape(ctx->deps, dir);
+        }
         return;
     }
+
+    ray_shade(model, ctx, dir, &hit, intensity, total_dist);
+}
+
+/**
+ * Find the reflectivities of the surface at a hit, after working out how
+ * much of the surface the pixel covers there.
+ *
+ * PARAMETERS:
+ *  model     - contains scene data
+ *  dir       - direction of the ray
+ *  hit       - where the ray hit the closest object
+ *  total_dist- the total distance the ray had traveled before the hit
+ *  mat       - material to fill in
+ */
+void ray_material(model_t *model, double *dir, hit_t *hit,
+                  double total_dist, material_t *mat) {
+    obj_t *closest = hit->obj;  // closest object that ray hits
+    double cosine;              // of the angle the ray meets the surface at
+
 #ifdef DEBUG_TRACE
     fprintf(stderr, "closest object=%d\n", closest->objid);
-    fprintf(stderr, "mindist=%lf\n", mindist);
+    fprintf(stderr, "mindist=%lf\n", hit->t);
 #endif
-    closest->getamb(closest, ambient);
-    total_dist += mindist;
+    // a pixel covers more of the surface the further the ray has come
+    // and the more obliquely it meets the surface
+    cosine = fabs(vec_dot3(dir, hit->normal));
+    cosine = cosine < FOOTPRINT_MIN_COS ? FOOTPRINT_MIN_COS : cosine;
+    hit->footprint = (total_dist + hit->t) * pixel_spread(model->proj) /
+                     cosine;
+    hit->proj = model->proj;
+
+    // the material is evaluated once and used for every light and for the
+    // reflection
+    closest->ops->shade(closest, hit, mat);
 
 #ifdef DEBUG_TRACE
-    fprintf(stderr, "Ambient of closest: %lf %lf %lf\n", *(ambient + 0),
-                                                      *(ambient + 1),
-                                                      *(ambient + 2));
+    fprintf(stderr, "Ambient of closest: %lf %lf %lf\n", mat->ambient[0],
+                                                      mat->ambient[1],
+                                                      mat->ambient[2]);
 #endif
+}
+
+/**
+ * Find the light reflected straight off a hit, from ambient and diffuse
+ * lighting, and the specular reflectivity there, given the material
+ * sampled at the hit.
+ *
+ * PARAMETERS:
+ *  model     - contains scene data
+ *  ctx       - state of the calling render thread
+ *  hit       - where the ray hit the closest object
+ *  mat       - reflectivities at the hit point
+ *  frame     - frame to fill in
+ */
+void ray_lighting(model_t *model, trace_ctx_t *ctx, hit_t *hit,
+                  material_t *mat, trace_frame_t *frame) {
+    double mindist = hit->t;    // distance from ray origin to hit point
+    double *intensity = frame->local;
 
-   // set intensity
-   // ambient
-   vec_sum3(ambient, intensity, intensity);
+    // ambient
+    intensity[0] = intensity[1] = intensity[2] = 0.0;
+    vec_sum3(mat->ambient, intensity, intensity);
 
-   // start diffuse...
-   diffuse_illumination(model, closest, intensity); 
+    // diffuse
+    diffuse_illumination(model, ctx, hit, mat->diffuse, intensity); 
 #ifdef DEBUG_DIFFUSE
-   fprintf(stderr, "ray_trace() mindist at end: %f\n", mindist);
+    fprintf(stderr, "ray_trace() mindist at end: %f\n", mindist);
 #endif
-   vec_scale3(1.0 / mindist, intensity, intensity);
-   // end diffuse...
-   
-   // start specular...
-   closest->getspec(closest, specref);
+    vec_scale3(1.0 / mindist, intensity, intensity);
 
+    frame->spec[0] = mat->specular[0];
+    frame->spec[1] = mat->specular[1];
+    frame->spec[2] = mat->specular[2];
+    frame->scale = 1.0;
 #ifdef DEBUG_SPECULAR
-   vec_prn3(stderr, "specreff", specref);
+    vec_prn3(stderr, "specreff", frame->spec);
 #endif
-    
-   if (vec_dot3(specref, specref) > 0.0) {
-        double specint[3] = {0.0, 0.0, 0.0};
-        vec_reflect3(dir, closest->normal, ref_dir);       
+}
+
+/*
+ * Find the light reflected straight off a hit, from ambient and diffuse
+ * lighting, and the specular reflectivity there.
+ *
+ * PARAMETERS:
+ *  model     - contains scene data
+ *  ctx       - state of the calling render thread
+ *  dir       - direction of the ray
+ *  hit       - where the ray hit the closest object
+ *  total_dist- the total distance the ray had traveled before the hit
+ *  frame     - frame to fill in
+ */
+static void ray_local(model_t *model, trace_ctx_t *ctx, double dir[3],
+                      hit_t *hit, double total_dist, trace_frame_t *frame) {
+    material_t mat;         // reflectivities at the hit point
+
+    ray_material(model, dir, hit, total_dist, &mat);
+    if (ctx->relight != NULL) {
+        relight_hit(ctx->relight, hit, &mat);
+    }
+    ray_lighting(model, ctx, hit, &mat, frame);
+}
+
+/*
+ * Uniform random number in [0, 1) for russian roulette.
+ */
+static double ray_random(trace_ctx_t *ctx) {
+    ctx->rng = ctx->rng * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (ctx->rng >> 11) / 9007199254740992.0;
+}
+
+/**
+ * Seed the random numbers a thread uses for one pixel, so a pixel renders
+ * the same whichever thread renders it.
+ *
+ * PARAMETERS:
+ *  ctx     - state of the calling render thread
+ *  x       - x coordinate of the pixel
+ *  y       - y coordinate of the pixel
+ */
+void ray_seed(trace_ctx_t *ctx, int x, int y) {
+    ctx->rng = ((unsigned long long)y << 32 | (unsigned)x) *
+               0x9e3779b97f4a7c15ULL + 1;
+}
+
+/**
+ * Decide whether a path goes on past a hit whose frame is filled in, and
+ * if so take the hit's reflectivity into the weight of the rest of the
+ * path.  A path ends at a hit that isn't specular, or at a render limit:
+ * it has gone too far, reflected too often, or what is left of it can add
+ * too little to the pixel.
+ *
+ * PARAMETERS:
+ *  model     - contains scene data
+ *  ctx       - state of the calling render thread, its random state that
+ *              of the path
+ *  frame     - frame of the hit
+ *  total_dist- the total distance the path has traveled, the hit included
+ *  depth     - hits in the path before this one
+ *  weight    - contribution of the hit to the pixel, updated for the next
+ *
+ * RETURNS:
+ *  1 if a reflected ray should be traced, 0 if the path ends here
+ */
+int ray_reflects(model_t *model, trace_ctx_t *ctx, trace_frame_t *frame,
+                 double total_dist, int depth, double *weight) {
+    proj_t *proj = model->proj;
+    double  most;               // largest channel of weight
+
+    if (vec_dot3(frame->spec, frame->spec) <= 0.0) {
+        return 0;
+    }
+    ctx->rays[RAY_SPECULAR]++;
+
+    if (total_dist > proj->max_dist || depth + 1 >= proj->max_depth) {
+        STATS_CUTOFF();
+        return 0;
+    }
+
+    weight[0] *= frame->spec[0];
+    weight[1] *= frame->spec[1];
+    weight[2] *= frame->spec[2];
+    most = weight[0] > weight[1] ? weight[0] : weight[1];
+    most = most > weight[2] ? most : weight[2];
+
+    // a path that can add little more ends here, or under russian
+    // roulette survives at random and counts for more if it does
+    if (most < proj->min_weight) {
+        if (!proj->roulette ||
+            ray_random(ctx) * proj->min_weight >= most) {
+            STATS_CUTOFF();
+            return 0;
+        }
+        frame->scale = proj->min_weight / most;
+        vec_scale3(frame->scale, weight, weight);
+    }
+    return 1;
+}
+
+/**
+ * Add the light reflected straight off a hit to that of the rest of its
+ * path, reflected off the hit.
+ *
+ * PARAMETERS:
+ *  frame   - frame of the hit
+ *  sum     - light from the rest of the path, replaced by that from the
+ *            hit on
+ */
+void ray_fold(trace_frame_t *frame, double *sum) {
+    if (frame->scale != 1.0) {
+        vec_scale3(frame->scale, sum, sum);
+    }
+    sum[0] = frame->local[0] + frame->spec[0] * sum[0];
+    sum[1] = frame->local[1] + frame->spec[1] * sum[1];
+    sum[2] = frame->local[2] + frame->spec[2] * sum[2];
+}
+
+/**
+ * Find the rgb values for a ray that has hit an object, following the
+ * reflections off specular objects.  The path is traced in a loop, each
+ * hit pushed on the thread's stack, and ends when it leaves the scene, a
+ * hit isn't specular, or it passes a render limit: it has gone too far,
+ * reflected too often, or what is left of it can add too little to the
+ * pixel.  The hits are then summed from the far end back.
+ *
+ * PARAMETERS:
+ *  model     - contains scene data
+ *  ctx       - state of the calling render thread
+ *  dir       - direction of ray
+ *  hit       - where the ray hit the closest object
+ *  intensity - intensity of rgb values of the pixel
+ *  total_dist- the total distance the ray had traveled before the hit
+ */
+void ray_shade(model_t *model, trace_ctx_t *ctx, double *dir, hit_t *hit,
+               double *intensity, double total_dist) {
+    trace_frame_t *frame;
+    hit_t   hits[2];            // hits of the reflected rays, in turn
+    double  dirs[2][3];         // directions of the reflected rays
+    double  weight[3] = {1.0, 1.0, 1.0};    // contribution of the next hit
+    double  sum[3] = {0.0, 0.0, 0.0};       // light from the end of the path
+    int     depth = 0;          // hits in the path, less one
+    int     k;
+
+    for (;;) {
+        frame = &ctx->stack[depth];
+        if (ctx->deps != NULL) {
+            deps_hit(ctx->deps, hit);
+        }
+        ray_local(model, ctx, dir, hit, total_dist, frame);
+        total_dist += hit->t;
+
+        if (!ray_reflects(model, ctx, frame, total_dist, depth, weight)) {
+            break;
+        }
+
+        vec_reflect3(dir, hit->normal, dirs[depth & 1]);
 #ifdef DEBUG_SPECULAR
-   vec_prn3(stderr, "ref_dir", ref_dir);
+        vec_prn3(stderr, "ref_dir", dirs[depth & 1]);
 #endif
-        ray_trace(model, closest->hitloc, ref_dir, specint,
-                                        total_dist, closest);
-        specref[0] = specref[0] * specint[0];
-        specref[1] = specref[1] * specint[1];
-        specref[2] = specref[2] * specint[2];
-   }
+        STATS_ENTER();
+        STATS_RAY();
+        if (find_closest_obj(model, hit->hitloc, dirs[depth & 1], hit->obj,
+                             &hits[depth & 1]) == NULL) {
+            STATS_LEAVE();
+            if (ctx->deps != NULL) {
+                deps_escape(ctx->deps, dirs[depth & 1]);
+            }
+            break;
+        }
+
+        dir = dirs[depth & 1];
+        hit = &hits[depth & 1];
+        depth++;
+    }
 
-   vec_sum3(intensity, specref, intensity);
-   // end specular...
+    if (ctx->relight != NULL) {
+        relight_path(ctx->relight, ctx->stack, depth + 1);
+    }
+
+    // light reflected off each hit adds that of the rest of the path
+    for (k = depth; k >= 0; k--) {
+        ray_fold(&ctx->stack[k], sum);
+        if (k > 0) {
+            STATS_LEAVE();
+        }
+    }
+
+    vec_sum3(intensity, sum, intensity);
 }
 
 /**
- * Returns the closest object that the ray hits.
+ * Returns the closest object that the ray hits.  Only the distance is
+ * found while searching, the hit point, normal and plane coordinates are
+ * filled in afterwards for the closest object alone.
  *
  * PARAMETERS:
- *  scene   - list of objects in the scene
+ *  model   - contains scene data
  *  base    - origin of ray
  *  dir     - direction of ray
  *  last_hit- location of the ray's last hit
- *  mindist - distance ray has traveled
+ *  hit     - hit record to fill in, hit->t is -1 if nothing was hit
  * 
  * RETURNS:
  *  the closest object that the ray hits
  */
-obj_t *find_closest_obj(list_t *scene, double base[3], 
-                        double dir[3], obj_t *last_hit, double *mindist) {
+obj_t *find_closest_obj(model_t *model, double base[3], 
+                        double dir[3], obj_t *last_hit, hit_t *hit) {
 
     obj_t *closest = NULL;      // closest object that ray hits
-    obj_t *obj = scene->head;   // first object
+    obj_t *obj = model->scene->head;    // first object
     double temp;                // temp holder to compare distances
+    double *mindist = &hit->t;  // distance to the closest object
     
     // have to initialize this to an invalid value, else this won't work
     // if there are no hit objects
     *mindist = -1;
 
+    // walk the hierarchy if there is one, else try every object
+    if (model->bvh != NULL) {
+        closest = bvh_closest(model->bvh, base, dir, last_hit, mindist);
+        obj = NULL;
+    }
+
     while (obj != NULL) {
-        temp = obj->hits(base, dir, obj);
+        temp = obj->ops->hits(base, dir, obj);
+        STATS_TEST(obj->objtype, temp > 0);
 #ifdef DEBUG_CLOSEST
         fprintf(stderr, "found hit, th=%lf\n", temp);
 #endif
@@ -142,77 +386,202 @@ obj_t *find_closest_obj(list_t *scene, double base[3],
 
         obj = obj->next;
     }
+
+    hit->obj = closest;
+    if (closest != NULL) {
+        closest->ops->hitinfo(base, dir, closest, hit);
+    }
     return closest;
 }
 
+/**
+ * Finds the closest object each ray in a packet of primary rays hits.
+ * Distances are left in the packet; hit points and normals are up to the
+ * caller.
+ *
+ * PARAMETERS:
+ *  model   - contains scene data
+ *  pk      - packet of rays
+ */
+void find_closest_packet(model_t *model, packet_t *pk) {
+    obj_t *obj;
+
+    if (model->bvh != NULL) {
+        bvh_closest_packet(model->bvh, pk);
+        return;
+    }
+
+    for (obj = model->scene->head; obj != NULL; obj = obj->next) {
+        packet_test(pk, obj, (1 << pk->n) - 1);
+    }
+}
+
+/**
+ * Returns an object blocking a ray before it has gone a given distance.
+ * The search stops at the first blocker found.  The last blocker found is
+ * kept in cache and tried first, since neighbouring shadow rays to the
+ * same light tend to be blocked by the same object.
+ *
+ * PARAMETERS:
+ *  model   - contains scene data
+ *  base    - origin of ray
+ *  dir     - direction of ray
+ *  dist    - distance the ray travels
+ *  last_hit- object the ray starts on, never counted as a blocker
+ *  cache   - last blocker found for this light, updated on a new one
+ *
+ * RETURNS:
+ *  an object between base and dist, or NULL if the ray isn't blocked
+ */
+obj_t *find_occluder(model_t *model, double *base, double *dir,
+                     double dist, obj_t *last_hit, obj_t **cache) {
+    obj_t *occluder = *cache;   // object blocking the ray
+    double t;                   // distance to occluder
+
+    if (occluder != NULL && occluder != last_hit) {
+        t = occluder->ops->hits(base, dir, occluder);
+        STATS_TEST(occluder->objtype, t > 0);
+        if (t > 0 && t < dist) {
+            return occluder;
+        }
+    }
+
+    if (model->bvh != NULL) {
+        occluder = bvh_occluded(model->bvh, base, dir, dist, last_hit);
+    } else {
+        for (occluder = model->scene->head; occluder != NULL;
+                                            occluder = occluder->next) {
+            if (occluder == last_hit) {
+                continue;
+            }
+            t = occluder->ops->hits(base, dir, occluder);
+            STATS_TEST(occluder->objtype, t > 0);
+            if (t > 0 && t < dist) {
+                break;
+            }
+        }
+    }
+
+    if (occluder != NULL) {
+        *cache = occluder;
+    }
+    return occluder;
+}
+
 /*
  * For a given object, checks against each light for diffuse lighting
  *
  * PARAMETERS:
  *  model     - struct holding all the lights and objects
- *  hitobj    - object that was hit and to check for diffusion
+ *  ctx       - state of the calling render thread
+ *  hit       - where the object to check for diffusion was hit
+ *  diffuse   - diffuse reflectivity at the hit point
  *  intensity - pixel values vector
  */
-void diffuse_illumination(model_t *model, obj_t *hitobj, double *intensity) {
+void diffuse_illumination(model_t *model, trace_ctx_t *ctx, hit_t *hit,
+                          double *diffuse, double *intensity) {
     obj_t *light = model->lights->head;
     int    accumulator = 0;
+    int    ndx = 0;             // index of light in the list
     while (light != NULL) {
-        accumulator += process_light(model->scene, hitobj, light, intensity);
+        accumulator += process_light(model, ctx, hit, light, ndx, diffuse,
+                                     intensity);
         light = light->next;
+        ndx++;
     }
 }
 
 
 /**
- * Checks diffuse lighting at a specific point on a specific object for a 
- * specific light.  Checks to see if there is any occlussion and applies
- * diffuse lighting to pixel if needed.
+ * Find the shadow ray from a hit point to a light.
  *
  * PARAMETERS:
- *  scene       - list of objects in the scene
- *  hitobj      - object that was hit and to check diffusion for
+ *  hit         - where the object to check diffusion for was hit
  *  light_obj   - light object to check
- *  intesnity   - vector describing the values of the pixel
+ *  dir         - filled in with the unit direction to the light
+ *  dist        - filled in with the distance to the light
+ *
+ * RETURNS:
+ *  cos(theta) where theta is between the normal and the light, below 0 if
+ *  the light is behind the surface
  */
-int process_light(list_t *scene, obj_t *hitobj, 
-                  obj_t *light_obj, double *intensity) {
-    double mindist;         // distance to nearest obj when checking occlussion
-    obj_t *closest = NULL;  // closest object when checking for occlussion
-    double dir[3];          // direction of ray from hitpt to light
-    double diffuse[3];      // hold diffuse values for hitobj
-    double dist;            // distance from hitpt to light
+double light_ray(hit_t *hit, obj_t *light_obj, double *dir, double *dist) {
+    light_t *light = (light_t *)light_obj->priv;
     double theta;           // cos(theta) where theta is b/w Normal and dir
-    light_t *light;         // light to check
-    
-    // pull values out of hitobj and light_obj
-    light = (light_t *)light_obj->priv;
-    hitobj->getdif(hitobj, diffuse);
 
     // find direction and distance from hitpoint to light
-    vec_diff3(hitobj->hitloc, light->center, dir);
+    vec_diff3(hit->hitloc, light->center, dir);
 #ifdef DEBUG_DIFFUSE
     vec_prn3(stderr, "direction vector was: ", dir);
 #endif
-    dist = vec_length3(dir);
+    *dist = vec_length3(dir);
     vec_unit3(dir, dir);
-    
-
 
     // find cos(theta) where theta is the angle between the direction and
     // the normal at the hit point
-    theta = vec_dot3(dir, hitobj->normal);
+    theta = vec_dot3(dir, hit->normal);
 #ifdef DEBUG_DIFFUSE
-    fprintf(stderr, "hit object id was: %d\n", hitobj->objid);
-    vec_prn3(stderr, "hit point was:", hitobj->hitloc);
-    vec_prn3(stderr, "normal at hitpoint: ", hitobj->normal);
+    fprintf(stderr, "hit object id was: %d\n", hit->obj->objid);
+    vec_prn3(stderr, "hit point was:", hit->hitloc);
+    vec_prn3(stderr, "normal at hitpoint: ", hit->normal);
     fprintf(stderr, "light object id was: %d\n", light_obj->objid);
     vec_prn3(stderr, "light center was: ", light->center);
     vec_prn3(stderr, "unit vector to light is: ", dir);
-    fprintf(stderr, "distance to light is: %f\n", dist);
+    fprintf(stderr, "distance to light is: %f\n", *dist);
     fprintf(stderr, "cosine(theta) is: %f\n", theta); 
-    fprintf(stderr, "distance to closest: %f\n", mindist);
 #endif   
+    return theta;
+}
+
+/**
+ * Apply diffuse lighting from a light that reaches a hit point.
+ *
+ * PARAMETERS:
+ *  light_obj   - light reaching the hit point
+ *  diffuse     - diffuse reflectivity at the hit point
+ *  theta       - cos(theta) from light_ray
+ *  dist        - distance to the light
+ *  intensity   - vector describing the values of the pixel
+ */
+void light_add(obj_t *light_obj, double *diffuse, double theta, double dist,
+               double *intensity) {
+    light_t *light = (light_t *)light_obj->priv;
 
+    *(intensity + 0) += (diffuse[0] * light->emissivity[0] * theta) / dist;
+    *(intensity + 1) += (diffuse[1] * light->emissivity[1] * theta) / dist;
+    *(intensity + 2) += (diffuse[2] * light->emissivity[2] * theta) / dist;
+
+#ifdef  DEBUG_DIFFUSE
+    vec_prn3(stderr, "Emissivity of the light: ", light->emissivity);
+    vec_prn3(stderr, "Diffuse reflectivity: ", diffuse);
+    vec_prn3(stderr, "Current intensity: ", intensity);
+#endif
+}
+
+/**
+ * Checks diffuse lighting at a specific point on a specific object for a 
+ * specific light.  Checks to see if there is any occlussion and applies
+ * diffuse lighting to pixel if needed.
+ *
+ * PARAMETERS:
+ *  model       - struct holding all the lights and objects
+ *  ctx         - state of the calling render thread
+ *  hit         - where the object to check diffusion for was hit
+ *  light_obj   - light object to check
+ *  ndx         - index of the light in the list
+ *  diffuse     - diffuse reflectivity at the hit point
+ *  intesnity   - vector describing the values of the pixel
+ */
+int process_light(model_t *model, trace_ctx_t *ctx, hit_t *hit,
+                  obj_t *light_obj, int ndx, double *diffuse,
+                  double *intensity) {
+    obj_t *hitobj = hit->obj;   // object that was hit
+    obj_t *occluder = NULL; // object between the hit point and the light
+    double dir[3];          // direction of ray from hitpt to light
+    double dist;            // distance from hitpt to light
+    double theta;           // cos(theta) where theta is b/w Normal and dir
+
+    theta = light_ray(hit, light_obj, dir, &dist);
 
     // check for self occlusion (if cos(theta) < 0)
     if (theta < 0) {
@@ -222,28 +591,86 @@ int process_light(list_t *scene, obj_t *hitobj,
         return -1;
     }
     
-    // find the closest object in the direction of the light to check for
-    // occlussion
-    closest = find_closest_obj(scene, hitobj->hitloc, dir, hitobj, &mindist);
+    // look for any object between the hit point and the light
+    ctx->rays[RAY_SHADOW]++;
+    occluder = find_occluder(model, hit->hitloc, dir, dist, hitobj,
+                             &ctx->occluders[ndx]);
 
     
     // check to make sure light isn't occluded by some other object
-    if (mindist < dist && mindist != -1) {
+    if (occluder != NULL) {
 #ifdef DEBUG_DIFFUSE
-        fprintf(stderr, "Found occluding object\n");
+        fprintf(stderr, "Found occluding object %d\n", occluder->objid);
 #endif
+        if (ctx->deps != NULL) {
+            deps_occluder(ctx->deps, occluder);
+        }
         return -1;
     // apply diffuse lighting to pixel
     } else {
-        *(intensity + 0) += (diffuse[0] * light->emissivity[0] * theta) / dist;
-        *(intensity + 1) += (diffuse[1] * light->emissivity[1] * theta) / dist;
-        *(intensity + 2) += (diffuse[2] * light->emissivity[2] * theta) / dist;
+        light_add(light_obj, diffuse, theta, dist, intensity);
+    }
+    return EXIT_SUCCESS;
+}
 
-#ifdef  DEBUG_DIFFUSE
-        vec_prn3(stderr, "Emissivity of the light: ", light->emissivity);
-        vec_prn3(stderr, "Diffuse reflectivity: ", diffuse);
-        vec_prn3(stderr, "Current intensity: ", intensity);
+/*
+ * Allocate the per thread state for tracing rays through a model.
+ *
+ * PARAMETERS:
+ *  model   - model the thread will trace
+ *
+ * RETURNS:
+ *  pointer to the new trace context
+ */
+trace_ctx_t *trace_ctx_init(model_t *model) {
+    trace_ctx_t *ctx = (trace_ctx_t *)smalloc(sizeof(trace_ctx_t));
+    obj_t       *light;
+    int          i;
+
+    ctx->nlights = 0;
+    for (light = model->lights->head; light != NULL; light = light->next) {
+        ctx->nlights++;
+    }
+
+    ctx->occluders = (obj_t **)smalloc(sizeof(obj_t *) * (ctx->nlights + 1));
+    for (i = 0; i < ctx->nlights; i++) {
+        ctx->occluders[i] = NULL;
+    }
+
+    for (i = 0; i < RAY_KINDS; i++) {
+        ctx->rays[i] = 0;
+    }
+
+    ctx->stack = (trace_frame_t *)smalloc(sizeof(trace_frame_t) *
+                                          model->proj->max_depth);
+    ctx->rng = 1;
+    ctx->wave = NULL;
+    ctx->deps = NULL;
+    ctx->relight = NULL;
+
+#ifdef RENDER_STATS
+    ctx->stats = stats_init();
+#else
+    ctx->stats = NULL;
 #endif
+
+    return ctx;
+}
+
+/*
+ * Free a trace context.
+ *
+ * PARAMETERS:
+ *  ctx     - trace context to free
+ */
+void trace_ctx_free(trace_ctx_t *ctx) {
+    if (ctx->stats != NULL) {
+        stats_free(ctx->stats);
     }
-    return EXIT_SUCCESS;
+    if (ctx->wave != NULL) {
+        wave_free(ctx->wave);
+    }
+    free(ctx->occluders);
+    free(ctx->stack);
+    free(ctx);
 }
@@ -1,15 +1,47 @@
 #include "common.h"
+#include "packet.h"
 
 #ifndef RAY_H
 #define RAY_H
 
-#define MAX_DIST 30
+#define DEFAULT_MAX_DIST    30      /* render limits without a limits record */
+#define DEFAULT_MAX_DEPTH   64
 
-void ray_trace(model_t *, double *, double *, double *, double, obj_t *);
+void ray_trace(model_t *, trace_ctx_t *, double *, double *, double *,
+               double, obj_t *);
 
-obj_t *find_closest_obj(list_t *, double *, double *, obj_t *, double *);
+void ray_shade(model_t *, trace_ctx_t *, double *, hit_t *, double *, double);
 
-void diffuse_illumination(model_t *, obj_t *, double *);
+void ray_material(model_t *, double *, hit_t *, double, material_t *);
 
-int process_light(list_t *, obj_t *, obj_t *, double *);
+void ray_lighting(model_t *, trace_ctx_t *, hit_t *, material_t *,
+                  trace_frame_t *);
+
+int ray_reflects(model_t *, trace_ctx_t *, trace_frame_t *, double, int,
+                 double *);
+
+void ray_fold(trace_frame_t *, double *);
+
+void ray_seed(trace_ctx_t *, int, int);
+
+obj_t *find_closest_obj(model_t *, double *, double *, obj_t *, hit_t *);
+
+void find_closest_packet(model_t *, packet_t *);
+
+obj_t *find_occluder(model_t *, double *, double *, double, obj_t *,
+                     obj_t **);
+
+void diffuse_illumination(model_t *, trace_ctx_t *, hit_t *, double *,
+                          double *);
+
+double light_ray(hit_t *, obj_t *, double *, double *);
+
+void light_add(obj_t *, double *, double, double, double *);
+
+int process_light(model_t *, trace_ctx_t *, hit_t *, obj_t *, int, double *,
+                  double *);
+
+trace_ctx_t *trace_ctx_init(model_t *);
+
+void trace_ctx_free(trace_ctx_t *);
 #endif
@@ -0,0 +1,484 @@
+/*
+ * relight.c
+ *
+ * Renders a scene again after only its lights changed without finding a
+ * single hit.  Where the rays of a pixel go depends on the objects, their
+ * materials and the projection, never on the lights, so the first render
+ * keeps every hit along each pixel's path in a relight cache: the object,
+ * hit point, normal, distance, the material sampled there and the weight
+ * the rest of the path carries.  A later render of the same objects from
+ * the same projection reads them back and only lights them: ambient and
+ * diffuse light, with its shadow rays, then the reflections folded back
+ * to the pixel as ray_shade does.  The image is the same as tracing it.
+ *
+ * The cache holds a hash of every object that isn't a light and the
+ * projection, so it is traced again and replaced when either changed.
+ *
+ * Chris Blades
+ *
+ * 18/10/2026
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "common.h"
+#include "safe.h"
+#include "image.h"
+#include "ray.h"
+#include "veclib3d.h"
+#include "bench.h"
+#include "stats.h"
+#include "scenebin.h"
+#include "relight.h"
+
+/* state shared by the render threads */
+typedef struct relight_job_type {
+    model_t        *model;
+    obj_t         **objs;       /* objects by place in the scene list */
+    int             nobjs;
+    int            *place;      /* place of each object by id */
+    uint32_t       *counts;     /* hits of each pixel, top row first */
+    relight_hit_t  *hits;       /* hits read from the cache, NULL to trace
+                                   the image */
+    long           *starts;     /* first hit of each row in hits */
+    relight_rec_t  *rows;       /* hits of each row traced */
+    unsigned char  *pixels;     /* image being rendered, top row first */
+    int             next;       /* next row to render */
+    pthread_mutex_t lock;
+} relight_job_t;
+
+/* one render thread */
+typedef struct relight_worker_type {
+    pthread_t       thread;
+    relight_job_t  *job;
+    trace_ctx_t    *ctx;
+} relight_worker_t;
+
+/**
+ * Keep a hit of the pixel being traced, with the material sampled there.
+ * Its weight is filled in by relight_path once the path is done.
+ *
+ * PARAMETERS:
+ *  rec     - hits of the row being traced
+ *  hit     - hit, its object, distance, point and normal filled in
+ *  mat     - reflectivities at the hit point
+ */
+void relight_hit(relight_rec_t *rec, hit_t *hit, material_t *mat) {
+    relight_hit_t *to;
+
+    if (rec->nhits == rec->cap) {
+        rec->cap = rec->cap > 0 ? rec->cap * 2 : 1024;
+        rec->hits = (relight_hit_t *)realloc(rec->hits,
+                                             sizeof(relight_hit_t) *
+                                             rec->cap);
+        if (rec->hits == NULL) {
+            fprintf(stderr, "Error allocating memory.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    to = &rec->hits[rec->nhits++];
+    memset(to, 0, sizeof(relight_hit_t));
+    to->obj   = rec->place[hit->obj->objid];
+    to->t     = hit->t;
+    memcpy(to->hitloc, hit->hitloc, sizeof(to->hitloc));
+    memcpy(to->normal, hit->normal, sizeof(to->normal));
+    memcpy(to->ambient, mat->ambient, sizeof(to->ambient));
+    memcpy(to->diffuse, mat->diffuse, sizeof(to->diffuse));
+    memcpy(to->spec, mat->specular, sizeof(to->spec));
+    to->scale = 1.0;
+}
+
+/**
+ * Fill in the weights of the hits of a path that is done, as russian
+ * roulette left them.
+ *
+ * PARAMETERS:
+ *  rec     - hits of the row being traced, the path's last
+ *  stack   - frames of the path's hits
+ *  n       - hits in the path
+ */
+void relight_path(relight_rec_t *rec, trace_frame_t *stack, int n) {
+    int k;
+
+    for (k = 0; k < n; k++) {
+        rec->hits[rec->nhits - n + k].scale = stack[k].scale;
+    }
+}
+
+/*
+ * Light the hits of a pixel read from the cache and set its rgb values.
+ *
+ * PARAMETERS:
+ *  job     - render holding the objects by id
+ *  ctx     - state of the calling render thread
+ *  hits    - hits of the pixel's path, in order
+ *  n       - number of hits
+ *  pixval  - pointer to location to store rgb values
+ */
+static void relight_pixel(relight_job_t *job, trace_ctx_t *ctx,
+                          relight_hit_t *hits, int n, unsigned char *pixval) {
+    trace_frame_t frame;
+    material_t    mat;
+    hit_t         hit;
+    double        intensity[3] = {0.0, 0.0, 0.0};
+    double        sum[3] = {0.0, 0.0, 0.0};     // light from the end of the
+                                                // path
+    int           k;
+
+    memset(&hit, 0, sizeof(hit));
+    hit.proj = job->model->proj;
+
+    // summed from the far end back, as ray_shade does
+    for (k = n - 1; k >= 0; k--) {
+        hit.obj = job->objs[hits[k].obj];
+        hit.t   = hits[k].t;
+        memcpy(hit.hitloc, hits[k].hitloc, sizeof(hit.hitloc));
+        memcpy(hit.normal, hits[k].normal, sizeof(hit.normal));
+        memcpy(mat.ambient, hits[k].ambient, sizeof(mat.ambient));
+        memcpy(mat.diffuse, hits[k].diffuse, sizeof(mat.diffuse));
+        memcpy(mat.specular, hits[k].spec, sizeof(mat.specular));
+
+        ray_lighting(job->model, ctx, &hit, &mat, &frame);
+        frame.scale = hits[k].scale;
+        ray_fold(&frame, sum);
+    }
+
+    vec_sum3(intensity, sum, intensity);
+    set_pixel(intensity, pixval);
+}
+
+/*
+ * Thread entry point, renders rows until there are none left, lighting
+ * the cached hits if there are any, else tracing the pixels and keeping
+ * their hits.
+ *
+ * PARAMETERS:
+ *  arg     - relight_worker_t for this thread
+ */
+static void *relight_worker(void *arg) {
+    relight_worker_t *worker = (relight_worker_t *)arg;
+    relight_job_t    *job = worker->job;
+    trace_ctx_t      *ctx = worker->ctx;
+    model_t          *model = job->model;
+    int               width  = model->proj->win_size_pixel[0];
+    int               height = model->proj->win_size_pixel[1];
+    relight_hit_t    *hits;         // hits of the pixel
+    long              before;       // hits of the row before the pixel
+    size_t            i;
+    int               r;
+    int               x;
+
+    stats_bind(ctx->stats);
+    while (1) {
+        pthread_mutex_lock(&job->lock);
+        r = job->next++;
+        pthread_mutex_unlock(&job->lock);
+        if (r >= height) {
+            break;
+        }
+
+        if (job->hits != NULL) {
+            hits = job->hits + job->starts[r];
+            for (x = 0; x < width; x++) {
+                i = (size_t)r * width + x;
+                relight_pixel(job, ctx, hits, job->counts[i],
+                              job->pixels + i * 3);
+                hits += job->counts[i];
+            }
+            continue;
+        }
+
+        ctx->relight = &job->rows[r];
+        for (x = 0; x < width; x++) {
+            i = (size_t)r * width + x;
+            before = job->rows[r].nhits;
+            // y counts up from the bottom
+            make_pixel(model, ctx, x, height - r - 1, job->pixels + i * 3);
+            job->counts[i] = job->rows[r].nhits - before;
+        }
+        ctx->relight = NULL;
+    }
+    return NULL;
+}
+
+/*
+ * Fill in the header a relight cache of this render would have.
+ *
+ * PARAMETERS:
+ *  model   - model being rendered
+ *  header  - header to fill in
+ */
+static void relight_header(model_t *model, relight_header_t *header) {
+    proj_t *proj = model->proj;
+    obj_t  *obj;
+    int     i = 0;                  // place of the object in the list
+
+    memset(header, 0, sizeof(relight_header_t));
+    memcpy(header->magic, RELIGHT_MAGIC, sizeof(RELIGHT_MAGIC));
+    header->version    = RELIGHT_VERSION;
+    header->size[0]    = proj->win_size_pixel[0];
+    header->size[1]    = proj->win_size_pixel[1];
+    header->mipmap     = model->opts->mipmap;
+    header->world[0]   = proj->win_size_world[0];
+    header->world[1]   = proj->win_size_world[1];
+    header->view[0]    = proj->view_point[0];
+    header->view[1]    = proj->view_point[1];
+    header->view[2]    = proj->view_point[2];
+    header->max_depth  = proj->max_depth;
+    header->roulette   = proj->roulette;
+    header->max_dist   = proj->max_dist;
+    header->min_weight = proj->min_weight;
+
+    // ids are shared with the lights, so an added light would renumber
+    // the objects without changing them
+    for (obj = model->scene->head; obj != NULL; obj = obj->next) {
+        header->scene = (header->scene ^ scenebin_hash(obj)) *
+                        1099511628211ULL + i++;
+    }
+}
+
+/*
+ * Read the hits of a relight cache, if they were found in the same scene
+ * from the same projection.
+ *
+ * PARAMETERS:
+ *  path    - relight cache
+ *  job     - render to fill in the hits of
+ *
+ * RETURNS:
+ *  0 if the hits can be lit
+ */
+static int relight_read(char *path, relight_job_t *job) {
+    model_t         *model = job->model;
+    size_t           npixels = (size_t)model->proj->win_size_pixel[0] *
+                               model->proj->win_size_pixel[1];
+    int              width = model->proj->win_size_pixel[0];
+    relight_header_t expect;
+    relight_header_t header;
+    FILE            *in;
+    long             nhits = 0;
+    size_t           i;
+
+    if ((in = fopen(path, "rb")) == NULL) {
+        fprintf(stderr, "No relight cache %s, tracing every pixel\n", path);
+        return -1;
+    }
+
+    relight_header(model, &expect);
+    if (fread(&header, sizeof(header), 1, in) != 1 ||
+        memcmp(header.magic, RELIGHT_MAGIC, sizeof(RELIGHT_MAGIC)) != 0 ||
+        header.version != RELIGHT_VERSION) {
+        fprintf(stderr, "%s isn't a relight cache, tracing every pixel\n",
+                path);
+        fclose(in);
+        return -1;
+    }
+
+    // the hits follow, the rest must match
+    expect.nhits = header.nhits;
+    if (memcmp(&expect, &header, sizeof(header)) != 0) {
+        fprintf(stderr, "Objects, projection, limits or filtering changed "
+                        "since %s, tracing every pixel\n", path);
+        fclose(in);
+        return -1;
+    }
+
+    job->hits = (relight_hit_t *)smalloc(sizeof(relight_hit_t) *
+                                         (header.nhits + 1));
+    if (fread(job->counts, sizeof(uint32_t), npixels, in) != npixels ||
+        fread(job->hits, sizeof(relight_hit_t), header.nhits, in) !=
+                                                        header.nhits) {
+        fprintf(stderr, "%s is cut short, tracing every pixel\n", path);
+        fclose(in);
+        free(job->hits);
+        job->hits = NULL;
+        return -1;
+    }
+    fclose(in);
+
+    for (i = 0; i < npixels; i++) {
+        if (i % width == 0) {
+            job->starts[i / width] = nhits;
+        }
+        nhits += job->counts[i];
+    }
+    for (i = 0; i < header.nhits && nhits == (long)header.nhits; i++) {
+        if (job->hits[i].obj < 0 || job->hits[i].obj >= job->nobjs) {
+            nhits = -1;
+        }
+    }
+    if (nhits != (long)header.nhits) {
+        fprintf(stderr, "%s is corrupt, tracing every pixel\n", path);
+        free(job->hits);
+        job->hits = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Write the hits of a traced render to a relight cache, replacing the
+ * last one once it is complete.
+ *
+ * PARAMETERS:
+ *  path    - relight cache
+ *  job     - render that is done
+ *  nhits   - where to store the number of hits
+ *
+ * RETURNS:
+ *  0 on success
+ */
+static int relight_write(char *path, relight_job_t *job, long *nhits) {
+    model_t         *model = job->model;
+    int              height = model->proj->win_size_pixel[1];
+    size_t           npixels = (size_t)model->proj->win_size_pixel[0] *
+                               height;
+    relight_header_t header;
+    char             tmp[FILENAME_MAX];
+    FILE            *out;
+    int              ok;
+    int              r;
+
+    relight_header(model, &header);
+    for (r = 0; r < height; r++) {
+        header.nhits += job->rows[r].nhits;
+    }
+    *nhits = header.nhits;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    if ((out = fopenAndCheck(tmp, "wb")) == NULL) {
+        return EXIT_FAILURE;
+    }
+
+    ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+         fwrite(job->counts, sizeof(uint32_t), npixels, out) == npixels;
+    for (r = 0; r < height && ok; r++) {
+        ok = fwrite(job->rows[r].hits, sizeof(relight_hit_t),
+                    job->rows[r].nhits, out) == (size_t)job->rows[r].nhits;
+    }
+    if (fclose(out) != 0 || !ok || rename(tmp, path) != 0) {
+        fprintf(stderr, "Error writing relight cache: %s\n", path);
+        remove(tmp);
+        return EXIT_FAILURE;
+    }
+    return 0;
+}
+
+/**
+ * Render a model and write the image to stdout as make_image would.  If
+ * the relight cache holds the hits of the same objects seen from the same
+ * projection, they are only lit again.  Otherwise every pixel is traced,
+ * one at a time without packets or the wavefront engine so its hits can
+ * be kept, and the cache is replaced.
+ *
+ * PARAMETERS:
+ *  model   - model to render
+ *
+ * RETURNS:
+ *  0 on success
+ */
+int relight_render(model_t *model) {
+    options_t        *opts   = model->opts;
+    int               width  = model->proj->win_size_pixel[0];
+    int               height = model->proj->win_size_pixel[1];
+    relight_job_t     job;
+    relight_worker_t *workers;
+    obj_t            *obj;
+    long              nhits = 0;
+    int               maxid = 0;
+    double            start;
+    int               rc = 0;
+    int               i;
+    int               k;
+
+    // pixels are traced one at a time so their hits can be kept
+    if (opts->heatmap != NULL || opts->stream || opts->packets ||
+        opts->wavefront) {
+        fprintf(stderr, "No heatmap, streaming, packets or wavefront engine "
+                        "when relighting\n");
+    }
+
+    memset(&job, 0, sizeof(job));
+    job.model  = model;
+    job.pixels = (unsigned char *)smalloc((size_t)width * height * 3);
+    job.counts = (uint32_t *)smalloc(sizeof(uint32_t) * width * height);
+    job.starts = (long *)smalloc(sizeof(long) * height);
+    pthread_mutex_init(&job.lock, NULL);
+
+    // hits name their objects by place in the scene list, which only
+    // changes with the objects
+    for (obj = model->scene->head; obj != NULL; obj = obj->next) {
+        maxid = obj->objid > maxid ? obj->objid : maxid;
+        job.nobjs++;
+    }
+    job.objs  = (obj_t **)smalloc(sizeof(obj_t *) * (job.nobjs + 1));
+    job.place = (int *)smalloc(sizeof(int) * (maxid + 1));
+    for (obj = model->scene->head, i = 0; obj != NULL; obj = obj->next, i++) {
+        job.objs[i] = obj;
+        job.place[obj->objid] = i;
+    }
+
+    if (relight_read(opts->relight, &job) != 0) {
+        job.rows = (relight_rec_t *)smalloc(sizeof(relight_rec_t) * height);
+        memset(job.rows, 0, sizeof(relight_rec_t) * height);
+        for (i = 0; i < height; i++) {
+            job.rows[i].place = job.place;
+        }
+    }
+
+    workers = (relight_worker_t *)smalloc(sizeof(relight_worker_t) *
+                                          opts->threads);
+    for (i = 0; i < opts->threads; i++) {
+        workers[i].job = &job;
+        workers[i].ctx = trace_ctx_init(model);
+        if (pthread_create(&workers[i].thread, NULL, relight_worker,
+                           &workers[i]) != 0) {
+            fprintf(stderr, "Error creating render thread.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (i = 0; i < opts->threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        for (k = 0; k < RAY_KINDS; k++) {
+            model->bench->rays[k] += workers[i].ctx->rays[k];
+        }
+        if (model->stats != NULL && workers[i].ctx->stats != NULL) {
+            stats_merge(model->stats, workers[i].ctx->stats);
+        }
+        trace_ctx_free(workers[i].ctx);
+    }
+    free(workers);
+
+    start = bench_now();
+    printf("P6 %d %d 255\n", width, height);
+    fwrite(job.pixels, sizeof(unsigned char), (size_t)width * height * 3,
+           stdout);
+    fflush(stdout);
+    model->bench->output_time += bench_now() - start;
+
+    if (job.hits != NULL) {
+        for (i = 0; i < width * height; i++) {
+            nhits += job.counts[i];
+        }
+        fprintf(stderr, "Relit %ld hits from %s\n", nhits, opts->relight);
+        free(job.hits);
+    } else {
+        rc = relight_write(opts->relight, &job, &nhits);
+        fprintf(stderr, "Kept %ld hits in %s\n", nhits, opts->relight);
+        for (i = 0; i < height; i++) {
+            free(job.rows[i].hits);
+        }
+        free(job.rows);
+    }
+
+    pthread_mutex_destroy(&job.lock);
+    free(job.objs);
+    free(job.place);
+    free(job.starts);
+    free(job.counts);
+    free(job.pixels);
+    return rc;
+}
@@ -0,0 +1,55 @@
+#include <stdint.h>
+#include "common.h"
+
+#ifndef RELIGHT_H
+#define RELIGHT_H
+
+#define RELIGHT_MAGIC   "RTGBUF"    /* first bytes of a relight cache */
+#define RELIGHT_VERSION 2
+
+/* hit along the path of a pixel, with what lighting it needs */
+typedef struct relight_hit_type {
+    int32_t     obj;            /* place in the scene list of the object
+                                   that was hit */
+    int32_t     spare;
+    double      t;              /* distance from the last hit */
+    double      hitloc[3];
+    double      normal[3];
+    double      ambient[3];     /* material sampled at the hit */
+    double      diffuse[3];
+    double      spec[3];
+    double      scale;          /* weight of the rest of the path */
+} relight_hit_t;
+
+/* hits of the pixels being rendered, in order */
+typedef struct relight_rec_type {
+    relight_hit_t  *hits;
+    long            nhits;
+    long            cap;
+    int            *place;          /* place of each object by id */
+} relight_rec_t;
+
+/* start of a relight cache.  It is followed by the number of hits of each
+ * pixel, top row first, then the hits */
+typedef struct relight_header_type {
+    char        magic[8];
+    uint32_t    version;
+    uint32_t    size[2];        /* image width and height */
+    uint32_t    mipmap;         /* textures were filtered */
+    double      world[2];       /* projection the hits were found with */
+    double      view[3];
+    int32_t     max_depth;
+    int32_t     roulette;
+    double      max_dist;
+    double      min_weight;
+    uint64_t    scene;          /* hash of every object that isn't a light,
+                                   and its place */
+    uint64_t    nhits;
+} relight_header_t;
+
+void relight_hit(relight_rec_t *, hit_t *, material_t *);
+
+void relight_path(relight_rec_t *, trace_frame_t *, int);
+
+int relight_render(model_t *);
+#endif
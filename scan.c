@@ -0,0 +1,474 @@
+/*
+ * scan.c
+ *
+ * Buffered tokenizer for scene files.  The input is read in large blocks
+ * and numbers are parsed straight out of the buffer, instead of going
+ * through fscanf and fgets one field at a time.
+ *
+ * It reads the same format the loaders always have: each read takes the
+ * numbers it wants from the input, skipping blank lines, and throws away
+ * whatever is left on the line after them, which is where scene files keep
+ * their comments.  A line that doesn't start with the numbers wanted is
+ * thrown away whole and the read tries again on the next one.
+ *
+ * Chris Blades
+ *
+ * 18/10/2026
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "safe.h"
+#include "scan.h"
+
+/* powers of ten that are exact in a double */
+static const double exact_pow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+#define MAX_POW10   22
+#define MAX_DIGITS  15      /* digits that always fit exactly in a double */
+
+#define IS_DIGIT(c) ((c) >= '0' && (c) <= '9')
+#define IS_SPACE(c) ((c) == ' ' || (c) == '\t' || (c) == '\n' || \
+                     (c) == '\r' || (c) == '\v' || (c) == '\f')
+
+/*
+ * Start reading a file.
+ *
+ * PARAMETERS:
+ *  in      - file to read from
+ *  name    - name of the file, used in error messages
+ *
+ * RETURNS:
+ *  pointer to the new scanner
+ */
+scan_t *scan_init(FILE *in, char *name) {
+    scan_t *scan = (scan_t *)smalloc(sizeof(scan_t));
+
+    scan->in = in;
+    scan->name = name;
+    scan->buf[0] = '\0';
+    scan->pos = 0;
+    scan->len = 0;
+    scan->eof = 0;
+    scan->line = 1;
+    scan->col = 1;
+    scan->tline = 1;
+    scan->tcol = 1;
+
+    return scan;
+}
+
+/*
+ * Make sure at least some bytes are buffered past the read position, unless
+ * the input runs out first.
+ *
+ * PARAMETERS:
+ *  scan    - scanner to fill
+ *  need    - bytes wanted past the read position
+ *
+ * RETURNS:
+ *  number of bytes buffered past the read position
+ */
+static int scan_fill(scan_t *scan, int need) {
+    size_t rc;
+
+    if (scan->len - scan->pos >= need || scan->eof) {
+        return scan->len - scan->pos;
+    }
+
+    // move what's left to the front and top up the buffer behind it
+    memmove(scan->buf, scan->buf + scan->pos, scan->len - scan->pos);
+    scan->len -= scan->pos;
+    scan->pos = 0;
+
+    while (scan->len < SCAN_BUF_SIZE && !scan->eof) {
+        rc = fread(scan->buf + scan->len, 1, SCAN_BUF_SIZE - scan->len,
+                   scan->in);
+        scan->len += rc;
+        if (rc == 0) {
+            scan->eof = 1;
+        }
+        if (scan->len - scan->pos >= need) {
+            break;
+        }
+    }
+    scan->buf[scan->len] = '\0';
+
+    return scan->len - scan->pos;
+}
+
+/*
+ * Skip whitespace, blank lines included.
+ *
+ * PARAMETERS:
+ *  scan    - scanner to advance
+ *
+ * RETURNS:
+ *  0 if the input ran out, 1 otherwise
+ */
+static int scan_space(scan_t *scan) {
+    char c;
+
+    while (1) {
+        if (scan->pos == scan->len && scan_fill(scan, 1) == 0) {
+            return 0;
+        }
+
+        c = scan->buf[scan->pos];
+        if (!IS_SPACE(c)) {
+            return 1;
+        }
+
+        scan->pos++;
+        if (c == '\n') {
+            scan->line++;
+            scan->col = 1;
+        } else {
+            scan->col++;
+        }
+    }
+}
+
+/*
+ * Throw away the rest of the current line, newline included.
+ *
+ * PARAMETERS:
+ *  scan    - scanner to advance
+ */
+static void scan_skip_line(scan_t *scan) {
+    char *nl;
+
+#ifdef DEBUG_SCAN
+    fprintf(stderr, "%s:%d:%d: skipping rest of line\n", scan->name,
+            scan->line, scan->col);
+#endif
+
+    while (1) {
+        if (scan->pos == scan->len && scan_fill(scan, 1) == 0) {
+            return;
+        }
+
+        nl = memchr(scan->buf + scan->pos, '\n', scan->len - scan->pos);
+        if (nl != NULL) {
+            scan->pos = nl - scan->buf + 1;
+            scan->line++;
+            scan->col = 1;
+            return;
+        }
+
+        scan->col += scan->len - scan->pos;
+        scan->pos = scan->len;
+    }
+}
+
+/*
+ * Move the read position past a token that was just parsed.
+ *
+ * PARAMETERS:
+ *  scan    - scanner to advance
+ *  end     - first byte after the token
+ */
+static void scan_advance(scan_t *scan, char *end) {
+    scan->tline = scan->line;
+    scan->tcol = scan->col;
+    scan->col += end - (scan->buf + scan->pos);
+    scan->pos = end - scan->buf;
+}
+
+/*
+ * Parse a double at the read position.  Numbers with at most 15
+ * significant digits and a small exponent are exact in a double, so one
+ * multiply or divide by an exact power of ten rounds them correctly.
+ * Anything else, including inf, nan and hex, is left to strtod, which
+ * gives the same result as fscanf.
+ *
+ * PARAMETERS:
+ *  scan    - scanner to read from
+ *  val     - where to store the number
+ *
+ * RETURNS:
+ *  1 if a number was read, 0 if the input doesn't start with one
+ */
+static int scan_double(scan_t *scan, double *val) {
+    char  *p;
+    char  *end;
+    int    neg = 0;             // number is negative
+    long   mant = 0;            // significant digits
+    int    sig = 0;             // number of significant digits
+    int    digits = 0;          // number of digits of any kind
+    int    exp10 = 0;           // power of ten to scale mant by
+    int    esign = 1;
+    int    e = 0;
+
+    scan_fill(scan, SCAN_LOOKAHEAD);
+    p = scan->buf + scan->pos;
+
+    if (*p == '+' || *p == '-') {
+        neg = *p++ == '-';
+    }
+
+    // leading zeros aren't significant
+    while (*p == '0') {
+        p++;
+        digits++;
+    }
+    if (digits > 0 && (*p == 'x' || *p == 'X')) {
+        goto slow;
+    }
+    while (IS_DIGIT(*p)) {
+        if (sig < MAX_DIGITS) {
+            mant = mant * 10 + (*p - '0');
+        } else {
+            exp10++;
+        }
+        sig += sig > 0 || *p != '0';
+        p++;
+        digits++;
+    }
+    if (*p == '.') {
+        p++;
+        if (sig == 0) {
+            while (*p == '0') {
+                p++;
+                digits++;
+                exp10--;
+            }
+        }
+        while (IS_DIGIT(*p)) {
+            if (sig < MAX_DIGITS) {
+                mant = mant * 10 + (*p - '0');
+                exp10--;
+            }
+            sig += sig > 0 || *p != '0';
+            p++;
+            digits++;
+        }
+    }
+    if (digits == 0) {
+        goto slow;
+    }
+    if ((*p == 'e' || *p == 'E') &&
+        (IS_DIGIT(p[1]) ||
+         ((p[1] == '+' || p[1] == '-') && IS_DIGIT(p[2])))) {
+        p++;
+        if (*p == '+' || *p == '-') {
+            esign = *p++ == '-' ? -1 : 1;
+        }
+        while (IS_DIGIT(*p)) {
+            e = e < 10000 ? e * 10 + (*p - '0') : e;
+            p++;
+        }
+        exp10 += esign * e;
+    }
+
+    if (sig > MAX_DIGITS || exp10 > MAX_POW10 || exp10 < -MAX_POW10) {
+        goto slow;
+    }
+
+    *val = (double)mant;
+    if (exp10 < 0) {
+        *val /= exact_pow10[-exp10];
+    } else {
+        *val *= exact_pow10[exp10];
+    }
+    *val = neg ? -*val : *val;
+
+    scan_advance(scan, p);
+    return 1;
+
+slow:
+    *val = strtod(scan->buf + scan->pos, &end);
+    if (end == scan->buf + scan->pos) {
+        return 0;
+    }
+
+    scan_advance(scan, end);
+    return 1;
+}
+
+/*
+ * Parse an int at the read position.
+ *
+ * PARAMETERS:
+ *  scan    - scanner to read from
+ *  val     - where to store the number
+ *
+ * RETURNS:
+ *  1 if a number was read, 0 if the input doesn't start with one
+ */
+static int scan_int(scan_t *scan, int *val) {
+    char *p;
+    int   neg = 0;
+    int   n = 0;
+
+    scan_fill(scan, SCAN_LOOKAHEAD);
+    p = scan->buf + scan->pos;
+
+    if (*p == '+' || *p == '-') {
+        neg = *p++ == '-';
+    }
+    if (!IS_DIGIT(*p)) {
+        return 0;
+    }
+    while (IS_DIGIT(*p)) {
+        n = n * 10 + (*p++ - '0');
+    }
+
+    *val = neg ? -n : n;
+    scan_advance(scan, p);
+    return 1;
+}
+
+/*
+ * Report running out of input while reading something and exit.
+ *
+ * PARAMETERS:
+ *  scan    - scanner that ran out
+ *  what    - what was being read
+ */
+static void scan_eof(scan_t *scan, char *what) {
+    fprintf(stderr, "%s:%d:%d: unexpected end of input reading %s\n",
+            scan->name, scan->line, scan->col, what);
+    exit(EXIT_FAILURE);
+}
+
+/*
+ * Read several doubles, then throw away the rest of the line.  Lines that
+ * don't hold that many numbers are skipped.
+ *
+ * PARAMETERS:
+ *  scan    - scanner to read from
+ *  vals    - where to store the numbers
+ *  n       - how many numbers to read
+ *  what    - what is being read, for errors.  If NULL running out of input
+ *            isn't an error.
+ *
+ * RETURNS:
+ *  n, or EOF if the input ran out and what is NULL
+ */
+int scan_doubles(scan_t *scan, double *vals, int n, char *what) {
+    int i;
+
+    while (1) {
+        for (i = 0; i < n; i++) {
+            if (!scan_space(scan)) {
+                if (what == NULL) {
+                    return EOF;
+                }
+                scan_eof(scan, what);
+            }
+            if (!scan_double(scan, vals + i)) {
+                break;
+            }
+        }
+
+        scan_skip_line(scan);
+        if (i == n) {
+            return n;
+        }
+    }
+}
+
+/*
+ * Read several ints, then throw away the rest of the line.  Lines that
+ * don't hold that many numbers are skipped.
+ *
+ * PARAMETERS:
+ *  scan    - scanner to read from
+ *  vals    - where to store the numbers
+ *  n       - how many numbers to read
+ *  what    - what is being read, for errors.  If NULL running out of input
+ *            isn't an error.
+ *
+ * RETURNS:
+ *  n, or EOF if the input ran out and what is NULL
+ */
+int scan_ints(scan_t *scan, int *vals, int n, char *what) {
+    int i;
+
+    while (1) {
+        for (i = 0; i < n; i++) {
+            if (!scan_space(scan)) {
+                if (what == NULL) {
+                    return EOF;
+                }
+                scan_eof(scan, what);
+            }
+            if (!scan_int(scan, vals + i)) {
+                break;
+            }
+        }
+
+        scan_skip_line(scan);
+        if (i == n) {
+            return n;
+        }
+    }
+}
+
+/*
+ * Read the next line with some text on it, without its newline.  A line
+ * too long for the buffer is cut short.
+ *
+ * PARAMETERS:
+ *  scan    - scanner to read from
+ *  buf     - where to store the line
+ *  size    - size of buf
+ *  what    - what is being read, for errors
+ *
+ * RETURNS:
+ *  length of the line
+ */
+int scan_line(scan_t *scan, char *buf, int size, char *what) {
+    char *p;
+    int   n;
+
+    // blank lines don't count, like the single newline fgets would return
+    if (!scan_space(scan)) {
+        scan_eof(scan, what);
+    }
+    scan->tline = scan->line;
+    scan->tcol = scan->col;
+
+    scan_fill(scan, size);
+    p = scan->buf + scan->pos;
+    for (n = 0; n < size - 1 && p[n] != '\n' && p[n] != '\0'; n++) {
+        buf[n] = p[n];
+    }
+    buf[n] = '\0';
+
+    scan_skip_line(scan);
+    return n;
+}
+
+/*
+ * Report an error at the last value read and exit.
+ *
+ * PARAMETERS:
+ *  scan    - scanner the value came from
+ *  fmt     - printf style message
+ */
+void scan_error(scan_t *scan, char *fmt, ...) {
+    va_list args;
+
+    fprintf(stderr, "%s:%d:%d: ", scan->name, scan->tline, scan->tcol);
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fprintf(stderr, "\n");
+
+    exit(EXIT_FAILURE);
+}
+
+/*
+ * Free a scanner.  The file is left open.
+ *
+ * PARAMETERS:
+ *  scan    - scanner to free
+ */
+void scan_free(scan_t *scan) {
+    free(scan);
+}
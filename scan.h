@@ -0,0 +1,34 @@
+#include <stdio.h>
+
+#ifndef SCAN_H
+#define SCAN_H
+
+#define SCAN_BUF_SIZE   65536   /* bytes read from the input at a time */
+#define SCAN_LOOKAHEAD  256     /* bytes a single token may span */
+
+/* buffered reader for scene files */
+typedef struct scan_type {
+    FILE   *in;
+    char   *name;                   /* name of the input for errors */
+    char    buf[SCAN_BUF_SIZE + 1]; /* unread input, always nul terminated */
+    int     pos;                    /* next unread byte in buf */
+    int     len;                    /* bytes in buf */
+    int     eof;                    /* nothing more to read from in */
+    int     line;                   /* line and column of buf[pos] */
+    int     col;
+    int     tline;                  /* line and column of the last value */
+    int     tcol;
+} scan_t;
+
+scan_t *scan_init(FILE *, char *);
+
+int scan_doubles(scan_t *, double *, int, char *);
+
+int scan_ints(scan_t *, int *, int, char *);
+
+int scan_line(scan_t *, char *, int, char *);
+
+void scan_error(scan_t *, char *, ...);
+
+void scan_free(scan_t *);
+#endif
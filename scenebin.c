@@ -0,0 +1,606 @@
+/*
+ * scenebin.c
+ *
+ * Compiles a parsed model into a binary scene file and maps one back in
+ * place.  Each object is stored as a record holding its obj_t followed by
+ * the structs of its priv chain, laid out exactly as they are in memory,
+ * with every pointer replaced by its offset in the file.  Loading a scene
+ * maps the file, turns the offsets listed in the relocation table back into
+ * pointers and binds the function table of each object, so no text is
+ * parsed and no object is allocated.
+ *
+ * The structs are stored as this build lays them out, so a file is only
+ * loaded by a build that stores them with the same sizes and byte order.
+ *
+ * Chris Blades
+ *
+ * 18/10/2026
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "common.h"
+#include "safe.h"
+#include "light.h"
+#include "sphere.h"
+#include "plane.h"
+#include "fplane.h"
+#include "tplane.h"
+#include "texplane.h"
+#include "texture.h"
+#include "pplane.h"
+#include "psphere.h"
+#include "scenebin.h"
+
+#define SCENEBIN_CHUNK  65536   /* bytes the output grows by at least */
+
+/* how one object type is stored and bound */
+typedef struct scenebin_kind_type {
+    int     nparts;                     /* structs in the priv chain */
+    size_t  size[SCENEBIN_PARTS];       /* size of each struct */
+    long    link[SCENEBIN_PARTS];       /* offset of the pointer to the next
+                                           struct, -1 for none.  Cleared in
+                                           the last struct */
+    void  (*bind)(obj_t *);             /* connects the function table */
+    int   (*param)(obj_t *);            /* value bind can't find in the file */
+    void  (*attach)(obj_t *, int);      /* restores it after binding */
+} scenebin_kind_t;
+
+static void scenebin_texture(obj_t *, int);
+
+/**
+ * Layout of every object type, indexed like the object loaders of model.c
+ */
+static scenebin_kind_t scenebin_kinds[] =
+{
+    // light
+    { 1, { sizeof(light_t) }, { -1 }, light_bind, NULL, NULL },
+    { 0 },
+    { 0 },
+    // sphere
+    { 1, { sizeof(sphere_t) }, { -1 }, sphere_bind, NULL, NULL },
+    // plane
+    { 1, { sizeof(plane_t) }, { offsetof(plane_t, priv) },
+      plane_bind, NULL, NULL },
+    // fplane
+    { 2, { sizeof(plane_t), sizeof(fplane_t) },
+      { offsetof(plane_t, priv), offsetof(fplane_t, priv) },
+      fplane_bind, NULL, NULL },
+    // tplane
+    { 2, { sizeof(plane_t), sizeof(tplane_t) },
+      { offsetof(plane_t, priv), -1 },
+      tplane_bind, NULL, NULL },
+    // texplane, the texture is loaded again from its file
+    { 3, { sizeof(plane_t), sizeof(fplane_t), sizeof(texplane_t) },
+      { offsetof(plane_t, priv), offsetof(fplane_t, priv),
+        offsetof(texplane_t, texture) },
+      texplane_bind, NULL, scenebin_texture },
+    { 0 },
+    // psphere
+    { 1, { sizeof(sphere_t) }, { -1 }, sphere_bind,
+      psphere_shader, psphere_shade },
+    // pplane
+    { 1, { sizeof(plane_t) }, { offsetof(plane_t, priv) }, plane_bind,
+      pplane_shader, pplane_shade }
+};
+#define NUM_KINDS sizeof(scenebin_kinds) / sizeof(scenebin_kind_t)
+
+/*
+ * Fill in the byte order and struct sizes of this build.
+ *
+ * PARAMETERS:
+ *  abi     - array of SCENEBIN_ABI values to fill
+ */
+static void scenebin_abi(uint32_t *abi) {
+    abi[0]  = 0x01020304;       // stored in the byte order of the build
+    abi[1]  = sizeof(void *);
+    abi[2]  = sizeof(obj_t);
+    abi[3]  = sizeof(material_t);
+    abi[4]  = sizeof(proj_t);
+    abi[5]  = sizeof(light_t);
+    abi[6]  = sizeof(sphere_t);
+    abi[7]  = sizeof(plane_t);
+    abi[8]  = sizeof(fplane_t);
+    abi[9]  = sizeof(tplane_t);
+    abi[10] = sizeof(texplane_t);
+}
+
+/*
+ * Checksum of a run of 64 bit words, FNV-1a taken a word at a time.
+ *
+ * PARAMETERS:
+ *  words   - words to sum
+ *  n       - number of words
+ *
+ * RETURNS:
+ *  the checksum
+ */
+static uint64_t scenebin_checksum(uint64_t *words, size_t n) {
+    uint64_t sum = 0xcbf29ce484222325ULL;
+    size_t   i;
+
+    for (i = 0; i < n; i++) {
+        sum = (sum ^ words[i]) * 0x100000001b3ULL;
+    }
+    return sum;
+}
+
+/*
+ * Grow the output by a number of zeroed bytes.
+ *
+ * PARAMETERS:
+ *  out     - output being written
+ *  size    - bytes to add, a multiple of 8
+ *
+ * RETURNS:
+ *  offset of the new bytes
+ */
+static uint64_t scenebin_alloc(scenebin_out_t *out, size_t size) {
+    uint64_t off = out->len;
+
+    if (out->len + size > out->cap) {
+        out->cap = out->cap * 2 > out->len + size + SCENEBIN_CHUNK ?
+                   out->cap * 2 : out->len + size + SCENEBIN_CHUNK;
+        out->buf = (char *)realloc(out->buf, out->cap);
+        if (out->buf == NULL) {
+            fprintf(stderr, "Error allocating memory.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    memset(out->buf + off, 0, size);
+    out->len += size;
+    return off;
+}
+
+/*
+ * Add bytes to a 64 bit FNV-1a hash.
+ *
+ * PARAMETERS:
+ *  hash    - hash of the bytes so far
+ *  bytes   - bytes to add
+ *  len     - number of bytes
+ *
+ * RETURNS:
+ *  the hash of all the bytes
+ */
+static uint64_t scenebin_fnv(uint64_t hash, void *bytes, size_t len) {
+    unsigned char *p = (unsigned char *)bytes;
+    size_t         i;
+
+    for (i = 0; i < len; i++) {
+        hash = (hash ^ p[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * Hash what an object holds: its type, material, shader and the structs
+ * of its priv chain, leaving out the pointers between them.  Objects are
+ * read into zeroed memory, so objects read alike hash alike.
+ *
+ * PARAMETERS:
+ *  obj     - object to hash
+ *
+ * RETURNS:
+ *  the hash
+ */
+uint64_t scenebin_hash(obj_t *obj) {
+    scenebin_kind_t *kind = &scenebin_kinds[obj->objtype - FIRST_TYPE];
+    uint64_t         hash = 14695981039346656037ULL;
+    char            *part = (char *)obj->priv;
+    int              param = kind->param != NULL ? kind->param(obj) : -1;
+    long             link;
+    int              i;
+
+    hash = scenebin_fnv(hash, &obj->objtype, sizeof(obj->objtype));
+    hash = scenebin_fnv(hash, &obj->material, sizeof(material_t));
+    hash = scenebin_fnv(hash, &param, sizeof(param));
+
+    for (i = 0; i < kind->nparts; i++) {
+        if ((link = kind->link[i]) < 0) {
+            hash = scenebin_fnv(hash, part, kind->size[i]);
+            continue;
+        }
+        hash = scenebin_fnv(hash, part, link);
+        hash = scenebin_fnv(hash, part + link + sizeof(void *),
+                            kind->size[i] - link - sizeof(void *));
+        if (i + 1 < kind->nparts) {
+            part = *(char **)(part + link);
+        }
+    }
+    return hash;
+}
+
+/*
+ * Store a pointer in the output as an offset and remember to relocate it.
+ *
+ * PARAMETERS:
+ *  out     - output being written
+ *  slot    - offset of the pointer
+ *  target  - offset it points to, 0 for NULL
+ */
+static void scenebin_pointer(scenebin_out_t *out, uint64_t slot,
+                             uint64_t target) {
+    *(uintptr_t *)(out->buf + slot) = (uintptr_t)target;
+
+    if (out->nrelocs == out->rcap) {
+        out->rcap = out->rcap == 0 ? SCENEBIN_CHUNK : out->rcap * 2;
+        out->relocs = (uint64_t *)realloc(out->relocs,
+                                          sizeof(uint64_t) * out->rcap);
+        if (out->relocs == NULL) {
+            fprintf(stderr, "Error allocating memory.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    out->relocs[out->nrelocs++] = slot;
+}
+
+/*
+ * Store every object of a list, each record straight after the last.
+ *
+ * PARAMETERS:
+ *  out     - output being written
+ *  list    - list to store
+ *  ends    - filled in with the offsets of the head and tail objects
+ */
+static void scenebin_list(scenebin_out_t *out, list_t *list, uint64_t *ends) {
+    obj_t           *obj;
+    obj_t           *copy;          // stored copy of obj
+    scenebin_kind_t *kind;          // layout of the object's type
+    scenebin_record_t *rec;
+    void            *part;          // struct of the priv chain being stored
+    uint64_t         size;          // bytes in the record
+    uint64_t         at;            // offset of the obj_t
+    uint64_t         off;           // offset of the next struct
+    int              i;
+
+    for (obj = list->head; obj != NULL; obj = obj->next) {
+        kind = &scenebin_kinds[obj->objtype - FIRST_TYPE];
+
+        size = sizeof(scenebin_record_t) + sizeof(obj_t);
+        for (i = 0; i < kind->nparts; i++) {
+            size += kind->size[i];
+        }
+
+        off = scenebin_alloc(out, size);
+        rec = (scenebin_record_t *)(out->buf + off);
+        rec->objtype = obj->objtype;
+        rec->param   = kind->param != NULL ? kind->param(obj) : -1;
+        rec->size    = size;
+
+        // function tables are bound again on load
+        at = off + sizeof(scenebin_record_t);
+        copy = (obj_t *)(out->buf + at);
+        copy->objid    = obj->objid;
+        copy->objtype  = obj->objtype;
+        copy->material = obj->material;
+
+        // records follow each other, so the next object is the next record
+        scenebin_pointer(out, at + offsetof(obj_t, next),
+                         obj->next != NULL ? off + size +
+                                             sizeof(scenebin_record_t) : 0);
+        off = at + sizeof(obj_t);
+        scenebin_pointer(out, at + offsetof(obj_t, priv), off);
+
+        part = obj->priv;
+        for (i = 0; i < kind->nparts; i++) {
+            memcpy(out->buf + off, part, kind->size[i]);
+
+            if (kind->link[i] >= 0) {
+                if (i + 1 < kind->nparts) {
+                    scenebin_pointer(out, off + kind->link[i],
+                                     off + kind->size[i]);
+                    part = *(void **)((char *)part + kind->link[i]);
+                } else {
+                    *(void **)(out->buf + off + kind->link[i]) = NULL;
+                }
+            }
+            off += kind->size[i];
+        }
+
+        if (ends[0] == 0) {
+            ends[0] = at;
+        }
+        ends[1] = at;
+        out->nrecords++;
+    }
+}
+
+/**
+ * Compile a model into memory.  The caller frees out->buf and out->relocs.
+ *
+ * PARAMETERS:
+ *  out     - filled in with the compiled scene, out->buf holding out->len
+ *            bytes
+ *  model   - model to store
+ */
+void scenebin_compile(scenebin_out_t *out, model_t *model) {
+    scenebin_header_t *header;
+    uint64_t           proj;        // offset of the projection
+    uint64_t           records;     // offset of the first record
+    uint64_t           lights[2] = { 0, 0 };
+    uint64_t           scene[2]  = { 0, 0 };
+    uint64_t           relocs;      // offset of the relocation table
+
+    memset(out, 0, sizeof(scenebin_out_t));
+    scenebin_alloc(out, sizeof(scenebin_header_t));
+
+    proj = scenebin_alloc(out, sizeof(proj_t));
+    memcpy(out->buf + proj, model->proj, sizeof(proj_t));
+
+    // lights then scene objects, in list order
+    records = out->len;
+    scenebin_list(out, model->lights, lights);
+    scenebin_list(out, model->scene, scene);
+
+    relocs = scenebin_alloc(out, sizeof(uint64_t) * out->nrelocs);
+    memcpy(out->buf + relocs, out->relocs, sizeof(uint64_t) * out->nrelocs);
+
+    // the output doesn't move any more
+    header = (scenebin_header_t *)out->buf;
+    memcpy(header->magic, SCENEBIN_MAGIC, sizeof(SCENEBIN_MAGIC));
+    header->version  = SCENEBIN_VERSION;
+    scenebin_abi(header->abi);
+    header->proj      = proj;
+    header->lights[0] = lights[0];
+    header->lights[1] = lights[1];
+    header->scene[0]  = scene[0];
+    header->scene[1]  = scene[1];
+    header->records  = records;
+    header->nrecords = out->nrecords;
+    header->relocs   = relocs;
+    header->nrelocs  = out->nrelocs;
+    header->size     = out->len;
+    header->checksum = scenebin_checksum(
+                (uint64_t *)(out->buf + sizeof(scenebin_header_t)),
+                (out->len - sizeof(scenebin_header_t)) / sizeof(uint64_t));
+
+#ifdef DEBUG_SCENEBIN
+    fprintf(stderr, "scenebin_compile: %lu objects, %lu pointers, "
+            "%lu bytes\n", (unsigned long)out->nrecords,
+            (unsigned long)out->nrelocs, (unsigned long)out->len);
+#endif
+}
+
+/**
+ * Write a model to a compiled scene file.
+ *
+ * PARAMETERS:
+ *  path    - file to write
+ *  model   - model to store
+ *
+ * RETURNS:
+ *  0 on success
+ */
+int scenebin_write(char *path, model_t *model) {
+    scenebin_out_t out;
+    FILE          *file;
+
+    scenebin_compile(&out, model);
+
+    if ((file = fopenAndCheck(path, "wb")) == NULL) {
+        free(out.buf);
+        free(out.relocs);
+        return EXIT_FAILURE;
+    }
+
+    if (fwrite(out.buf, 1, out.len, file) != out.len || fclose(file) != 0) {
+        fprintf(stderr, "Error writing compiled scene: %s\n", path);
+        free(out.buf);
+        free(out.relocs);
+        return EXIT_FAILURE;
+    }
+
+    free(out.buf);
+    free(out.relocs);
+    return 0;
+}
+
+/*
+ * Print an error about a compiled scene and exit.
+ *
+ * PARAMETERS:
+ *  bin     - compiled scene
+ *  fmt     - printf style message
+ */
+static void scenebin_error(scenebin_t *bin, char *fmt, ...) {
+    va_list args;
+
+    fprintf(stderr, "%s: ", bin->name);
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fprintf(stderr, "\n");
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * Map a compiled scene if a file holds one.  The file is checked against
+ * this build and its checksum before it is used.
+ *
+ * PARAMETERS:
+ *  in      - file to map, read from its start
+ *  name    - name of the file for errors
+ *
+ * RETURNS:
+ *  the mapped scene, or NULL if the file doesn't hold a compiled scene and
+ *  should be read as text
+ */
+scenebin_t *scenebin_open(FILE *in, char *name) {
+    scenebin_header_t header;
+    uint32_t          abi[SCENEBIN_ABI];
+    struct stat       st;
+    scenebin_t       *bin;
+    int               fd = fileno(in);
+
+    // only regular files can be mapped, anything else is read as text
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+        (size_t)st.st_size < sizeof(scenebin_header_t) ||
+        pread(fd, &header, sizeof(scenebin_header_t), 0) !=
+                                      (ssize_t)sizeof(scenebin_header_t) ||
+        memcmp(header.magic, SCENEBIN_MAGIC, sizeof(SCENEBIN_MAGIC)) != 0) {
+        return NULL;
+    }
+
+    bin = (scenebin_t *)smalloc(sizeof(scenebin_t));
+    bin->name = name;
+    bin->size = st.st_size;
+
+    if (header.version != SCENEBIN_VERSION) {
+        scenebin_error(bin, "compiled scene version %u, expected %u",
+                       header.version, SCENEBIN_VERSION);
+    }
+
+    scenebin_abi(abi);
+    if (memcmp(header.abi, abi, sizeof(abi)) != 0) {
+        scenebin_error(bin, "scene was compiled by an incompatible build");
+    }
+
+    if (header.size != bin->size || bin->size % sizeof(uint64_t) != 0) {
+        scenebin_error(bin, "compiled scene is %lu bytes, expected %lu",
+                       (unsigned long)bin->size, (unsigned long)header.size);
+    }
+
+    // private, so pointers are relocated without touching the file
+    bin->base = (char *)mmap(NULL, bin->size, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE, fd, 0);
+    if (bin->base == MAP_FAILED) {
+        scenebin_error(bin, "could not map compiled scene");
+    }
+    bin->header = (scenebin_header_t *)bin->base;
+
+    if (scenebin_checksum((uint64_t *)(bin->base + sizeof(scenebin_header_t)),
+                (bin->size - sizeof(scenebin_header_t)) / sizeof(uint64_t))
+        != header.checksum) {
+        scenebin_error(bin, "compiled scene is corrupt, bad checksum");
+    }
+
+    if (header.proj > bin->size - sizeof(proj_t) ||
+        header.relocs > bin->size ||
+        header.nrelocs > (bin->size - header.relocs) / sizeof(uint64_t)) {
+        scenebin_error(bin, "compiled scene is corrupt, bad header");
+    }
+
+    return bin;
+}
+
+/**
+ * Find the projection stored in a compiled scene.
+ *
+ * PARAMETERS:
+ *  bin     - compiled scene
+ *
+ * RETURNS:
+ *  the stored projection
+ */
+proj_t *scenebin_proj(scenebin_t *bin) {
+    return (proj_t *)(bin->base + bin->header->proj);
+}
+
+/*
+ * Load the texture of a texplane mapped from a compiled scene.
+ *
+ * PARAMETERS:
+ *  obj     - texplane object
+ *  param   - unused
+ */
+static void scenebin_texture(obj_t *obj, int param) {
+    texplane_t *tp =
+            (texplane_t *)((fplane_t *)((plane_t *)obj->priv)->priv)->priv;
+
+    if (texture_load(tp)) {
+        fprintf(stderr, "Failed to load texture file: %s\n", tp->texname);
+        exit(INIT_FAILURE);
+    }
+}
+
+/**
+ * Relocate and bind the objects of a compiled scene in place and hand them
+ * to a model.
+ *
+ * PARAMETERS:
+ *  bin     - compiled scene
+ *  model   - model whose empty lists get the lights and scene objects
+ *
+ * RETURNS:
+ *  0 on success
+ */
+int scenebin_load(scenebin_t *bin, model_t *model) {
+    scenebin_header_t *header = bin->header;
+    uint64_t          *relocs = (uint64_t *)(bin->base + header->relocs);
+    scenebin_record_t *rec;
+    scenebin_kind_t   *kind;
+    uintptr_t         *slot;
+    obj_t             *obj;
+    uint64_t           off;
+    uint64_t           i;
+
+    // turn stored offsets back into pointers
+    for (i = 0; i < header->nrelocs; i++) {
+        if (relocs[i] > bin->size - sizeof(uintptr_t) ||
+            relocs[i] % sizeof(uintptr_t) != 0) {
+            scenebin_error(bin, "compiled scene is corrupt, bad pointer");
+        }
+
+        slot = (uintptr_t *)(bin->base + relocs[i]);
+        if (*slot >= bin->size) {
+            scenebin_error(bin, "compiled scene is corrupt, bad pointer");
+        }
+        *slot = *slot != 0 ? (uintptr_t)(bin->base + *slot) : 0;
+    }
+
+    // bind the function table of every object
+    off = header->records;
+    for (i = 0; i < header->nrecords; i++) {
+        rec = (scenebin_record_t *)(bin->base + off);
+        if (off > bin->size - sizeof(scenebin_record_t) ||
+            rec->size > bin->size - off ||
+            rec->objtype > LAST_TYPE || rec->objtype < FIRST_TYPE ||
+            scenebin_kinds[rec->objtype - FIRST_TYPE].nparts == 0) {
+            scenebin_error(bin, "compiled scene is corrupt, bad object");
+        }
+        kind = &scenebin_kinds[rec->objtype - FIRST_TYPE];
+        obj  = (obj_t *)(rec + 1);
+
+        kind->bind(obj);
+        if (kind->attach != NULL) {
+            kind->attach(obj, rec->param);
+        }
+
+        off += rec->size;
+    }
+
+    model->lights->head = (obj_t *)(header->lights[0] != 0 ?
+                                    bin->base + header->lights[0] : NULL);
+    model->lights->tail = (obj_t *)(header->lights[1] != 0 ?
+                                    bin->base + header->lights[1] : NULL);
+    model->scene->head  = (obj_t *)(header->scene[0] != 0 ?
+                                    bin->base + header->scene[0] : NULL);
+    model->scene->tail  = (obj_t *)(header->scene[1] != 0 ?
+                                    bin->base + header->scene[1] : NULL);
+
+#ifdef DEBUG_SCENEBIN
+    fprintf(stderr, "scenebin_load: %lu objects, %lu pointers\n",
+            (unsigned long)header->nrecords, (unsigned long)header->nrelocs);
+#endif
+
+    return 0;
+}
+
+/**
+ * Unmap a compiled scene.  The objects mapped from it must already have
+ * been freed.
+ *
+ * PARAMETERS:
+ *  bin     - compiled scene to close
+ */
+void scenebin_close(scenebin_t *bin) {
+    munmap(bin->base, bin->size);
+    free(bin);
+}
@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <stdint.h>
+#include "common.h"
+
+#ifndef SCENEBIN_H
+#define SCENEBIN_H
+
+#define SCENEBIN_MAGIC      "RTSCENE"   /* first bytes of a compiled scene */
+#define SCENEBIN_VERSION    1
+#define SCENEBIN_ABI        11          /* struct sizes checked on load */
+#define SCENEBIN_PARTS      3           /* longest priv chain */
+
+/* start of a compiled scene.  Offsets are from the start of the file and
+ * 0 stands for NULL */
+typedef struct scenebin_header_type {
+    char        magic[8];
+    uint32_t    version;
+    uint32_t    abi[SCENEBIN_ABI];  /* byte order and sizes of the stored
+                                       structs of the build that wrote it */
+    uint64_t    size;               /* bytes in the file */
+    uint64_t    checksum;           /* of everything after the header */
+    uint64_t    proj;               /* projection */
+    uint64_t    lights[2];          /* head and tail of the light list */
+    uint64_t    scene[2];           /* head and tail of the scene list */
+    uint64_t    records;            /* first object record */
+    uint64_t    nrecords;
+    uint64_t    relocs;             /* offsets of every stored pointer */
+    uint64_t    nrelocs;
+} scenebin_header_t;
+
+/* start of one object, followed by its obj_t and its priv chain */
+typedef struct scenebin_record_type {
+    int32_t     objtype;
+    int32_t     param;              /* shader index of procedural objects */
+    uint64_t    size;               /* bytes in the record, this included */
+} scenebin_record_t;
+
+/* compiled scene being written */
+typedef struct scenebin_out_type {
+    char       *buf;
+    size_t      len;
+    size_t      cap;
+    uint64_t   *relocs;             /* offsets of the pointers in buf */
+    size_t      nrelocs;
+    size_t      rcap;
+    uint64_t    nrecords;
+} scenebin_out_t;
+
+/* compiled scene mapped into memory */
+typedef struct scenebin_type {
+    char               *name;       /* name of the input for errors */
+    char               *base;       /* start of the mapping */
+    size_t              size;
+    scenebin_header_t  *header;
+} scenebin_t;
+
+uint64_t scenebin_hash(obj_t *);
+
+void scenebin_compile(scenebin_out_t *, model_t *);
+
+int scenebin_write(char *, model_t *);
+
+scenebin_t *scenebin_open(FILE *, char *);
+
+proj_t *scenebin_proj(scenebin_t *);
+
+int scenebin_load(scenebin_t *, model_t *);
+
+void scenebin_close(scenebin_t *);
+#endif
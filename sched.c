@@ -0,0 +1,127 @@
+/*
+ * sched.c
+ *
+ * Work stealing scheduler that hands out render tiles to worker threads.
+ * Every worker owns a deque holding a contiguous run of tiles.  It takes
+ * tiles from the bottom of its own deque and, once that is empty, steals
+ * from the top of the other workers' deques so that expensive regions of
+ * the image don't leave threads idle.
+ *
+ * Chris Blades
+ *
+ * 18/10/2026
+ */
+#include <stdlib.h>
+#include <pthread.h>
+#include "safe.h"
+#include "sched.h"
+
+/*
+ * Initialize a scheduler and split the tiles evenly between the workers.
+ *
+ * PARAMETERS:
+ *  nworkers    - number of worker threads
+ *  ntiles      - number of tiles to hand out
+ *
+ * RETURNS:
+ *  pointer to the new scheduler
+ */
+sched_t *sched_init(int nworkers, int ntiles) {
+    sched_t *sched = (sched_t *)smalloc(sizeof(sched_t));
+    deque_t *dq;        // deque being filled
+    int      first;     // first tile given to the current worker
+    int      last;      // one past the last tile given to the current worker
+    int      w;         // worker index
+    int      i;
+
+    sched->nworkers = nworkers;
+    sched->deques = (deque_t *)smalloc(sizeof(deque_t) * nworkers);
+
+    for (w = 0; w < nworkers; w++) {
+        dq = &sched->deques[w];
+        first = (int)((long)ntiles * w / nworkers);
+        last  = (int)((long)ntiles * (w + 1) / nworkers);
+
+        pthread_mutex_init(&dq->lock, NULL);
+        dq->tiles = (int *)smalloc(sizeof(int) * (last - first + 1));
+        dq->top = 0;
+        dq->bottom = 0;
+
+        // owner works from the bottom, so push in reverse to have it
+        // start with its first tile
+        for (i = last - 1; i >= first; i--) {
+            dq->tiles[dq->bottom++] = i;
+        }
+    }
+
+    return sched;
+}
+
+/*
+ * Take a tile from the top of another worker's deque.
+ *
+ * PARAMETERS:
+ *  dq  - deque to steal from
+ *
+ * RETURNS:
+ *  the stolen tile or -1 if the deque was empty
+ */
+static int sched_steal(deque_t *dq) {
+    int tile = -1;
+
+    pthread_mutex_lock(&dq->lock);
+    if (dq->top < dq->bottom) {
+        tile = dq->tiles[dq->top++];
+    }
+    pthread_mutex_unlock(&dq->lock);
+
+    return tile;
+}
+
+/*
+ * Get the next tile for a worker.  Tiles come from the worker's own deque
+ * first, then are stolen from the other workers in turn.  No tiles are
+ * added once rendering starts, so a full pass over every deque that finds
+ * nothing means the image is done.
+ *
+ * PARAMETERS:
+ *  sched   - scheduler to take from
+ *  worker  - index of the calling worker
+ *
+ * RETURNS:
+ *  index of the next tile to render or -1 if there are none left
+ */
+int sched_next(sched_t *sched, int worker) {
+    deque_t *dq = &sched->deques[worker];   // worker's own deque
+    int      tile = -1;
+    int      i;
+
+    pthread_mutex_lock(&dq->lock);
+    if (dq->top < dq->bottom) {
+        tile = dq->tiles[--dq->bottom];
+    }
+    pthread_mutex_unlock(&dq->lock);
+
+    for (i = 1; tile < 0 && i < sched->nworkers; i++) {
+        tile = sched_steal(&sched->deques[(worker + i) % sched->nworkers]);
+    }
+
+    return tile;
+}
+
+/*
+ * Free a scheduler and its deques.
+ *
+ * PARAMETERS:
+ *  sched   - scheduler to free
+ */
+void sched_free(sched_t *sched) {
+    int w;
+
+    for (w = 0; w < sched->nworkers; w++) {
+        pthread_mutex_destroy(&sched->deques[w].lock);
+        free(sched->deques[w].tiles);
+    }
+    free(sched->deques);
+    free(sched);
+}
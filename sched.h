@@ -0,0 +1,25 @@
+#include <pthread.h>
+
+#ifndef SCHED_H
+#define SCHED_H
+
+/* double ended queue of tile indices owned by one worker */
+typedef struct deque_type {
+    pthread_mutex_t lock;
+    int     *tiles;     /* tile indices */
+    int      top;       /* next tile a thief takes */
+    int      bottom;    /* one past the next tile the owner takes */
+} deque_t;
+
+/* work stealing tile scheduler */
+typedef struct sched_type {
+    int      nworkers;
+    deque_t *deques;    /* one deque per worker */
+} sched_t;
+
+sched_t *sched_init(int, int);
+
+int sched_next(sched_t *, int);
+
+void sched_free(sched_t *);
+#endif
@@ -16,58 +16,56 @@
 #include "material.h"
 #include "veclib3d.h"
 
+/* functions of every sphere */
+static const obj_ops_t sphere_ops = {
+    hits_sphere, sphere_hitinfo, shade_default,
+    getamb_default, getdif_default, getspec_default,
+    sphere_bounds, sphere_dump, NULL
+};
+
 /*
  * Intialize a sphere object by reading in from a file.
  *
  * PARAMETERS:
- *  in      - file to read from
+ *  scan    - scanner to read from
  *  objtype - type of object to initialize
  *
  *  RETURN:
  *  newly created object
  */
-obj_t *sphere_init(FILE *in, int objtype) {
+obj_t *sphere_init(scan_t *scan, int objtype) {
     sphere_t *sphere = NULL;    // sphere object to create
-    char    buf[256];           // buffer to read into
-    int     rc = 0;             // read counter
-
     
-    obj_t *obj = object_init(in, objtype);
+    obj_t *obj = object_init(scan, objtype);
     
-    sphere = (sphere_t *)smalloc(sizeof(sphere_t));
+    sphere = (sphere_t *)object_alloc(sizeof(sphere_t));
     
-    material_init(in, &obj->material);
+    material_init(scan, &obj->material);
     // connect sphere to obj
     obj->priv = sphere;
 
     // connect function pointers
-    obj->hits = hits_sphere;
-    obj->dump = sphere_dump;;
+    sphere_bind(obj);
 
     // read in center
-    while (rc != 3) {
-        rc = fscanf(in, "%lf %lf %lf", &sphere->center[0], &sphere->center[1],
-                                        &sphere->center[2]);
-        fgets(buf, 256, in);
-#ifdef DEBUG_OBJECTS
-        fprintf(stderr, "sphere read %s\n", buf);
-#endif
-    }
-
-    rc = 0;
+    scan_doubles(scan, sphere->center, 3, "sphere center");
 
     // read in radius
-    while (rc != 1) {
-        rc = fscanf(in, "%lf", &sphere->radius);
-        fgets(buf, 256, in);
-#ifdef DEBUG_OBJECTS
-        fprintf(stderr, "sphere read %s\n", buf);
-#endif
-    }
+    scan_doubles(scan, &sphere->radius, 1, "sphere radius");
 
     return obj;
 }
 
+/*
+ * Connect the function table of a sphere object.
+ *
+ * PARAMETERS:
+ *  obj -   object to bind
+ */
+void sphere_bind(obj_t *obj) {
+    obj->ops = &sphere_ops;
+}
+
 /*
  * Prints information about a sphere object.
  *
@@ -100,9 +98,6 @@ double hits_sphere(double *base, double *dir, obj_t *obj) {
     sphere_t *sphere = (sphere_t *)obj->priv;
     
     double Vprime[3];
-    double H[3];
-    double N[3];
-    double temp[3];
     double a;
     double b;
     double c;
@@ -126,24 +121,48 @@ double hits_sphere(double *base, double *dir, obj_t *obj) {
     } else {
         return -1;
     }
-    
 
-    vec_scale3(t, dir, temp);   
-    vec_sum3(base, temp, H);
+    return t;
+}
 
-    vec_diff3(sphere->center, H, N);
-    vec_unit3(N, N);
+/*
+ * Fills in the hit point and normal for a ray that hits a sphere.
+ *
+ * PARAMETERS:
+ *  base    - the starting point of the ray
+ *  dir     - the direction of the ray
+ *  obj     - sphere that was hit
+ *  hit     - hit record holding the distance, filled in with the rest
+ */
+void sphere_hitinfo(double *base, double *dir, obj_t *obj, hit_t *hit) {
+    sphere_t *sphere = (sphere_t *)obj->priv;
+    double temp[3];
+
+    vec_scale3(hit->t, dir, temp);
+    vec_sum3(base, temp, hit->hitloc);
+
+    vec_diff3(sphere->center, hit->hitloc, hit->normal);
+    vec_unit3(hit->normal, hit->normal);
 
 #ifdef DEBUG_OBJECTS
-    vec_prn3(stderr, "Sphere Normal", N);
+    vec_prn3(stderr, "Sphere Normal", hit->normal);
 #endif
-    obj->hitloc[0] = H[0];
-    obj->hitloc[1] = H[1];
-    obj->hitloc[2] = H[2];
-    
-    obj->normal[0] = N[0];
-    obj->normal[1] = N[1];
-    obj->normal[2] = N[2];
+}
 
-    return t;
+/*
+ * Finds the bounding box of a sphere.
+ *
+ * PARAMETERS:
+ *  obj     - sphere object
+ *  min     - lower corner of the box
+ *  max     - upper corner of the box
+ */
+void sphere_bounds(obj_t *obj, double *min, double *max) {
+    sphere_t *sphere = (sphere_t *)obj->priv;
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        min[i] = sphere->center[i] - fabs(sphere->radius);
+        max[i] = sphere->center[i] + fabs(sphere->radius);
+    }
 }
@@ -1,12 +1,19 @@
 #include <stdio.h>
 #include "ray.h"
+#include "scan.h"
 
 #ifndef SPHERE_H
 #define SPHERE_H
 
-obj_t *sphere_init(FILE *, int);
+obj_t *sphere_init(scan_t *, int);
+
+void sphere_bind(obj_t *);
 
 void sphere_dump(FILE *, obj_t *);
 
 double hits_sphere(double *, double *, obj_t *);
+
+void sphere_hitinfo(double *, double *, obj_t *, hit_t *);
+
+void sphere_bounds(obj_t *, double *, double *);
 #endif
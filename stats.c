@@ -0,0 +1,182 @@
+/*
+ * stats.c
+ *
+ * Render statistics: intersection tests and hits by object type, rays by
+ * recursion depth and rays cut off by a render limit.  The counters are only
+ * compiled in with -DRENDER_STATS, otherwise the STATS_ macros in stats.h
+ * are empty.  Each render thread counts into its own stats_t, found
+ * through a thread local pointer, and the counts are added up when the
+ * thread is done.  The report is written as JSON, together with the stage
+ * times and rays by kind kept by bench.c.
+ *
+ * Chris Blades
+ *
+ * 18/10/2026
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "safe.h"
+#include "stats.h"
+
+#ifdef RENDER_STATS
+__thread stats_t *stats_local = NULL;
+#endif
+
+/* names of the object types in reports, NULL for unused type codes */
+static char *type_names[STATS_TYPES] =
+{
+    "light",
+    NULL,
+    NULL,
+    "sphere",
+    "plane",
+    "fplane",
+    "tplane",
+    "texplane",
+    NULL,
+    "psphere",
+    "pplane"
+};
+
+/* names of the ray kinds in reports */
+static char *kind_names[RAY_KINDS] =
+{
+    "primary",
+    "shadow",
+    "specular"
+};
+
+/**
+ * Allocate a zeroed set of statistics.
+ *
+ * RETURNS:
+ *  pointer to the new statistics
+ */
+stats_t *stats_init(void) {
+    stats_t *stats = (stats_t *)smalloc(sizeof(stats_t));
+
+    memset(stats, 0, sizeof(stats_t));
+    return stats;
+}
+
+/**
+ * Make a set of statistics the one the calling thread counts into.
+ *
+ * PARAMETERS:
+ *  stats   - statistics of the calling thread
+ */
+void stats_bind(stats_t *stats) {
+#ifdef RENDER_STATS
+    stats_local = stats;
+#endif
+}
+
+/**
+ * Add one set of statistics to another.
+ *
+ * PARAMETERS:
+ *  into    - statistics to add to
+ *  from    - statistics to add
+ */
+void stats_merge(stats_t *into, stats_t *from) {
+    int i;
+
+    for (i = 0; i < STATS_TYPES; i++) {
+        into->tests[i] += from->tests[i];
+        into->hits[i]  += from->hits[i];
+    }
+    for (i = 0; i < STATS_DEPTHS; i++) {
+        into->depth[i] += from->depth[i];
+    }
+    into->cutoff += from->cutoff;
+}
+
+/*
+ * Print a statistics report as JSON.
+ *
+ * PARAMETERS:
+ *  out     - file to print to
+ *  model   - model that was rendered
+ *  stats   - statistics of every render thread
+ */
+static void stats_json(FILE *out, model_t *model, stats_t *stats) {
+    bench_t *bench = model->bench;
+    char    *sep = "";
+    int      last = 0;          // deepest depth with any rays
+    int      i;
+
+    fprintf(out, "{\n  \"time_s\": {\"parse\": %.6f, \"build\": %.6f, "
+                 "\"render\": %.6f, \"output\": %.6f},\n",
+            bench->parse_time, bench->build_time,
+            bench->render_time - bench->output_time, bench->output_time);
+
+    fprintf(out, "  \"rays\": {");
+    for (i = 0; i < RAY_KINDS; i++) {
+        fprintf(out, "%s\"%s\": %ld", sep, kind_names[i], bench->rays[i]);
+        sep = ", ";
+    }
+    fprintf(out, ", \"cutoff\": %ld},\n", stats->cutoff);
+
+    fprintf(out, "  \"objects\": {");
+    sep = "";
+    for (i = 0; i < STATS_TYPES; i++) {
+        if (type_names[i] == NULL || i == LIGHT - FIRST_TYPE) {
+            continue;
+        }
+        fprintf(out, "%s\n    \"%s\": {\"tests\": %ld, \"hits\": %ld}",
+                sep, type_names[i], stats->tests[i], stats->hits[i]);
+        sep = ",";
+    }
+    fprintf(out, "\n  },\n");
+
+    for (i = 0; i < STATS_DEPTHS; i++) {
+        if (stats->depth[i] != 0) {
+            last = i;
+        }
+    }
+    fprintf(out, "  \"depth\": [");
+    for (i = 0; i <= last; i++) {
+        fprintf(out, "%s%ld", i > 0 ? ", " : "", stats->depth[i]);
+    }
+    fprintf(out, "]\n}\n");
+}
+
+/**
+ * Write a statistics report as JSON.
+ *
+ * PARAMETERS:
+ *  path    - file to write, "-" for stderr
+ *  model   - model that was rendered
+ *  stats   - statistics of every render thread
+ *
+ * RETURNS:
+ *  0 on success
+ */
+int stats_write(char *path, model_t *model, stats_t *stats) {
+    FILE *out;
+
+    if (strcmp(path, "-") == 0) {
+        stats_json(stderr, model, stats);
+        return 0;
+    }
+
+    if ((out = fopenAndCheck(path, "w")) == NULL) {
+        return EXIT_FAILURE;
+    }
+
+    stats_json(out, model, stats);
+    fclose(out);
+    return 0;
+}
+
+/**
+ * Free a set of statistics.
+ *
+ * PARAMETERS:
+ *  stats   - statistics to free
+ */
+void stats_free(stats_t *stats) {
+    free(stats);
+}
@@ -0,0 +1,56 @@
+#include <stdio.h>
+#include "common.h"
+
+#ifndef STATS_H
+#define STATS_H
+
+#define STATS_TYPES     (LAST_TYPE - FIRST_TYPE + 1)
+#define STATS_DEPTHS    16      /* depths counted apart, deeper rays are
+                                   counted with the last */
+
+/* render statistics gathered by one thread, or by all of them */
+typedef struct stats_type {
+    long    tests[STATS_TYPES]; /* intersection tests by object type */
+    long    hits[STATS_TYPES];  /* tests that hit, by object type */
+    long    depth[STATS_DEPTHS];/* rays traced at each recursion depth */
+    long    cutoff;             /* rays not traced, past a render limit */
+    int     level;              /* recursion depth of the current ray */
+} stats_t;
+
+#ifdef RENDER_STATS
+/* statistics of the calling thread */
+extern __thread stats_t *stats_local;
+
+#define STATS_TEST(objtype, hit) do {                                   \
+        stats_local->tests[(objtype) - FIRST_TYPE]++;                   \
+        stats_local->hits[(objtype) - FIRST_TYPE] += (hit) ? 1 : 0;     \
+    } while (0)
+
+#define STATS_RAY() do {                                                \
+        stats_local->depth[stats_local->level < STATS_DEPTHS ?          \
+                           stats_local->level : STATS_DEPTHS - 1]++;    \
+    } while (0)
+
+#define STATS_ENTER()   (stats_local->level++)
+#define STATS_LEAVE()   (stats_local->level--)
+#define STATS_LEVEL(n)  (stats_local->level = (n))
+#define STATS_CUTOFF()  (stats_local->cutoff++)
+#else
+#define STATS_TEST(objtype, hit)    do { } while (0)
+#define STATS_RAY()                 do { } while (0)
+#define STATS_ENTER()               do { } while (0)
+#define STATS_LEAVE()               do { } while (0)
+#define STATS_LEVEL(n)              do { } while (0)
+#define STATS_CUTOFF()              do { } while (0)
+#endif
+
+stats_t *stats_init(void);
+
+void stats_bind(stats_t *);
+
+void stats_merge(stats_t *, stats_t *);
+
+int stats_write(char *, model_t *, stats_t *);
+
+void stats_free(stats_t *);
+#endif
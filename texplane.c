@@ -19,61 +19,49 @@
 #include "material.h"
 #include "veclib3d.h"
 
+/* functions of every texplane, textured over a finite plane */
+static const obj_ops_t texplane_ops = {
+    hits_fplane, fplane_hitinfo, texplane_shade,
+    texplane_amb, texplane_diff, getspec_default,
+    fplane_bounds, texplane_dump, texplane_release
+};
+
 /**
  * Initialize an texplane object from a file.
  *
  * PARAMETERS:
- *  in      - file to read from
+ *  scan    - scanner to read from
  *  objtype - type of object to initalize
  *
  *  RETURNS:
  *  the newly created object
  */
-obj_t * texplane_init(FILE *in, int objtype) {
+obj_t * texplane_init(scan_t *scan, int objtype) {
     texplane_t *texplane;
     fplane_t   *fp;
     plane_t    *p;
     obj_t      *obj;
     
-    obj = fplane_init(in, objtype);  // base object struct
+    obj = fplane_init(scan, objtype);  // base object struct
     
     p = (plane_t *)obj->priv;
     fp = (fplane_t *)p->priv;
 
     texplane = 
-            (texplane_t *)smalloc(sizeof(texplane_t));   // new texplane struct
+            (texplane_t *)object_alloc(sizeof(texplane_t));  // new texplane
         
+    texplane->texture = NULL;
     fp->priv = texplane;      // connect texplane to obj
-    obj->dump = texplane_dump;    
-    obj->getamb = texplane_amb;
-    obj->getdif = texplane_diff;
-    obj->obj_free = texplane_free;
-
-    char    buf[256];       // buffer for reading in values
-    int     rc = 0;         // read counter
+    texplane_bind(obj);       // connect texplane functions
 
-    texplane->texname[0] = '\0';
-
-    while (strlen(texplane->texname) < 2) {
-        // read in texture filename
-        fgets(texplane->texname, FILENAME_SIZE, in);
-    }
-    if (texplane->texname[strlen(texplane->texname) - 1] == '\n') {
-        texplane->texname[strlen(texplane->texname) - 1] = '\0';
-    }
+    // read in texture filename
+    scan_line(scan, texplane->texname, FILENAME_SIZE, "texture filename");
 #ifdef DEBUG_TEXTURE
         fprintf(stderr, "texture file: %s\n", texplane->texname);
 #endif    
-#ifdef DEBUG_OBJECTS
-        fprintf(stderr, "texplane read %s\n", buf);
-#endif
 
-    rc = 0;
     // read in tile mode
-    while (rc != 1) {
-        rc = fscanf(in, "%df", &texplane->texmode);
-
-        fgets(buf, 256, in);
+    scan_ints(scan, &texplane->texmode, 1, "texture mode");
 
 #ifdef DEBUG_TEXTURE
         fprintf(stderr, "Texturing mode: ");
@@ -85,10 +73,6 @@ obj_t * texplane_init(FILE *in, int objtype) {
             fprintf(stderr, "unrecognized (%d\n", texplane->texmode);
         }
 #endif
-#ifdef DEBUG_OBJECTS
-        fprintf(stderr, "texplane read %s\n", buf);
-#endif
-    }
     
     if (texture_load(texplane)) {
 #ifdef DEBUG_TEXTURE
@@ -100,24 +84,31 @@ obj_t * texplane_init(FILE *in, int objtype) {
    return obj;
 }
 
+/*
+ * Connect the function table of a texplane object.
+ *
+ * PARAMETERS:
+ *  obj -   object to bind
+ */
+void texplane_bind(obj_t *obj) {
+    obj->ops = &texplane_ops;
+}
+
 
 /*
- * Frees memory associated with a texplane object.
+ * Lets go of the texture of a texplane object.
  *
  * PARMETERS:
- *  obj - texplane object to free
+ *  obj - texplane object to release
  */
-void texplane_free(obj_t *obj) {
+void texplane_release(obj_t *obj) {
     plane_t *p = (plane_t *)obj->priv;
     fplane_t *fp = (fplane_t *)p->priv;
     texplane_t *tp = (texplane_t *)fp->priv;
    
     if (tp->texture != NULL) {
         texture_free(tp->texture);
-        free(tp->texture);
     }
-
-    fplane_free(obj);
 }
 
 
@@ -148,15 +139,16 @@ void texplane_dump(FILE *out, obj_t *obj) {
  *
  * PARAMETRS:
  *  obj    - texplane object
+ *  hit    - hit point on the texplane
  *  values - array to store rgb values in
  */
-void texplane_diff(obj_t *obj, double *values) {
+void texplane_diff(obj_t *obj, hit_t *hit, double *values) {
     plane_t    *p   = (plane_t *)obj->priv;
     fplane_t   *fp  = (fplane_t *)p->priv;
     material_t *mat = &obj->material;
     double texel[3];
 
-    texture_map(fp, texel);
+    texture_map(fp, hit, texel);
 #ifdef DEBUG_TEXTURE
     fprintf(stderr, "Texel: (%lf, %lf, %lf)\n", texel[0], texel[1], texel[2]);
 #endif
@@ -172,15 +164,16 @@ void texplane_diff(obj_t *obj, double *values) {
  *
  * PARAMETRS:
  *  obj    - texplane object
+ *  hit    - hit point on the texplane
  *  values - array to store rgb values in
  */
-void texplane_amb(obj_t *obj, double *values) {
+void texplane_amb(obj_t *obj, hit_t *hit, double *values) {
     plane_t    *p   = (plane_t *)obj->priv;
     fplane_t   *fp  = (fplane_t *)p->priv;
     material_t *mat = &obj->material;
     double texel[3];
 
-    texture_map(fp, texel);
+    texture_map(fp, hit, texel);
 #ifdef DEBUG_TEXTURE
     fprintf(stderr, "Texel: (%lf, %lf, %lf)\n", texel[0], texel[1], texel[2]);
 #endif
@@ -189,3 +182,30 @@ void texplane_amb(obj_t *obj, double *values) {
     *(values + 1) = mat->ambient[1] * texel[1];
     *(values + 2) = mat->ambient[2] * texel[2];
 }
+
+/*
+ * Retrieves all the reflectivities for a texplane, looking the texture up
+ * once for both the ambient and the diffuse values
+ *
+ * PARAMETRS:
+ *  obj    - texplane object
+ *  hit    - hit point on the texplane
+ *  mat    - material to store the reflectivities in
+ */
+void texplane_shade(obj_t *obj, hit_t *hit, material_t *mat) {
+    plane_t    *p   = (plane_t *)obj->priv;
+    fplane_t   *fp  = (fplane_t *)p->priv;
+    double texel[3];
+    int i;
+
+    texture_map(fp, hit, texel);
+#ifdef DEBUG_TEXTURE
+    fprintf(stderr, "Texel: (%lf, %lf, %lf)\n", texel[0], texel[1], texel[2]);
+#endif
+
+    for (i = 0; i < 3; i++) {
+        mat->ambient[i]  = obj->material.ambient[i] * texel[i];
+        mat->diffuse[i]  = obj->material.diffuse[i] * texel[i];
+        mat->specular[i] = obj->material.specular[i];
+    }
+}
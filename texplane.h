@@ -1,14 +1,19 @@
 #include "common.h"
+#include "scan.h"
 
 #ifndef TEXPLANE_H
 #define TEXPLANE_H
-obj_t * texplane_init(FILE *, int);
+obj_t * texplane_init(scan_t *, int);
+
+void texplane_bind(obj_t *);
 
 void texplane_dump(FILE *, obj_t *);
 
-void texplane_diff(obj_t *, double *);
+void texplane_diff(obj_t *, hit_t *, double *);
+
+void texplane_amb(obj_t *, hit_t *, double *);
 
-void texplane_amb(obj_t *, double *);
+void texplane_shade(obj_t *, hit_t *, material_t *);
 
-void texplane_free(obj_t *);
+void texplane_release(obj_t *);
 #endif
@@ -1,24 +1,178 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
 #include "header.h"
 #include "safe.h"
 #include "common.h"
 #include "texture.h"
 #include "projection.h"
+#include "vtexture.h"
 
 #define PPM_COLOR_VERSION 6
 
+// offset of a texel within its tile, by its x coordinate in the tile.  A
+// texel's y coordinate is spread the same way and shifted up by one
+static const unsigned char morton[TEXTURE_TILE] =
+                                            { 0, 1, 4, 5, 16, 17, 20, 21 };
+
+// build mip pyramids for textures as they are loaded
+static int mipmap = 0;
+
+// every loaded texture, shared by the texplanes using it.  The daemon
+// loads and frees scenes from different threads, so it is locked
+static texture_t *registry = NULL;
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Choose whether textures loaded from now on are mipmapped.
+ *
+ * PARAMETERS:
+ *  on  - non-zero to build mip pyramids and filter through them
+ */
+void texture_mipmap(int on) {
+    mipmap = on;
+}
+
+/*
+ * Find a loaded texture in the registry.
+ *
+ * PARAMETERS:
+ *  path    - canonical path of the texture file
+ *
+ * RETURNS:
+ *  the texture, NULL if it hasn't been loaded
+ */
+static texture_t *texture_find(char *path) {
+    texture_t *tex;
+
+    for (tex = registry; tex != NULL; tex = tex->next) {
+        if (strcmp(tex->path, path) == 0) {
+            return tex;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Read the pixels of a ppm file.  Regular files are mapped and the pixels
+ * used where they lie in the mapping, anything else is read into a buffer.
+ *
+ * PARAMETERS:
+ *  tex     - texture to store the pixels in, its size filled in
+ *  texFile - ppm file, positioned just past its header
+ *
+ * RETURNS:
+ *  EXIT_SUCCESS, or EXIT_FAILURE if the file is too short
+ */
+static int texture_pixels(texture_t *tex, FILE *texFile) {
+    size_t      size   = 3 * (size_t)tex->size[0] * tex->size[1];
+    long        offset = ftell(texFile);    // start of the pixels
+    struct stat st;
+    size_t      numRead;
+
+    if (offset >= 0 && fstat(fileno(texFile), &st) == 0 &&
+        S_ISREG(st.st_mode) && (size_t)st.st_size >= offset + size) {
+        tex->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+                        fileno(texFile), 0);
+        if (tex->map != MAP_FAILED) {
+            tex->mapsize = st.st_size;
+            tex->texbuf  = (unsigned char *)tex->map + offset;
+            return EXIT_SUCCESS;
+        }
+    }
+
+    // not mappable, fall back to a copy
+    tex->map    = NULL;
+    tex->texbuf = (unsigned char *)smalloc(size);
+    numRead = fread(tex->texbuf, sizeof(unsigned char), size, texFile);
+
+    if (numRead != size) {
+        fprintf(stderr, "Corrupt input file, got %lu bytes\n",
+                (unsigned long)numRead);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Make a texture virtual: its file is kept open and its pixels read a page
+ * at a time as they are used.
+ *
+ * PARAMETERS:
+ *  tex     - texture, its size filled in
+ *  texFile - ppm file, positioned just past its header
+ *
+ * RETURNS:
+ *  EXIT_SUCCESS, or EXIT_FAILURE if the file isn't a regular file holding
+ *  every pixel
+ */
+static int texture_virtual(texture_t *tex, FILE *texFile) {
+    size_t      size   = 3 * (size_t)tex->size[0] * tex->size[1];
+    long        offset = ftell(texFile);    // start of the pixels
+    struct stat st;
+
+    if (offset < 0 || fstat(fileno(texFile), &st) != 0 ||
+        !S_ISREG(st.st_mode) || (size_t)st.st_size < offset + size ||
+        (tex->fd = dup(fileno(texFile))) < 0) {
+        return EXIT_FAILURE;
+    }
+
+    tex->offset = offset;
+    tex->texbuf = NULL;
+    tex->map    = NULL;
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Release the pixels of a texture, unmapping them if they were mapped.
+ *
+ * PARAMETERS:
+ *  tex - texture to release the pixels of
+ */
+static void texture_pixels_free(texture_t *tex) {
+    if (tex->map != NULL) {
+        munmap(tex->map, tex->mapsize);
+        tex->map = NULL;
+    } else if (tex->texbuf != NULL) {
+        free(tex->texbuf);
+    }
+    tex->texbuf = NULL;
+}
+
 /*
- * Loads a ppm file as a texture and stores pixel values.
+ * Loads a ppm file as a texture and stores pixel values, or shares the
+ * texture if the file is loaded already.  The registry is locked.
  *
  * PARAMETERS:
  *  tp  - texplane objec to store texture struct in
  */
-int texture_load(texplane_t *tp) {
-    int            size       = 0;
+static int texture_open(texplane_t *tp) {
+    char           path[PATH_MAX];
     ppm_header    *header     = NULL;
     FILE          *texFile    = NULL;
     texture_t     *texture    = NULL;
 
+    // files are told apart by their canonical path
+    if (realpath(tp->texname, path) == NULL) {
+        snprintf(path, sizeof(path), "%s", tp->texname);
+    }
+
+    if ((texture = texture_find(path)) != NULL) {
+        texture->refs++;
+        tp->texture = texture;
+#ifdef DEBUG_TEXTURE
+        fprintf(stderr, "sharing texture %s (%d refs)\n", path,
+                texture->refs);
+#endif
+        return EXIT_SUCCESS;
+    }
+
     if ((texFile = fopenAndCheck(tp->texname, "r")) == NULL) {
 #ifdef DEBUG_TEXTURE
         fprintf(stderr, "failed to open texture file:%s|\n", tp->texname);
@@ -45,6 +199,9 @@ int texture_load(texplane_t *tp) {
 
     texture = (texture_t *)smalloc(sizeof(texture_t));
     tp->texture = texture;
+    texture->levels = 0;
+    texture->mipbuf = NULL;
+    texture->fd     = -1;
     
     texture->size[0] = header->width;
     texture->size[1] = header->height;
@@ -54,51 +211,204 @@ int texture_load(texplane_t *tp) {
                                                texture->size[1]);
 #endif
 
-    size = header->width * header->height;
-    
-    texture->texbuf = (unsigned char *)smalloc(3 * size);
-
-    int numRead = fread(texture->texbuf, sizeof(unsigned char),
-                                                        size * 3, texFile);
+    free(header);
 
-    if (numRead != size * 3) {
-        fprintf(stderr, "Corrupt input file, got %d bytes\n", numRead);
+    // mipmapped textures need every pixel to build their pyramid
+    if (vtex_enabled() && !mipmap &&
+        texture_virtual(texture, texFile) == EXIT_SUCCESS) {
+#ifdef DEBUG_TEXTURE
+        fprintf(stderr, "virtual texture %s\n", path);
+#endif
+    } else if (texture_pixels(texture, texFile)) {
+        fclose(texFile);
         return EXIT_FAILURE;
     }
+    fclose(texFile);
 
+    // the pyramid holds every texel, so the file isn't needed past this
+    if (mipmap) {
+        texture_build(texture);
+        texture_pixels_free(texture);
+    }
 
-    free(header);
+    texture->path = strdup(path);
+    texture->refs = 1;
+    texture->next = registry;
+    registry = texture;
     return EXIT_SUCCESS;
 
 }
 
+/**
+ * Loads a ppm file as a texture and stores pixel values.  Textures are
+ * shared: a file already loaded by another texplane is not loaded again,
+ * the texplane takes a reference to the loaded texture instead.
+ *
+ * PARAMETERS:
+ *  tp  - texplane objec to store texture struct in
+ */
+int texture_load(texplane_t *tp) {
+    int rc;
+
+    pthread_mutex_lock(&registry_lock);
+    rc = texture_open(tp);
+    pthread_mutex_unlock(&registry_lock);
+    return rc;
+}
+
+/*
+ * Find a texel of one mip level.
+ *
+ * PARAMETERS:
+ *  lv  - level of the pyramid
+ *  x   - x coordinate on the level
+ *  y   - y coordinate on the level, counted up from the bottom
+ *
+ * RETURNS:
+ *  the rgb values of the texel
+ */
+static inline unsigned char *texel_at(texlevel_t *lv, int x, int y) {
+    int tile = (y >> TEXTURE_TILE_SHIFT) * lv->tiles + 
+               (x >> TEXTURE_TILE_SHIFT);
+
+    return lv->texels + 3 * (tile * TEXTURE_TILE * TEXTURE_TILE +
+                             (morton[x & (TEXTURE_TILE - 1)] |
+                              morton[y & (TEXTURE_TILE - 1)] << 1));
+}
+
+/*
+ * Build the mip pyramid of a loaded texture.  Each level halves the one
+ * below it, rounding up, down to a single texel.
+ *
+ * PARAMETERS:
+ *  tex - texture to build the pyramid of
+ */
+void texture_build(texture_t *tex) {
+    texlevel_t    *lv;
+    texlevel_t    *up;          // level a level is built from
+    unsigned char *src[4];      // texels a texel is averaged from
+    size_t total = 0;           // bytes in every level
+    int w = tex->size[0];
+    int h = tex->size[1];
+    int l, x, y, i;
+
+    // size every level first so they can share one buffer
+    for (l = 0; l < TEXTURE_LEVELS; l++) {
+        lv = &tex->level[l];
+        lv->size[0] = w;
+        lv->size[1] = h;
+        lv->scale[0] = (double)w / tex->size[0];
+        lv->scale[1] = (double)h / tex->size[1];
+        lv->tiles = (w + TEXTURE_TILE - 1) / TEXTURE_TILE;
+        total += (size_t)lv->tiles * ((h + TEXTURE_TILE - 1) / TEXTURE_TILE) *
+                 TEXTURE_TILE * TEXTURE_TILE * 3;
+
+        if (w == 1 && h == 1) {
+            break;
+        }
+        w = (w + 1) / 2;
+        h = (h + 1) / 2;
+    }
+    tex->levels = l < TEXTURE_LEVELS ? l + 1 : TEXTURE_LEVELS;
+    tex->mipbuf = (unsigned char *)smalloc(total);
+    memset(tex->mipbuf, 0, total);
+
+    total = 0;
+    for (l = 0; l < tex->levels; l++) {
+        lv = &tex->level[l];
+        lv->texels = tex->mipbuf + total;
+        total += (size_t)lv->tiles *
+                 ((lv->size[1] + TEXTURE_TILE - 1) / TEXTURE_TILE) *
+                 TEXTURE_TILE * TEXTURE_TILE * 3;
+    }
+
+    // the pixmap is stored top row first
+    lv = &tex->level[0];
+    for (y = 0; y < lv->size[1]; y++) {
+        for (x = 0; x < lv->size[0]; x++) {
+            memcpy(texel_at(lv, x, y), tex->texbuf +
+                   3 * ((lv->size[1] - 1 - y) * lv->size[0] + x), 3);
+        }
+    }
+
+    // average each 2x2 block of texels, repeating the last row and column
+    // of levels with an odd size
+    for (l = 1; l < tex->levels; l++) {
+        lv = &tex->level[l];
+        up = &tex->level[l - 1];
+        for (y = 0; y < lv->size[1]; y++) {
+            for (x = 0; x < lv->size[0]; x++) {
+                int x1 = 2 * x + 1 < up->size[0] ? 2 * x + 1 : 2 * x;
+                int y1 = 2 * y + 1 < up->size[1] ? 2 * y + 1 : 2 * y;
+
+                src[0] = texel_at(up, 2 * x, 2 * y);
+                src[1] = texel_at(up, x1, 2 * y);
+                src[2] = texel_at(up, 2 * x, y1);
+                src[3] = texel_at(up, x1, y1);
+                for (i = 0; i < 3; i++) {
+                    texel_at(lv, x, y)[i] = (src[0][i] + src[1][i] +
+                                             src[2][i] + src[3][i] + 2) / 4;
+                }
+            }
+        }
+    }
+
+#ifdef DEBUG_TEXTURE
+    fprintf(stderr, "texture pyramid: %d levels, %lu bytes\n", tex->levels,
+            (unsigned long)total);
+#endif
+}
+
 /*
  * Returns the rgb values for the texture at a given point.
  *
  * PARAMETERS:
- *  fp    - finite plane object that holds the point to retrieve
+ *  fp    - finite plane object that was hit
+ *  hit   - hit record holding the point to retrieve
  *  texel - array to store texture rgb values in
  */
-int texture_map(fplane_t *fp, double *texel) {
+int texture_map(fplane_t *fp, hit_t *hit, double *texel) {
     texplane_t *tp  = (texplane_t *)fp->priv;
     texture_t  *tex = (texture_t  *)tp->texture;
     double xfrac, yfrac;
+
+    // filter through the pyramid, with the texture coordinates and the
+    // width of the pixel in texels of the bottom level
+    if (tex->levels > 0) {
+        double st[2];
+        double width[2];
+        double footprint[2] = { hit->footprint, hit->footprint };
+
+        if (tp->texmode == FIT_TEXTURE) {
+            st[0] = hit->planehit[0] / fp->size[0] * tex->size[0];
+            st[1] = hit->planehit[1] / fp->size[1] * tex->size[1];
+            width[0] = hit->footprint / fp->size[0] * tex->size[0];
+            width[1] = hit->footprint / fp->size[1] * tex->size[1];
+        } else {
+            map_world_to_pixf(hit->proj, hit->planehit, st);
+            map_world_to_pixf(hit->proj, footprint, width);
+        }
+
+        texel_filter(tex, st, width[0] > width[1] ? width[0] : width[1],
+                     tp->texmode == TILE_TEXTURE, texel);
+        return EXIT_SUCCESS;
+    }
     
     // scale mode
     if (tp->texmode == FIT_TEXTURE) {
 #ifdef DEBUG_TEXTURE
-        fprintf(stderr, "lasthit: (%lf, %lf)\n", fp->lasthit[0], 
-                                                 fp->lasthit[1]);
+        fprintf(stderr, "planehit: (%lf, %lf)\n", hit->planehit[0], 
+                                                  hit->planehit[1]);
 #endif
-        xfrac = fp->lasthit[0] / fp->size[0];
-        yfrac = fp->lasthit[1] / fp->size[1];
+        xfrac = hit->planehit[0] / fp->size[0];
+        yfrac = hit->planehit[1] / fp->size[1];
 
         texel_get(tex, xfrac, yfrac, texel);
 
     // tile mode
     } else {
         int pixhit[2];
-        map_world_to_pix(fp->lasthit, pixhit);
+        map_world_to_pix(hit->proj, hit->planehit, pixhit);
 
         xfrac = (double)(pixhit[0] % tex->size[0]) / tex->size[0];
         yfrac = (double)(pixhit[1] % tex->size[1]) / tex->size[1];
@@ -122,6 +432,7 @@ int texture_map(fplane_t *fp, double *texel) {
  */
 void texel_get(texture_t *tex, double xrel, double yrel, double *texel) {
     unsigned char *texloc;
+    unsigned char  page_texel[3];   // texel read from a virtual texture
     int xtex;       /* x coordinate of the texel */
     int ytex;       /* y coordinate of the texel */
     
@@ -146,8 +457,13 @@ void texel_get(texture_t *tex, double xrel, double yrel, double *texel) {
     fprintf(stderr, "texloc offset = %d\n", offset);
 #endif
 
-    texloc = tex->texbuf + 
+    if (tex->texbuf == NULL) {
+        vtex_texel(tex, xtex, tex->size[1] - 1 - ytex, page_texel);
+        texloc = page_texel;
+    } else {
+        texloc = tex->texbuf + 
                 (((tex->size[1] - 1 - ytex) * tex->size[0] * 3) + 3 * xtex);
+    }
 
     *(texel + 0) = *(texloc + 0) / 255.0;
     *(texel + 1) = *(texloc + 1) / 255.0;
@@ -155,8 +471,130 @@ void texel_get(texture_t *tex, double xrel, double yrel, double *texel) {
 }
 
 
+/*
+ * Find the bilinearly filtered rgb values of one mip level.
+ *
+ * PARAMETERS:
+ *  tex     - texture object
+ *  l       - level of the pyramid
+ *  st      - coordinates in texels of the bottom level
+ *  wrap    - non-zero to repeat the texture past its edges, zero to
+ *            repeat its edge texels
+ *  texel   - array to store texture rgb values in
+ */
+static void texel_bilinear(texture_t *tex, int l, double *st, int wrap,
+                           double *texel) {
+    texlevel_t    *lv = &tex->level[l];
+    unsigned char *t[4];        // neighbouring texels
+    double u = st[0] * lv->scale[0] - 0.5;
+    double v = st[1] * lv->scale[1] - 0.5;
+    double fu, fv;              // position between neighbours
+    int x[2], y[2];
+    int i;
+
+    // round towards minus infinity
+    x[0] = (int)u - (u < 0.0 && u != (int)u);
+    y[0] = (int)v - (v < 0.0 && v != (int)v);
+    fu = u - x[0];
+    fv = v - y[0];
+    x[1] = x[0] + 1;
+    y[1] = y[0] + 1;
+
+    for (i = 0; i < 2; i++) {
+        if (wrap) {
+            // only the edges of a tile pass or the edges of the plane
+            // need the remainder
+            if (x[i] < 0 || x[i] >= lv->size[0]) {
+                x[i] = ((x[i] % lv->size[0]) + lv->size[0]) % lv->size[0];
+            }
+            if (y[i] < 0 || y[i] >= lv->size[1]) {
+                y[i] = ((y[i] % lv->size[1]) + lv->size[1]) % lv->size[1];
+            }
+        } else {
+            x[i] = x[i] < 0 ? 0 : x[i] >= lv->size[0] ? lv->size[0] - 1 : x[i];
+            y[i] = y[i] < 0 ? 0 : y[i] >= lv->size[1] ? lv->size[1] - 1 : y[i];
+        }
+    }
+
+    t[0] = texel_at(lv, x[0], y[0]);
+    t[1] = texel_at(lv, x[1], y[0]);
+    t[2] = texel_at(lv, x[0], y[1]);
+    t[3] = texel_at(lv, x[1], y[1]);
+
+    for (i = 0; i < 3; i++) {
+        texel[i] = ((t[0][i] * (1.0 - fu) + t[1][i] * fu) * (1.0 - fv) +
+                    (t[2][i] * (1.0 - fu) + t[3][i] * fu) * fv) / 255.0;
+    }
+}
+
+/*
+ * Find the trilinearly filtered rgb values of a mipmapped texture: the
+ * levels either side of the one whose texels match the width of the pixel
+ * are filtered bilinearly and blended.
+ *
+ * PARAMETERS:
+ *  tex     - texture object, with a pyramid
+ *  st      - coordinates in texels of the bottom level
+ *  width   - width the pixel covers in texels of the bottom level
+ *  wrap    - non-zero to repeat the texture past its edges
+ *  texel   - array to store texture rgb values in
+ */
+void texel_filter(texture_t *tex, double *st, double width, int wrap,
+                  double *texel) {
+    double lod = width > 1.0 ? log2(width) : 0.0;   // level to sample
+    double upper[3];
+    double frac;
+    int    l;
+
+    if (lod >= tex->levels - 1) {
+        texel_bilinear(tex, tex->levels - 1, st, wrap, texel);
+        return;
+    }
+
+    l = (int)lod;
+    frac = lod - l;
+    texel_bilinear(tex, l, st, wrap, texel);
+
+    if (frac > 0.0) {
+        texel_bilinear(tex, l + 1, st, wrap, upper);
+        texel[0] += (upper[0] - texel[0]) * frac;
+        texel[1] += (upper[1] - texel[1]) * frac;
+        texel[2] += (upper[2] - texel[2]) * frac;
+    }
+}
+
+/*
+ * Drop a texplane's reference to its texture, freeing the texture once no
+ * texplane uses it.
+ *
+ * PARAMETERS:
+ *  tex - texture to release
+ */
 void texture_free(texture_t *tex) {
-    if (tex->texbuf != NULL) {
-        free(tex->texbuf);
+    texture_t **link;
+
+    pthread_mutex_lock(&registry_lock);
+    if (--tex->refs > 0) {
+        pthread_mutex_unlock(&registry_lock);
+        return;
+    }
+
+    for (link = &registry; *link != NULL; link = &(*link)->next) {
+        if (*link == tex) {
+            *link = tex->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+
+    if (tex->fd >= 0) {
+        vtex_drop(tex);
+        close(tex->fd);
+    }
+    texture_pixels_free(tex);
+    if (tex->mipbuf != NULL) {
+        free(tex->mipbuf);
     }
+    free(tex->path);
+    free(tex);
 }
@@ -1,11 +1,20 @@
 #ifndef TEXTURE_H
 #define TEXTURE_H
 
+#define TEXTURE_TILE_SHIFT  3   /* mip levels are stored in 8x8 tiles */
+#define TEXTURE_TILE        (1 << TEXTURE_TILE_SHIFT)
+
+void texture_mipmap(int);
+
 int texture_load(texplane_t *);
 
-int texture_map(fplane_t *, double *);
+void texture_build(texture_t *);
+
+int texture_map(fplane_t *, hit_t *, double *);
 
 void texel_get(texture_t *, double, double, double *);
 
+void texel_filter(texture_t *, double *, double, int, double *);
+
 void texture_free(texture_t *tex);
 #endif
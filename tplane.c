@@ -16,59 +16,42 @@
 #include "material.h"
 #include "veclib3d.h"
 
+/* functions of every tplane, tiled over an infinite plane */
+static const obj_ops_t tplane_ops = {
+    hits_plane, plane_hitinfo, tp_shade,
+    tp_amb, tp_diff, tp_spec,
+    NULL, plane_dump, NULL
+};
+
 /**
  * Initialize a tplane object from a file.
  *
  * PARAMETERS:
- *  in      - file to read from
+ *  scan    - scanner to read from
  *  objtype - type of object to initalize
  *
  *  RETURNS:
  *  the newly created object
  */
-obj_t * tplane_init(FILE *in, int objtype) {
-    obj_t *obj = plane_init(in, objtype);  // base object struct
+obj_t * tplane_init(scan_t *scan, int objtype) {
+    obj_t *obj = plane_init(scan, objtype);  // base object struct
     plane_t *plane = (plane_t *)obj->priv; // base plane struct
 
     tplane_t *tplane = 
-            (tplane_t *)smalloc(sizeof(tplane_t));   // new tplane struct
+            (tplane_t *)object_alloc(sizeof(tplane_t));  // new tplane
 
     plane->priv = tplane;      // connect tplane to obj
-    obj->hits = hits_plane; // connect hits function
-    obj->getamb = tp_amb;
-    obj->getdif = tp_diff;
-    obj->getspec = tp_spec;
-
-
-    char    buf[256];       // buffer for reading in values
-    int     rc = 0;         // read counter
-
+    tplane_bind(obj);          // connect tplane functions
 
     // read in x direction
-    while (rc != 3) {
-        rc = fscanf(in, "%lf %lf %lf", tplane->xdir, (tplane->xdir + 1),
-                                        (tplane->xdir + 2));
-        fgets(buf, 256, in);
-#ifdef DEBUG_OBJECTS
-        fprintf(stderr, "tplane read %s\n", buf);
-#endif
-    }
+    scan_doubles(scan, tplane->xdir, 3, "tplane x direction");
 
-    rc = 0;
     // read in normal
-    while (rc != 2) {
-        rc = fscanf(in, "%lf %lf", tplane->size,
-                                       (tplane->size + 1));
-
-        fgets(buf, 256, in);
-#ifdef DEBUG_OBJECTS
-        fprintf(stderr, "tplane read %s\n", buf);
-#endif
-    }
+    scan_doubles(scan, tplane->size, 2, "tplane size");
 
     
     // initailize backgorund material
-    material_init(in, &tplane->background);
+    material_init(scan, &tplane->background);
     
     // construct rotation matrix
    double normal[3];
@@ -87,6 +70,16 @@ obj_t * tplane_init(FILE *in, int objtype) {
    return obj;
 }
 
+/*
+ * Connect the function table of a tplane object.
+ *
+ * PARAMETERS:
+ *  obj -   object to bind
+ */
+void tplane_bind(obj_t *obj) {
+    obj->ops = &tplane_ops;
+}
+
 /**
  * Prints information about a tplane object to a file.
  *
@@ -115,9 +108,10 @@ void tplane_dump(FILE *out, obj_t *obj) {
  *
  * PARAMETERS:
  *  obj     - tplane object
+ *  hit     - hit point on the tplane
  *  value   - intensity vector
  */
-void tp_diff(obj_t *obj, double *value) {
+void tp_diff(obj_t *obj, hit_t *hit, double *value) {
 #ifdef DEBUG_TPLANE
     fprintf(stderr, "tp_diff\n");
 #endif
@@ -126,7 +120,7 @@ void tp_diff(obj_t *obj, double *value) {
     tplane_t *tp = (tplane_t *)pln->priv;
     material_t *mat;
 
-    if (tp_select(obj)) {
+    if (tp_select(obj, hit)) {
         mat = &obj->material;
     } else {
         mat = &tp->background;
@@ -143,9 +137,10 @@ void tp_diff(obj_t *obj, double *value) {
  *
  * PARAMETERS:
  *  obj     - tplane object
+ *  hit     - hit point on the tplane
  *  value   - intensity vector
  */
-void tp_amb(obj_t *obj, double *value) {
+void tp_amb(obj_t *obj, hit_t *hit, double *value) {
 #ifdef DEBUG_TPLANE
     fprintf(stderr, "tp_amb\n");
 #endif
@@ -154,7 +149,7 @@ void tp_amb(obj_t *obj, double *value) {
     tplane_t *tp = (tplane_t *)pln->priv;
     material_t *mat;
 
-    if (tp_select(obj)) {
+    if (tp_select(obj, hit)) {
         mat = &obj->material;
     } else {
         mat = &tp->background;
@@ -171,9 +166,10 @@ void tp_amb(obj_t *obj, double *value) {
  *
  * PARAMETERS:
  *  obj     - tplane object
+ *  hit     - hit point on the tplane
  *  value   - intensity vector
  */
-void tp_spec(obj_t *obj, double *value) {
+void tp_spec(obj_t *obj, hit_t *hit, double *value) {
 #ifdef DEBUG_TPLANE
     fprintf(stderr, "tp_spec\n");
 #endif
@@ -182,7 +178,7 @@ void tp_spec(obj_t *obj, double *value) {
     tplane_t *tp = (tplane_t *)pln->priv;
     material_t *mat;
 
-    if (tp_select(obj)) {
+    if (tp_select(obj, hit)) {
         mat = &obj->material;
     } else {
         mat = &tp->background;
@@ -193,23 +189,40 @@ void tp_spec(obj_t *obj, double *value) {
     *(value + 2)  = mat->specular[2];
 }
 
+/**
+ * Retrieve all the reflectivities for the last hitpoint, choosing the
+ * tile once
+ *
+ * PARAMETERS:
+ *  obj     - tplane object
+ *  hit     - hit point on the tplane
+ *  mat     - material to store the reflectivities in
+ */
+void tp_shade(obj_t *obj, hit_t *hit, material_t *mat) {
+    plane_t *pln = (plane_t *)obj->priv;
+    tplane_t *tp = (tplane_t *)pln->priv;
+
+    *mat = tp_select(obj, hit) ? obj->material : tp->background;
+}
+
 /**
  * Determine if the current hitpoint is on a foreground or background
  * tile.
  *
  * PARAMETERS:
  *  obj - tplane object
+ *  hit - hit point on the tplane
  *
  *  RETURNS:
  *  0 for background and 1 for foreground
  */
-int tp_select(obj_t *obj) {
+int tp_select(obj_t *obj, hit_t *hit) {
     plane_t  *plane  = (plane_t *)obj->priv;       // plane struct
     tplane_t *tplane = (tplane_t *)plane->priv;    // tplane struct
 
     double *newhit = (double *)alloca(sizeof(double) * 3);
 
-    vec_diff3(plane->point, obj->hitloc, newhit);
+    vec_diff3(plane->point, hit->hitloc, newhit);
 
     xform3(tplane->rotmat, newhit, newhit);
 
@@ -4,15 +4,19 @@
 #ifndef TPLANE_H
 #define TPLANE_H
 
-obj_t *tplane_init(FILE *, int);
+obj_t *tplane_init(scan_t *, int);
+
+void tplane_bind(obj_t *);
 
 void tplane_dump(FILE *, obj_t *);
 
-void tp_diff(obj_t *, double *);
+void tp_diff(obj_t *, hit_t *, double *);
+
+void tp_amb(obj_t *, hit_t *, double *);
 
-void tp_amb(obj_t *, double *);
+void tp_spec(obj_t *, hit_t *, double *);
 
-void tp_spec(obj_t *, double *);
+void tp_shade(obj_t *, hit_t *, material_t *);
 
-int tp_select(obj_t *);
+int tp_select(obj_t *, hit_t *);
 #endif
@@ -0,0 +1,428 @@
+/*
+ * vtexture.c
+ *
+ * Page cache for virtual textures.  A virtual texture keeps its file open
+ * instead of reading its pixels at load time; texels are read a square
+ * page at a time on first use and held in a cache shared by every
+ * texture.  Once the cache fills its memory budget the least recently
+ * used page is dropped to make room, so a scene can use textures far
+ * larger than memory as long as little of each is seen.
+ *
+ * Chris Blades
+ *
+ * 18/10/2026
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "common.h"
+#include "safe.h"
+#include "vtexture.h"
+
+#define PAGE_BYTES  (3 * VTEX_PAGE * VTEX_PAGE)
+
+/* buckets whose number is the shard number modulo VTEX_SHARDS, their pages
+ * and the lock over them */
+typedef struct vtex_shard_type {
+    pthread_mutex_t lock;
+    pthread_cond_t  loaded;     // signalled when a page has been read
+    vtex_page_t    *lru_head;   // most recently used
+    vtex_page_t    *lru_tail;   // next to be dropped
+    vtex_counts_t   counts;     // capacity is the shard's share
+} __attribute__((aligned(64))) vtex_shard_t;
+
+/* page a thread read its last texel from, which it keeps pinned so the
+ * next texel on the same page is read without a lock */
+typedef struct vtex_thread_type {
+    vtex_page_t    *page;
+    texture_t      *tex;
+    int             px;
+    int             py;
+    unsigned long   drops;      // drops when the page was pinned
+    long            hits;       // hits not yet added to the shard
+} vtex_thread_t;
+
+static int              enabled  = 0;
+static vtex_page_t     *buckets[VTEX_BUCKETS];
+static vtex_shard_t     shards[VTEX_SHARDS];
+static unsigned long    drops = 0;      // textures dropped so far
+static pthread_key_t    local_key;      // releases the page of a thread
+static __thread vtex_thread_t *local = NULL;
+
+static void vtex_release(void *);
+
+/**
+ * Turn on virtual textures.  Textures loaded from now on are read a page
+ * at a time as they are used.
+ *
+ * PARAMETERS:
+ *  budget  - megabytes of pages to hold in memory at once
+ */
+void vtex_init(double budget) {
+    long capacity = (long)(budget * 1024.0 * 1024.0 / PAGE_BYTES);
+    int  i;
+
+    capacity = capacity < VTEX_MIN_PAGES ? VTEX_MIN_PAGES : capacity;
+    for (i = 0; i < VTEX_SHARDS; i++) {
+        pthread_mutex_init(&shards[i].lock, NULL);
+        pthread_cond_init(&shards[i].loaded, NULL);
+        shards[i].lru_head = NULL;
+        shards[i].lru_tail = NULL;
+        memset(&shards[i].counts, 0, sizeof(vtex_counts_t));
+        shards[i].counts.capacity = (capacity + VTEX_SHARDS - 1) /
+                                    VTEX_SHARDS;
+    }
+    pthread_key_create(&local_key, vtex_release);
+    enabled = 1;
+}
+
+/**
+ * Whether textures are loaded virtually.
+ *
+ * RETURNS:
+ *  non-zero if vtex_init has been called
+ */
+int vtex_enabled(void) {
+    return enabled;
+}
+
+/*
+ * Hash bucket of a page.
+ */
+static inline int vtex_bucket(texture_t *tex, int px, int py) {
+    uintptr_t h = (uintptr_t)tex >> 4;
+
+    h = h * 31 + px;
+    h = h * 31 + py;
+    return (int)(h & (VTEX_BUCKETS - 1));
+}
+
+/*
+ * Take a page out of the lru list of its shard.
+ */
+static void lru_unlink(vtex_shard_t *shard, vtex_page_t *page) {
+    if (page->prev != NULL) {
+        page->prev->next = page->next;
+    } else {
+        shard->lru_head = page->next;
+    }
+    if (page->next != NULL) {
+        page->next->prev = page->prev;
+    } else {
+        shard->lru_tail = page->prev;
+    }
+}
+
+/*
+ * Put a page at the front of the lru list of its shard.
+ */
+static void lru_push(vtex_shard_t *shard, vtex_page_t *page) {
+    page->prev = NULL;
+    page->next = shard->lru_head;
+    if (shard->lru_head != NULL) {
+        shard->lru_head->prev = page;
+    } else {
+        shard->lru_tail = page;
+    }
+    shard->lru_head = page;
+}
+
+/*
+ * Take a page out of its hash bucket.
+ */
+static void hash_unlink(vtex_page_t *page) {
+    vtex_page_t **link = &buckets[vtex_bucket(page->tex, page->px,
+                                              page->py)];
+
+    while (*link != page) {
+        link = &(*link)->hnext;
+    }
+    *link = page->hnext;
+}
+
+/*
+ * Read a page of a texture from its file.  Pages on the right and top
+ * edges of a texture only read the texels the texture has.
+ *
+ * PARAMETERS:
+ *  page    - page to fill, its texture and coordinates set
+ */
+static void vtex_read(vtex_page_t *page) {
+    texture_t *tex = page->tex;
+    int x0 = page->px << VTEX_PAGE_SHIFT;
+    int y0 = page->py << VTEX_PAGE_SHIFT;
+    int w  = tex->size[0] - x0 < VTEX_PAGE ? tex->size[0] - x0 : VTEX_PAGE;
+    int h  = tex->size[1] - y0 < VTEX_PAGE ? tex->size[1] - y0 : VTEX_PAGE;
+    int y;
+
+    for (y = 0; y < h; y++) {
+        if (pread(tex->fd, page->texels + 3 * VTEX_PAGE * y, 3 * w,
+                  tex->offset + 3 * ((off_t)(y0 + y) * tex->size[0] + x0))
+                != 3 * w) {
+            // a file cut short reads as black
+            memset(page->texels + 3 * VTEX_PAGE * y, 0, 3 * w);
+        }
+    }
+}
+
+/*
+ * Take the least recently used page no thread has pinned out of a shard.
+ * Called with the shard locked.
+ *
+ * PARAMETERS:
+ *  shard   - shard to take the page from
+ *
+ * RETURNS:
+ *  the page, or NULL if every page is pinned
+ */
+static vtex_page_t *vtex_evict(vtex_shard_t *shard) {
+    vtex_page_t *page;
+
+    for (page = shard->lru_tail; page != NULL && page->pins > 0;
+         page = page->prev);
+    if (page != NULL) {
+        lru_unlink(shard, page);
+        hash_unlink(page);
+        shard->counts.evictions++;
+    }
+    return page;
+}
+
+/*
+ * Find a page of a texture and pin it, reading it if it isn't in memory.
+ * The file is read with the shard unlocked; a thread wanting the page
+ * meanwhile waits for it to be read.
+ *
+ * PARAMETERS:
+ *  tex - virtual texture
+ *  px  - x coordinate of the page
+ *  py  - y coordinate of the page, counted down from the top of the file
+ *
+ * RETURNS:
+ *  the page, read and pinned
+ */
+static vtex_page_t *vtex_pin(texture_t *tex, int px, int py) {
+    int           b = vtex_bucket(tex, px, py);
+    vtex_shard_t *shard = &shards[b & (VTEX_SHARDS - 1)];
+    vtex_page_t  *page;
+
+    pthread_mutex_lock(&shard->lock);
+    for (page = buckets[b]; page != NULL; page = page->hnext) {
+        if (page->tex == tex && page->px == px && page->py == py) {
+            shard->counts.hits++;
+            page->pins++;
+            if (page != shard->lru_head) {
+                lru_unlink(shard, page);
+                lru_push(shard, page);
+            }
+            while (page->loading) {
+                pthread_cond_wait(&shard->loaded, &shard->lock);
+            }
+            pthread_mutex_unlock(&shard->lock);
+            return page;
+        }
+    }
+
+    shard->counts.misses++;
+    page = NULL;
+    if (shard->counts.resident >= shard->counts.capacity) {
+        page = vtex_evict(shard);
+    }
+    if (page == NULL) {
+        // under budget, or every page is pinned, which goes over it until
+        // the pages are unpinned
+        page = (vtex_page_t *)smalloc(sizeof(vtex_page_t));
+        page->texels = (unsigned char *)smalloc(PAGE_BYTES);
+        page->shard  = (int)(shard - shards);
+        shard->counts.resident++;
+    }
+
+    page->tex     = tex;
+    page->px      = px;
+    page->py      = py;
+    page->pins    = 1;
+    page->loading = 1;
+    page->hnext = buckets[b];
+    buckets[b]  = page;
+    lru_push(shard, page);
+    pthread_mutex_unlock(&shard->lock);
+
+    vtex_read(page);
+
+    pthread_mutex_lock(&shard->lock);
+    page->loading = 0;
+    pthread_cond_broadcast(&shard->loaded);
+    pthread_mutex_unlock(&shard->lock);
+    return page;
+}
+
+/*
+ * Unpin the page a thread read its last texel from, freeing it if its
+ * texture was dropped meanwhile.
+ *
+ * PARAMETERS:
+ *  thread  - page cache of the thread
+ */
+static void vtex_unpin(vtex_thread_t *thread) {
+    vtex_page_t  *page = thread->page;
+    vtex_shard_t *shard;
+
+    if (page == NULL) {
+        return;
+    }
+
+    shard = &shards[page->shard];
+    pthread_mutex_lock(&shard->lock);
+    shard->counts.hits += thread->hits;
+    if (--page->pins == 0 && page->tex == NULL) {
+        free(page->texels);
+        free(page);
+    } else if (shard->counts.resident > shard->counts.capacity &&
+               (page = vtex_evict(shard)) != NULL) {
+        // back down to the budget exceeded while every page was pinned
+        free(page->texels);
+        free(page);
+        shard->counts.resident--;
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    thread->page = NULL;
+    thread->hits = 0;
+}
+
+/*
+ * Unpin the page of a thread that is ending.
+ *
+ * PARAMETERS:
+ *  arg - page cache of the thread
+ */
+static void vtex_release(void *arg) {
+    vtex_unpin((vtex_thread_t *)arg);
+    free(arg);
+}
+
+/**
+ * Read one texel of a virtual texture.
+ *
+ * PARAMETERS:
+ *  tex - virtual texture
+ *  x   - x coordinate of the texel
+ *  row - row of the texel, counted down from the top of the file
+ *  rgb - array to store the texel in
+ */
+void vtex_texel(texture_t *tex, int x, int row, unsigned char *rgb) {
+    vtex_thread_t *thread = local;
+    unsigned char *texel;
+    unsigned long  dropped = __atomic_load_n(&drops, __ATOMIC_ACQUIRE);
+    int            px = x >> VTEX_PAGE_SHIFT;
+    int            py = row >> VTEX_PAGE_SHIFT;
+
+    if (thread == NULL) {
+        thread = (vtex_thread_t *)smalloc(sizeof(vtex_thread_t));
+        memset(thread, 0, sizeof(vtex_thread_t));
+        pthread_setspecific(local_key, thread);
+        local = thread;
+    }
+
+    // a texture dropped since could have been freed and another loaded
+    // at its address, so the pinned page is only trusted if none was
+    if (thread->page != NULL && thread->tex == tex && thread->px == px &&
+        thread->py == py && thread->drops == dropped) {
+        thread->hits++;
+    } else {
+        vtex_unpin(thread);
+        thread->page  = vtex_pin(tex, px, py);
+        thread->tex   = tex;
+        thread->px    = px;
+        thread->py    = py;
+        thread->drops = dropped;
+    }
+
+    texel = thread->page->texels + 3 * (VTEX_PAGE * (row & (VTEX_PAGE - 1)) +
+                                        (x & (VTEX_PAGE - 1)));
+    rgb[0] = texel[0];
+    rgb[1] = texel[1];
+    rgb[2] = texel[2];
+}
+
+/**
+ * Drop every page of a texture that is being freed.  A page a thread
+ * still has pinned is freed once the thread moves on.
+ *
+ * PARAMETERS:
+ *  tex - texture being freed
+ */
+void vtex_drop(texture_t *tex) {
+    vtex_shard_t *shard;
+    vtex_page_t  *page;
+    vtex_page_t  *next;
+    int           i;
+
+    for (i = 0; i < VTEX_SHARDS; i++) {
+        shard = &shards[i];
+        pthread_mutex_lock(&shard->lock);
+        for (page = shard->lru_head; page != NULL; page = next) {
+            next = page->next;
+            if (page->tex == tex) {
+                lru_unlink(shard, page);
+                hash_unlink(page);
+                shard->counts.resident--;
+                if (page->pins > 0) {
+                    page->tex = NULL;
+                } else {
+                    free(page->texels);
+                    free(page);
+                }
+            }
+        }
+        pthread_mutex_unlock(&shard->lock);
+    }
+    __atomic_add_fetch(&drops, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Read the counts kept by the page cache.  Hits on the page other
+ * threads have pinned are counted once they move on or end.
+ *
+ * PARAMETERS:
+ *  out - struct to copy the counts into
+ */
+void vtex_counts(vtex_counts_t *out) {
+    int i;
+
+    memset(out, 0, sizeof(vtex_counts_t));
+    for (i = 0; i < VTEX_SHARDS; i++) {
+        pthread_mutex_lock(&shards[i].lock);
+        out->hits      += shards[i].counts.hits;
+        out->misses    += shards[i].counts.misses;
+        out->evictions += shards[i].counts.evictions;
+        out->resident  += shards[i].counts.resident;
+        out->capacity  += shards[i].counts.capacity;
+        pthread_mutex_unlock(&shards[i].lock);
+    }
+    if (local != NULL) {
+        out->hits += local->hits;
+    }
+}
+
+/**
+ * Print information about the page cache.
+ *
+ * PARAMETERS:
+ *  out - file to print to
+ */
+void vtex_dump(FILE *out) {
+    vtex_counts_t c;
+
+    vtex_counts(&c);
+    fprintf(out, "\tTEXTURE PAGES:\n");
+    fprintf(out, "\t\tBudget: %ld pages of %dx%d texels\n", c.capacity,
+            VTEX_PAGE, VTEX_PAGE);
+    fprintf(out, "\t\tHits: %ld\n", c.hits);
+    fprintf(out, "\t\tMisses: %ld\n", c.misses);
+    fprintf(out, "\t\tEvictions: %ld\n", c.evictions);
+    fprintf(out, "\t\tResident: %ld pages\n", c.resident);
+}
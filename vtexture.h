@@ -0,0 +1,49 @@
+#include <stdio.h>
+#include "common.h"
+
+#ifndef VTEXTURE_H
+#define VTEXTURE_H
+
+#define VTEX_PAGE_SHIFT 6       /* pages are 64x64 texels */
+#define VTEX_PAGE       (1 << VTEX_PAGE_SHIFT)
+#define VTEX_BUCKETS    4096    /* hash buckets, a power of two */
+#define VTEX_SHARDS     16      /* locks the buckets are split between */
+#define VTEX_MIN_PAGES  16      /* pages kept however small the budget */
+
+/* one page of a virtual texture held in memory */
+typedef struct vtex_page_type {
+    texture_t  *tex;                    /* texture the page is from, NULL */
+                                        /* once dropped while pinned */
+    int         px;                     /* page coordinates, rows counted */
+    int         py;                     /* down from the top of the file */
+    int         shard;                  /* shard the page is cached in */
+    int         pins;                   /* threads using the page, which */
+                                        /* keep it from being dropped */
+    int         loading;                /* still being read from the file */
+    unsigned char *texels;              /* rgb rows of the page */
+    struct vtex_page_type *hnext;       /* next page in the hash bucket */
+    struct vtex_page_type *prev;        /* neighbours in the lru list, most */
+    struct vtex_page_type *next;        /* recently used first */
+} vtex_page_t;
+
+/* counts kept by the page cache */
+typedef struct vtex_counts_type {
+    long    hits;           /* texel reads from a page in memory */
+    long    misses;         /* texel reads that loaded a page */
+    long    evictions;      /* pages dropped to stay in the budget */
+    long    resident;       /* pages in memory */
+    long    capacity;       /* pages the budget holds */
+} vtex_counts_t;
+
+void vtex_init(double);
+
+int vtex_enabled(void);
+
+void vtex_texel(texture_t *, int, int, unsigned char *);
+
+void vtex_drop(texture_t *);
+
+void vtex_counts(vtex_counts_t *);
+
+void vtex_dump(FILE *);
+#endif
@@ -0,0 +1,453 @@
+/*
+ * wavefront.c
+ *
+ * Traces a run of pixels a stage at a time instead of a path at a time.
+ * All the primary rays of the run are queued and intersected together,
+ * then every hit is shaded, sorted so hits on the same kind of object are
+ * shaded together.  The shadow rays of every hit are queued one light at
+ * a time and traced as a batch, and reflections go into the queue of the
+ * next generation.  Once no rays are left each pixel's hits are summed
+ * from the far end back, using the same steps as ray_shade so the image
+ * is the same as the one ray_trace gives.
+ *
+ * Chris Blades
+ *
+ * 18/10/2026
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "common.h"
+#include "safe.h"
+#include "ray.h"
+#include "packet.h"
+#include "projection.h"
+#include "veclib3d.h"
+#include "stats.h"
+#include "wavefront.h"
+
+/*
+ * Allocate the queues of a render thread.  They start empty and grow to
+ * fit the runs traced.
+ *
+ * PARAMETERS:
+ *  model   - model the thread will trace
+ *
+ * RETURNS:
+ *  pointer to the new queues
+ */
+static wave_t *wave_init(model_t *model) {
+    wave_t *wave = (wave_t *)smalloc(sizeof(wave_t));
+
+    wave->cap     = 0;
+    wave->rays[0] = NULL;
+    wave->rays[1] = NULL;
+    wave->order   = NULL;
+    wave->shadows = NULL;
+    wave->sum     = NULL;
+    wave->frames  = NULL;
+    wave->owner   = NULL;
+    wave->nframes = 0;
+    wave->fcap    = 0;
+    // a path has at most max_depth hits, one per generation
+    wave->start   = (int *)smalloc(sizeof(int) *
+                                   (model->proj->max_depth + 2));
+    return wave;
+}
+
+/*
+ * Make sure the queues hold a run of pixels.
+ *
+ * PARAMETERS:
+ *  wave    - queues to grow
+ *  n       - pixels in the run
+ */
+static void wave_reserve(wave_t *wave, int n) {
+    if (n <= wave->cap) {
+        return;
+    }
+
+    free(wave->rays[0]);
+    free(wave->rays[1]);
+    free(wave->order);
+    free(wave->shadows);
+    free(wave->sum);
+
+    wave->cap     = n;
+    wave->rays[0] = (wave_ray_t *)smalloc(sizeof(wave_ray_t) * n);
+    wave->rays[1] = (wave_ray_t *)smalloc(sizeof(wave_ray_t) * n);
+    wave->order   = (wave_ray_t **)smalloc(sizeof(wave_ray_t *) * n);
+    wave->shadows = (wave_shadow_t *)smalloc(sizeof(wave_shadow_t) * n);
+    wave->sum     = (double *)smalloc(sizeof(double) * 3 * n);
+}
+
+/*
+ * Make room for the frames of one more generation, keeping those of the
+ * generations before it.
+ *
+ * PARAMETERS:
+ *  wave    - queues to grow
+ *  n       - frames to add
+ */
+static void wave_frames(wave_t *wave, int n) {
+    if (wave->nframes + n <= wave->fcap) {
+        return;
+    }
+
+    wave->fcap = wave->fcap * 2 > wave->nframes + n ?
+                 wave->fcap * 2 : wave->nframes + n;
+    wave->frames = (trace_frame_t *)realloc(wave->frames,
+                                     sizeof(trace_frame_t) * wave->fcap);
+    wave->owner = (int *)realloc(wave->owner, sizeof(int) * wave->fcap);
+    if (wave->frames == NULL || wave->owner == NULL) {
+        fprintf(stderr, "Error allocating memory.\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ * Queue and intersect the primary rays of a run of pixels, in packets if
+ * packet tracing is turned on.
+ *
+ * PARAMETERS:
+ *  model   - contains scene data
+ *  ctx     - state of the calling render thread
+ *  wave    - queues of the thread
+ *  x       - x coordinate of the left column
+ *  y       - y coordinate of the top row
+ *  w       - columns in the run
+ *  h       - rows in the run
+ */
+static void wave_primary(model_t *model, trace_ctx_t *ctx, wave_t *wave,
+                         int x, int y, int w, int h) {
+    proj_t     *proj = model->proj;
+    wave_ray_t *ray;
+    packet_t    pk;             // primary rays of neighbouring pixels
+    double      world[3];       // world coords of pixel
+    int         i;
+    int         j;
+    int         k;
+    int         n;              // rays in a packet
+
+    for (j = 0; j < h; j++) {
+        for (i = 0; i < w; i++) {
+            ray = &wave->rays[0][j * w + i];
+            ray->pixel = j * w + i;
+
+            map_pix_to_world(proj, x + i, y - j, world);
+            vec_diff3(proj->view_point, world, ray->dir);
+            vec_unit3(ray->dir, ray->dir);
+            ray->base[0] = proj->view_point[0];
+            ray->base[1] = proj->view_point[1];
+            ray->base[2] = proj->view_point[2];
+
+            ray->last_hit   = NULL;
+            ray->total_dist = 0.0;
+            ray->weight[0] = ray->weight[1] = ray->weight[2] = 1.0;
+            ray_seed(ctx, x + i, y - j);
+            ray->rng = ctx->rng;
+
+            ctx->rays[RAY_PRIMARY]++;
+            STATS_RAY();
+        }
+    }
+
+    if (!model->opts->packets) {
+        for (i = 0; i < w * h; i++) {
+            ray = &wave->rays[0][i];
+            find_closest_obj(model, ray->base, ray->dir, NULL, &ray->hit);
+        }
+        return;
+    }
+
+    // packets never straddle two rows
+    for (j = 0; j < h; j++) {
+        for (i = 0; i < w; i += n) {
+            ray = &wave->rays[0][j * w + i];
+            n = w - i < PACKET_SIZE ? w - i : PACKET_SIZE;
+            packet_init(&pk, proj->view_point, n);
+
+            for (k = 0; k < PACKET_SIZE; k++) {
+                // unused lanes repeat the last ray so the kernels see real
+                // rays
+                pk.dir[k][0] = pk.soa[0][k] = ray[k < n ? k : n - 1].dir[0];
+                pk.dir[k][1] = pk.soa[1][k] = ray[k < n ? k : n - 1].dir[1];
+                pk.dir[k][2] = pk.soa[2][k] = ray[k < n ? k : n - 1].dir[2];
+            }
+            find_closest_packet(model, &pk);
+
+            for (k = 0; k < n; k++) {
+                ray[k].hit.obj = pk.closest[k];
+                ray[k].hit.t = pk.t[k];
+                if (pk.closest[k] != NULL) {
+                    pk.closest[k]->ops->hitinfo(pk.base, pk.dir[k],
+                                                pk.closest[k], &ray[k].hit);
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Intersect the reflected rays of one generation.
+ *
+ * PARAMETERS:
+ *  model   - contains scene data
+ *  rays    - queue of rays
+ *  n       - rays in the queue
+ */
+static void wave_intersect(model_t *model, wave_ray_t *rays, int n) {
+    int i;
+
+    for (i = 0; i < n; i++) {
+        STATS_RAY();
+        find_closest_obj(model, rays[i].base, rays[i].dir, rays[i].last_hit,
+                         &rays[i].hit);
+    }
+}
+
+/*
+ * Order hits by the kind of object hit, then by the object, so each
+ * shader runs over a run of hits.
+ */
+static int wave_compare(const void *a, const void *b) {
+    obj_t *left  = (*(wave_ray_t **)a)->hit.obj;
+    obj_t *right = (*(wave_ray_t **)b)->hit.obj;
+
+    if (left->objtype != right->objtype) {
+        return left->objtype - right->objtype;
+    }
+    return left->objid - right->objid;
+}
+
+/*
+ * Shade the hits of one generation: find the material at each, start its
+ * frame with the ambient light and keep its diffuse reflectivity for the
+ * shadow stage.
+ *
+ * PARAMETERS:
+ *  model   - contains scene data
+ *  wave    - queues of the thread, order holding the hits
+ *  m       - hits in the generation
+ */
+static void wave_shade(model_t *model, wave_t *wave, int m) {
+    wave_ray_t    *ray;
+    trace_frame_t *frame;
+    material_t     mat;         // reflectivities at the hit point
+    int            k;
+
+    wave_frames(wave, m);
+
+    for (k = 0; k < m; k++) {
+        ray = wave->order[k];
+        ray->frame = wave->nframes++;
+        wave->owner[ray->frame] = ray->pixel;
+        frame = &wave->frames[ray->frame];
+
+        ray_material(model, ray->dir, &ray->hit, ray->total_dist, &mat);
+
+        frame->local[0] = frame->local[1] = frame->local[2] = 0.0;
+        vec_sum3(mat.ambient, frame->local, frame->local);
+        ray->diffuse[0] = mat.diffuse[0];
+        ray->diffuse[1] = mat.diffuse[1];
+        ray->diffuse[2] = mat.diffuse[2];
+
+        frame->spec[0] = mat.specular[0];
+        frame->spec[1] = mat.specular[1];
+        frame->spec[2] = mat.specular[2];
+        frame->scale = 1.0;
+    }
+}
+
+/*
+ * Trace the shadow rays of one generation's hits, a light at a time, and
+ * add the diffuse light of each light that isn't blocked.  Each hit still
+ * takes its lights in list order, so sums round as they do in
+ * diffuse_illumination.
+ *
+ * PARAMETERS:
+ *  model   - contains scene data
+ *  ctx     - state of the calling render thread
+ *  wave    - queues of the thread, order holding the hits
+ *  m       - hits in the generation
+ */
+static void wave_shadow(model_t *model, trace_ctx_t *ctx, wave_t *wave,
+                        int m) {
+    obj_t         *light;
+    wave_shadow_t *shadow;
+    int            ndx = 0;     // index of light in the list
+    int            q;           // shadow rays queued
+    int            k;
+
+    for (light = model->lights->head; light != NULL; light = light->next) {
+        q = 0;
+        for (k = 0; k < m; k++) {
+            shadow = &wave->shadows[q];
+            shadow->ray = wave->order[k];
+            shadow->theta = light_ray(&shadow->ray->hit, light, shadow->dir,
+                                      &shadow->dist);
+            // lights behind the surface don't need a shadow ray
+            if (shadow->theta >= 0) {
+                q++;
+            }
+        }
+
+        ctx->rays[RAY_SHADOW] += q;
+        for (k = 0; k < q; k++) {
+            shadow = &wave->shadows[k];
+            if (find_occluder(model, shadow->ray->hit.hitloc, shadow->dir,
+                              shadow->dist, shadow->ray->hit.obj,
+                              &ctx->occluders[ndx]) == NULL) {
+                light_add(light, shadow->ray->diffuse, shadow->theta,
+                          shadow->dist,
+                          wave->frames[shadow->ray->frame].local);
+            }
+        }
+        ndx++;
+    }
+}
+
+/*
+ * Finish the frames of one generation's hits and queue the reflections
+ * of those whose paths go on.
+ *
+ * PARAMETERS:
+ *  model   - contains scene data
+ *  ctx     - state of the calling render thread
+ *  wave    - queues of the thread
+ *  n       - rays in the generation
+ *  gen     - generation, 0 for primary rays
+ *
+ * RETURNS:
+ *  rays queued for the next generation
+ */
+static int wave_reflect(model_t *model, trace_ctx_t *ctx, wave_t *wave,
+                        int n, int gen) {
+    wave_ray_t    *rays = wave->rays[gen & 1];
+    wave_ray_t    *next = wave->rays[(gen + 1) & 1];
+    wave_ray_t    *ray;
+    trace_frame_t *frame;
+    double         total_dist;  // distance the path has traveled
+    int            count = 0;
+    int            i;
+
+    // rays are visited in pixel order so the next generation is too
+    for (i = 0; i < n; i++) {
+        ray = &rays[i];
+        if (ray->hit.obj == NULL) {
+            continue;
+        }
+        frame = &wave->frames[ray->frame];
+        vec_scale3(1.0 / ray->hit.t, frame->local, frame->local);
+
+        total_dist = ray->total_dist + ray->hit.t;
+        ctx->rng = ray->rng;
+        if (!ray_reflects(model, ctx, frame, total_dist, gen, ray->weight)) {
+            continue;
+        }
+
+        next[count].pixel = ray->pixel;
+        next[count].base[0] = ray->hit.hitloc[0];
+        next[count].base[1] = ray->hit.hitloc[1];
+        next[count].base[2] = ray->hit.hitloc[2];
+        vec_reflect3(ray->dir, ray->hit.normal, next[count].dir);
+        next[count].last_hit = ray->hit.obj;
+        next[count].total_dist = total_dist;
+        next[count].weight[0] = ray->weight[0];
+        next[count].weight[1] = ray->weight[1];
+        next[count].weight[2] = ray->weight[2];
+        next[count].rng = ctx->rng;
+        count++;
+    }
+    return count;
+}
+
+/**
+ * Trace a run of pixels a generation of rays at a time.  Each generation
+ * is intersected, its hits shaded, its shadow rays traced and its
+ * reflections queued as the next generation.
+ *
+ * PARAMETERS:
+ *  model   - contains scene data
+ *  ctx     - state of the calling render thread
+ *  x       - x coordinate of the left column of the run
+ *  y       - y coordinate of the top row of the run
+ *  w       - columns in the run
+ *  h       - rows in the run, going down from y
+ *
+ * RETURNS:
+ *  the rgb intensity of each pixel, top row first, held until the thread
+ *  traces its next run
+ */
+double *wave_trace(model_t *model, trace_ctx_t *ctx, int x, int y, int w,
+                   int h) {
+    wave_t *wave;
+    int     n = w * h;          // rays in the current generation
+    int     m;                  // of those, rays that hit something
+    int     gen = 0;
+    int     i;
+    int     f;
+
+    if (ctx->wave == NULL) {
+        ctx->wave = wave_init(model);
+    }
+    wave = ctx->wave;
+    wave_reserve(wave, n);
+    wave->nframes = 0;
+
+    STATS_LEVEL(0);
+    wave_primary(model, ctx, wave, x, y, w, h);
+
+    while (n > 0) {
+        if (gen > 0) {
+            STATS_LEVEL(gen);
+            wave_intersect(model, wave->rays[gen & 1], n);
+        }
+
+        m = 0;
+        for (i = 0; i < n; i++) {
+            if (wave->rays[gen & 1][i].hit.obj != NULL) {
+                wave->order[m++] = &wave->rays[gen & 1][i];
+            }
+        }
+        qsort(wave->order, m, sizeof(wave_ray_t *), wave_compare);
+
+        wave->start[gen] = wave->nframes;
+        wave_shade(model, wave, m);
+        wave_shadow(model, ctx, wave, m);
+        n = wave_reflect(model, ctx, wave, n, gen);
+        gen++;
+    }
+    wave->start[gen] = wave->nframes;
+    STATS_LEVEL(0);
+
+    // light reflected off each hit adds that of the rest of its path, so
+    // the deepest generation is summed first
+    for (i = 0; i < 3 * w * h; i++) {
+        wave->sum[i] = 0.0;
+    }
+    while (--gen >= 0) {
+        for (f = wave->start[gen]; f < wave->start[gen + 1]; f++) {
+            ray_fold(&wave->frames[f], &wave->sum[3 * wave->owner[f]]);
+        }
+    }
+
+    return wave->sum;
+}
+
+/**
+ * Free the queues of a render thread.
+ *
+ * PARAMETERS:
+ *  wave    - queues to free
+ */
+void wave_free(wave_t *wave) {
+    free(wave->rays[0]);
+    free(wave->rays[1]);
+    free(wave->order);
+    free(wave->shadows);
+    free(wave->sum);
+    free(wave->frames);
+    free(wave->owner);
+    free(wave->start);
+    free(wave);
+}
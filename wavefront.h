@@ -0,0 +1,46 @@
+#include "common.h"
+
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+
+/* ray of one generation, queued to be intersected and then, if it hit
+ * something, shaded */
+typedef struct wave_ray_type {
+    int     pixel;          /* pixel of the run its path started from */
+    double  base[3];        /* origin */
+    double  dir[3];         /* unit direction */
+    obj_t  *last_hit;       /* object the ray leaves, NULL for primary rays */
+    double  total_dist;     /* distance the path traveled before the ray */
+    double  weight[3];      /* contribution of the ray's hit to the pixel */
+    unsigned long long rng; /* russian roulette state of the path */
+    hit_t   hit;            /* closest hit, hit.obj NULL for a miss */
+    double  diffuse[3];     /* diffuse reflectivity at the hit */
+    int     frame;          /* frame of the hit */
+} wave_ray_t;
+
+/* shadow ray queued to be traced towards one light */
+typedef struct wave_shadow_type {
+    wave_ray_t *ray;        /* ray whose hit point the shadow ray leaves */
+    double  dir[3];         /* unit direction to the light */
+    double  dist;           /* distance to the light */
+    double  theta;          /* cos of the angle to the normal */
+} wave_shadow_t;
+
+/* queues of the wavefront engine, kept by a render thread between runs */
+typedef struct wave_type {
+    int             cap;        /* rays each queue holds */
+    wave_ray_t     *rays[2];    /* this generation and the next, in turn */
+    wave_ray_t    **order;      /* this generation's hits, sorted by shader */
+    wave_shadow_t  *shadows;    /* shadow rays to one light */
+    double         *sum;        /* light reaching each pixel of the run */
+    trace_frame_t  *frames;     /* hits of every generation, in order */
+    int            *owner;      /* pixel of each frame */
+    int             nframes;
+    int             fcap;       /* frames the frame arrays hold */
+    int            *start;      /* first frame of each generation */
+} wave_t;
+
+double *wave_trace(model_t *, trace_ctx_t *, int, int, int, int);
+
+void wave_free(wave_t *);
+#endif